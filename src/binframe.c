@@ -0,0 +1,169 @@
+/* binframe.c
+   Copyright (C) 2024 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "binframe.h"
+
+/* crc32.c */
+unsigned int xcrc32 (const unsigned char *buf, int len, unsigned int init);
+
+
+enum binframe_states {
+	STATE_SYNC = 0,
+	STATE_HEADER,
+	STATE_PAYLOAD,
+	STATE_CRC,
+};
+
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le32(uint8_t *p, uint32_t val)
+{
+	p[0] = val & 0xff;
+	p[1] = (val >> 8) & 0xff;
+	p[2] = (val >> 16) & 0xff;
+	p[3] = (val >> 24) & 0xff;
+}
+
+
+void binframe_parser_init(binframe_parser_t *p)
+{
+	memset(p, 0, sizeof(*p));
+	p->state = STATE_SYNC;
+}
+
+
+/* Feed one byte to the parser.
+
+   Returns 1 when a complete (valid) frame has been received,
+   (frame is available in p->type, p->seq, p->len and p->payload
+   until next call), 0 if more data is needed, and < 0 if a frame
+   was dropped (invalid length or CRC mismatch).
+ */
+int binframe_parse_byte(binframe_parser_t *p, uint8_t c)
+{
+	uint32_t crc;
+	uint8_t len;
+
+	switch (p->state) {
+
+	case STATE_SYNC:
+		if (c != BINFRAME_SYNC) {
+			p->skipped_bytes++;
+			return 0;
+		}
+		p->pos = 0;
+		p->state = STATE_HEADER;
+		return 0;
+
+	case STATE_HEADER:
+		p->buf[p->pos++] = c;
+		if (p->pos < BINFRAME_HEADER_LEN - 1)
+			return 0;
+		len = p->buf[2];
+		if (len > BINFRAME_MAX_PAYLOAD) {
+			p->len_errors++;
+			p->state = STATE_SYNC;
+			return -1;
+		}
+		p->state = (len > 0 ? STATE_PAYLOAD : STATE_CRC);
+		return 0;
+
+	case STATE_PAYLOAD:
+		p->buf[p->pos++] = c;
+		if (p->pos < BINFRAME_HEADER_LEN - 1 + p->buf[2])
+			return 0;
+		p->state = STATE_CRC;
+		return 0;
+
+	case STATE_CRC:
+		p->buf[p->pos++] = c;
+		len = p->buf[2];
+		if (p->pos < BINFRAME_HEADER_LEN - 1 + len + BINFRAME_CRC_LEN)
+			return 0;
+		p->state = STATE_SYNC;
+
+		crc = xcrc32(p->buf, BINFRAME_HEADER_LEN - 1 + len, BINFRAME_CRC_INIT);
+		if (crc != get_le32(&p->buf[BINFRAME_HEADER_LEN - 1 + len])) {
+			p->crc_errors++;
+			return -2;
+		}
+
+		if (p->seq_valid)
+			p->seq_gaps += (uint8_t)(p->buf[1] - p->seq - 1);
+		p->seq_valid = 1;
+		p->type = p->buf[0];
+		p->seq = p->buf[1];
+		p->len = len;
+		p->payload = &p->buf[BINFRAME_HEADER_LEN - 1];
+		p->frames++;
+		return 1;
+
+	default:
+		p->state = STATE_SYNC;
+	}
+
+	return 0;
+}
+
+
+/* Return (estimated) number of frames lost.
+   Corrupted frames normally also show up as gaps in sequence numbers,
+   so use whichever count is higher instead of adding them together. */
+uint32_t binframe_drops(const binframe_parser_t *p)
+{
+	uint32_t errors = p->crc_errors + p->len_errors;
+
+	return (p->seq_gaps > errors ? p->seq_gaps : errors);
+}
+
+
+/* Encode a frame into buffer. Returns length of the frame, or 0 if
+   buffer is too small.
+ */
+size_t binframe_encode(uint8_t *buf, size_t size, uint8_t type, uint8_t seq,
+		const uint8_t *payload, uint8_t len)
+{
+	size_t flen = BINFRAME_HEADER_LEN + len + BINFRAME_CRC_LEN;
+
+	if (len > BINFRAME_MAX_PAYLOAD || size < flen)
+		return 0;
+
+	buf[0] = BINFRAME_SYNC;
+	buf[1] = type;
+	buf[2] = seq;
+	buf[3] = len;
+	if (len > 0)
+		memcpy(&buf[BINFRAME_HEADER_LEN], payload, len);
+	put_le32(&buf[BINFRAME_HEADER_LEN + len],
+		xcrc32(&buf[1], BINFRAME_HEADER_LEN - 1 + len, BINFRAME_CRC_INIT));
+
+	return flen;
+}
+
+
+/* eof :-) */
@@ -0,0 +1,91 @@
+/* binframe.h
+   Copyright (C) 2024 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRICKPICO_BINFRAME_H
+#define BRICKPICO_BINFRAME_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Binary frame format (used by the USB/serial streaming mode):
+
+   offset  size  field
+   0       1     sync (0xA5)
+   1       1     frame type
+   2       1     sequence number
+   3       1     payload length (0..BINFRAME_MAX_PAYLOAD)
+   4       n     payload
+   4+n     4     CRC-32 (little-endian) over bytes 1..3+n
+
+   CRC is calculated using xcrc32() with initial value of 0xffffffff
+   (poly 0x04c11db7, no reflection, no final XOR).
+*/
+
+#define BINFRAME_SYNC          0xa5
+#define BINFRAME_HEADER_LEN    4
+#define BINFRAME_CRC_LEN       4
+#define BINFRAME_MAX_PAYLOAD   64
+#define BINFRAME_MAX_LEN       (BINFRAME_HEADER_LEN + BINFRAME_MAX_PAYLOAD + BINFRAME_CRC_LEN)
+#define BINFRAME_CRC_INIT      0xffffffff
+
+/* Frame types (host -> device) */
+#define BINFRAME_LEVELS        0x01  /* payload: output levels (0-100), one byte per output */
+#define BINFRAME_PING          0x02  /* no payload */
+#define BINFRAME_EXIT          0x03  /* no payload, return to SCPI (text) mode */
+
+/* Frame types (device -> host) */
+#define BINFRAME_ACK           0x80  /* payload: type, status, drops (uint32 little-endian) */
+
+/* ACK status codes */
+#define BINFRAME_STATUS_OK     0x00
+#define BINFRAME_STATUS_INVAL  0x01  /* invalid payload */
+#define BINFRAME_STATUS_UNKNOWN 0x02 /* unknown frame type */
+
+
+typedef struct binframe_parser {
+	uint8_t state;
+	uint8_t pos;
+	uint8_t buf[BINFRAME_MAX_LEN];
+
+	/* Last (valid) frame received */
+	uint8_t type;
+	uint8_t seq;
+	uint8_t len;
+	const uint8_t *payload;
+
+	/* Statistics */
+	uint8_t seq_valid;
+	uint32_t frames;
+	uint32_t crc_errors;
+	uint32_t len_errors;
+	uint32_t seq_gaps;      /* frames missing based on sequence numbers */
+	uint32_t skipped_bytes; /* bytes discarded while looking for sync */
+} binframe_parser_t;
+
+
+void binframe_parser_init(binframe_parser_t *p);
+int binframe_parse_byte(binframe_parser_t *p, uint8_t c);
+uint32_t binframe_drops(const binframe_parser_t *p);
+size_t binframe_encode(uint8_t *buf, size_t size, uint8_t type, uint8_t seq,
+		const uint8_t *payload, uint8_t len);
+
+
+#endif /* BRICKPICO_BINFRAME_H */
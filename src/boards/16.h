@@ -3,7 +3,7 @@
 
 #define BRICKPICO_MODEL     "16"
 
-#define OUTPUT_COUNT     16   /* Number of PWM outputs on the board */
+#define PWM_OUTPUT_COUNT 16   /* Number of PWM outputs on the board */
 
 #ifdef LIB_PICO_CYW43_ARCH
 #define LED_PIN -1
@@ -50,16 +50,23 @@ struct brickpico_state *brickpico_state = &system_state;
 
 struct persistent_memory_block __uninitialized_ram(persistent_memory);
 struct persistent_memory_block *persistent_mem = &persistent_memory;
-u8_ringbuffer_t *log_rb = NULL;
+var_ringbuffer_t *log_rb = NULL;
 
-#define PERSISTENT_MEMORY_ID 0xbaddecaf
+/* ID must be changed whenever layout of struct persistent_memory_block
+   changes (persistent memory is then reinitialized on next boot). */
+#define PERSISTENT_MEMORY_ID 0xbaddecb0
+#define PERSISTENT_MEMORY_ID_MASK 0xffffff00
 #define PERSISTENT_MEMORY_CRC_LEN offsetof(struct persistent_memory_block, crc32)
+#define PERSISTENT_STATE_CRC_LEN offsetof(struct persistent_output_state, crc32)
 
 auto_init_mutex(pmem_mutex_inst);
 mutex_t *pmem_mutex = &pmem_mutex_inst;
 auto_init_mutex(state_mutex_inst);
 mutex_t *state_mutex = &state_mutex_inst;
+auto_init_mutex(i2c_mutex_inst);
+mutex_t *i2c_mutex = &i2c_mutex_inst;
 bool rebooted_by_watchdog = false;
+static volatile bool core1_config_update = false;
 
 
 void update_persistent_memory_crc()
@@ -69,6 +76,63 @@ void update_persistent_memory_crc()
 	m->crc32 = xcrc32((unsigned char*)m, PERSISTENT_MEMORY_CRC_LEN, 0);
 }
 
+/* Check if there is valid output state in persistent memory
+   (from before a soft/watchdog reset). */
+static bool persistent_state_valid()
+{
+	struct persistent_memory_block *m = persistent_mem;
+
+	if (m->id != PERSISTENT_MEMORY_ID)
+		return false;
+	if (xcrc32((unsigned char*)&m->state, PERSISTENT_STATE_CRC_LEN, 0) != m->state.crc32)
+		return false;
+
+	return true;
+}
+
+/* Mirror current output state (and optionally active effects)
+   into persistent memory. */
+void update_persistent_state(bool effects)
+{
+	static enum light_effect_types saved_effect[OUTPUT_MAX_COUNT];
+	static void *saved_ctx[OUTPUT_MAX_COUNT];
+	struct persistent_output_state *ps = &persistent_mem->state;
+	int i;
+
+	if (!mutex_enter_timeout_us(pmem_mutex, 100)) {
+		log_msg_ratelimited(10000, 1, LOG_DEBUG, "update_persistent_state(): Failed to get pmem_mutex");
+		return;
+	}
+
+	memcpy(ps->pwm, system_state.pwm, sizeof(ps->pwm));
+	memcpy(ps->pwr, system_state.pwr, sizeof(ps->pwr));
+
+	for (i = 0; effects && i < OUTPUT_COUNT; i++) {
+		const struct pwm_output *o = &cfg->outputs[i];
+		char *args;
+
+		if (ps->effect[i] != 0xff && o->effect == saved_effect[i]
+			&& o->effect_ctx == saved_ctx[i])
+			continue;
+
+		args = effect_print_args(o->effect, o->effect_ctx);
+		if (!args || strlen(args) < sizeof(ps->effect_args[i])) {
+			ps->effect[i] = o->effect;
+			strncopy(ps->effect_args[i], (args ? args : ""), sizeof(ps->effect_args[i]));
+		} else {
+			/* Arguments too long, use configured effect after reset... */
+			ps->effect[i] = 0xff;
+		}
+		if (args)
+			free(args);
+		saved_effect[i] = o->effect;
+		saved_ctx[i] = o->effect_ctx;
+	}
+
+	ps->crc32 = xcrc32((unsigned char*)ps, PERSISTENT_STATE_CRC_LEN, 0);
+	mutex_exit(pmem_mutex);
+}
+
 void init_persistent_memory()
 {
 	struct persistent_memory_block *m = persistent_mem;
@@ -84,16 +148,26 @@ void init_persistent_memory()
 				m->prev_uptime = m->uptime;
 				update_persistent_memory_crc();
 			}
+			if (!persistent_log_valid()) {
+				printf("Found corrupt log buffer, clearing it...\n");
+				init_persistent_log();
+			}
+			index_persistent_log();
 			return;
 		}
 		printf("Found corrupt persistent memory block"
 			" (CRC-32 mismatch  %08lx != %08lx)\n", crc, m->crc32);
+	} else if ((m->id & PERSISTENT_MEMORY_ID_MASK) == (PERSISTENT_MEMORY_ID & PERSISTENT_MEMORY_ID_MASK)) {
+		printf("Found persistent memory block from different firmware version"
+			" (%08lx != %08lx)\n", m->id, PERSISTENT_MEMORY_ID);
 	}
 
 	printf("Initializing persistent memory block...\n");
 	memset(m, 0, sizeof(*m));
 	m->id = PERSISTENT_MEMORY_ID;
-	u8_ringbuffer_init(&m->log_rb, m->log, sizeof(m->log));
+	init_persistent_log();
+	index_persistent_log();
+	memset(m->state.effect, 0xff, sizeof(m->state.effect));
 	update_persistent_memory_crc();
 }
 
@@ -111,8 +185,9 @@ void update_persistent_memory()
 		update_persistent_memory_crc();
 		mutex_exit(pmem_mutex);
 	} else {
-		log_msg(LOG_DEBUG, "update_persistent_memory(): Failed to get pmem_mutex");
+		log_msg_ratelimited(10000, 1, LOG_DEBUG, "update_persistent_memory(): Failed to get pmem_mutex");
 	}
+	update_persistent_state(true);
 }
 
 void boot_reason()
@@ -123,22 +198,110 @@ void boot_reason()
 	printf("WATCHDOG_REASON: %08lx\n", watchdog_hw->reason);
 }
 
+
+#define BOOT_STAGE_MAX 16
+
+struct boot_stage {
+	const char *name;
+	uint64_t t;
+};
+
+static struct boot_stage boot_stages[BOOT_STAGE_MAX];
+static uint boot_stage_count = 0;
+
+/* Record time (since boot) when given boot stage completed. */
+static void boot_stage(const char *name)
+{
+	if (boot_stage_count >= BOOT_STAGE_MAX)
+		return;
+	boot_stages[boot_stage_count].name = name;
+	boot_stages[boot_stage_count].t = to_us_since_boot(get_absolute_time());
+	boot_stage_count++;
+}
+
+void print_boot_stages()
+{
+	uint64_t prev = 0;
+
+	cmd_printf("Boot stage          Time (ms)  Duration (ms)\n");
+	for (int i = 0; i < boot_stage_count; i++) {
+		const struct boot_stage *s = &boot_stages[i];
+
+		cmd_printf("%-16s %12.3f %14.3f\n", s->name, s->t / 1000.0,
+			(s->t - prev) / 1000.0);
+		prev = s->t;
+	}
+}
+
+/* Wait (until given time since t_start) for USB Serial to connect... */
+static void wait_for_usb(absolute_time_t t_start, uint32_t timeout_ms)
+{
+	absolute_time_t t_end = delayed_by_ms(t_start, timeout_ms);
+
+	while (!stdio_usb_connected()) {
+		if (absolute_time_diff_us(get_absolute_time(), t_end) <= 0)
+			break;
+		sleep_ms(10);
+	}
+}
+
+#if FAST_BOOT
+static absolute_time_t t_usb;
+static uint32_t usb_wait;
+#endif
+
 void setup()
 {
 	char buf[32];
 	int i = 0;
+	bool warm_boot = persistent_state_valid();
+	struct persistent_output_state *ps = &persistent_mem->state;
 
 
+	boot_stage("init");
 	stdio_usb_init();
-	/* Wait a while for USB Serial to connect... */
-	while (i++ < 40) {
-		if (stdio_usb_connected())
-			break;
-		sleep_ms(50);
-	}
+#if FAST_BOOT
+	/* USB Serial gets (rest of) the time to connect in setup_deferred(),
+	   after outputs, display and network have been initialized. */
+	t_usb = get_absolute_time();
+	usb_wait = (warm_boot ? 0 : 2000);
+#else
+	/* Wait a while for USB Serial to connect...
+	   (unless outputs need to be restored after a reset) */
+	wait_for_usb(get_absolute_time(), (warm_boot ? 0 : 2000));
+	boot_stage("usb");
+#endif
+
+	init_persistent_memory();
+	log_rb = &persistent_mem->log_rb;
+	/* Persistent memory may have been (re)initialized... */
+	warm_boot = warm_boot && persistent_state_valid();
 
 	lfs_setup(false);
+	boot_stage("filesystem");
 	read_config();
+	if (warm_boot)
+		restore_output_effects(ps);
+	boot_stage("config");
+
+	/* Configure I2C bus and PWM pins... */
+	i2c_bus_init();
+	setup_pwm_outputs();
+
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		uint8_t duty = cfg->outputs[i].default_pwm;
+		uint8_t state = cfg->outputs[i].default_state;
+		if (warm_boot) {
+			/* Restore output state from before the reset */
+			duty = ps->pwm[i];
+			state = ps->pwr[i];
+		}
+		set_pwm_duty_cycle(i, (state ? duty : 0));
+		brickpico_state->pwm[i] = duty;
+		brickpico_state->pwr[i] = state;
+	}
+	flush_pwm_outputs();
+	boot_stage("outputs");
 
 #if TTL_SERIAL > 0
 	stdio_uart_init_full(TTL_SERIAL_UART,
@@ -164,15 +327,13 @@ void setup()
 		clock_get_hz(clk_sys) / 1000000.0);
 	printf(" Serial Number: %s\n\n", pico_serial_str());
 
-	init_persistent_memory();
-	log_rb = &persistent_mem->log_rb;
-	printf("\n");
-
 	log_msg(LOG_NOTICE, "System starting...");
 	if (persistent_mem->prev_uptime) {
 		log_msg(LOG_NOTICE, "Uptime before soft reset: %llus\n",
 			persistent_mem->prev_uptime / 1000000);
 	}
+	if (warm_boot)
+		log_msg(LOG_NOTICE, "Output state restored from persistent memory.");
 	if (aon_timer_is_running()) {
 		struct timespec ts;
 		aon_timer_get_time(&ts);
@@ -180,8 +341,12 @@ void setup()
 			time_t_to_str(buf, sizeof(buf), timespec_to_time_t(&ts)));
 	}
 
+#if !FAST_BOOT
 	display_init();
+	boot_stage("display");
 	network_init(&system_state);
+	boot_stage("network");
+#endif
 
 	/* Enable ADC */
 	log_msg(LOG_NOTICE, "Initialize ADC...");
@@ -202,17 +367,6 @@ void setup()
 	cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 0);
 #endif
 
-	/* Configure PWM pins... */
-	setup_pwm_outputs();
-
-	for (i = 0; i < OUTPUT_COUNT; i++) {
-		uint8_t duty = cfg->outputs[i].default_pwm;
-		uint8_t state = cfg->outputs[i].default_state;
-		set_pwm_duty_cycle(i, (state ? duty : 0));
-		brickpico_state->pwm[i] = duty;
-		brickpico_state->pwr[i] = state;
-	}
-
 	/* Set Timezone */
 	if (strlen(cfg->timezone) > 1) {
 		log_msg(LOG_NOTICE, "Set Timezone: %s", cfg->timezone);
@@ -220,7 +374,38 @@ void setup()
 		tzset();
 	}
 
+	history_init();
+
+#if !FAST_BOOT
+	boot_stage("complete");
 	log_msg(LOG_NOTICE, "System initialization complete.");
+#endif
+}
+
+#if FAST_BOOT
+/* Initialize display and network and wait for USB Serial. This is done
+   (on core0) after core1 has been started, so light effects are already
+   running meanwhile. */
+static void setup_deferred()
+{
+	display_init();
+	boot_stage("display");
+	process_log_queue();
+	network_init(&system_state);
+	boot_stage("network");
+	process_log_queue();
+	wait_for_usb(t_usb, usb_wait);
+	boot_stage("usb");
+
+	boot_stage("complete");
+	log_msg(LOG_NOTICE, "System initialization complete.");
+}
+#endif
+
+
+static void console_drain(void *ctx, const char *data, size_t len)
+{
+	printf("%.*s", (int)len, data);
 }
 
 
@@ -241,6 +426,13 @@ void update_core1_state()
 	mutex_enter_blocking(state_mutex);
 	memcpy(&transfer_state, &system_state, sizeof(transfer_state));
 	mutex_exit(state_mutex);
+	update_persistent_state(false);
+}
+
+/* Request core1 to refresh its copy of the configuration immediately. */
+void update_core1_config()
+{
+	core1_config_update = true;
 }
 
 void core1_main()
@@ -252,6 +444,8 @@ void core1_main()
 	int64_t max_delta = 0;
 	int64_t delta;
 	uint8_t pwm[OUTPUT_MAX_COUNT];
+	uint8_t level[OUTPUT_MAX_COUNT];
+	uint32_t stream_seq = 0;
 
 	log_msg(LOG_INFO, "core1: started...");
 	memset(pwm, 0, sizeof(pwm));
@@ -269,16 +463,17 @@ void core1_main()
 
 		if (delta > max_delta) {
 			max_delta = delta;
-			log_msg(LOG_INFO, "core1: max_loop_time=%lld", max_delta);
+			log_msg_ratelimited(10000, 2, LOG_INFO, "core1: max_loop_time=%lld", max_delta);
 		}
 
 		if (time_passed(&t_tick, 60000)) {
 			log_msg(LOG_DEBUG, "tick");
 		}
 
-		if (time_passed(&t_config, 4000)) {
+		if (core1_config_update || time_passed(&t_config, 4000)) {
 			/* Attempt to update (read) config from core0 */
 			if (mutex_enter_timeout_us(config_mutex, 100)) {
+				core1_config_update = false;
 				memcpy(config, cfg, sizeof(*config));
 				mutex_exit(config_mutex);
 			} else {
@@ -305,11 +500,24 @@ void core1_main()
 					}
 				}
 			} else {
-				log_msg(LOG_INFO, "failed to get state_mutex");
+				log_msg_ratelimited(10000, 1, LOG_INFO, "failed to get state_mutex");
+			}
+		}
+
+		/* Apply output levels received in binary streaming mode */
+		if (usb_stream_levels(&stream_seq, level)) {
+			for(int i = 0; i < OUTPUT_COUNT; i++) {
+				state->pwm[i] = level[i];
+				state->pwr[i] = (level[i] > 0 ? 1 : 0);
+				if (level[i] != pwm[i]) {
+					set_pwm_lightness(i, level[i]);
+					pwm[i] = level[i];
+				}
 			}
+			flush_pwm_outputs();
 		}
 
-		if (time_passed(&t_effect, 100)) {
+		if (!usb_stream_active() && time_passed(&t_effect, 100)) {
 			uint8_t new;
 			uint64_t t = to_us_since_boot(get_absolute_time());
 
@@ -323,6 +531,7 @@ void core1_main()
 					pwm[i] = new;
 				}
 			}
+			flush_pwm_outputs();
 		}
 	}
 }
@@ -332,18 +541,25 @@ int main()
 {
 	absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(t_led, 0);
 	absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(t_network, 0);
-	absolute_time_t t_now, t_last, t_display, t_timer, t_temp, t_ram;
+	absolute_time_t t_now, t_last, t_display, t_timer, t_temp, t_ram, t_flash;
 	uint8_t led_state = 0;
 	int64_t max_delta = 0;
 	int64_t delta;
 	int c;
 	char input_buf[1024 + 1];
 	int i_ptr = 0;
+	bool c_usb;
+	bool input_usb = true;
+	static char console_resp_buf[1024];
+	struct cmd_response console_resp;
 
 
 	set_binary_info();
+	cmd_response_init(&console_resp, console_resp_buf, sizeof(console_resp_buf),
+			console_drain, NULL);
 	clear_state(&system_state);
 	clear_state(&transfer_state);
+	xcrc32_init();
 
 	/* Initialize MCU and other hardware... */
 	if (get_debug_level() >= 2)
@@ -356,7 +572,11 @@ int main()
 	memcpy(&core1_config, cfg, sizeof(core1_config));
 	memcpy(&core1_state, &system_state, sizeof(core1_state));
 	update_core1_state();
+	log_enable_queue();
 	multicore_launch_core1(core1_main);
+#if FAST_BOOT
+	setup_deferred();
+#endif
 
 #if WATCHDOG_ENABLED
 	watchdog_enable(WATCHDOG_REBOOT_DELAY, 1);
@@ -364,7 +584,7 @@ int main()
 #endif
 
 	t_last = get_absolute_time();
-	t_ram = t_temp = t_timer = t_display = t_last;
+	t_flash = t_ram = t_temp = t_timer = t_display = t_last;
 
 	while (1) {
 		t_now = get_absolute_time();
@@ -373,14 +593,23 @@ int main()
 
 		if (delta > max_delta || delta > 1000000) {
 			max_delta = delta;
-			log_msg(LOG_INFO, "core0: max_loop_time=%lld", max_delta);
+			log_msg_ratelimited(10000, 2, LOG_INFO, "core0: max_loop_time=%lld", max_delta);
 		}
 
 		if (time_passed(&t_network, 100)) {
 			network_poll();
 		}
+		/* Process any commands queued by network (MQTT) handlers */
+		network_process_commands();
+		/* Output any queued log messages */
+		process_log_queue();
 		if (time_passed(&t_ram, 1000)) {
 			update_persistent_memory();
+			history_update(brickpico_state);
+		}
+		/* Commit any buffered file writes to flash */
+		if (time_passed(&t_flash, 5000)) {
+			flash_sync();
 		}
 
 		/* Toggle LED every 1000ms */
@@ -420,7 +649,15 @@ int main()
 		}
 
 		/* Process any (user) input */
-		while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+		usb_stream_poll();
+		while ((c = console_getchar(&c_usb)) != PICO_ERROR_TIMEOUT) {
+			if (usb_stream_active()) {
+				if (c_usb)
+					usb_stream_input(c);
+				continue;
+			}
+			if (!c_usb)
+				input_usb = false;
 			if (c == 0xff || c == 0x00)
 				continue;
 			if (c == 0x7f || c == 0x08) {
@@ -432,10 +669,14 @@ int main()
 				if (cfg->local_echo) printf("\r\n");
 				input_buf[i_ptr] = 0;
 				if (i_ptr > 0) {
-					process_command(brickpico_state, (struct brickpico_config *)cfg, input_buf);
+					console_resp.source = (input_usb ? CMD_SRC_USB : CMD_SRC_CONSOLE);
+					process_command(brickpico_state, (struct brickpico_config *)cfg,
+							input_buf, &console_resp);
+					cmd_response_flush(&console_resp);
 					i_ptr = 0;
 					update_core1_state();
 				}
+				input_usb = true;
 				continue;
 			}
 			input_buf[i_ptr++] = c;
@@ -38,7 +38,25 @@
 #error unknown board model
 #endif
 
+#if PCA9685_COUNT > 0
+#include "pca9685.h"
+#define EXPANDER_OUTPUT_COUNT  (PCA9685_COUNT * PCA9685_CHANNELS)
+#define OUTPUT_MAX_COUNT       32   /* Max number of outputs (output bitmasks are 32bit) */
+#else
+#define EXPANDER_OUTPUT_COUNT  0
 #define OUTPUT_MAX_COUNT       16   /* Max number of PWM outputs on the board */
+#endif
+
+/* Outputs driven by the Pico PWM hardware come first, followed by
+   outputs on the (optional) PCA9685 expanders. */
+#define OUTPUT_COUNT           (PWM_OUTPUT_COUNT + EXPANDER_OUTPUT_COUNT)
+
+#if OUTPUT_COUNT > OUTPUT_MAX_COUNT
+#error too many outputs configured (check PCA9685_COUNT)
+#endif
+
+/* I2C bus is shared by OLED display and PCA9685 expanders */
+#define I2C_BUS_SPEED          1000000L
 
 #define MAX_NAME_LEN           64
 #define MAX_MAP_POINTS         32
@@ -78,7 +96,7 @@ struct timer_event {
 	int8_t hour;            /* 0-23 */
 	uint8_t wday;            /* bitmask for weekdays */
 	enum timer_action_types action;
-	uint16_t mask;          /* bitmask of outputs this applies to */
+	uint32_t mask;          /* bitmask of outputs this applies to */
 };
 
 struct pwm_output {
@@ -115,6 +133,7 @@ struct brickpico_config {
 	double adc_ref_voltage;
 	double temp_offset;
 	double temp_coefficient;
+	uint8_t history_blocks;
 #ifdef WIFI_SUPPORT
 	char wifi_ssid[WIFI_SSID_MAX_LEN + 1];
 	char wifi_passwd[WIFI_PASSWD_MAX_LEN + 1];
@@ -123,6 +142,7 @@ struct brickpico_config {
 	uint8_t wifi_mode;
 	char hostname[32];
 	ip_addr_t syslog_server;
+	bool syslog_tcp;
 	ip_addr_t ntp_server;
 	ip_addr_t ip;
 	ip_addr_t netmask;
@@ -143,7 +163,7 @@ struct brickpico_config {
 	uint32_t mqtt_status_interval;
 	uint32_t mqtt_pwm_interval;
 	uint32_t mqtt_temp_interval;
-	uint16_t mqtt_pwm_mask;
+	uint32_t mqtt_pwm_mask;
 	char mqtt_ha_discovery_prefix[32 + 1];
 	bool telnet_active;
 	bool telnet_auth;
@@ -162,45 +182,185 @@ struct brickpico_state {
 };
 
 
+#define PERSISTENT_EFFECT_ARGS_LEN 48
+#define PERSISTENT_LOG_MSG_LEN 320
+
+/* Output state mirrored into persistent memory (restored on warm boot) */
+struct persistent_output_state {
+	uint8_t pwm[OUTPUT_MAX_COUNT];
+	uint8_t pwr[OUTPUT_MAX_COUNT];
+	uint8_t effect[OUTPUT_MAX_COUNT];  /* 0xff = effect not saved */
+	char effect_args[OUTPUT_MAX_COUNT][PERSISTENT_EFFECT_ARGS_LEN];
+	uint32_t crc32;
+};
+
 struct persistent_memory_block {
 	uint32_t id;
 	struct timespec saved_time;
 	uint64_t uptime;
 	uint64_t prev_uptime;
-	u8_ringbuffer_t log_rb;
-	uint32_t crc32;
-	uint8_t log[8192];
+	uint32_t crc32;                        /* header CRC */
+	var_ringbuffer_t log_rb;
+	uint32_t log_crc32;                    /* ring buffer metadata CRC */
+	uint8_t log[8192];                     /* each record has its own CRC */
+	struct persistent_output_state state;  /* has its own CRC */
 };
 
 
 
 /* brickpico.c */
-extern u8_ringbuffer_t *log_rb;
+extern var_ringbuffer_t *log_rb;
 extern struct persistent_memory_block *persistent_mem;
 extern struct brickpico_state *brickpico_state;
 extern bool rebooted_by_watchdog;
 extern mutex_t *pmem_mutex;
 extern mutex_t *state_mutex;
+extern mutex_t *i2c_mutex;
 void update_persistent_memory_crc();
 void update_persistent_memory();
+void update_persistent_state(bool effects);
 void update_display_state();
 void update_core1_state();
+void update_core1_config();
+void print_boot_stages();
+
+/* persistent_log.c */
+bool persistent_log_valid();
+void init_persistent_log();
+void index_persistent_log();
+char* persistent_log_reserve(size_t len);
+int persistent_log_commit(char *msg);
+int persistent_log_next(var_ringbuffer_iter_t *iter, const char **msg);
+
+/* usbstream.c */
+bool usb_stream_active();
+int console_getchar(bool *usb);
+void usb_stream_start();
+void usb_stream_input(int c);
+void usb_stream_poll();
+int usb_stream_levels(uint32_t *seq, uint8_t *levels);
+void print_usb_stream_stats();
 
 /* bi_decl.c */
 void set_binary_info();
 
 /* command.c */
-void process_command(struct brickpico_state *state, struct brickpico_config *config, char *command);
+typedef void (*cmd_response_drain_func_t)(void *ctx, const char *data, size_t len);
+enum cmd_sources {
+	CMD_SRC_CONSOLE = 0,  /* stdio console (UART, telnet) */
+	CMD_SRC_USB = 1,      /* USB (CDC) console */
+	CMD_SRC_MQTT = 2,     /* MQTT command topic */
+};
+
+struct cmd_response {
+	char *buf;
+	size_t size;
+	size_t len;
+	bool truncated;
+	cmd_response_drain_func_t drain;  /* called when buffer is full (optional) */
+	void *ctx;
+	uint8_t source;  /* enum cmd_sources */
+};
+void cmd_response_init(struct cmd_response *r, char *buf, size_t size,
+		cmd_response_drain_func_t drain, void *ctx);
+void cmd_response_flush(struct cmd_response *r);
+int cmd_printf(const char *format, ...);
+void cmd_write(const char *data, size_t len);
+void cmd_flush();
+int cmd_source();
+void process_command(struct brickpico_state *state, struct brickpico_config *config, char *command,
+		struct cmd_response *resp);
 int cmd_version(const char *cmd, const char *args, int query, char *prev_cmd);
 int last_command_status();
+void print_cmd_stats();
+char* cmd_stats_json();
+
+/* history.c */
+#define HISTORY_BLOCK_SIZE  4096
+#define HISTORY_MAX_BLOCKS  32
+enum history_types {
+	HISTORY_STATE = 0,   /* output state at start of query */
+	HISTORY_OUTPUT = 1,  /* output state change */
+	HISTORY_TEMP = 2,    /* temperature sample */
+};
+struct history_record {
+	uint32_t t;
+	uint8_t type;
+	uint8_t output;
+	uint8_t pwm;
+	uint8_t pwr;
+	float temp;
+};
+struct history_query {
+	uint32_t from;
+	uint32_t to;
+	int8_t order[HISTORY_MAX_BLOCKS + 1];  /* blocks to read (-1 = current block) */
+	uint32_t seq[HISTORY_MAX_BLOCKS + 1];
+	uint8_t blocks;
+	uint8_t pos;
+	bool done;
+	uint8_t buf[HISTORY_BLOCK_SIZE];
+	uint16_t len;
+	const uint8_t *p;
+	const uint8_t *end;
+	uint32_t t;
+	int32_t temp;
+	uint8_t state[OUTPUT_MAX_COUNT];
+	uint8_t state_count;
+	uint8_t state_left;
+	bool state_pending;
+	uint32_t state_t;
+	struct history_record pending;
+	bool have_pending;
+};
+void history_init();
+void history_update(const struct brickpico_state *state);
+void history_flush();
+void print_history_stats();
+int history_query_start(struct history_query *q, uint32_t from, uint32_t to);
+int history_query_next(struct history_query *q, struct history_record *r);
+
+/* json_stream.c */
+typedef void (*json_stream_write_func_t)(void *ctx, const char *data, size_t len);
+struct json_stream {
+	json_stream_write_func_t write;
+	void *ctx;
+	char buf[128];
+	size_t len;
+	uint32_t bytes;   /* total bytes written */
+	uint32_t arrays;  /* bitmask of nesting levels that are arrays */
+	uint8_t depth;
+	bool first;
+};
+void json_stream_init(struct json_stream *js, json_stream_write_func_t write, void *ctx);
+void json_stream_flush(struct json_stream *js);
+void json_stream_object_start(struct json_stream *js, const char *name);
+void json_stream_object_end(struct json_stream *js);
+void json_stream_array_start(struct json_stream *js, const char *name);
+void json_stream_array_end(struct json_stream *js);
+void json_stream_string(struct json_stream *js, const char *name, const char *val);
+void json_stream_number(struct json_stream *js, const char *name, double val);
+void json_stream_bool(struct json_stream *js, const char *name, bool val);
 
 /* config.c */
 extern mutex_t *config_mutex;
 extern const struct brickpico_config *cfg;
 void read_config();
 void save_config();
+int export_config_json();
+void reset_saved_config_hash();
+void restore_output_effects(const struct persistent_output_state *s);
+void get_config_save_stats(uint32_t *saves, uint32_t *skipped);
 void delete_config();
 void print_config();
+void config_to_json_stream(const struct brickpico_config *cfg, struct json_stream *js);
+int validate_config(const struct brickpico_config *c);
+void apply_config(const struct brickpico_config *new);
+void discard_config(struct brickpico_config *c);
+
+/* config_bin.c */
+uint8_t* config_to_bin(const struct brickpico_config *cfg, uint32_t *size);
+int bin_to_config(const uint8_t *buf, uint32_t size, struct brickpico_config *cfg);
 
 /* display.c */
 void display_init();
@@ -222,11 +382,24 @@ char* effect_print_args(enum light_effect_types effect, void *ctx);
 uint8_t light_effect(enum light_effect_types effect, void *ctx, uint64_t t, uint8_t pwm, uint8_t pwr);
 
 /* flash.h */
+struct flash_wear_stats {
+	uint32_t file_writes;   /* file write operations */
+	uint64_t file_bytes;    /* bytes written to files */
+	uint32_t prog_count;    /* flash program operations */
+	uint64_t prog_bytes;    /* bytes programmed to flash */
+	uint32_t erase_count;   /* flash block erase operations */
+};
 void lfs_setup(bool multicore);
 int flash_format(bool multicore);
 int flash_read_file(char **bufptr, uint32_t *sizeptr, const char *filename);
 int flash_write_file(const char *buf, uint32_t size, const char *filename);
 int flash_delete_file(const char *filename);
+int flash_file_read_at(const char *filename, uint32_t offset, void *buf, uint32_t size);
+int flash_file_write_at(const char *filename, uint32_t offset, const void *buf, uint32_t size);
+int flash_file_truncate(const char *filename, uint32_t size);
+int flash_rename_file(const char *oldname, const char *newname);
+void flash_sync();
+void flash_get_wear_stats(struct flash_wear_stats *stats);
 int flash_get_fs_info(size_t *size, size_t *free, size_t *files,
 		size_t *directories, size_t *filesizetotal);
 void print_rp2040_flashinfo();
@@ -235,6 +408,7 @@ void print_rp2040_flashinfo();
 void network_init();
 void network_mac();
 void network_poll();
+void network_process_commands();
 void network_status();
 void set_pico_system_time(long unsigned int sec);
 const char *network_ip();
@@ -257,6 +431,7 @@ void brickpico_mqtt_publish();
 void brickpico_mqtt_publish_duty();
 void brickpico_mqtt_publish_temp();
 void brickpico_mqtt_scpi_command();
+void brickpico_mqtt_print_stats();
 void brickpico_mqtt_poll();
 
 #endif
@@ -274,20 +449,111 @@ void set_pwm_duty_cycle(uint out, float duty);
 void set_pwm_lightness(uint out, uint lightness);
 float get_pwm_duty_cycle(uint fan);
 void get_pwm_duty_cycles(const struct brickpico_config *config);
+void flush_pwm_outputs();
+void print_pwm_expander_stats();
 
 
 /* log.c */
+enum log_subsystems {
+	LOG_SUBSYS_SYSTEM = 0,
+	LOG_SUBSYS_PWM,
+	LOG_SUBSYS_EFFECTS,
+	LOG_SUBSYS_MQTT,
+	LOG_SUBSYS_HTTPD,
+	LOG_SUBSYS_TIMER,
+	LOG_SUBSYS_FLASH,
+	LOG_SUBSYS_NET,
+	LOG_SUBSYS_COUNT
+};
+
+/* Highest log level compiled in (per subsystem). Calls above this level
+   are removed at build time. Defaults to LOG_MAX_LEVEL (see CMakeLists.txt),
+   but can be overridden, for example: -DLOG_MAX_LEVEL_MQTT=LOG_DEBUG */
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LOG_DEBUG
+#endif
+#ifndef LOG_MAX_LEVEL_SYSTEM
+#define LOG_MAX_LEVEL_SYSTEM LOG_MAX_LEVEL
+#endif
+#ifndef LOG_MAX_LEVEL_PWM
+#define LOG_MAX_LEVEL_PWM LOG_MAX_LEVEL
+#endif
+#ifndef LOG_MAX_LEVEL_EFFECTS
+#define LOG_MAX_LEVEL_EFFECTS LOG_MAX_LEVEL
+#endif
+#ifndef LOG_MAX_LEVEL_MQTT
+#define LOG_MAX_LEVEL_MQTT LOG_MAX_LEVEL
+#endif
+#ifndef LOG_MAX_LEVEL_HTTPD
+#define LOG_MAX_LEVEL_HTTPD LOG_MAX_LEVEL
+#endif
+#ifndef LOG_MAX_LEVEL_TIMER
+#define LOG_MAX_LEVEL_TIMER LOG_MAX_LEVEL
+#endif
+#ifndef LOG_MAX_LEVEL_FLASH
+#define LOG_MAX_LEVEL_FLASH LOG_MAX_LEVEL
+#endif
+#ifndef LOG_MAX_LEVEL_NET
+#define LOG_MAX_LEVEL_NET LOG_MAX_LEVEL
+#endif
+
+/* Subsystem that log_msg() calls in a source file belong to.
+   Define this before including brickpico.h, for example:
+     #define LOG_SUBSYS MQTT */
+#ifndef LOG_SUBSYS
+#define LOG_SUBSYS SYSTEM
+#endif
+
+#define log_msg(priority, ...)						\
+	log_msg_subsys(LOG_SUBSYS, priority, __VA_ARGS__)
+#define log_msg_subsys(subsys, priority, ...)				\
+	_log_msg_subsys(subsys, priority, __VA_ARGS__)
+#define _log_msg_subsys(subsys, priority, ...) do {			\
+		if ((priority) <= LOG_MAX_LEVEL_##subsys)		\
+			log_subsys_msg(LOG_SUBSYS_##subsys, priority, __VA_ARGS__); \
+	} while (0)
+
+struct log_ratelimit {
+	uint64_t t_start;
+	uint32_t count;
+	uint32_t suppressed;
+};
+
+/* Rate limited log_msg(): log at most 'burst' messages per 'interval' (ms)
+   from each call site. Number of suppressed messages is reported once
+   the interval has passed and call site logs again. */
+#define log_msg_ratelimited(interval, burst, priority, ...)		\
+	log_msg_subsys_ratelimited(LOG_SUBSYS, interval, burst, priority, __VA_ARGS__)
+#define log_msg_subsys_ratelimited(subsys, interval, burst, priority, ...) \
+	_log_msg_subsys_ratelimited(subsys, interval, burst, priority, __VA_ARGS__)
+#define _log_msg_subsys_ratelimited(subsys, interval, burst, priority, ...) do { \
+		static struct log_ratelimit _log_rl;			\
+		if ((priority) <= LOG_MAX_LEVEL_##subsys &&		\
+			log_ratelimit(&_log_rl, interval, burst,	\
+				LOG_SUBSYS_##subsys, priority, __func__)) \
+			log_subsys_msg(LOG_SUBSYS_##subsys, priority, __VA_ARGS__); \
+	} while (0)
+
 int str2log_priority(const char *pri);
 const char* log_priority2str(int pri);
 int str2log_facility(const char *facility);
 const char* log_facility2str(int facility);
-void log_msg(int priority, const char *format, ...);
+int str2log_subsys(const char *subsys);
+const char* log_subsys2str(int subsys);
+void (log_msg)(int priority, const char *format, ...);
+void log_subsys_msg(int subsys, int priority, const char *format, ...);
+int log_ratelimit(struct log_ratelimit *rl, uint32_t interval, uint32_t burst,
+		int subsys, int priority, const char *func);
+void log_enable_queue();
+void process_log_queue();
 int get_debug_level();
 void set_debug_level(int level);
 int get_log_level();
 void set_log_level(int level);
 int get_syslog_level();
 void set_syslog_level(int level);
+int get_log_subsys_level(int subsys);
+void set_log_subsys_level(int subsys, int level);
 void debug(int debug_level, const char *fmt, ...);
 
 /* timer.c */
@@ -334,12 +600,14 @@ const char *rp2040_model_str();
 const char *pico_serial_str();
 int time_passed(absolute_time_t *t, uint32_t us);
 int getstring_timeout_ms(char *str, uint32_t maxlen, uint32_t timeout);
+void i2c_bus_init();
 
 /* temp.c */
 double get_temperature(double adc_ref_voltage, double temp_offset, double temp_coefficient);
 void update_temp(const struct brickpico_config *conf, struct brickpico_state *state);
 
 /* crc32.c */
+void xcrc32_init(void);
 unsigned int xcrc32 (const unsigned char *buf, int len, unsigned int init);
 
 
@@ -2295,6 +2295,204 @@ Pragma: no-cache
 
 
 
+#if FSDATA_FILE_ALIGNMENT==1
+static const unsigned int dummy_align__cmdstats_json = 10;
+#endif
+static const unsigned char FSDATA_ALIGN_PRE data__cmdstats_json[] FSDATA_ALIGN_POST = {
+/* /cmdstats.json (15 chars) */
+0x2f,0x63,0x6d,0x64,0x73,0x74,0x61,0x74,0x73,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,
+
+/* HTTP header */
+/* "HTTP/1.0 200 OK
+" (17 bytes) */
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x0a,
+/* "Server: BrickPico (https://github.com/tjko/brickpico)
+" (55 bytes) */
+0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x42,0x72,0x69,0x63,0x6b,0x50,0x69,0x63,
+0x6f,0x20,0x28,0x68,0x74,0x74,0x70,0x73,0x3a,0x2f,0x2f,0x67,0x69,0x74,0x68,0x75,
+0x62,0x2e,0x63,0x6f,0x6d,0x2f,0x74,0x6a,0x6b,0x6f,0x2f,0x62,0x72,0x69,0x63,0x6b,
+0x70,0x69,0x63,0x6f,0x29,0x0d,0x0a,
+/* "Last-Modified: Fri, 16 Oct 2026 23:58:20 GMT"
+" (46+ bytes) */
+0x4c,0x61,0x73,0x74,0x2d,0x4d,0x6f,0x64,0x69,0x66,0x69,0x65,0x64,0x3a,0x20,0x46,
+0x72,0x69,0x2c,0x20,0x31,0x36,0x20,0x4f,0x63,0x74,0x20,0x32,0x30,0x32,0x36,0x20,
+0x32,0x33,0x3a,0x35,0x38,0x3a,0x32,0x30,0x20,0x47,0x4d,0x54,0x0d,0x0a,
+/* "Expires: Fri, 10 Apr 2008 14:00:00 GMT
+Pragma: no-cache
+" (58 bytes) */
+0x45,0x78,0x70,0x69,0x72,0x65,0x73,0x3a,0x20,0x46,0x72,0x69,0x2c,0x20,0x31,0x30,
+0x20,0x41,0x70,0x72,0x20,0x32,0x30,0x30,0x38,0x20,0x31,0x34,0x3a,0x30,0x30,0x3a,
+0x30,0x30,0x20,0x47,0x4d,0x54,0x0d,0x0a,0x50,0x72,0x61,0x67,0x6d,0x61,0x3a,0x20,
+0x6e,0x6f,0x2d,0x63,0x61,0x63,0x68,0x65,0x0d,0x0a,
+/* "Content-Type: application/json
+
+" (34 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
+0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x0d,0x0a,
+0x0d,0x0a,
+/* raw file data (16 bytes) */
+0x3c,0x21,0x2d,0x2d,0x23,0x63,0x6d,0x64,0x73,0x74,0x61,0x74,0x2d,0x2d,0x3e,0x0a,
+};
+
+#if FSDATA_FILE_ALIGNMENT==1
+static const unsigned int dummy_align__history_csv = 11;
+#endif
+static const unsigned char FSDATA_ALIGN_PRE data__history_csv[] FSDATA_ALIGN_POST = {
+/* /history.csv (13 chars) */
+0x2f,0x68,0x69,0x73,0x74,0x6f,0x72,0x79,0x2e,0x63,0x73,0x76,0x00,0x00,0x00,0x00,
+
+/* HTTP header */
+/* "HTTP/1.0 200 OK
+" (17 bytes) */
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x0a,
+/* "Server: BrickPico (https://github.com/tjko/brickpico)
+" (55 bytes) */
+0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x42,0x72,0x69,0x63,0x6b,0x50,0x69,0x63,
+0x6f,0x20,0x28,0x68,0x74,0x74,0x70,0x73,0x3a,0x2f,0x2f,0x67,0x69,0x74,0x68,0x75,
+0x62,0x2e,0x63,0x6f,0x6d,0x2f,0x74,0x6a,0x6b,0x6f,0x2f,0x62,0x72,0x69,0x63,0x6b,
+0x70,0x69,0x63,0x6f,0x29,0x0d,0x0a,
+/* "Last-Modified: Sat, 17 Oct 2026 00:15:38 GMT"
+" (46+ bytes) */
+0x4c,0x61,0x73,0x74,0x2d,0x4d,0x6f,0x64,0x69,0x66,0x69,0x65,0x64,0x3a,0x20,0x53,
+0x61,0x74,0x2c,0x20,0x31,0x37,0x20,0x4f,0x63,0x74,0x20,0x32,0x30,0x32,0x36,0x20,
+0x30,0x30,0x3a,0x31,0x35,0x3a,0x33,0x38,0x20,0x47,0x4d,0x54,0x0d,0x0a,
+/* "Expires: Fri, 10 Apr 2008 14:00:00 GMT
+Pragma: no-cache
+" (58 bytes) */
+0x45,0x78,0x70,0x69,0x72,0x65,0x73,0x3a,0x20,0x46,0x72,0x69,0x2c,0x20,0x31,0x30,
+0x20,0x41,0x70,0x72,0x20,0x32,0x30,0x30,0x38,0x20,0x31,0x34,0x3a,0x30,0x30,0x3a,
+0x30,0x30,0x20,0x47,0x4d,0x54,0x0d,0x0a,0x50,0x72,0x61,0x67,0x6d,0x61,0x3a,0x20,
+0x6e,0x6f,0x2d,0x63,0x61,0x63,0x68,0x65,0x0d,0x0a,
+/* "Content-Type: text/plain
+
+" (28 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x74,0x65,
+0x78,0x74,0x2f,0x70,0x6c,0x61,0x69,0x6e,0x0d,0x0a,0x0d,0x0a,
+/* raw file data (16 bytes) */
+0x3c,0x21,0x2d,0x2d,0x23,0x68,0x69,0x73,0x74,0x63,0x73,0x76,0x2d,0x2d,0x3e,0x0a,
+};
+
+#if FSDATA_FILE_ALIGNMENT==1
+static const unsigned int dummy_align__history_json = 12;
+#endif
+static const unsigned char FSDATA_ALIGN_PRE data__history_json[] FSDATA_ALIGN_POST = {
+/* /history.json (14 chars) */
+0x2f,0x68,0x69,0x73,0x74,0x6f,0x72,0x79,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,
+
+/* HTTP header */
+/* "HTTP/1.0 200 OK
+" (17 bytes) */
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x0a,
+/* "Server: BrickPico (https://github.com/tjko/brickpico)
+" (55 bytes) */
+0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x42,0x72,0x69,0x63,0x6b,0x50,0x69,0x63,
+0x6f,0x20,0x28,0x68,0x74,0x74,0x70,0x73,0x3a,0x2f,0x2f,0x67,0x69,0x74,0x68,0x75,
+0x62,0x2e,0x63,0x6f,0x6d,0x2f,0x74,0x6a,0x6b,0x6f,0x2f,0x62,0x72,0x69,0x63,0x6b,
+0x70,0x69,0x63,0x6f,0x29,0x0d,0x0a,
+/* "Last-Modified: Sat, 17 Oct 2026 00:15:38 GMT"
+" (46+ bytes) */
+0x4c,0x61,0x73,0x74,0x2d,0x4d,0x6f,0x64,0x69,0x66,0x69,0x65,0x64,0x3a,0x20,0x53,
+0x61,0x74,0x2c,0x20,0x31,0x37,0x20,0x4f,0x63,0x74,0x20,0x32,0x30,0x32,0x36,0x20,
+0x30,0x30,0x3a,0x31,0x35,0x3a,0x33,0x38,0x20,0x47,0x4d,0x54,0x0d,0x0a,
+/* "Expires: Fri, 10 Apr 2008 14:00:00 GMT
+Pragma: no-cache
+" (58 bytes) */
+0x45,0x78,0x70,0x69,0x72,0x65,0x73,0x3a,0x20,0x46,0x72,0x69,0x2c,0x20,0x31,0x30,
+0x20,0x41,0x70,0x72,0x20,0x32,0x30,0x30,0x38,0x20,0x31,0x34,0x3a,0x30,0x30,0x3a,
+0x30,0x30,0x20,0x47,0x4d,0x54,0x0d,0x0a,0x50,0x72,0x61,0x67,0x6d,0x61,0x3a,0x20,
+0x6e,0x6f,0x2d,0x63,0x61,0x63,0x68,0x65,0x0d,0x0a,
+/* "Content-Type: application/json
+
+" (34 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
+0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x0d,0x0a,
+0x0d,0x0a,
+/* raw file data (17 bytes) */
+0x3c,0x21,0x2d,0x2d,0x23,0x68,0x69,0x73,0x74,0x6a,0x73,0x6f,0x6e,0x2d,0x2d,0x3e,
+0x0a,};
+
+#if FSDATA_FILE_ALIGNMENT==1
+static const unsigned int dummy_align__log_json = 13;
+#endif
+static const unsigned char FSDATA_ALIGN_PRE data__log_json[] FSDATA_ALIGN_POST = {
+/* /log.json (10 chars) */
+0x2f,0x6c,0x6f,0x67,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,
+
+/* HTTP header */
+/* "HTTP/1.0 200 OK
+" (17 bytes) */
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x0a,
+/* "Server: BrickPico (https://github.com/tjko/brickpico)
+" (55 bytes) */
+0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x42,0x72,0x69,0x63,0x6b,0x50,0x69,0x63,
+0x6f,0x20,0x28,0x68,0x74,0x74,0x70,0x73,0x3a,0x2f,0x2f,0x67,0x69,0x74,0x68,0x75,
+0x62,0x2e,0x63,0x6f,0x6d,0x2f,0x74,0x6a,0x6b,0x6f,0x2f,0x62,0x72,0x69,0x63,0x6b,
+0x70,0x69,0x63,0x6f,0x29,0x0d,0x0a,
+/* "Last-Modified: Sat, 17 Oct 2026 00:39:51 GMT"
+" (46+ bytes) */
+0x4c,0x61,0x73,0x74,0x2d,0x4d,0x6f,0x64,0x69,0x66,0x69,0x65,0x64,0x3a,0x20,0x53,
+0x61,0x74,0x2c,0x20,0x31,0x37,0x20,0x4f,0x63,0x74,0x20,0x32,0x30,0x32,0x36,0x20,
+0x30,0x30,0x3a,0x33,0x39,0x3a,0x35,0x31,0x20,0x47,0x4d,0x54,0x0d,0x0a,
+/* "Expires: Fri, 10 Apr 2008 14:00:00 GMT
+Pragma: no-cache
+" (58 bytes) */
+0x45,0x78,0x70,0x69,0x72,0x65,0x73,0x3a,0x20,0x46,0x72,0x69,0x2c,0x20,0x31,0x30,
+0x20,0x41,0x70,0x72,0x20,0x32,0x30,0x30,0x38,0x20,0x31,0x34,0x3a,0x30,0x30,0x3a,
+0x30,0x30,0x20,0x47,0x4d,0x54,0x0d,0x0a,0x50,0x72,0x61,0x67,0x6d,0x61,0x3a,0x20,
+0x6e,0x6f,0x2d,0x63,0x61,0x63,0x68,0x65,0x0d,0x0a,
+/* "Content-Type: application/json
+
+" (34 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
+0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x0d,0x0a,
+0x0d,0x0a,
+/* raw file data (16 bytes) */
+0x3c,0x21,0x2d,0x2d,0x23,0x6c,0x6f,0x67,0x6a,0x73,0x6f,0x6e,0x2d,0x2d,0x3e,0x0a,
+};
+
+#if FSDATA_FILE_ALIGNMENT==1
+static const unsigned int dummy_align__log_txt = 14;
+#endif
+static const unsigned char FSDATA_ALIGN_PRE data__log_txt[] FSDATA_ALIGN_POST = {
+/* /log.txt (9 chars) */
+0x2f,0x6c,0x6f,0x67,0x2e,0x74,0x78,0x74,0x00,0x00,0x00,0x00,
+
+/* HTTP header */
+/* "HTTP/1.0 200 OK
+" (17 bytes) */
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x0a,
+/* "Server: BrickPico (https://github.com/tjko/brickpico)
+" (55 bytes) */
+0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x42,0x72,0x69,0x63,0x6b,0x50,0x69,0x63,
+0x6f,0x20,0x28,0x68,0x74,0x74,0x70,0x73,0x3a,0x2f,0x2f,0x67,0x69,0x74,0x68,0x75,
+0x62,0x2e,0x63,0x6f,0x6d,0x2f,0x74,0x6a,0x6b,0x6f,0x2f,0x62,0x72,0x69,0x63,0x6b,
+0x70,0x69,0x63,0x6f,0x29,0x0d,0x0a,
+/* "Last-Modified: Sat, 17 Oct 2026 00:39:51 GMT"
+" (46+ bytes) */
+0x4c,0x61,0x73,0x74,0x2d,0x4d,0x6f,0x64,0x69,0x66,0x69,0x65,0x64,0x3a,0x20,0x53,
+0x61,0x74,0x2c,0x20,0x31,0x37,0x20,0x4f,0x63,0x74,0x20,0x32,0x30,0x32,0x36,0x20,
+0x30,0x30,0x3a,0x33,0x39,0x3a,0x35,0x31,0x20,0x47,0x4d,0x54,0x0d,0x0a,
+/* "Expires: Fri, 10 Apr 2008 14:00:00 GMT
+Pragma: no-cache
+" (58 bytes) */
+0x45,0x78,0x70,0x69,0x72,0x65,0x73,0x3a,0x20,0x46,0x72,0x69,0x2c,0x20,0x31,0x30,
+0x20,0x41,0x70,0x72,0x20,0x32,0x30,0x30,0x38,0x20,0x31,0x34,0x3a,0x30,0x30,0x3a,
+0x30,0x30,0x20,0x47,0x4d,0x54,0x0d,0x0a,0x50,0x72,0x61,0x67,0x6d,0x61,0x3a,0x20,
+0x6e,0x6f,0x2d,0x63,0x61,0x63,0x68,0x65,0x0d,0x0a,
+/* "Content-Type: text/plain
+
+" (28 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x74,0x65,
+0x78,0x74,0x2f,0x70,0x6c,0x61,0x69,0x6e,0x0d,0x0a,0x0d,0x0a,
+/* raw file data (16 bytes) */
+0x3c,0x21,0x2d,0x2d,0x23,0x6c,0x6f,0x67,0x74,0x65,0x78,0x74,0x2d,0x2d,0x3e,0x0a,
+};
+
 const struct fsdata_file file__img_brickpico_icon_png[] = { {
 file_NULL,
 data__img_brickpico_icon_png,
@@ -2375,6 +2573,46 @@ sizeof(data__status_shtml) - 16,
 FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
 }};
 
-#define FS_ROOT file__status_shtml
-#define FS_NUMFILES 10
+const struct fsdata_file file__cmdstats_json[] = { {
+file__status_shtml,
+data__cmdstats_json,
+data__cmdstats_json + 16,
+sizeof(data__cmdstats_json) - 16,
+FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
+}};
+
+const struct fsdata_file file__history_csv[] = { {
+file__cmdstats_json,
+data__history_csv,
+data__history_csv + 16,
+sizeof(data__history_csv) - 16,
+FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
+}};
+
+const struct fsdata_file file__history_json[] = { {
+file__history_csv,
+data__history_json,
+data__history_json + 16,
+sizeof(data__history_json) - 16,
+FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
+}};
+
+const struct fsdata_file file__log_json[] = { {
+file__history_json,
+data__log_json,
+data__log_json + 12,
+sizeof(data__log_json) - 12,
+FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
+}};
+
+const struct fsdata_file file__log_txt[] = { {
+file__log_json,
+data__log_txt,
+data__log_txt + 12,
+sizeof(data__log_txt) - 12,
+FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
+}};
+
+#define FS_ROOT file__log_txt
+#define FS_NUMFILES 15
 
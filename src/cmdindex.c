@@ -0,0 +1,211 @@
+/* cmdindex.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "cmdindex.h"
+
+
+static_assert(CMD_MAX_LEVELS < CMD_HASH_EMPTY, "CMD_MAX_LEVELS too large");
+static_assert(CMD_MAX_CMDS <= CMD_HASH_EMPTY, "CMD_MAX_CMDS too large");
+static_assert(CMD_MAX_MATCH < 16, "CMD_MAX_MATCH does not fit in lengths bitmask");
+static_assert((CMD_HASH_SIZE & (CMD_HASH_SIZE - 1)) == 0, "CMD_HASH_SIZE not power of 2");
+
+
+static uint32_t cmd_hash(int level, const char *s, int len)
+{
+	uint32_t h = 2166136261UL ^ level;
+
+	/* FNV-1a */
+	for (int i = 0; i < len; i++) {
+		h ^= toupper((int)s[i]);
+		h *= 16777619UL;
+	}
+	return h & (CMD_HASH_SIZE - 1);
+}
+
+static int add_cmd_level(cmd_index_t *ci, const struct cmd_t *cmds)
+{
+	struct cmd_level_t *l;
+	int level, i;
+
+	for (level = 0; level < ci->level_count; level++) {
+		if (ci->levels[level].cmds == cmds)
+			return level;
+	}
+	if (ci->level_count >= CMD_MAX_LEVELS)
+		return -1;
+	level = ci->level_count++;
+	l = &ci->levels[level];
+	l->cmds = cmds;
+	l->lengths = 0;
+	l->parent = CMD_HASH_EMPTY;
+	l->parent_idx = 0;
+
+	for (i = 0; cmds[i].cmd; i++) {
+		uint8_t len = cmds[i].min_match;
+		uint32_t h = cmd_hash(level, cmds[i].cmd, len);
+		int sub;
+
+		/* Keep hash table at most half full (so that probing stays short) */
+		if (i >= CMD_MAX_CMDS || len < 1 || len > CMD_MAX_MATCH
+			|| ci->hash_count >= CMD_HASH_SIZE / 2)
+			return -1;
+		l->lengths |= (1 << len);
+		while (ci->hash_table[h].level != CMD_HASH_EMPTY)
+			h = (h + 1) & (CMD_HASH_SIZE - 1);
+		ci->hash_table[h].level = level;
+		ci->hash_table[h].idx = i;
+		ci->hash_count++;
+
+		if ((sub = (cmds[i].subcmds ? add_cmd_level(ci, cmds[i].subcmds) : 0)) < 0)
+			return -1;
+		l->subs[i] = sub;
+		if (sub > 0 && ci->levels[sub].parent == CMD_HASH_EMPTY) {
+			ci->levels[sub].parent = level;
+			ci->levels[sub].parent_idx = i;
+		}
+	}
+
+	return level;
+}
+
+
+/* Build index for command tree. Returns 0 on success, or -1 if command tree
+   does not fit in the index (lookups then use linear scan). */
+int cmd_index_build(cmd_index_t *ci, const struct cmd_t *root)
+{
+	memset(ci, 0, sizeof(*ci));
+	memset(ci->hash_table, CMD_HASH_EMPTY, sizeof(ci->hash_table));
+	ci->root = root;
+	if (add_cmd_level(ci, root) < 0)
+		return -1;
+	ci->valid = true;
+
+	return 0;
+}
+
+
+void cmd_index_root(const cmd_index_t *ci, struct cmd_pos_t *p)
+{
+	p->level = (ci->valid ? 0 : -1);
+	p->cmds = ci->root;
+}
+
+
+void cmd_index_sub(const cmd_index_t *ci, struct cmd_pos_t *p, int idx)
+{
+	if (p->level >= 0)
+		p->level = ci->levels[p->level].subs[idx];
+	p->cmds = p->cmds[idx].subcmds;
+}
+
+
+/* Find command matching 's' on current level of the command tree.
+   Returns index of the command or -1 if no match found. */
+int cmd_index_find(const cmd_index_t *ci, const struct cmd_pos_t *p, const char *s)
+{
+	const struct cmd_t *cmds = p->cmds;
+	int level = p->level;
+	uint16_t lengths;
+	int len = strlen(s);
+	int best = -1;
+
+	if (level < 0) {
+		/* Linear scan (first matching command in the table wins) */
+		for (int i = 0; cmds[i].cmd; i++) {
+			if (!strncasecmp(s, cmds[i].cmd, cmds[i].min_match))
+				return i;
+		}
+		return -1;
+	}
+
+	lengths = ci->levels[level].lengths;
+
+	for (int m = 1; m <= CMD_MAX_MATCH && m <= len; m++) {
+		if (!(lengths & (1 << m)))
+			continue;
+		uint32_t h = cmd_hash(level, s, m);
+		while (ci->hash_table[h].level != CMD_HASH_EMPTY) {
+			const struct cmd_hash_t *e = &ci->hash_table[h];
+			if (e->level == level && cmds[e->idx].min_match == m
+				&& !strncasecmp(s, cmds[e->idx].cmd, m)) {
+				/* If multiple commands match, first one in the table wins... */
+				if (best < 0 || e->idx < best)
+					best = e->idx;
+				break;
+			}
+			h = (h + 1) & (CMD_HASH_SIZE - 1);
+		}
+	}
+
+	return best;
+}
+
+
+/* Generate full command name (like "SYStem:MEMory") for a command. */
+const char* cmd_index_name(const cmd_index_t *ci, int level, int idx, char *buf, size_t size)
+{
+	uint8_t levels[8], idxs[8];
+	size_t len = 0;
+	int n = 0;
+
+	if (size < 1)
+		return buf;
+	buf[0] = 0;
+	if (level < 0 || level >= ci->level_count)
+		return buf;
+
+	while (n < 8) {
+		levels[n] = level;
+		idxs[n++] = idx;
+		if (ci->levels[level].parent == CMD_HASH_EMPTY)
+			break;
+		idx = ci->levels[level].parent_idx;
+		level = ci->levels[level].parent;
+	}
+
+	while (n-- > 0 && len < size) {
+		len += snprintf(buf + len, size - len, "%s%s",
+				ci->levels[levels[n]].cmds[idxs[n]].cmd, (n > 0 ? ":" : ""));
+	}
+
+	return buf;
+}
+
+
+/* Parse index from commands like "OUTPUT12" */
+int cmd_parse_index(const char *s)
+{
+	while (isalpha((int)*s))
+		s++;
+	if (!isdigit((int)*s))
+		return -1;
+	return atoi(s) - 1;
+}
+
+
+/* eof :-) */
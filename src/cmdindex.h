@@ -0,0 +1,89 @@
+/* cmdindex.h
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRICKPICO_CMDINDEX_H
+#define BRICKPICO_CMDINDEX_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Command lookup index.
+
+   Command tree is indexed (once) into a hash table keyed on command level
+   and the (upper case) short form of each command. Lookup then needs only
+   one hash probe per distinct short form length used on the command level.
+
+   If command tree does not fit in the index (limits below), commands are
+   looked up using linear scan of the command tables instead.
+ */
+
+struct cmd_t {
+	const char   *cmd;
+	uint8_t       min_match;
+	const struct cmd_t *subcmds;
+	int (*func)(const char *cmd, const char *args, int query, char *prev_cmd);
+};
+
+#define CMD_MAX_LEVELS     48
+#define CMD_MAX_CMDS       64    /* max commands per level */
+#define CMD_MAX_MATCH      15
+#define CMD_HASH_SIZE      512   /* must be power of 2 */
+#define CMD_HASH_EMPTY     0xff
+
+struct cmd_level_t {
+	const struct cmd_t *cmds;
+	uint16_t lengths;   /* bitmask of min_match lengths used on this level */
+	uint8_t parent;     /* parent command level (CMD_HASH_EMPTY for root) */
+	uint8_t parent_idx; /* index of parent command in parent level */
+	uint8_t subs[CMD_MAX_CMDS];  /* command level of subcommands */
+};
+
+struct cmd_hash_t {
+	uint8_t level;
+	uint8_t idx;
+};
+
+typedef struct cmd_index {
+	const struct cmd_t *root;
+	struct cmd_level_t levels[CMD_MAX_LEVELS];
+	struct cmd_hash_t hash_table[CMD_HASH_SIZE];
+	int level_count;
+	int hash_count;
+	bool valid;
+} cmd_index_t;
+
+/* Current position in the command tree (level is -1 if index is not used) */
+struct cmd_pos_t {
+	int level;
+	const struct cmd_t *cmds;
+};
+
+
+int cmd_index_build(cmd_index_t *ci, const struct cmd_t *root);
+void cmd_index_root(const cmd_index_t *ci, struct cmd_pos_t *p);
+void cmd_index_sub(const cmd_index_t *ci, struct cmd_pos_t *p, int idx);
+int cmd_index_find(const cmd_index_t *ci, const struct cmd_pos_t *p, const char *s);
+const char* cmd_index_name(const cmd_index_t *ci, int level, int idx, char *buf, size_t size);
+int cmd_parse_index(const char *s);
+
+
+#endif /* BRICKPICO_CMDINDEX_H */
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <time.h>
 #include <string.h>
 #include <ctype.h>
@@ -36,21 +37,16 @@
 #include "cJSON.h"
 
 #include "brickpico.h"
+#include "cmdindex.h"
 #ifdef WIFI_SUPPORT
 #include "lwip/ip_addr.h"
 #include "lwip/stats.h"
+#include "syslog.h"
 #include "pico_telnetd/util.h"
 #endif
 
 
 
-struct cmd_t {
-	const char   *cmd;
-	uint8_t       min_match;
-	const struct cmd_t *subcmds;
-	int (*func)(const char *cmd, const char *args, int query, char *prev_cmd);
-};
-
 struct error_t {
 	const char    *error;
 	int            error_num;
@@ -68,12 +64,149 @@ int last_error_num = 0;
 
 struct brickpico_state *st = NULL;
 struct brickpico_config *conf = NULL;
+static int out_idx = -1;  /* OUTPUTx index (0..) parsed from current command */
+static struct cmd_response *cmd_resp = NULL;  /* response buffer for current command */
+static struct brickpico_config *conf_shadow = NULL;  /* staged config (CONF:BEGIN) */
+static int conf_shadow_source = -1;  /* source (transport) that started the transaction */
 
 /* credits.s */
 extern const char brickpico_credits_text[];
 
 
 
+/* Command response buffer.
+
+   Command handlers write their output using cmd_printf() / cmd_write(),
+   which append to the response buffer given to process_command().
+   When buffer fills up, it is passed to the drain function (if any),
+   otherwise output is truncated. If no response buffer is given,
+   output goes directly to stdout.
+ */
+
+void cmd_response_init(struct cmd_response *r, char *buf, size_t size,
+		cmd_response_drain_func_t drain, void *ctx)
+{
+	assert(r && buf && size > 1);
+
+	r->buf = buf;
+	r->size = size;
+	r->len = 0;
+	r->truncated = false;
+	r->drain = drain;
+	r->ctx = ctx;
+	r->source = CMD_SRC_CONSOLE;
+	r->buf[0] = 0;
+}
+
+void cmd_response_flush(struct cmd_response *r)
+{
+	if (!r)
+		return;
+
+	if (r->drain && r->len > 0)
+		r->drain(r->ctx, r->buf, r->len);
+	r->len = 0;
+	r->truncated = false;
+	r->buf[0] = 0;
+}
+
+void cmd_write(const char *data, size_t len)
+{
+	struct cmd_response *r = cmd_resp;
+
+	if (!r) {
+		printf("%.*s", (int)len, data);
+		return;
+	}
+
+	while (len > 0) {
+		size_t count = r->size - 1 - r->len;
+
+		if (count == 0) {
+			if (!r->drain) {
+				r->truncated = true;
+				return;
+			}
+			cmd_response_flush(r);
+			continue;
+		}
+		if (count > len)
+			count = len;
+		memcpy(r->buf + r->len, data, count);
+		r->len += count;
+		r->buf[r->len] = 0;
+		data += count;
+		len -= count;
+	}
+}
+
+int cmd_printf(const char *format, ...)
+{
+	struct cmd_response *r = cmd_resp;
+	va_list ap;
+	int len;
+
+	va_start(ap, format);
+	if (!r) {
+		len = vprintf(format, ap);
+		va_end(ap);
+		return len;
+	}
+	len = vsnprintf(r->buf + r->len, r->size - r->len, format, ap);
+	va_end(ap);
+
+	if (len < 0) {
+		r->buf[r->len] = 0;
+		return len;
+	}
+	if (r->len + len < r->size) {
+		r->len += len;
+		return len;
+	}
+
+	/* Output did not fit in the buffer... */
+	r->buf[r->len] = 0;
+	if (r->drain) {
+		char *tmp;
+
+		cmd_response_flush(r);
+		if (len < r->size) {
+			va_start(ap, format);
+			len = vsnprintf(r->buf, r->size, format, ap);
+			va_end(ap);
+			r->len = len;
+			return len;
+		}
+		/* Output is larger than the buffer, pass it through in pieces */
+		if ((tmp = malloc(len + 1))) {
+			va_start(ap, format);
+			vsnprintf(tmp, len + 1, format, ap);
+			va_end(ap);
+			cmd_write(tmp, len);
+			free(tmp);
+			return len;
+		}
+	}
+	r->len = strnlen(r->buf, r->size - 1);
+	r->buf[r->len] = 0;
+	r->truncated = true;
+
+	return len;
+}
+
+/* Send any buffered output (before waiting for user input, etc.) */
+void cmd_flush()
+{
+	cmd_response_flush(cmd_resp);
+}
+
+/* Return source (transport) of the command currently being processed. */
+int cmd_source()
+{
+	return (cmd_resp ? cmd_resp->source : CMD_SRC_CONSOLE);
+}
+
+
 /* Helper functions for commands */
 
 typedef int (*validate_str_func_t)(const char *args);
@@ -82,7 +215,7 @@ int string_setting(const char *cmd, const char *args, int query, char *prev_cmd,
 		char *var, size_t var_len, const char *name, validate_str_func_t validate_func)
 {
 	if (query) {
-		printf("%s\n", var);
+		cmd_printf("%s\n", var);
 	} else {
 		if (validate_func) {
 			if (!validate_func(args)) {
@@ -98,14 +231,14 @@ int string_setting(const char *cmd, const char *args, int query, char *prev_cmd,
 	return 0;
 }
 
-int bitmask16_setting(const char *cmd, const char *args, int query, char *prev_cmd,
-		uint16_t *mask, uint16_t len, uint8_t base, const char *name)
+int bitmask32_setting(const char *cmd, const char *args, int query, char *prev_cmd,
+		uint32_t *mask, uint16_t len, uint8_t base, const char *name)
 {
 	uint32_t old = *mask;
 	uint32_t new;
 
 	if (query) {
-		printf("%s\n", bitmask_to_str(old, len, base, true));
+		cmd_printf("%s\n", bitmask_to_str(old, len, base, true));
 		return 0;
 	}
 
@@ -126,7 +259,7 @@ int uint32_setting(const char *cmd, const char *args, int query, char *prev_cmd,
 	int v;
 
 	if (query) {
-		printf("%lu\n", *var);
+		cmd_printf("%lu\n", *var);
 		return 0;
 	}
 
@@ -153,7 +286,7 @@ int uint8_setting(const char *cmd, const char *args, int query, char *prev_cmd,
 	int v;
 
 	if (query) {
-		printf("%u\n", *var);
+		cmd_printf("%u\n", *var);
 		return 0;
 	}
 
@@ -179,7 +312,7 @@ int bool_setting(const char *cmd, const char *args, int query, char *prev_cmd,
 	bool val;
 
 	if (query) {
-		printf("%s\n", (*var ? "ON" : "OFF"));
+		cmd_printf("%s\n", (*var ? "ON" : "OFF"));
 		return 0;
 	}
 
@@ -208,7 +341,7 @@ int ip_change(const char *cmd, const char *args, int query, char *prev_cmd, cons
 	ip_addr_t tmpip;
 
 	if (query) {
-		printf("%s\n", ipaddr_ntoa(ip));
+		cmd_printf("%s\n", ipaddr_ntoa(ip));
 	} else {
 		if (!ipaddr_aton(args, &tmpip))
 			return 2;
@@ -231,11 +364,11 @@ int cmd_idn(const char *cmd, const char *args, int query, char *prev_cmd)
 	if (!query)
 		return 1;
 
-	printf("TJKO Industries,BRICKPICO-%s,", BRICKPICO_MODEL);
+	cmd_printf("TJKO Industries,BRICKPICO-%s,", BRICKPICO_MODEL);
 	pico_get_unique_board_id(&board_id);
 	for (i = 0; i < PICO_UNIQUE_BOARD_ID_SIZE_BYTES; i++)
-		printf("%02x", board_id.id[i]);
-	printf(",%s%s\n", BRICKPICO_VERSION, BRICKPICO_BUILD_TAG);
+		cmd_printf("%02x", board_id.id[i]);
+	cmd_printf(",%s%s\n", BRICKPICO_VERSION, BRICKPICO_BUILD_TAG);
 
 	return 0;
 }
@@ -271,7 +404,7 @@ int cmd_version(const char *cmd, const char *args, int query, char *prev_cmd)
 	if (cmd && !query)
 		return 1;
 
-	printf("BrickPico-%s v%s%s (%s; %s; SDK v%s; %s)\n\n",
+	cmd_printf("BrickPico-%s v%s%s (%s; %s; SDK v%s; %s)\n\n",
 		BRICKPICO_MODEL,
 		BRICKPICO_VERSION,
 		BRICKPICO_BUILD_TAG,
@@ -281,7 +414,7 @@ int cmd_version(const char *cmd, const char *args, int query, char *prev_cmd)
 		PICO_BOARD);
 
 	if (query)
-		printf("%s\n", credits);
+		cmd_printf("%s\n", credits);
 
 	return 0;
 }
@@ -291,7 +424,16 @@ int cmd_outputs(const char *cmd, const char *args, int query, char *prev_cmd)
 	if (!query)
 		return 1;
 
-	printf("%d\n", OUTPUT_COUNT);
+	cmd_printf("%d\n", OUTPUT_COUNT);
+	return 0;
+}
+
+int cmd_expander(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (!query)
+		return 1;
+
+	print_pwm_expander_stats();
 	return 0;
 }
 
@@ -301,6 +443,21 @@ int cmd_led(const char *cmd, const char *args, int query, char *prev_cmd)
 			&conf->led_mode, 0, 2, "System LED Mode");
 }
 
+int cmd_history(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (!query)
+		return 1;
+
+	print_history_stats();
+	return 0;
+}
+
+int cmd_history_blocks(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	return uint8_setting(cmd, args, query, prev_cmd,
+			&conf->history_blocks, 0, HISTORY_MAX_BLOCKS, "History Blocks");
+}
+
 int cmd_null(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	log_msg(LOG_INFO, "null command: %s %s (query=%d)", cmd, args, query);
@@ -312,7 +469,7 @@ int cmd_debug(const char *cmd, const char *args, int query, char *prev_cmd)
 	int level;
 
 	if (query) {
-		printf("%d\n", get_debug_level());
+		cmd_printf("%d\n", get_debug_level());
 	} else if (str_to_int(args, &level, 10)) {
 		set_debug_level((level < 0 ? 0 : level));
 	}
@@ -329,9 +486,9 @@ int cmd_log_level(const char *cmd, const char *args, int query, char *prev_cmd)
 
 	if (query) {
 		if (name) {
-			printf("%s\n", name);
+			cmd_printf("%s\n", name);
 		} else {
-			printf("%d\n", level);
+			cmd_printf("%d\n", level);
 		}
 	} else {
 		if ((new_level = str2log_priority(args)) < 0)
@@ -345,32 +502,77 @@ int cmd_log_level(const char *cmd, const char *args, int query, char *prev_cmd)
 	return 0;
 }
 
-#define MEM_LOG_BUF_SIZE 256
+int cmd_log_subsys(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	char *s, *tok, *saveptr;
+	const char *name, *new_name;
+	int i, subsys, level, new_level;
+	int res = 1;
+
+	if (query) {
+		subsys = str2log_subsys(args);
+		for (i = 0; i < LOG_SUBSYS_COUNT; i++) {
+			if (subsys >= 0 && i != subsys)
+				continue;
+			level = get_log_subsys_level(i);
+			name = (level < 0 ? "DEFAULT" : log_priority2str(level));
+			cmd_printf("%s %s\n", log_subsys2str(i), (name ? name : ""));
+		}
+		return 0;
+	}
+
+	if (!(s = strdup(args)))
+		return 1;
+
+	if ((tok = strtok_r(s, " \t", &saveptr))) {
+		if ((subsys = str2log_subsys(tok)) >= 0) {
+			if ((tok = strtok_r(NULL, " \t", &saveptr))) {
+				if (!strcasecmp(tok, "DEFAULT"))
+					new_level = -1;
+				else
+					new_level = str2log_priority(tok);
+				if (new_level >= 0 || !strcasecmp(tok, "DEFAULT")) {
+					level = get_log_subsys_level(subsys);
+					name = (level < 0 ? "DEFAULT" : log_priority2str(level));
+					new_name = (new_level < 0 ? "DEFAULT" : log_priority2str(new_level));
+					log_msg(LOG_NOTICE, "Change %s log level: %s -> %s",
+						log_subsys2str(subsys), name, new_name);
+					set_log_subsys_level(subsys, new_level);
+					res = 0;
+				}
+			}
+		}
+	}
+	free(s);
+
+	return res;
+}
 
 int cmd_mem_log(const char *cmd, const char *args, int query, char *prev_cmd)
 {
-	int c, o, len, next, prev;
-	uint8_t *buf;
+	var_ringbuffer_iter_t iter;
+	const char *msg;
+	int len, count;
 
 	if (!query)
 		return 1;
-	if (!(buf = malloc(MEM_LOG_BUF_SIZE)))
-		return 2;
 
-	printf("logbuffer: items=%u, size=%u, free=%u\n",
+	cmd_printf("logbuffer: items=%u, size=%u, free=%u\n",
 		log_rb->items, log_rb->size, log_rb->free);
 
-	c = 0;
-	o = log_rb->head;
-	do {
-		c++;
-		len = u8_ringbuffer_peek(log_rb, o, buf, MEM_LOG_BUF_SIZE, &next, &prev);
+	/* Optionally only show N most recent entries... */
+	if (str_to_int(args, &count, 10) && count > 0)
+		var_ringbuffer_iter_init_recent(log_rb, &iter, count);
+	else
+		var_ringbuffer_iter_init(log_rb, &iter);
+
+	while ((len = persistent_log_next(&iter, &msg))) {
 		if (len > 0)
-			printf(">%s\n", buf);
-		o = next;
-	} while (len > 0 && o >= 0);
+			cmd_printf(">%s\n", msg);
+		else if (len == -5)
+			cmd_printf(">(corrupt log record)\n");
+	}
 
-	free(buf);
 	return 0;
 }
 
@@ -384,9 +586,9 @@ int cmd_syslog_level(const char *cmd, const char *args, int query, char *prev_cm
 
 	if (query) {
 		if (name) {
-			printf("%s\n", name);
+			cmd_printf("%s\n", name);
 		} else {
-			printf("%d\n", level);
+			cmd_printf("%d\n", level);
 		}
 	} else {
 		if ((new_level = str2log_priority(args)) < 0)
@@ -399,6 +601,17 @@ int cmd_syslog_level(const char *cmd, const char *args, int query, char *prev_cm
 	return 0;
 }
 
+#ifdef WIFI_SUPPORT
+int cmd_syslog_stats(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (!query)
+		return 1;
+
+	syslog_print_stats();
+	return 0;
+}
+#endif
+
 
 int cmd_echo(const char *cmd, const char *args, int query, char *prev_cmd)
 {
@@ -406,6 +619,38 @@ int cmd_echo(const char *cmd, const char *args, int query, char *prev_cmd)
 			&conf->local_echo, "Command Echo");
 }
 
+int cmd_stats_cmd(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (!query)
+		return 1;
+
+	print_cmd_stats();
+	return 0;
+}
+
+int cmd_stream(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	bool val = false;
+	int res;
+
+	if (query) {
+		print_usb_stream_stats();
+		return 0;
+	}
+
+	if ((res = bool_setting(cmd, args, query, prev_cmd, &val, "Binary Streaming Mode")))
+		return res;
+	if (val) {
+		if (cmd_source() != CMD_SRC_USB) {
+			log_msg(LOG_WARNING, "Binary Streaming Mode only available on USB console");
+			return 1;
+		}
+		usb_stream_start();
+	}
+
+	return 0;
+}
+
 int cmd_gamma(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	return string_setting(cmd, args, query, prev_cmd,
@@ -449,6 +694,9 @@ int cmd_reset(const char *cmd, const char *args, int query, char *prev_cmd)
 	log_msg(LOG_ALERT, "Initiating reboot...");
 	display_message(1, msg);
 	update_persistent_memory();
+	history_flush();
+	flash_sync();
+	process_log_queue();
 
 	watchdog_disable();
 	sleep_ms(500);
@@ -463,10 +711,84 @@ int cmd_save_config(const char *cmd, const char *args, int query, char *prev_cmd
 {
 	if (query)
 		return 1;
+	if (conf_shadow) {
+		log_msg(LOG_NOTICE, "Configuration transaction active, use CONF:COMMIT to save.");
+		return 1;
+	}
 	save_config(true);
 	return 0;
 }
 
+int cmd_config_begin(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (query) {
+		cmd_printf("%d\n", (conf_shadow ? 1 : 0));
+		return 0;
+	}
+	if (conf_shadow) {
+		log_msg(LOG_NOTICE, "Configuration transaction already active.");
+		return 1;
+	}
+	if (!(conf_shadow = malloc(sizeof(*conf_shadow)))) {
+		log_msg(LOG_ALERT, "Out of memory");
+		return 2;
+	}
+	memcpy(conf_shadow, conf, sizeof(*conf_shadow));
+	conf_shadow_source = cmd_source();
+	conf = conf_shadow;
+	log_msg(LOG_NOTICE, "Configuration transaction started.");
+
+	return 0;
+}
+
+int cmd_config_commit(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (query)
+		return 1;
+	if (!conf_shadow) {
+		log_msg(LOG_NOTICE, "No configuration transaction active.");
+		return 1;
+	}
+	if (conf != conf_shadow) {
+		log_msg(LOG_NOTICE, "Configuration transaction active on another console.");
+		return 1;
+	}
+	if (validate_config(conf_shadow)) {
+		log_msg(LOG_WARNING, "Configuration validation failed, changes not committed.");
+		return 2;
+	}
+
+	apply_config(conf_shadow);
+	free(conf_shadow);
+	conf_shadow = NULL;
+	conf_shadow_source = -1;
+	conf = (struct brickpico_config *)cfg;
+	log_msg(LOG_NOTICE, "Configuration transaction committed.");
+	save_config();
+
+	return 0;
+}
+
+int cmd_config_abort(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (query)
+		return 1;
+	if (!conf_shadow) {
+		log_msg(LOG_NOTICE, "No configuration transaction active.");
+		return 1;
+	}
+
+	if (conf != conf_shadow)
+		log_msg(LOG_NOTICE, "Aborting configuration transaction started on another console.");
+	discard_config(conf_shadow);
+	conf_shadow = NULL;
+	conf_shadow_source = -1;
+	conf = (struct brickpico_config *)cfg;
+	log_msg(LOG_NOTICE, "Configuration transaction aborted.");
+
+	return 0;
+}
+
 int cmd_print_config(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	if (!query)
@@ -475,6 +797,13 @@ int cmd_print_config(const char *cmd, const char *args, int query, char *prev_cm
 	return 0;
 }
 
+int cmd_export_config(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (query)
+		return 1;
+	return (export_config_json() ? 2 : 0);
+}
+
 int cmd_delete_config(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	if (query)
@@ -486,14 +815,14 @@ int cmd_delete_config(const char *cmd, const char *args, int query, char *prev_c
 int cmd_one(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	if (query)
-		printf("1\n");
+		cmd_printf("1\n");
 	return 0;
 }
 
 int cmd_zero(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	if (query)
-		printf("0\n");
+		cmd_printf("0\n");
 	return 0;
 }
 
@@ -505,7 +834,7 @@ int cmd_read(const char *cmd, const char *args, int query, char *prev_cmd)
 		return 1;
 
 	for (i = 0; i < OUTPUT_COUNT; i++) {
-		printf("output%d,\"%s\",%d,%s\n", i + 1,
+		cmd_printf("output%d,\"%s\",%d,%s\n", i + 1,
 			conf->outputs[i].name,
 			st->pwm[i],
 			st->pwr[i] ? "ON": "OFF");
@@ -538,11 +867,11 @@ int cmd_defaults_state(const char *cmd, const char *args, int query, char *prev_
 
 int cmd_out_name(const char *cmd, const char *args, int query, char *prev_cmd)
 {
-	int out = atoi(&prev_cmd[6]) - 1;
+	int out = out_idx;
 
 	if (out >= 0 && out < OUTPUT_COUNT) {
 		if (query) {
-			printf("%s\n", conf->outputs[out].name);
+			cmd_printf("%s\n", conf->outputs[out].name);
 		} else {
 			log_msg(LOG_NOTICE, "output%d: change name '%s' --> '%s'", out + 1,
 				conf->outputs[out].name, args);
@@ -557,10 +886,10 @@ int cmd_out_min_pwm(const char *cmd, const char *args, int query, char *prev_cmd
 {
 	int out, val;
 
-	out = atoi(&prev_cmd[6]) - 1;
+	out = out_idx;
 	if (out >= 0 && out < OUTPUT_COUNT) {
 		if (query) {
-			printf("%d\n", conf->outputs[out].min_pwm);
+			cmd_printf("%d\n", conf->outputs[out].min_pwm);
 		} else if (str_to_int(args, &val, 10)) {
 			if (val >= 0 && val <= 100) {
 				log_msg(LOG_NOTICE, "output%d: change min PWM %d%% --> %d%%", out + 1,
@@ -581,10 +910,10 @@ int cmd_out_max_pwm(const char *cmd, const char *args, int query, char *prev_cmd
 {
 	int out, val;
 
-	out = atoi(&prev_cmd[6]) - 1;
+	out = out_idx;
 	if (out >= 0 && out < OUTPUT_COUNT) {
 		if (query) {
-			printf("%d\n", conf->outputs[out].max_pwm);
+			cmd_printf("%d\n", conf->outputs[out].max_pwm);
 		} else if (str_to_int(args, &val, 10)) {
 			if (val >= 0 && val <= 100) {
 				log_msg(LOG_NOTICE, "output%d: change max PWM %d%% --> %d%%", out + 1,
@@ -605,10 +934,10 @@ int cmd_out_default_pwm(const char *cmd, const char *args, int query, char *prev
 {
 	int out, val;
 
-	out = atoi(&prev_cmd[6]) - 1;
+	out = out_idx;
 	if (out >= 0 && out < OUTPUT_COUNT) {
 		if (query) {
-			printf("%d\n", conf->outputs[out].default_pwm);
+			cmd_printf("%d\n", conf->outputs[out].default_pwm);
 		} else if (str_to_int(args, &val, 10)) {
 			if (val >= 0 && val <= 100) {
 				if (conf->outputs[out].default_pwm != val) {
@@ -631,10 +960,10 @@ int cmd_out_default_state(const char *cmd, const char *args, int query, char *pr
 {
 	int out, val;
 
-	out = atoi(&prev_cmd[6]) - 1;
+	out = out_idx;
 	if (out >= 0 && out < OUTPUT_COUNT) {
 		if (query) {
-			printf("%s\n", (conf->outputs[out].default_state ? "ON" : "OFF"));
+			cmd_printf("%s\n", (conf->outputs[out].default_state ? "ON" : "OFF"));
 		} else {
 			if (!strncasecmp(args, "on", 3))
 				val = 1;
@@ -667,16 +996,12 @@ int cmd_out_read(const char *cmd, const char *args, int query, char *prev_cmd)
 	if (!query)
 		return 1;
 
-	if (!strncasecmp(prev_cmd, "output", 6)) {
-		out = atoi(&prev_cmd[6]) - 1;
-	} else {
-		out = atoi(&cmd[6]) - 1;
-	}
+	out = out_idx;
 
 	if (out >= 0 && out < OUTPUT_COUNT) {
 		d = st->pwm[out];
 		log_msg(LOG_DEBUG, "output%d duty = %d%%", out + 1, d);
-		printf("%d\n", d);
+		cmd_printf("%d\n", d);
 		return 0;
 	}
 
@@ -693,19 +1018,19 @@ int cmd_out_effect(const char *cmd, const char *args, int query, char *prev_cmd)
 	void *new_ctx;
 
 
-	out = atoi(&prev_cmd[6]) - 1;
+	out = out_idx;
 	if (out < 0 || out >= OUTPUT_COUNT)
 		return 1;
 
 	o = &conf->outputs[out];
 	if (query) {
-		printf("%s", effect2str(o->effect));
+		cmd_printf("%s", effect2str(o->effect));
 		tok = effect_print_args(o->effect, o->effect_ctx);
 		if (tok) {
-			printf(",%s\n", tok);
+			cmd_printf(",%s\n", tok);
 			free(tok);
 		} else {
-			printf(",\n");
+			cmd_printf(",\n");
 		}
 	} else {
 		if (!(param = strdup(args)))
@@ -716,7 +1041,9 @@ int cmd_out_effect(const char *cmd, const char *args, int query, char *prev_cmd)
 			new_ctx = effect_parse_args(new_effect, tok ? tok : "");
 			if (new_effect == EFFECT_NONE || new_ctx != NULL) {
 				o->effect = new_effect;
-				if (o->effect_ctx)
+				/* Active config still uses old settings if this is a copy... */
+				if (o->effect_ctx && !(conf != cfg
+						&& o->effect_ctx == cfg->outputs[out].effect_ctx))
 					free(o->effect_ctx);
 				o->effect_ctx = new_ctx;
 			} else {
@@ -736,11 +1063,7 @@ int cmd_write_state(const char *cmd, const char *args, int query, char *prev_cmd
 	if (query)
 		return 1;
 
-	if (!strncasecmp(prev_cmd, "output", 6)) {
-		out = atoi(&prev_cmd[6]) - 1;
-	} else {
-		out = atoi(&cmd[6]) - 1;
-	}
+	out = out_idx;
 
 	if (out >= 0 && out < OUTPUT_COUNT) {
 		if (!strncasecmp(args, "on", 3))
@@ -752,7 +1075,7 @@ int cmd_write_state(const char *cmd, const char *args, int query, char *prev_cmd
 
 		if (val >= 0) {
 			if (st->pwr[out] != val) {
-				log_msg(LOG_INFO, "output%d: change power %s", out + 1,
+				log_msg_ratelimited(1000, 5, LOG_INFO, "output%d: change power %s", out + 1,
 					(val ? "ON" : "OFF"));
 				st->pwr[out] = val;
 			}
@@ -774,13 +1097,13 @@ int cmd_write_pwm(const char *cmd, const char *args, int query, char *prev_cmd)
 	if (query)
 		return 1;
 
-	out = atoi(&prev_cmd[6]) - 1;
+	out = out_idx;
 
 	if (out >= 0 && out < OUTPUT_COUNT) {
 		if (str_to_int(args, &val, 10)) {
 			if (val >= 0 && val <= 100) {
 				if (st->pwm[out] != val) {
-					log_msg(LOG_INFO, "output%d: change PWM %d%% --> %d%%", out + 1,
+					log_msg_ratelimited(1000, 5, LOG_INFO, "output%d: change PWM %d%% --> %d%%", out + 1,
 						st->pwm[out], val);
 					st->pwm[out] = val;
 				}
@@ -796,13 +1119,174 @@ int cmd_write_pwm(const char *cmd, const char *args, int query, char *prev_cmd)
 	return 1;
 }
 
+/* Parse "<outputs> <value>" style arguments used by bulk output commands. */
+static int parse_bulk_args(const char *args, uint32_t *mask, char *val, size_t val_len)
+{
+	char *s, *tok, *saveptr;
+	int res = 1;
+
+	if (!(s = strdup(args)))
+		return 1;
+
+	if ((tok = strtok_r(s, " \t", &saveptr))) {
+		if (!str_to_bitmask(tok, OUTPUT_COUNT, mask, 1) && *mask) {
+			if ((tok = strtok_r(NULL, " \t", &saveptr))) {
+				strncopy(val, tok, val_len);
+				res = 0;
+			}
+		}
+	}
+	free(s);
+
+	return res;
+}
+
+/* Copy bulk command arguments removing any whitespace around commas
+   (so that "10, 20, 30" is treated same as "10,20,30"). */
+static char* normalize_bulk_args(const char *args)
+{
+	char *s, *o;
+	const char *p;
+
+	if (!(s = malloc(strlen(args) + 1)))
+		return NULL;
+
+	o = s;
+	for (p = args; *p; p++) {
+		if (*p == ' ' || *p == '\t') {
+			const char *n = p;
+			while (*n == ' ' || *n == '\t')
+				n++;
+			if (o == s || o[-1] == ',' || *n == ',' || *n == 0) {
+				p = n - 1;
+				continue;
+			}
+		}
+		*o++ = *p;
+	}
+	*o = 0;
+
+	return s;
+}
+
+int cmd_write_outputs_pwm(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	uint8_t pwm[OUTPUT_MAX_COUNT];
+	uint32_t mask = 0;
+	char tmp[8];
+	char *a;
+	const char *p;
+	int i, val, changes;
+	int res = 0;
+
+	if (query)
+		return 1;
+	if (!(a = normalize_bulk_args(args)))
+		return 1;
+
+	/* Parse and validate all values first, so that either all or none are updated... */
+	if (strpbrk(a, " \t")) {
+		/* <outputs> <pwm> */
+		if (parse_bulk_args(a, &mask, tmp, sizeof(tmp))) {
+			res = 2;
+		} else if (!str_to_int(tmp, &val, 10) || val < 0 || val > 100) {
+			log_msg(LOG_WARNING, "outputs %s: invalid new value for PWM: %s",
+				bitmask_to_str(mask, OUTPUT_COUNT, 1, true), tmp);
+			res = 2;
+		} else {
+			for (i = 0; i < OUTPUT_COUNT; i++)
+				pwm[i] = val;
+		}
+	} else {
+		/* <pwm1>,<pwm2>,... (empty value leaves output unchanged) */
+		p = a;
+		for (i = 0; i < OUTPUT_COUNT && *p && !res; i++) {
+			if (*p != ',') {
+				char *end;
+				val = strtol(p, &end, 10);
+				if (end == p || val < 0 || val > 100 || (*end && *end != ',')) {
+					log_msg(LOG_WARNING, "output%d: invalid new value for PWM: %.*s",
+						i + 1, (int)strcspn(p, ","), p);
+					res = 2;
+					break;
+				}
+				pwm[i] = val;
+				mask |= (1UL << i);
+				p = end;
+			}
+			if (*p == ',')
+				p++;
+		}
+		if (*p && !res) {
+			log_msg(LOG_WARNING, "outputs: too many PWM values: %s", a);
+			res = 2;
+		}
+	}
+	free(a);
+	if (res)
+		return res;
+
+	changes = 0;
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		if ((mask & (1UL << i)) && st->pwm[i] != pwm[i]) {
+			st->pwm[i] = pwm[i];
+			changes++;
+		}
+	}
+	if (changes > 0)
+		log_msg(LOG_INFO, "outputs %s: change PWM (%d changed)",
+			bitmask_to_str(mask, OUTPUT_COUNT, 1, true), changes);
+
+	return 0;
+}
+
+int cmd_write_outputs_state(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	uint32_t mask = 0;
+	char tmp[8];
+	char *a;
+	int i, val, changes, res;
+
+	if (query)
+		return 1;
+
+	if (!(a = normalize_bulk_args(args)))
+		return 1;
+	res = parse_bulk_args(a, &mask, tmp, sizeof(tmp));
+	free(a);
+	if (res)
+		return 2;
+	if (!strncasecmp(tmp, "on", 3) || !strncmp(tmp, "1", 2)) {
+		val = 1;
+	} else if (!strncasecmp(tmp, "off", 4) || !strncmp(tmp, "0", 2)) {
+		val = 0;
+	} else {
+		log_msg(LOG_WARNING, "outputs %s: invalid new value for state: %s",
+			bitmask_to_str(mask, OUTPUT_COUNT, 1, true), tmp);
+		return 2;
+	}
+
+	changes = 0;
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		if ((mask & (1UL << i)) && st->pwr[i] != val) {
+			st->pwr[i] = val;
+			changes++;
+		}
+	}
+	if (changes > 0)
+		log_msg_ratelimited(1000, 5, LOG_INFO, "outputs %s: change power %s (%d changed)",
+			bitmask_to_str(mask, OUTPUT_COUNT, 1, true), (val ? "ON" : "OFF"), changes);
+
+	return 0;
+}
+
 int cmd_wifi(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	if (query) {
 #ifdef WIFI_SUPPORT
-		printf("1\n");
+		cmd_printf("1\n");
 #else
-		printf("0\n");
+		cmd_printf("0\n");
 #endif
 		return 0;
 	}
@@ -832,6 +1316,12 @@ int cmd_wifi_syslog(const char *cmd, const char *args, int query, char *prev_cmd
 	return ip_change(cmd, args, query, prev_cmd, "Syslog Server", &conf->syslog_server);
 }
 
+int cmd_wifi_syslog_tcp(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	return bool_setting(cmd, args, query, prev_cmd,
+			&conf->syslog_tcp, "Syslog TCP Transport");
+}
+
 int cmd_wifi_ntp(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	return ip_change(cmd, args, query, prev_cmd, "NTP Server", &conf->ntp_server);
@@ -896,7 +1386,7 @@ int cmd_wifi_auth_mode(const char *cmd, const char *args, int query, char *prev_
 	uint32_t type;
 
 	if (query) {
-		printf("%s\n", conf->wifi_auth_mode);
+		cmd_printf("%s\n", conf->wifi_auth_mode);
 	} else {
 		if (!wifi_get_auth_type(args, &type))
 			return 1;
@@ -964,6 +1454,15 @@ int cmd_mqtt_allow_scpi(const char *cmd, const char *args, int query, char *prev
 			&conf->mqtt_allow_scpi, "MQTT Allow SCPI Commands");
 }
 
+int cmd_mqtt_stats(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (!query)
+		return 1;
+
+	brickpico_mqtt_print_stats();
+	return 0;
+}
+
 int cmd_mqtt_status_topic(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	return string_setting(cmd, args, query, prev_cmd,
@@ -1015,7 +1514,7 @@ int cmd_mqtt_pwm_topic(const char *cmd, const char *args, int query, char *prev_
 
 int cmd_mqtt_mask_pwm(const char *cmd, const char *args, int query, char *prev_cmd)
 {
-	return bitmask16_setting(cmd, args, query, prev_cmd,
+	return bitmask32_setting(cmd, args, query, prev_cmd,
 				&conf->mqtt_pwm_mask, OUTPUT_COUNT,
 				1, "MQTT PWM Mask");
 }
@@ -1045,11 +1544,12 @@ int cmd_tls_pkey(const char *cmd, const char *args, int query, char *prev_cmd)
 	if (query) {
 		res = flash_read_file(&buf, &file_size, "key.pem");
 		if (res == 0 && buf != NULL) {
-			printf("%s\n", buf);
+			cmd_write(buf, strlen(buf));
+			cmd_write("\n", 1);
 			free(buf);
 			return 0;
 		} else {
-			printf("No private key present.\n");
+			cmd_printf("No private key present.\n");
 		}
 		return 2;
 	}
@@ -1066,14 +1566,14 @@ int cmd_tls_pkey(const char *cmd, const char *args, int query, char *prev_cmd)
 	if (!strncasecmp(args, "DELETE", 7)) {
 		res = flash_delete_file("key.pem");
 		if (res == -2) {
-			printf("No private key present.\n");
+			cmd_printf("No private key present.\n");
 			res = 0;
 		}
 		else if (res) {
-			printf("Failed to delete private key: %d\n", res);
+			cmd_printf("Failed to delete private key: %d\n", res);
 			res = 2;
 		} else {
-			printf("Private key succesfully deleted.\n");
+			cmd_printf("Private key succesfully deleted.\n");
 		}
 	}
 	else {
@@ -1082,10 +1582,11 @@ int cmd_tls_pkey(const char *cmd, const char *args, int query, char *prev_cmd)
 			if (v >= 1 && v <= 3)
 				incount = v;
 		}
-		printf("Paste private key in PEM format:\n");
+		cmd_printf("Paste private key in PEM format:\n");
+		cmd_flush();
 		for(int i = 0; i < incount; i++) {
 			if (read_pem_file(buf, buf_len, 5000, true) != 1) {
-				printf("Invalid private key!\n");
+				cmd_printf("Invalid private key!\n");
 				res = 2;
 				break;
 			}
@@ -1093,10 +1594,10 @@ int cmd_tls_pkey(const char *cmd, const char *args, int query, char *prev_cmd)
 		if (res == 0) {
 			res = flash_write_file(buf, strlen(buf) + 1, "key.pem");
 			if (res) {
-				printf("Failed to save private key.\n");
+				cmd_printf("Failed to save private key.\n");
 				res = 2;
 			} else {
-				printf("Private key succesfully saved. (length=%u)\n",
+				cmd_printf("Private key succesfully saved. (length=%u)\n",
 					strlen(buf));
 				res = 0;
 			}
@@ -1120,11 +1621,12 @@ int cmd_tls_cert(const char *cmd, const char *args, int query, char *prev_cmd)
 	if (query) {
 		res = flash_read_file(&buf, &file_size, "cert.pem");
 		if (res == 0 && buf != NULL) {
-			printf("%s\n", buf);
+			cmd_write(buf, strlen(buf));
+			cmd_write("\n", 1);
 			free(buf);
 			return 0;
 		} else {
-			printf("No certificate present.\n");
+			cmd_printf("No certificate present.\n");
 		}
 		return 2;
 	}
@@ -1141,29 +1643,30 @@ int cmd_tls_cert(const char *cmd, const char *args, int query, char *prev_cmd)
 	if (!strncasecmp(args, "DELETE", 7)) {
 		res = flash_delete_file("cert.pem");
 		if (res == -2) {
-			printf("No certificate present.\n");
+			cmd_printf("No certificate present.\n");
 			res = 0;
 		}
 		else if (res) {
-			printf("Failed to delete certificate: %d\n", res);
+			cmd_printf("Failed to delete certificate: %d\n", res);
 			res = 2;
 		} else {
-			printf("Certificate succesfully deleted.\n");
+			cmd_printf("Certificate succesfully deleted.\n");
 		}
 	}
 	else {
-		printf("Paste certificate in PEM format:\n");
+		cmd_printf("Paste certificate in PEM format:\n");
+		cmd_flush();
 
 		if (read_pem_file(buf, buf_len, 5000, false) != 1) {
-			printf("Invalid private key!\n");
+			cmd_printf("Invalid private key!\n");
 			res = 2;
 		} else {
 			res = flash_write_file(buf, strlen(buf) + 1, "cert.pem");
 			if (res) {
-				printf("Failed to save certificate.\n");
+				cmd_printf("Failed to save certificate.\n");
 				res = 2;
 			} else {
-				printf("Certificate succesfully saved. (length=%u)\n",
+				cmd_printf("Certificate succesfully saved. (length=%u)\n",
 					strlen(buf));
 				res = 0;
 			}
@@ -1213,7 +1716,7 @@ int cmd_telnet_user(const char *cmd, const char *args, int query, char *prev_cmd
 int cmd_telnet_pass(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	if (query) {
-		printf("%s\n", cfg->telnet_pwhash);
+		cmd_printf("%s\n", cfg->telnet_pwhash);
 		return 0;
 	}
 
@@ -1240,7 +1743,7 @@ int cmd_time(const char *cmd, const char *args, int query, char *prev_cmd)
 		if (aon_timer_is_running()) {
 			aon_timer_get_time(&ts);
 			time_t_to_str(buf, sizeof(buf), timespec_to_time_t(&ts));
-			printf("%s\n", buf);
+			cmd_printf("%s\n", buf);
 		}
 		return 0;
 	}
@@ -1266,6 +1769,15 @@ int cmd_timezone(const char *cmd, const char *args, int query, char *prev_cmd)
 			conf->timezone, sizeof(conf->timezone), "Timezone", NULL);
 }
 
+int cmd_boot(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (!query)
+		return 1;
+
+	print_boot_stages();
+	return 0;
+}
+
 int cmd_uptime(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	uint32_t secs = to_us_since_boot(get_absolute_time()) / 1000000;
@@ -1276,7 +1788,7 @@ int cmd_uptime(const char *cmd, const char *args, int query, char *prev_cmd)
 	if (!query)
 		return 1;
 
-	printf("up %lu days, %lu hours, %lu minutes%s\n", days, hours % 24, mins % 60,
+	cmd_printf("up %lu days, %lu hours, %lu minutes%s\n", days, hours % 24, mins % 60,
 		(rebooted_by_watchdog ? " [rebooted by watchdog]" : ""));
 
 	return 0;
@@ -1289,12 +1801,12 @@ int cmd_err(const char *cmd, const char *args, int query, char *prev_cmd)
 
 	for (int i = 0; error_codes[i].error != NULL; i++) {
 		if (error_codes[i].error_num == last_error_num) {
-			printf("%d,\"%s\"\n", last_error_num, error_codes[i].error);
+			cmd_printf("%d,\"%s\"\n", last_error_num, error_codes[i].error);
 			last_error_num = 0;
 			return 0;
 		}
 	}
-	printf("-1,\"Internal Error\"\n");
+	cmd_printf("-1,\"Internal Error\"\n");
 	return 0;
 }
 
@@ -1307,18 +1819,29 @@ int cmd_name(const char *cmd, const char *args, int query, char *prev_cmd)
 int cmd_lfs(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	size_t size, free, used, files, dirs;
+	struct flash_wear_stats wear;
+	uint32_t saves, skipped;
 
 	if (!query)
 		return 1;
 	if (flash_get_fs_info(&size, &free, &files, &dirs, NULL) < 0)
 		return 2;
+	flash_get_wear_stats(&wear);
+	get_config_save_stats(&saves, &skipped);
 
 	used = size - free;
-	printf("Filesystem size:                       %u\n", size);
-	printf("Filesystem used:                       %u\n", used);
-	printf("Filesystem free:                       %u\n", free);
-	printf("Number of files:                       %u\n", files);
-	printf("Number of subdirectories:              %u\n", dirs);
+	cmd_printf("Filesystem size:                       %u\n", size);
+	cmd_printf("Filesystem used:                       %u\n", used);
+	cmd_printf("Filesystem free:                       %u\n", free);
+	cmd_printf("Number of files:                       %u\n", files);
+	cmd_printf("Number of subdirectories:              %u\n", dirs);
+	cmd_printf("File writes (since boot):              %lu\n", wear.file_writes);
+	cmd_printf("Bytes written (since boot):            %llu\n", wear.file_bytes);
+	cmd_printf("Flash program operations:              %lu\n", wear.prog_count);
+	cmd_printf("Flash bytes programmed:                %llu\n", wear.prog_bytes);
+	cmd_printf("Flash block erases:                    %lu\n", wear.erase_count);
+	cmd_printf("Configuration saves:                   %lu\n", saves);
+	cmd_printf("Configuration saves skipped:           %lu\n", skipped);
 
 	return 0;
 }
@@ -1328,10 +1851,12 @@ int cmd_lfs_format(const char *cmd, const char *args, int query, char *prev_cmd)
 	if (query)
 		return 1;
 
-	printf("Formatting flash filesystem...\n");
+	cmd_printf("Formatting flash filesystem...\n");
+	cmd_flush();
+	reset_saved_config_hash();
 	if (flash_format(true))
 		return 2;
-	printf("Filesystem successfully formatted.\n");
+	cmd_printf("Filesystem successfully formatted.\n");
 
 	return 0;
 }
@@ -1354,7 +1879,7 @@ int cmd_memory(const char *cmd, const char *args, int query, char *prev_cmd)
 
 	if (query) {
 		print_rp2040_meminfo();
-		printf("mallinfo:\n");
+		cmd_printf("mallinfo:\n");
 		print_mallinfo();
 		return 0;
 	}
@@ -1378,7 +1903,7 @@ int cmd_memory(const char *cmd, const char *args, int query, char *prev_cmd)
 		}
 		buf = malloc(bufsize);
 	} while (buf && bufsize < TEST_MEM_SIZE);
-	printf("Largest available memory block:        %u bytes\n",
+	cmd_printf("Largest available memory block:        %u bytes\n",
 		bufsize - blocksize);
 
 	/* Test how much memory available in 'blocksize' blocks... */
@@ -1393,7 +1918,7 @@ int cmd_memory(const char *cmd, const char *args, int query, char *prev_cmd)
 			i++;
 		}
 	}
-	printf("Total available memory:                %u bytes (%d x %dbytes)\n",
+	cmd_printf("Total available memory:                %u bytes (%d x %dbytes)\n",
 		i * blocksize, i, blocksize);
 	if (refbuf) {
 		i = 0;
@@ -1422,7 +1947,7 @@ int cmd_pwm_freq(const char *cmd, const char *args, int query, char *prev_cmd)
 	int val;
 
 	if (query) {
-		printf("%u\n", conf->pwm_freq);
+		cmd_printf("%u\n", conf->pwm_freq);
 		return 0;
 	}
 
@@ -1448,7 +1973,7 @@ int cmd_timer(const char *cmd, const char *args, int query, char *prev_cmd)
 		return 1;
 
 	for (i = 0; i < conf->event_count; i++) {
-		printf("%d: %s\n", i + 1, timer_event_str(&conf->events[i]));
+		cmd_printf("%d: %s\n", i + 1, timer_event_str(&conf->events[i]));
 	}
 
 	return 0;
@@ -1516,6 +2041,13 @@ const struct cmd_t lfs_commands[] = {
 	{ 0, 0, 0, 0 }
 };
 
+const struct cmd_t wifi_syslog_commands[] = {
+#ifdef WIFI_SUPPORT
+	{ "TCP",       3, NULL,              cmd_wifi_syslog_tcp },
+#endif
+	{ 0, 0, 0, 0 }
+};
+
 const struct cmd_t wifi_commands[] = {
 #ifdef WIFI_SUPPORT
 	{ "AUTHmode",  4, NULL,              cmd_wifi_auth_mode },
@@ -1531,7 +2063,7 @@ const struct cmd_t wifi_commands[] = {
 	{ "SSID",      4, NULL,              cmd_wifi_ssid },
 	{ "STATS",     5, NULL,              cmd_wifi_stats },
 	{ "STATus",    4, NULL,              cmd_wifi_status },
-	{ "SYSLOG",    6, NULL,              cmd_wifi_syslog },
+	{ "SYSLOG",    6, wifi_syslog_commands, cmd_wifi_syslog },
 #endif
 	{ 0, 0, 0, 0 }
 };
@@ -1573,6 +2105,7 @@ const struct cmd_t mqtt_commands[] = {
 	{ "USER",      4, NULL,              cmd_mqtt_user },
 	{ "PASSword",  4, NULL,              cmd_mqtt_pass },
 	{ "SCPI",      4, NULL,              cmd_mqtt_allow_scpi },
+	{ "STATS",     5, NULL,              cmd_mqtt_stats },
 #if TLS_SUPPORT
 	{ "TLS",       3, NULL,              cmd_mqtt_tls },
 #endif
@@ -1606,17 +2139,42 @@ const struct cmd_t telnet_commands[] = {
 	{ 0, 0, 0, 0 }
 };
 
+const struct cmd_t stats_commands[] = {
+	{ "CMD",       3, NULL,              cmd_stats_cmd },
+	{ 0, 0, 0, 0 }
+};
+
+const struct cmd_t log_commands[] = {
+	{ "SUBsys",    3, NULL,              cmd_log_subsys },
+	{ 0, 0, 0, 0 }
+};
+
+const struct cmd_t syslog_commands[] = {
+#ifdef WIFI_SUPPORT
+	{ "STATS",     5, NULL,              cmd_syslog_stats },
+#endif
+	{ 0, 0, 0, 0 }
+};
+
+const struct cmd_t history_commands[] = {
+	{ "BLOCKS",    6, NULL,              cmd_history_blocks },
+	{ 0, 0, 0, 0 }
+};
+
 const struct cmd_t system_commands[] = {
+	{ "BOOT",      4, NULL,              cmd_boot },
 	{ "DEBUG",     5, NULL,              cmd_debug }, /* Obsolete ? */
 	{ "DISPlay",   4, display_commands,  cmd_display_type },
 	{ "ECHO",      4, NULL,              cmd_echo },
 	{ "ERRor",     3, NULL,              cmd_err },
+	{ "EXPander",  3, NULL,              cmd_expander },
 	{ "FLASH",     5, NULL,              cmd_flash },
 	{ "GAMMA",     5, NULL,              cmd_gamma },
+	{ "HISTory",   4, history_commands,  cmd_history },
 	{ "OUTputs",   3, NULL,              cmd_outputs },
 	{ "LED",       3, NULL,              cmd_led },
 	{ "LFS",       3, lfs_commands,      cmd_lfs },
-	{ "LOG",       3, NULL,              cmd_log_level },
+	{ "LOG",       3, log_commands,      cmd_log_level },
 	{ "MEMLOG",    6, NULL,              cmd_mem_log },
 	{ "MEMory",    3, NULL,              cmd_memory },
 	{ "MQTT",      4, mqtt_commands,     NULL },
@@ -1624,7 +2182,9 @@ const struct cmd_t system_commands[] = {
 	{ "PWMfreq",   3, NULL,              cmd_pwm_freq },
 	{ "SERIAL",    6, NULL,              cmd_serial },
 	{ "SPI",       3, NULL,              cmd_spi },
-	{ "SYSLOG",    6, NULL,              cmd_syslog_level },
+	{ "STATS",     5, stats_commands,    NULL },
+	{ "STREAM",    6, NULL,              cmd_stream },
+	{ "SYSLOG",    6, syslog_commands,   cmd_syslog_level },
 	{ "TELNET",    6, telnet_commands,   NULL },
 	{ "TIMEZONE",  8, NULL,              cmd_timezone },
 	{ "TIME",      4, NULL,              cmd_time },
@@ -1659,8 +2219,12 @@ const struct cmd_t timer_c_commands[] = {
 };
 
 const struct cmd_t config_commands[] = {
+	{ "ABORT",     5, NULL,              cmd_config_abort },
+	{ "BEGIN",     5, NULL,              cmd_config_begin },
+	{ "COMMIT",    6, NULL,              cmd_config_commit },
 	{ "DEFAULTS",  8, defaults_c_commands, NULL },
 	{ "DELete",    3, NULL,              cmd_delete_config },
+	{ "EXPort",    3, NULL,              cmd_export_config },
 	{ "OUTPUT",    6, output_c_commands, NULL },
 	{ "Read",      1, NULL,              cmd_print_config },
 	{ "SAVe",      3, NULL,              cmd_save_config },
@@ -1686,7 +2250,14 @@ const struct cmd_t write_o_commands[] = {
 	{ 0, 0, 0, 0 }
 };
 
+const struct cmd_t write_os_commands[] = {
+	{ "PWM",       3, NULL,              cmd_write_outputs_pwm },
+	{ "STAte",     3, NULL,              cmd_write_outputs_state },
+	{ 0, 0, 0, 0 }
+};
+
 const struct cmd_t write_commands[] = {
+	{ "OUTPUTS",   7, write_os_commands, NULL },
 	{ "OUTPUT",    6, write_o_commands,  cmd_write_state },
 	{ 0, 0, 0, 0 }
 };
@@ -1712,9 +2283,187 @@ const struct cmd_t commands[] = {
 
 
 
-const struct cmd_t* run_cmd(char *cmd, const struct cmd_t *cmd_level, char **prev_subcmd)
+/* Command lookup index (see cmdindex.c) */
+static cmd_index_t cmd_index;
+static bool cmd_index_built = false;
+
+
+static void build_cmd_index()
+{
+	if (cmd_index_built)
+		return;
+	cmd_index_built = true;
+
+	if (cmd_index_build(&cmd_index, commands) < 0)
+		log_msg(LOG_ERR, "Command index limits exceeded, using linear command lookup.");
+}
+
+/* Per command execution statistics */
+
+#define CMD_STATS_MAX      64
+
+struct cmd_stat_t {
+	uint8_t level;
+	uint8_t idx;
+	uint8_t query;
+	uint32_t count;
+	uint32_t min_time;  /* execution time (us) */
+	uint32_t max_time;
+	uint64_t total_time;
+	uint32_t max_wait;  /* config_mutex wait time (us) */
+	uint64_t total_wait;
+};
+
+static struct cmd_stat_t cmd_stats[CMD_STATS_MAX];
+static int cmd_stats_count = 0;
+static uint32_t cmd_stats_overflow = 0;
+
+
+static void update_cmd_stats(int level, int idx, int query, uint32_t wait, uint32_t time)
+{
+	struct cmd_stat_t *s = NULL;
+	int i;
+
+	for (i = 0; i < cmd_stats_count; i++) {
+		if (cmd_stats[i].level == level && cmd_stats[i].idx == idx
+			&& cmd_stats[i].query == query) {
+			s = &cmd_stats[i];
+			break;
+		}
+	}
+	if (!s) {
+		if (cmd_stats_count >= CMD_STATS_MAX) {
+			cmd_stats_overflow++;
+			return;
+		}
+		s = &cmd_stats[cmd_stats_count];
+		memset(s, 0, sizeof(*s));
+		s->level = level;
+		s->idx = idx;
+		s->query = query;
+		s->min_time = UINT32_MAX;
+		cmd_stats_count++;
+	}
+
+	s->count++;
+	s->total_time += time;
+	if (time < s->min_time)
+		s->min_time = time;
+	if (time > s->max_time)
+		s->max_time = time;
+	s->total_wait += wait;
+	if (wait > s->max_wait)
+		s->max_wait = wait;
+}
+
+/* Generate full command name (like "SYStem:MEMory?") for a command. */
+static const char* cmd_stats_name(const struct cmd_stat_t *s, char *buf, size_t size)
+{
+	cmd_index_name(&cmd_index, s->level, s->idx, buf, size);
+	if (s->query)
+		strncatenate(buf, "?", size);
+
+	return buf;
+}
+
+void print_cmd_stats()
 {
-	int i, query, cmd_len, total_len;
+	char name[64];
+	int i;
+
+	cmd_printf("%-32s %8s %9s %9s %9s %9s %9s\n", "Command", "Calls",
+		"Min(us)", "Avg(us)", "Max(us)", "WaitAvg", "WaitMax");
+	for (i = 0; i < cmd_stats_count; i++) {
+		const struct cmd_stat_t *s = &cmd_stats[i];
+
+		cmd_printf("%-32s %8lu %9lu %9llu %9lu %9llu %9lu\n",
+			cmd_stats_name(s, name, sizeof(name)),
+			s->count,
+			s->min_time,
+			s->total_time / s->count,
+			s->max_time,
+			s->total_wait / s->count,
+			s->max_wait);
+	}
+	if (cmd_stats_overflow > 0)
+		cmd_printf("(%lu calls not tracked, statistics table full)\n", cmd_stats_overflow);
+}
+
+/* Return command statistics as JSON string (caller must free() it). */
+char* cmd_stats_json()
+{
+	cJSON *json, *array, *o;
+	char name[64];
+	char *buf;
+	int i;
+
+	if (!(json = cJSON_CreateObject()))
+		return NULL;
+	if (!(array = cJSON_CreateArray())) {
+		cJSON_Delete(json);
+		return NULL;
+	}
+
+	for (i = 0; i < cmd_stats_count; i++) {
+		const struct cmd_stat_t *s = &cmd_stats[i];
+
+		if (!(o = cJSON_CreateObject()))
+			break;
+		cJSON_AddItemToObject(o, "command", cJSON_CreateString(
+						cmd_stats_name(s, name, sizeof(name))));
+		cJSON_AddItemToObject(o, "calls", cJSON_CreateNumber(s->count));
+		cJSON_AddItemToObject(o, "min_us", cJSON_CreateNumber(s->min_time));
+		cJSON_AddItemToObject(o, "avg_us", cJSON_CreateNumber(s->total_time / s->count));
+		cJSON_AddItemToObject(o, "max_us", cJSON_CreateNumber(s->max_time));
+		cJSON_AddItemToObject(o, "wait_avg_us", cJSON_CreateNumber(s->total_wait / s->count));
+		cJSON_AddItemToObject(o, "wait_max_us", cJSON_CreateNumber(s->max_wait));
+		cJSON_AddItemToArray(array, o);
+	}
+	cJSON_AddItemToObject(json, "commands", array);
+	cJSON_AddItemToObject(json, "untracked_calls", cJSON_CreateNumber(cmd_stats_overflow));
+
+	buf = cJSON_Print(json);
+	cJSON_Delete(json);
+
+	return buf;
+}
+
+
+/* Run command against a copy of the active configuration.
+
+   This is used while a configuration transaction is active on another
+   source (transport), so that commands from other sources still see
+   the active configuration but cannot modify it (changes would either
+   be lost or overwritten when transaction is committed).
+ */
+static int run_isolated_cmd(const struct cmd_t *c, const char *cmd, const char *args,
+			int query, const char *prev_cmd)
+{
+	struct brickpico_config *tmp;
+	int res;
+
+	if (!(tmp = malloc(sizeof(*tmp)))) {
+		log_msg(LOG_ALERT, "Out of memory");
+		return 2;
+	}
+	memcpy(tmp, cfg, sizeof(*tmp));
+	conf = tmp;
+	res = c->func(cmd, args, query, (char*)prev_cmd);
+	conf = (struct brickpico_config *)cfg;
+	if (memcmp(tmp, cfg, sizeof(*tmp))) {
+		log_msg(LOG_NOTICE, "Configuration transaction active on another console, changes rejected.");
+		res = 1;
+	}
+	discard_config(tmp);
+
+	return res;
+}
+
+
+static void run_cmd(char *cmd, struct cmd_pos_t *pos, char **prev_subcmd)
+{
+	const struct cmd_t *c;
+	int i, query, cmd_len, total_len, idx;
 	char *saveptr1, *saveptr2, *t, *sub, *s, *arg;
 	int res = -1;
 
@@ -1724,38 +2473,60 @@ const struct cmd_t* run_cmd(char *cmd, const struct cmd_t *cmd_level, char **pre
 		cmd_len = strlen(t);
 		if (*t == ':' || *t == '*') {
 			/* reset command level to 'root' */
-			cmd_level = commands;
+			cmd_index_root(&cmd_index, pos);
 			*prev_subcmd = NULL;
+			out_idx = -1;
 		}
 		/* Split command to subcommands and search from command tree ... */
 		sub = strtok_r(t, ":", &saveptr2);
 		while (sub && strlen(sub) > 0) {
 			s = sub;
 			sub = NULL;
-			i = 0;
-			while (cmd_level[i].cmd) {
-				if (!strncasecmp(s, cmd_level[i].cmd, cmd_level[i].min_match)) {
-					sub = strtok_r(NULL, ":", &saveptr2);
-					if (cmd_level[i].subcmds && sub && strlen(sub) > 0) {
-						/* Match for subcommand...*/
-						*prev_subcmd = s;
-						cmd_level = cmd_level[i].subcmds;
-					} else if (cmd_level[i].func) {
-						/* Match for command */
-						query = (s[strlen(s)-1] == '?' ? 1 : 0);
-						arg = t + cmd_len + 1;
-						if (!query)
-							mutex_enter_blocking(config_mutex);
-						res = cmd_level[i].func(s,
-								(total_len > cmd_len+1 ? arg : ""),
-								query,
-								(*prev_subcmd ? *prev_subcmd : ""));
-						if (!query)
-							mutex_exit(config_mutex);
-					}
-					break;
+			if ((i = cmd_index_find(&cmd_index, pos, s)) < 0)
+				break;
+			c = &pos->cmds[i];
+			idx = cmd_parse_index(s);
+			sub = strtok_r(NULL, ":", &saveptr2);
+			if (c->subcmds && sub && strlen(sub) > 0) {
+				/* Match for subcommand...*/
+				*prev_subcmd = s;
+				out_idx = idx;
+				cmd_index_sub(&cmd_index, pos, i);
+			} else {
+				if (c->func) {
+					/* Match for command */
+					if (idx >= 0)
+						out_idx = idx;
+					uint64_t t_start, t_lock;
+					bool locked, isolated;
+
+					query = (s[strlen(s)-1] == '?' ? 1 : 0);
+					arg = t + cmd_len + 1;
+					t_start = to_us_since_boot(get_absolute_time());
+					/* Staged config (transaction) is not shared with core1 */
+					locked = (!query && !conf_shadow);
+					/* Transaction active on another source? */
+					isolated = (!query && conf_shadow && conf != conf_shadow);
+					if (locked)
+						mutex_enter_blocking(config_mutex);
+					t_lock = to_us_since_boot(get_absolute_time());
+					if (isolated)
+						res = run_isolated_cmd(c, s,
+							(total_len > cmd_len+1 ? arg : ""),
+							query,
+							(*prev_subcmd ? *prev_subcmd : ""));
+					else
+						res = c->func(s,
+							(total_len > cmd_len+1 ? arg : ""),
+							query,
+							(*prev_subcmd ? *prev_subcmd : ""));
+					if (locked)
+						mutex_exit(config_mutex);
+					if (pos->level >= 0)
+						update_cmd_stats(pos->level, i, query, t_lock - t_start,
+								to_us_since_boot(get_absolute_time()) - t_lock);
 				}
-				i++;
+				break;
 			}
 		}
 	}
@@ -1775,32 +2546,37 @@ const struct cmd_t* run_cmd(char *cmd, const struct cmd_t *cmd_level, char **pre
 	} else {
 		last_error_num = -1;
 	}
-
-	return cmd_level;
 }
 
 
-void process_command(struct brickpico_state *state, struct brickpico_config *config, char *command)
+void process_command(struct brickpico_state *state, struct brickpico_config *config, char *command,
+		struct cmd_response *resp)
 {
 	char *saveptr, *cmd;
 	char *prev_subcmd = NULL;
-	const struct cmd_t *cmd_level = commands;
+	struct cmd_pos_t pos;
 
 	if (!state || !config || !command)
 		return;
 
 	st = state;
-	conf = config;
+	cmd_resp = resp;
+	/* Staged config (transaction) is only used by the source that started it */
+	conf = (conf_shadow && cmd_source() == conf_shadow_source ? conf_shadow : config);
+	out_idx = -1;
+	build_cmd_index();
+	cmd_index_root(&cmd_index, &pos);
 
 	cmd = strtok_r(command, ";", &saveptr);
 	while (cmd) {
 		cmd = trim_str(cmd);
 		log_msg(LOG_DEBUG, "command: '%s'", cmd);
 		if (cmd && strlen(cmd) > 0) {
-			cmd_level = run_cmd(cmd, cmd_level, &prev_subcmd);
+			run_cmd(cmd, &pos, &prev_subcmd);
 		}
 		cmd = strtok_r(NULL, ";", &saveptr);
 	}
+	cmd_resp = NULL;
 }
 
 int last_command_status()
@@ -37,6 +37,16 @@ const struct brickpico_config *cfg = &brickpico_config;
 auto_init_mutex(config_mutex_inst);
 mutex_t *config_mutex = &config_mutex_inst;
 
+#define CONFIG_BIN_FILE "brickpico.bin"
+#define CONFIG_JSON_FILE "brickpico.cfg"
+#define CONFIG_JSON_TMP_FILE "brickpico.tmp"
+
+static uint32_t saved_config_hash = 0;
+static uint32_t saved_config_size = 0;
+static bool saved_config_valid = false;
+static uint32_t config_saves = 0;
+static uint32_t config_saves_skipped = 0;
+
 
 void json2effect(cJSON *item, enum light_effect_types *effect, void **effect_ctx)
 {
@@ -52,24 +62,6 @@ void json2effect(cJSON *item, enum light_effect_types *effect, void **effect_ctx
 }
 
 
-cJSON* effect2json(enum light_effect_types effect, void *effect_ctx)
-{
-	cJSON *o;
-	char *s;
-
-	if ((o = cJSON_CreateObject()) == NULL)
-		return NULL;
-
-	cJSON_AddItemToObject(o, "name", cJSON_CreateString(effect2str(effect)));
-	s = effect_print_args(effect, effect_ctx);
-	cJSON_AddItemToObject(o, "args", cJSON_CreateString(s ? s : ""));
-	if (s)
-		free(s);
-
-	return o;
-}
-
-
 void clear_config(struct brickpico_config *cfg)
 {
 	int i;
@@ -109,6 +101,7 @@ void clear_config(struct brickpico_config *cfg)
 	cfg->adc_ref_voltage = 3.3;
 	cfg->temp_offset = 0.0;
 	cfg->temp_coefficient = 1.0;
+	cfg->history_blocks = 8;
 	strncopy(cfg->name, "brickpico1", sizeof(cfg->name));
 	strncopy(cfg->display_type, "default", sizeof(cfg->display_type));
 	strncopy(cfg->display_theme, "default", sizeof(cfg->display_theme));
@@ -124,6 +117,7 @@ void clear_config(struct brickpico_config *cfg)
 	cfg->hostname[0] = 0;
 	strncopy(cfg->wifi_country, "XX", sizeof(cfg->wifi_country));
 	ip_addr_set_any(0, &cfg->syslog_server);
+	cfg->syslog_tcp = false;
 	ip_addr_set_any(0, &cfg->ntp_server);
 	ip_addr_set_any(0, &cfg->ip);
 	ip_addr_set_any(0, &cfg->netmask);
@@ -160,27 +154,26 @@ void clear_config(struct brickpico_config *cfg)
 
 #define STRING_TO_JSON(name, var) {					\
 	if (strlen(var) > 0)						\
-		cJSON_AddItemToObject(config, name, cJSON_CreateString(var)); \
+		json_stream_string(js, name, var);			\
 }
 
-cJSON *config_to_json(const struct brickpico_config *cfg)
+/* Write configuration in JSON format (using streaming JSON writer). */
+void config_to_json_stream(const struct brickpico_config *cfg, struct json_stream *js)
 {
-	cJSON *config = cJSON_CreateObject();
-	cJSON *outputs, *events, *o;
+	char *s;
 	int i;
 
-	if (!config)
-		return NULL;
-
-	cJSON_AddItemToObject(config, "id", cJSON_CreateString("brickpico-config-v1"));
-	cJSON_AddItemToObject(config, "debug", cJSON_CreateNumber(get_debug_level()));
-	cJSON_AddItemToObject(config, "log_level", cJSON_CreateNumber(get_log_level()));
-	cJSON_AddItemToObject(config, "syslog_level", cJSON_CreateNumber(get_syslog_level()));
-	cJSON_AddItemToObject(config, "local_echo", cJSON_CreateBool(cfg->local_echo));
-	cJSON_AddItemToObject(config, "led_mode", cJSON_CreateNumber(cfg->led_mode));
-	cJSON_AddItemToObject(config, "spi_active", cJSON_CreateNumber(cfg->spi_active));
-	cJSON_AddItemToObject(config, "serial_active", cJSON_CreateNumber(cfg->serial_active));
-	cJSON_AddItemToObject(config, "pwm_freq", cJSON_CreateNumber(cfg->pwm_freq));
+	json_stream_object_start(js, NULL);
+	json_stream_string(js, "id", "brickpico-config-v1");
+	json_stream_number(js, "debug", get_debug_level());
+	json_stream_number(js, "log_level", get_log_level());
+	json_stream_number(js, "syslog_level", get_syslog_level());
+	json_stream_bool(js, "local_echo", cfg->local_echo);
+	json_stream_number(js, "led_mode", cfg->led_mode);
+	json_stream_number(js, "spi_active", cfg->spi_active);
+	json_stream_number(js, "serial_active", cfg->serial_active);
+	json_stream_number(js, "pwm_freq", cfg->pwm_freq);
+	json_stream_number(js, "history_blocks", cfg->history_blocks);
 	STRING_TO_JSON("display_type", cfg->display_type);
 	STRING_TO_JSON("display_theme", cfg->display_theme);
 	STRING_TO_JSON("display_logo", cfg->display_logo);
@@ -196,32 +189,34 @@ cJSON *config_to_json(const struct brickpico_config *cfg)
 	if (strlen(cfg->wifi_passwd) > 0) {
 		char *p = base64encode(cfg->wifi_passwd);
 		if (p) {
-			cJSON_AddItemToObject(config, "wifi_passwd", cJSON_CreateString(p));
+			json_stream_string(js, "wifi_passwd", p);
 			free(p);
 		}
 	}
 	STRING_TO_JSON("wifi_auth_mode", cfg->wifi_auth_mode);
 	if (cfg->wifi_mode != 0) {
-		cJSON_AddItemToObject(config, "wifi_mode", cJSON_CreateNumber(cfg->wifi_mode));
+		json_stream_number(js, "wifi_mode", cfg->wifi_mode);
 	}
 	if (!ip_addr_isany(&cfg->syslog_server))
-		cJSON_AddItemToObject(config, "syslog_server", cJSON_CreateString(ipaddr_ntoa(&cfg->syslog_server)));
+		json_stream_string(js, "syslog_server", ipaddr_ntoa(&cfg->syslog_server));
+	if (cfg->syslog_tcp)
+		json_stream_number(js, "syslog_tcp", cfg->syslog_tcp);
 	if (!ip_addr_isany(&cfg->ntp_server))
-		cJSON_AddItemToObject(config, "ntp_server", cJSON_CreateString(ipaddr_ntoa(&cfg->ntp_server)));
+		json_stream_string(js, "ntp_server", ipaddr_ntoa(&cfg->ntp_server));
 	if (!ip_addr_isany(&cfg->ip))
-		cJSON_AddItemToObject(config, "ip", cJSON_CreateString(ipaddr_ntoa(&cfg->ip)));
+		json_stream_string(js, "ip", ipaddr_ntoa(&cfg->ip));
 	if (!ip_addr_isany(&cfg->netmask))
-		cJSON_AddItemToObject(config, "netmask", cJSON_CreateString(ipaddr_ntoa(&cfg->netmask)));
+		json_stream_string(js, "netmask", ipaddr_ntoa(&cfg->netmask));
 	if (!ip_addr_isany(&cfg->gateway))
-		cJSON_AddItemToObject(config, "gateway", cJSON_CreateString(ipaddr_ntoa(&cfg->gateway)));
+		json_stream_string(js, "gateway", ipaddr_ntoa(&cfg->gateway));
 	STRING_TO_JSON("mqtt_server", cfg->mqtt_server);
 	if (cfg->mqtt_port > 0)
-		cJSON_AddItemToObject(config, "mqtt_port", cJSON_CreateNumber(cfg->mqtt_port));
+		json_stream_number(js, "mqtt_port", cfg->mqtt_port);
 	STRING_TO_JSON("mqtt_user", cfg->mqtt_user);
 	if (strlen(cfg->mqtt_pass) > 0) {
 		char *p = base64encode(cfg->mqtt_pass);
 		if (p) {
-			cJSON_AddItemToObject(config, "mqtt_pass", cJSON_CreateString(p));
+			json_stream_string(js, "mqtt_pass", p);
 			free(p);
 		}
 	}
@@ -233,82 +228,73 @@ cJSON *config_to_json(const struct brickpico_config *cfg)
 	STRING_TO_JSON("mqtt_pwm_topic", cfg->mqtt_pwm_topic);
 	STRING_TO_JSON("mqtt_temp_topic", cfg->mqtt_temp_topic);
 	if (cfg->mqtt_tls != true)
-		cJSON_AddItemToObject(config, "mqtt_tls", cJSON_CreateNumber(cfg->mqtt_tls));
+		json_stream_number(js, "mqtt_tls", cfg->mqtt_tls);
 	if (cfg->mqtt_allow_scpi == true)
-		cJSON_AddItemToObject(config, "mqtt_allow_scpi",
-				cJSON_CreateNumber(cfg->mqtt_allow_scpi));
+		json_stream_number(js, "mqtt_allow_scpi", cfg->mqtt_allow_scpi);
 	if (cfg->mqtt_status_interval != DEFAULT_MQTT_STATUS_INTERVAL)
-		cJSON_AddItemToObject(config, "mqtt_status_interval",
-				cJSON_CreateNumber(cfg->mqtt_status_interval));
+		json_stream_number(js, "mqtt_status_interval", cfg->mqtt_status_interval);
 	if (cfg->mqtt_temp_interval != DEFAULT_MQTT_TEMP_INTERVAL)
-		cJSON_AddItemToObject(config, "mqtt_temp_interval",
-				cJSON_CreateNumber(cfg->mqtt_temp_interval));
+		json_stream_number(js, "mqtt_temp_interval", cfg->mqtt_temp_interval);
 	if (cfg->mqtt_pwm_interval != DEFAULT_MQTT_PWM_INTERVAL)
-		cJSON_AddItemToObject(config, "mqtt_pwm_interval",
-				cJSON_CreateNumber(cfg->mqtt_pwm_interval));
+		json_stream_number(js, "mqtt_pwm_interval", cfg->mqtt_pwm_interval);
 	if (cfg->mqtt_pwm_mask)
-		cJSON_AddItemToObject(config, "mqtt_pwm_mask",
-				cJSON_CreateString(
-					bitmask_to_str(cfg->mqtt_pwm_mask, OUTPUT_COUNT,
-						1, true)));
+		json_stream_string(js, "mqtt_pwm_mask",
+				bitmask_to_str(cfg->mqtt_pwm_mask, OUTPUT_COUNT, 1, true));
 	STRING_TO_JSON("mqtt_ha_discovery_prefix", cfg->mqtt_ha_discovery_prefix);
 	if (cfg->telnet_active)
-		cJSON_AddItemToObject(config, "telnet_active", cJSON_CreateNumber(cfg->telnet_active));
+		json_stream_number(js, "telnet_active", cfg->telnet_active);
 	if (cfg->telnet_auth != true)
-		cJSON_AddItemToObject(config, "telnet_auth", cJSON_CreateNumber(cfg->telnet_auth));
+		json_stream_number(js, "telnet_auth", cfg->telnet_auth);
 	if (cfg->telnet_raw_mode)
-		cJSON_AddItemToObject(config, "telnet_raw_mode", cJSON_CreateNumber(cfg->telnet_raw_mode));
+		json_stream_number(js, "telnet_raw_mode", cfg->telnet_raw_mode);
 	if (cfg->telnet_port > 0)
-		cJSON_AddItemToObject(config, "telnet_port", cJSON_CreateNumber(cfg->telnet_port));
+		json_stream_number(js, "telnet_port", cfg->telnet_port);
 	STRING_TO_JSON("telnet_user", cfg->telnet_user);
 	STRING_TO_JSON("telnet_pwhash", cfg->telnet_pwhash);
 #endif
 
 	/* PWM Outputs */
-	outputs = cJSON_CreateArray();
-	if (!outputs)
-		goto panic;
+	json_stream_array_start(js, "outputs");
 	for (i = 0; i < OUTPUT_COUNT; i++) {
 		const struct pwm_output *f = &cfg->outputs[i];
 
-		o = cJSON_CreateObject();
-		if (!o)
-			goto panic;
-		cJSON_AddItemToObject(o, "id", cJSON_CreateNumber(i));
-		cJSON_AddItemToObject(o, "name", cJSON_CreateString(f->name));
-		cJSON_AddItemToObject(o, "min_pwm", cJSON_CreateNumber(f->min_pwm));
-		cJSON_AddItemToObject(o, "max_pwm", cJSON_CreateNumber(f->max_pwm));
-		cJSON_AddItemToObject(o, "default_pwm", cJSON_CreateNumber(f->default_pwm));
-		cJSON_AddItemToObject(o, "default_state", cJSON_CreateNumber(f->default_state));
-		cJSON_AddItemToObject(o, "type", cJSON_CreateNumber(f->type));
-		cJSON_AddItemToObject(o, "effect", effect2json(f->effect, f->effect_ctx));
-		cJSON_AddItemToArray(outputs, o);
-	}
-	cJSON_AddItemToObject(config, "outputs", outputs);
+		json_stream_object_start(js, NULL);
+		json_stream_number(js, "id", i);
+		json_stream_string(js, "name", f->name);
+		json_stream_number(js, "min_pwm", f->min_pwm);
+		json_stream_number(js, "max_pwm", f->max_pwm);
+		json_stream_number(js, "default_pwm", f->default_pwm);
+		json_stream_number(js, "default_state", f->default_state);
+		json_stream_number(js, "type", f->type);
+		json_stream_object_start(js, "effect");
+		json_stream_string(js, "name", effect2str(f->effect));
+		s = effect_print_args(f->effect, f->effect_ctx);
+		json_stream_string(js, "args", (s ? s : ""));
+		if (s)
+			free(s);
+		json_stream_object_end(js);
+		json_stream_object_end(js);
+	}
+	json_stream_array_end(js);
 
 	/* Timers */
-	if ((events = cJSON_CreateArray()) == NULL)
-		goto panic;
+	json_stream_array_start(js, "timers");
 	for (i = 0; i < cfg->event_count; i++) {
 		const struct timer_event *e = &cfg->events[i];
 
-		if ((o = cJSON_CreateObject()) == NULL)
-			goto panic;
-		cJSON_AddItemToObject(o, "name", cJSON_CreateString(e->name));
-		cJSON_AddItemToObject(o, "minute", cJSON_CreateNumber(e->minute));
-		cJSON_AddItemToObject(o, "hour", cJSON_CreateNumber(e->hour));
-		cJSON_AddItemToObject(o, "wday", cJSON_CreateNumber(e->wday));
-		cJSON_AddItemToObject(o, "action", cJSON_CreateNumber(e->action));
-		cJSON_AddItemToObject(o, "mask", cJSON_CreateNumber(e->mask));
-		cJSON_AddItemToArray(events, o);
+		json_stream_object_start(js, NULL);
+		json_stream_string(js, "name", e->name);
+		json_stream_number(js, "minute", e->minute);
+		json_stream_number(js, "hour", e->hour);
+		json_stream_number(js, "wday", e->wday);
+		json_stream_number(js, "action", e->action);
+		json_stream_number(js, "mask", e->mask);
+		json_stream_object_end(js);
 	}
-	cJSON_AddItemToObject(config, "timers", events);
-
-	return config;
+	json_stream_array_end(js);
 
-panic:
-	cJSON_Delete(config);
-	return NULL;
+	json_stream_object_end(js);
+	json_stream_flush(js);
 }
 
 
@@ -352,6 +338,8 @@ int json_to_config(cJSON *config, struct brickpico_config *cfg)
 		cfg->serial_active = cJSON_GetNumberValue(ref);
 	if ((ref = cJSON_GetObjectItem(config, "pwm_freq")))
 		cfg->pwm_freq = cJSON_GetNumberValue(ref);
+	if ((ref = cJSON_GetObjectItem(config, "history_blocks")))
+		cfg->history_blocks = cJSON_GetNumberValue(ref);
 	JSON_TO_STRING("display_type", cfg->display_type, sizeof(cfg->display_type));
 	JSON_TO_STRING("display_theme", cfg->display_theme, sizeof(cfg->display_theme));
 	JSON_TO_STRING("display_logo", cfg->display_logo, sizeof(cfg->display_logo));
@@ -381,6 +369,9 @@ int json_to_config(cJSON *config, struct brickpico_config *cfg)
 		if ((val = cJSON_GetStringValue(ref)))
 			ipaddr_aton(val, &cfg->syslog_server);
 	}
+	if ((ref = cJSON_GetObjectItem(config, "syslog_tcp"))) {
+		cfg->syslog_tcp = cJSON_GetNumberValue(ref);
+	}
 	if ((ref = cJSON_GetObjectItem(config, "ntp_server"))) {
 		if ((val = cJSON_GetStringValue(ref)))
 			ipaddr_aton(val, &cfg->ntp_server);
@@ -531,7 +522,26 @@ void read_config()
 
 	log_msg(LOG_INFO, "Reading configuration...");
 
-	res = flash_read_file(&buf, &file_size, "brickpico.cfg");
+	clear_config(&brickpico_config);
+
+	/* Binary configuration is primary format... */
+	res = flash_read_file(&buf, &file_size, CONFIG_BIN_FILE);
+	if (res == 0 && buf != NULL) {
+		res = bin_to_config((uint8_t*)buf, file_size, &brickpico_config);
+		if (res == 0) {
+			saved_config_hash = xcrc32((unsigned char*)buf, file_size, 0xffffffff);
+			saved_config_size = file_size;
+			saved_config_valid = true;
+		}
+		free(buf);
+		if (res == 0)
+			return;
+		log_msg(LOG_ERR, "Failed to parse saved config: %d", res);
+		clear_config(&brickpico_config);
+	}
+
+	/* Fallback to JSON configuration (backup, or saved by older firmware)... */
+	res = flash_read_file(&buf, &file_size, CONFIG_JSON_FILE);
 	if (res == 0 && buf != NULL) {
 		/* parse saved config... */
 		config = cJSON_Parse(buf);
@@ -543,8 +553,6 @@ void read_config()
 		free(buf);
 	}
 
-	clear_config(&brickpico_config);
-
 	if (!config) {
 		log_msg(LOG_NOTICE, "Using default configuration...");
 		return;
@@ -559,50 +567,218 @@ void read_config()
 }
 
 
+struct config_file_sink {
+	const char *filename;
+	uint32_t offset;
+	int error;
+};
+
+static void config_file_write(void *ctx, const char *data, size_t len)
+{
+	struct config_file_sink *f = (struct config_file_sink*)ctx;
+
+	if (f->error)
+		return;
+	if (flash_file_write_at(f->filename, f->offset, data, len) != len)
+		f->error = 1;
+	else
+		f->offset += len;
+}
+
+/* Save (backup) copy of configuration in JSON format (only on request,
+   to avoid doubling flash wear of every save_config()).
+   File is written in small chunks (using the streaming JSON writer)
+   to a temporary file that then replaces the previous backup. */
+int export_config_json()
+{
+	const struct brickpico_config *c = cfg;
+	struct config_file_sink f;
+	struct json_stream js;
+
+	f.filename = CONFIG_JSON_TMP_FILE;
+	f.offset = 0;
+	f.error = flash_file_truncate(f.filename, 0);
+
+	json_stream_init(&js, config_file_write, &f);
+	if (!f.error)
+		config_to_json_stream(c, &js);
+	if (!f.error)
+		f.error = flash_rename_file(f.filename, CONFIG_JSON_FILE);
+	if (f.error) {
+		log_msg(LOG_ERR, "Failed to save JSON configuration backup: %d", f.error);
+		return -1;
+	}
+	log_msg(LOG_NOTICE, "JSON configuration backup saved: %lu bytes", f.offset);
+
+	return 0;
+}
+
+
 void save_config()
 {
-	cJSON *config;
-	char *str;
+	uint8_t *buf;
+	uint32_t size, hash;
 
-	log_msg(LOG_NOTICE, "Saving configuration...");
+	if (!(buf = config_to_bin(cfg, &size))) {
+		log_msg(LOG_ERR, "Failed to generate configuration");
+		return;
+	}
 
-	config = config_to_json(cfg);
-	if (!config) {
-		log_msg(LOG_ALERT, "Out of memory!");
+	/* Avoid (unnecessary) flash writes if configuration has not changed... */
+	hash = xcrc32(buf, size, 0xffffffff);
+	if (saved_config_valid && saved_config_size == size && saved_config_hash == hash) {
+		log_msg(LOG_NOTICE, "Configuration unchanged, not saving.");
+		config_saves_skipped++;
+		free(buf);
 		return;
 	}
 
-	if ((str = cJSON_Print(config)) == NULL) {
-		log_msg(LOG_ERR, "Failed to generate JSON output");
-	} else {
-		uint32_t config_size = strlen(str) + 1;
-		flash_write_file(str, config_size, "brickpico.cfg");
-		free(str);
+	log_msg(LOG_NOTICE, "Saving configuration...");
+	saved_config_valid = false;
+	if (flash_write_file((const char*)buf, size, CONFIG_BIN_FILE) == 0) {
+		saved_config_hash = hash;
+		saved_config_size = size;
+		saved_config_valid = true;
+		config_saves++;
+	}
+	free(buf);
+}
+
+
+/* Restore output effects that were active before (soft) reset. */
+void restore_output_effects(const struct persistent_output_state *s)
+{
+	int i;
+
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		struct pwm_output *o = &brickpico_config.outputs[i];
+		void *ctx;
+
+		if (s->effect[i] > EFFECT_ENUM_MAX)
+			continue;
+		ctx = effect_parse_args(s->effect[i], s->effect_args[i]);
+		if (s->effect[i] != EFFECT_NONE && !ctx)
+			continue;
+		if (o->effect_ctx)
+			free(o->effect_ctx);
+		o->effect = s->effect[i];
+		o->effect_ctx = ctx;
 	}
+}
 
-	cJSON_Delete(config);
+
+/* Forget hash of the saved configuration (if configuration file
+   has been removed, etc.) so that next save_config() will write it. */
+void reset_saved_config_hash()
+{
+	saved_config_valid = false;
 }
 
 
+void get_config_save_stats(uint32_t *saves, uint32_t *skipped)
+{
+	if (saves)
+		*saves = config_saves;
+	if (skipped)
+		*skipped = config_saves_skipped;
+}
+
+
+static void print_config_write(void *ctx, const char *data, size_t len)
+{
+	cmd_write(data, len);
+}
+
 void print_config()
 {
-	cJSON *config;
-	char *str;
+	struct json_stream js;
 
-	config = config_to_json(cfg);
-	if (!config) {
-		log_msg(LOG_ALERT, "Out of memory");
-		return;
+	cmd_printf("Current Configuration:\n");
+	json_stream_init(&js, print_config_write, NULL);
+	config_to_json_stream(cfg, &js);
+	cmd_printf("\n---\n");
+}
+
+
+/* Sanity check configuration (before making it active). */
+int validate_config(const struct brickpico_config *c)
+{
+	int i;
+
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		const struct pwm_output *o = &c->outputs[i];
+
+		if (o->min_pwm > o->max_pwm || o->max_pwm > 100) {
+			log_msg(LOG_WARNING, "output%d: invalid PWM range %u-%u",
+				i + 1, o->min_pwm, o->max_pwm);
+			return 1;
+		}
+		if (o->default_pwm > 100 || o->default_state > 1 || o->type > 1) {
+			log_msg(LOG_WARNING, "output%d: invalid default settings", i + 1);
+			return 2;
+		}
+		if (o->effect > EFFECT_ENUM_MAX
+			|| (o->effect != EFFECT_NONE && !o->effect_ctx)) {
+			log_msg(LOG_WARNING, "output%d: invalid effect", i + 1);
+			return 3;
+		}
+	}
+	if (c->event_count > MAX_EVENT_COUNT) {
+		log_msg(LOG_WARNING, "invalid timer event count: %u", c->event_count);
+		return 4;
+	}
+	if (c->pwm_freq < 10 || c->pwm_freq > 100000) {
+		log_msg(LOG_WARNING, "invalid PWM frequency: %u", c->pwm_freq);
+		return 5;
+	}
+	if (c->led_mode > 2) {
+		log_msg(LOG_WARNING, "invalid LED mode: %u", c->led_mode);
+		return 6;
 	}
 
-	if ((str = cJSON_Print(config)) == NULL) {
-		log_msg(LOG_ERR, "Failed to generate JSON output");
-	} else {
-		printf("Current Configuration:\n%s\n---\n", str);
-		free(str);
+	return 0;
+}
+
+
+/* Replace active configuration with 'new' configuration.
+   (Active configuration cannot be modified while a configuration
+   transaction is active, so 'new' contains all changes.) */
+void apply_config(const struct brickpico_config *new)
+{
+	void *old_ctx[OUTPUT_MAX_COUNT];
+	int i;
+
+	mutex_enter_blocking(config_mutex);
+	for (i = 0; i < OUTPUT_MAX_COUNT; i++) {
+		old_ctx[i] = brickpico_config.outputs[i].effect_ctx;
+		if (old_ctx[i] == new->outputs[i].effect_ctx)
+			old_ctx[i] = NULL;
 	}
+	memcpy(&brickpico_config, new, sizeof(brickpico_config));
+	mutex_exit(config_mutex);
 
-	cJSON_Delete(config);
+	/* Release effect settings that were replaced... */
+	for (i = 0; i < OUTPUT_MAX_COUNT; i++) {
+		if (old_ctx[i])
+			free(old_ctx[i]);
+	}
+
+	update_core1_config();
+}
+
+
+/* Discard (uncommitted) configuration copy created from active configuration. */
+void discard_config(struct brickpico_config *c)
+{
+	int i;
+
+	for (i = 0; i < OUTPUT_MAX_COUNT; i++) {
+		void *ctx = c->outputs[i].effect_ctx;
+
+		if (ctx && ctx != cfg->outputs[i].effect_ctx)
+			free(ctx);
+	}
+	free(c);
 }
 
 
@@ -610,8 +786,11 @@ void delete_config()
 {
 	int res;
 
-	res = flash_delete_file("brickpico.cfg");
+	reset_saved_config_hash();
+	res = flash_delete_file(CONFIG_BIN_FILE);
 	if (res) {
 		log_msg(LOG_ERR, "Failed to delete configuration.");
 	}
+	/* Remove JSON configuration backup as well */
+	flash_delete_file(CONFIG_JSON_FILE);
 }
@@ -0,0 +1,565 @@
+/* config_bin.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/mutex.h"
+#ifdef WIFI_SUPPORT
+#include "lwip/ip_addr.h"
+#endif
+
+#include "brickpico.h"
+
+
+/* Binary configuration file format:
+
+   Header (16 bytes):
+      uint32_t magic        "BPCF"
+      uint16_t version      format version (incremented only on incompatible changes)
+      uint16_t header_len   length of this header
+      uint32_t payload_len  length of the payload (records)
+      uint32_t crc32        CRC-32 (xcrc32) of the payload
+
+   Payload consists of tagged records:
+      uint16_t tag          field identifier
+      uint8_t  idx          array index (output/timer number), 0 for other fields
+      uint8_t  len          length of data
+      uint8_t  data[len]
+
+   Integers are stored little-endian, strings without terminating null.
+   Floating point values are stored as IEEE 754 binary64 (8 bytes,
+   little-endian), independent of the native representation. If encoding
+   of an existing field ever needs to change, a new tag must be used.
+   Records with unknown tags are skipped, so that configuration saved by
+   newer firmware can still be read (and vice versa).
+
+   Configuration saved in JSON format (brickpico.cfg) by older firmware
+   is still read if binary configuration is not found (or is invalid), and
+   it is converted to binary format on next CONF:SAVE. JSON copy of the
+   configuration is still saved as a backup (see save_config()) and it is
+   available using CONF:Read? command.
+*/
+
+#define CONFIG_BIN_MAGIC       0x46435042  /* "BPCF" */
+#define CONFIG_BIN_VERSION     1
+#define CONFIG_BIN_MAX_RECORD  255
+
+static_assert(sizeof(double) == 8, "double must be IEEE 754 binary64");
+
+struct config_bin_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_len;
+	uint32_t payload_len;
+	uint32_t crc32;
+};
+
+enum config_bin_types {
+	CB_UINT = 0,   /* unsigned integer (1, 2 or 4 bytes) */
+	CB_INT,        /* signed integer (1, 2 or 4 bytes) */
+	CB_DOUBLE,     /* IEEE 754 binary64 (little-endian) */
+	CB_STR,
+	CB_IPADDR,     /* ip_addr_t (stored as string) */
+};
+
+struct config_bin_field {
+	uint16_t tag;
+	uint8_t type;
+	uint16_t offset;
+	uint16_t size;
+};
+
+#define CB_FIELD(tag, type, st, field) {				\
+		tag, type, offsetof(st, field), sizeof(((st*)0)->field)	\
+	}
+#define CB_CFG(tag, type, field) CB_FIELD(tag, type, struct brickpico_config, field)
+#define CB_OUT(tag, type, field) CB_FIELD(tag, type, struct pwm_output, field)
+#define CB_EVT(tag, type, field) CB_FIELD(tag, type, struct timer_event, field)
+
+/* Special (non-table) tags */
+#define TAG_DEBUG              0x0001
+#define TAG_LOG_LEVEL          0x0002
+#define TAG_SYSLOG_LEVEL       0x0003
+#define TAG_EVENT_COUNT        0x0004
+#define TAG_OUTPUT_EFFECT      0x0107
+
+
+/* Tags must never be reused for different purposes... */
+
+static const struct config_bin_field config_fields[] = {
+	CB_CFG(0x0010, CB_UINT, local_echo),
+	CB_CFG(0x0011, CB_UINT, led_mode),
+	CB_CFG(0x0012, CB_UINT, spi_active),
+	CB_CFG(0x0013, CB_UINT, serial_active),
+	CB_CFG(0x0014, CB_UINT, pwm_freq),
+	CB_CFG(0x0015, CB_STR, display_type),
+	CB_CFG(0x0016, CB_STR, display_theme),
+	CB_CFG(0x0017, CB_STR, display_logo),
+	CB_CFG(0x0018, CB_STR, display_layout_r),
+	CB_CFG(0x0019, CB_STR, gamma),
+	CB_CFG(0x001a, CB_STR, name),
+	CB_CFG(0x001b, CB_STR, timezone),
+	CB_CFG(0x001c, CB_DOUBLE, adc_ref_voltage),
+	CB_CFG(0x001d, CB_DOUBLE, temp_offset),
+	CB_CFG(0x001e, CB_DOUBLE, temp_coefficient),
+	CB_CFG(0x001f, CB_UINT, history_blocks),
+#ifdef WIFI_SUPPORT
+	CB_CFG(0x0040, CB_STR, wifi_ssid),
+	CB_CFG(0x0041, CB_STR, wifi_passwd),
+	CB_CFG(0x0042, CB_STR, wifi_country),
+	CB_CFG(0x0043, CB_STR, wifi_auth_mode),
+	CB_CFG(0x0044, CB_UINT, wifi_mode),
+	CB_CFG(0x0045, CB_STR, hostname),
+	CB_CFG(0x0046, CB_IPADDR, syslog_server),
+	CB_CFG(0x0047, CB_IPADDR, ntp_server),
+	CB_CFG(0x0048, CB_IPADDR, ip),
+	CB_CFG(0x0049, CB_IPADDR, netmask),
+	CB_CFG(0x004a, CB_IPADDR, gateway),
+	CB_CFG(0x004b, CB_UINT, syslog_tcp),
+	CB_CFG(0x0050, CB_STR, mqtt_server),
+	CB_CFG(0x0051, CB_UINT, mqtt_port),
+	CB_CFG(0x0052, CB_UINT, mqtt_tls),
+	CB_CFG(0x0053, CB_UINT, mqtt_allow_scpi),
+	CB_CFG(0x0054, CB_STR, mqtt_user),
+	CB_CFG(0x0055, CB_STR, mqtt_pass),
+	CB_CFG(0x0056, CB_STR, mqtt_cmd_topic),
+	CB_CFG(0x0057, CB_STR, mqtt_resp_topic),
+	CB_CFG(0x0058, CB_STR, mqtt_err_topic),
+	CB_CFG(0x0059, CB_STR, mqtt_warn_topic),
+	CB_CFG(0x005a, CB_STR, mqtt_status_topic),
+	CB_CFG(0x005b, CB_STR, mqtt_pwm_topic),
+	CB_CFG(0x005c, CB_STR, mqtt_temp_topic),
+	CB_CFG(0x005d, CB_UINT, mqtt_status_interval),
+	CB_CFG(0x005e, CB_UINT, mqtt_pwm_interval),
+	CB_CFG(0x005f, CB_UINT, mqtt_temp_interval),
+	CB_CFG(0x0060, CB_UINT, mqtt_pwm_mask),
+	CB_CFG(0x0061, CB_STR, mqtt_ha_discovery_prefix),
+	CB_CFG(0x0070, CB_UINT, telnet_active),
+	CB_CFG(0x0071, CB_UINT, telnet_auth),
+	CB_CFG(0x0072, CB_UINT, telnet_raw_mode),
+	CB_CFG(0x0073, CB_UINT, telnet_port),
+	CB_CFG(0x0074, CB_STR, telnet_user),
+	CB_CFG(0x0075, CB_STR, telnet_pwhash),
+#endif
+	{ 0, 0, 0, 0 }
+};
+
+static const struct config_bin_field output_fields[] = {
+	CB_OUT(0x0100, CB_STR, name),
+	CB_OUT(0x0101, CB_UINT, min_pwm),
+	CB_OUT(0x0102, CB_UINT, max_pwm),
+	CB_OUT(0x0103, CB_UINT, default_pwm),
+	CB_OUT(0x0104, CB_UINT, default_state),
+	CB_OUT(0x0105, CB_UINT, type),
+	{ 0, 0, 0, 0 }
+};
+
+static const struct config_bin_field event_fields[] = {
+	CB_EVT(0x0200, CB_STR, name),
+	CB_EVT(0x0201, CB_INT, minute),
+	CB_EVT(0x0202, CB_INT, hour),
+	CB_EVT(0x0203, CB_UINT, wday),
+	CB_EVT(0x0204, CB_UINT, action),
+	CB_EVT(0x0205, CB_UINT, mask),
+	{ 0, 0, 0, 0 }
+};
+
+
+struct config_bin_writer {
+	uint8_t *buf;
+	size_t size;
+	size_t len;
+	int error;
+};
+
+
+static void put_record(struct config_bin_writer *w, uint16_t tag, uint8_t idx,
+		const void *data, size_t len)
+{
+	uint8_t *p;
+
+	if (w->error)
+		return;
+	if (len > CONFIG_BIN_MAX_RECORD) {
+		w->error = 1;
+		return;
+	}
+	if (w->len + 4 + len > w->size) {
+		size_t new_size = w->size * 2 + len;
+
+		if (!(p = realloc(w->buf, new_size))) {
+			w->error = 2;
+			return;
+		}
+		w->buf = p;
+		w->size = new_size;
+	}
+
+	p = w->buf + w->len;
+	*p++ = tag & 0xff;
+	*p++ = tag >> 8;
+	*p++ = idx;
+	*p++ = len;
+	if (len > 0)
+		memcpy(p, data, len);
+	w->len += 4 + len;
+}
+
+static void put_uint(struct config_bin_writer *w, uint16_t tag, uint8_t idx,
+		uint32_t val, size_t size)
+{
+	uint8_t b[4];
+
+	for (int i = 0; i < size && i < 4; i++)
+		b[i] = (val >> (8 * i)) & 0xff;
+	put_record(w, tag, idx, b, (size < 4 ? size : 4));
+}
+
+static uint32_t get_uint(const uint8_t *p, size_t len)
+{
+	uint32_t val = 0;
+
+	for (int i = 0; i < len && i < 4; i++)
+		val |= (uint32_t)p[i] << (8 * i);
+	return val;
+}
+
+static void put_double(struct config_bin_writer *w, uint16_t tag, uint8_t idx, double val)
+{
+	uint8_t b[8];
+	uint64_t v;
+
+	memcpy(&v, &val, sizeof(v));
+	for (int i = 0; i < 8; i++)
+		b[i] = (v >> (8 * i)) & 0xff;
+	put_record(w, tag, idx, b, sizeof(b));
+}
+
+static double get_double(const uint8_t *p)
+{
+	uint64_t v = 0;
+	double val;
+
+	for (int i = 0; i < 8; i++)
+		v |= (uint64_t)p[i] << (8 * i);
+	memcpy(&val, &v, sizeof(val));
+	return val;
+}
+
+static uint32_t load_field_uint(const void *p, size_t size)
+{
+	switch (size) {
+	case 1:
+		return *(const uint8_t*)p;
+	case 2:
+		return *(const uint16_t*)p;
+	case 4:
+		return *(const uint32_t*)p;
+	}
+	return 0;
+}
+
+static void store_field_uint(void *p, size_t size, uint32_t val)
+{
+	switch (size) {
+	case 1:
+		*(uint8_t*)p = val;
+		break;
+	case 2:
+		*(uint16_t*)p = val;
+		break;
+	case 4:
+		*(uint32_t*)p = val;
+		break;
+	}
+}
+
+
+static void put_fields(struct config_bin_writer *w, const struct config_bin_field *fields,
+		const void *base, uint8_t idx)
+{
+	const struct config_bin_field *f;
+
+	for (f = fields; f->tag; f++) {
+		const void *p = (const uint8_t*)base + f->offset;
+
+		switch (f->type) {
+		case CB_UINT:
+		case CB_INT:
+			put_uint(w, f->tag, idx, load_field_uint(p, f->size), f->size);
+			break;
+		case CB_DOUBLE:
+			put_double(w, f->tag, idx, *(const double*)p);
+			break;
+		case CB_STR:
+			put_record(w, f->tag, idx, p, strnlen(p, f->size - 1));
+			break;
+#ifdef WIFI_SUPPORT
+		case CB_IPADDR:
+			if (!ip_addr_isany((const ip_addr_t*)p)) {
+				const char *s = ipaddr_ntoa((const ip_addr_t*)p);
+				put_record(w, f->tag, idx, s, strlen(s));
+			}
+			break;
+#endif
+		}
+	}
+}
+
+static int get_field(const struct config_bin_field *fields, void *base,
+		uint16_t tag, const uint8_t *data, uint8_t len)
+{
+	const struct config_bin_field *f;
+	uint32_t val;
+
+	for (f = fields; f->tag; f++) {
+		void *p = (uint8_t*)base + f->offset;
+
+		if (f->tag != tag)
+			continue;
+
+		switch (f->type) {
+		case CB_UINT:
+			store_field_uint(p, f->size, get_uint(data, len));
+			break;
+		case CB_INT:
+			val = get_uint(data, len);
+			/* sign extend */
+			if (len > 0 && len < 4 && (data[len - 1] & 0x80))
+				val |= 0xffffffff << (8 * len);
+			store_field_uint(p, f->size, val);
+			break;
+		case CB_DOUBLE:
+			if (len == 8)
+				*(double*)p = get_double(data);
+			break;
+		case CB_STR:
+			if (len > f->size - 1)
+				len = f->size - 1;
+			memcpy(p, data, len);
+			((char*)p)[len] = 0;
+			break;
+#ifdef WIFI_SUPPORT
+		case CB_IPADDR:
+		{
+			char tmp[48];
+
+			if (len < sizeof(tmp)) {
+				memcpy(tmp, data, len);
+				tmp[len] = 0;
+				ipaddr_aton(tmp, (ip_addr_t*)p);
+			}
+			break;
+		}
+#endif
+		}
+		return 0;
+	}
+
+	return 1;
+}
+
+
+/* Serialize configuration in binary format. Returns pointer to
+   allocated buffer (that caller must free()), or NULL on error.
+ */
+uint8_t* config_to_bin(const struct brickpico_config *cfg, uint32_t *size)
+{
+	struct config_bin_writer w;
+	struct config_bin_header hdr;
+	int i;
+
+	w.size = 2048;
+	w.len = sizeof(hdr);
+	w.error = 0;
+	if (!(w.buf = malloc(w.size)))
+		return NULL;
+
+	put_uint(&w, TAG_DEBUG, 0, get_debug_level(), 1);
+	put_uint(&w, TAG_LOG_LEVEL, 0, get_log_level(), 1);
+	put_uint(&w, TAG_SYSLOG_LEVEL, 0, get_syslog_level(), 1);
+	put_fields(&w, config_fields, cfg, 0);
+
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		const struct pwm_output *o = &cfg->outputs[i];
+		char effect[CONFIG_BIN_MAX_RECORD + 1];
+		char *args;
+
+		put_fields(&w, output_fields, o, i);
+
+		/* Effect is stored as: <name>\0<args> */
+		strncopy(effect, effect2str(o->effect), sizeof(effect));
+		args = effect_print_args(o->effect, o->effect_ctx);
+		if (args) {
+			size_t l = strlen(effect) + 1;
+			size_t args_len = strlen(args);
+
+			if (l + args_len > CONFIG_BIN_MAX_RECORD) {
+				log_msg(LOG_ERR, "config_to_bin: output %d effect parameters too long: %u",
+					i + 1, (unsigned int)(l + args_len));
+				w.error = 3;
+			} else {
+				memcpy(effect + l, args, args_len);
+				put_record(&w, TAG_OUTPUT_EFFECT, i, effect, l + args_len);
+			}
+			free(args);
+		} else {
+			put_record(&w, TAG_OUTPUT_EFFECT, i, effect, strlen(effect));
+		}
+	}
+
+	put_uint(&w, TAG_EVENT_COUNT, 0, cfg->event_count, 1);
+	for (i = 0; i < cfg->event_count; i++) {
+		put_fields(&w, event_fields, &cfg->events[i], i);
+	}
+
+	if (w.error) {
+		log_msg(LOG_ERR, "config_to_bin: failed to serialize configuration: %d", w.error);
+		free(w.buf);
+		return NULL;
+	}
+
+	hdr.magic = CONFIG_BIN_MAGIC;
+	hdr.version = CONFIG_BIN_VERSION;
+	hdr.header_len = sizeof(hdr);
+	hdr.payload_len = w.len - sizeof(hdr);
+	hdr.crc32 = xcrc32(w.buf + sizeof(hdr), hdr.payload_len, 0xffffffff);
+	memcpy(w.buf, &hdr, sizeof(hdr));
+
+	*size = w.len;
+	return w.buf;
+}
+
+
+/* Parse binary configuration. Configuration should be initialized
+   (with defaults) before calling this.
+   Returns 0 on success.
+ */
+int bin_to_config(const uint8_t *buf, uint32_t size, struct brickpico_config *cfg)
+{
+	struct config_bin_header hdr;
+	const uint8_t *p, *end;
+	uint32_t crc;
+	int records = 0;
+	int unknown = 0;
+
+	if (!buf || size < sizeof(hdr))
+		return -1;
+
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (hdr.magic != CONFIG_BIN_MAGIC) {
+		log_msg(LOG_ERR, "Invalid binary config file");
+		return -2;
+	}
+	if (hdr.version != CONFIG_BIN_VERSION) {
+		log_msg(LOG_ERR, "Unsupported binary config version: %u", hdr.version);
+		return -3;
+	}
+	if (hdr.header_len < sizeof(hdr) || hdr.header_len > size
+		|| hdr.payload_len > size - hdr.header_len) {
+		log_msg(LOG_ERR, "Truncated binary config file");
+		return -4;
+	}
+	p = buf + hdr.header_len;
+	end = p + hdr.payload_len;
+	crc = xcrc32(p, hdr.payload_len, 0xffffffff);
+	if (crc != hdr.crc32) {
+		log_msg(LOG_ERR, "Binary config CRC mismatch: %08lx != %08lx", crc, hdr.crc32);
+		return -5;
+	}
+
+	mutex_enter_blocking(config_mutex);
+
+	while (p + 4 <= end) {
+		uint16_t tag = p[0] | (p[1] << 8);
+		uint8_t idx = p[2];
+		uint8_t len = p[3];
+		const uint8_t *data = p + 4;
+
+		if (data + len > end)
+			break;
+		p = data + len;
+		records++;
+
+		if (tag < 0x0100) {
+			if (tag == TAG_DEBUG)
+				set_debug_level(get_uint(data, len));
+			else if (tag == TAG_LOG_LEVEL)
+				set_log_level(get_uint(data, len));
+			else if (tag == TAG_SYSLOG_LEVEL)
+				set_syslog_level(get_uint(data, len));
+			else if (tag == TAG_EVENT_COUNT) {
+				cfg->event_count = get_uint(data, len);
+				if (cfg->event_count > MAX_EVENT_COUNT)
+					cfg->event_count = MAX_EVENT_COUNT;
+			}
+			else if (get_field(config_fields, cfg, tag, data, len))
+				unknown++;
+		}
+		else if (tag < 0x0200) {
+			struct pwm_output *o;
+
+			if (idx >= OUTPUT_COUNT)
+				continue;
+			o = &cfg->outputs[idx];
+			if (tag == TAG_OUTPUT_EFFECT) {
+				char tmp[CONFIG_BIN_MAX_RECORD + 1];
+				size_t l = len;
+
+				memcpy(tmp, data, l);
+				tmp[l] = 0;
+				l = strlen(tmp);
+				/* Duplicate records: last one wins */
+				if (o->effect_ctx)
+					free(o->effect_ctx);
+				o->effect = str2effect(tmp);
+				o->effect_ctx = effect_parse_args(o->effect,
+							(l + 1 < len ? tmp + l + 1 : ""));
+				if (!o->effect_ctx)
+					o->effect = EFFECT_NONE;
+			}
+			else if (get_field(output_fields, o, tag, data, len))
+				unknown++;
+		}
+		else if (tag < 0x0300) {
+			if (idx >= MAX_EVENT_COUNT)
+				continue;
+			if (get_field(event_fields, &cfg->events[idx], tag, data, len))
+				unknown++;
+		}
+		else {
+			unknown++;
+		}
+	}
+
+	mutex_exit(config_mutex);
+
+	log_msg(LOG_INFO, "Binary config: %d records (%d unknown)", records, unknown);
+
+	return 0;
+}
+
+
+/* eof :-) */
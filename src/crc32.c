@@ -35,6 +35,16 @@
 #include "libiberty.h"
 */
 
+#include <stdint.h>
+
+#if LIB_HARDWARE_DMA
+#include "pico/mutex.h"
+#include "hardware/dma.h"
+
+/* Buffers at least this long are checksummed using DMA sniffer. */
+#define CRC32_DMA_MIN_LEN 256
+#endif
+
 /* This table was generated by the following program.
 
    #include <stdio.h>
@@ -168,10 +178,21 @@ make it easy to compose the values of multiple blocks.
 
 */
 
-unsigned int
-xcrc32 (const unsigned char *buf, int len, unsigned int init)
+/* Tables for slicing-by-4, generated by xcrc32_init().
+   crc32_slice[0] is same as crc32_table. */
+static unsigned int crc32_slice[4][256];
+static volatile int crc32_slice_ready = 0;
+
+#if LIB_HARDWARE_DMA
+static int crc32_dma_channel = -1;
+static uint32_t crc32_dma_dummy;
+auto_init_mutex(crc32_dma_mutex);
+#endif
+
+
+static unsigned int
+xcrc32_bytes (const unsigned char *buf, int len, unsigned int crc)
 {
-  unsigned int crc = init;
   while (len--)
     {
       crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buf) & 255];
@@ -179,3 +200,88 @@ xcrc32 (const unsigned char *buf, int len, unsigned int init)
     }
   return crc;
 }
+
+/* Process four bytes per iteration.  Bytes are loaded individually, so
+   buffer does not need to be word aligned.  */
+static unsigned int
+xcrc32_slice4 (const unsigned char *buf, int len, unsigned int crc)
+{
+  while (len >= 4)
+    {
+      crc ^= ((unsigned int) buf[0] << 24) | ((unsigned int) buf[1] << 16)
+	| ((unsigned int) buf[2] << 8) | buf[3];
+      crc = crc32_slice[3][crc >> 24] ^ crc32_slice[2][(crc >> 16) & 255]
+	^ crc32_slice[1][(crc >> 8) & 255] ^ crc32_slice[0][crc & 255];
+      buf += 4;
+      len -= 4;
+    }
+  return xcrc32_bytes (buf, len, crc);
+}
+
+#if LIB_HARDWARE_DMA
+/* Use DMA sniffer in CRC-32 mode (same polynomial, not bit-reversed,
+   no final XOR).  Returns 0 if DMA was not available.  */
+static int
+xcrc32_dma (const unsigned char *buf, int len, unsigned int *crc)
+{
+  dma_channel_config c;
+
+  if (crc32_dma_channel < 0)
+    return 0;
+  /* Only one sniffer, if other core is using it fall back to software. */
+  if (!mutex_try_enter (&crc32_dma_mutex, NULL))
+    return 0;
+
+  c = dma_channel_get_default_config (crc32_dma_channel);
+  channel_config_set_transfer_data_size (&c, DMA_SIZE_8);
+  channel_config_set_read_increment (&c, true);
+  channel_config_set_write_increment (&c, false);
+  channel_config_set_sniff_enable (&c, true);
+  dma_sniffer_enable (crc32_dma_channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC32, true);
+  dma_sniffer_set_data_accumulator (*crc);
+  dma_channel_configure (crc32_dma_channel, &c, &crc32_dma_dummy, buf, len, true);
+  dma_channel_wait_for_finish_blocking (crc32_dma_channel);
+  *crc = dma_sniffer_get_data_accumulator ();
+  dma_sniffer_disable ();
+
+  mutex_exit (&crc32_dma_mutex);
+  return 1;
+}
+#endif
+
+/* Generate slicing tables (and claim DMA channel for the sniffer).
+   Until this is called xcrc32() uses the plain byte-at-a-time loop.  */
+void
+xcrc32_init (void)
+{
+  unsigned int i, j;
+
+  if (crc32_slice_ready)
+    return;
+
+  for (i = 0; i < 256; i++)
+    crc32_slice[0][i] = crc32_table[i];
+  for (j = 1; j < 4; j++)
+    for (i = 0; i < 256; i++)
+      crc32_slice[j][i] = (crc32_slice[j - 1][i] << 8)
+	^ crc32_table[crc32_slice[j - 1][i] >> 24];
+
+#if LIB_HARDWARE_DMA
+  crc32_dma_channel = dma_claim_unused_channel (false);
+#endif
+  crc32_slice_ready = 1;
+}
+
+unsigned int
+xcrc32 (const unsigned char *buf, int len, unsigned int init)
+{
+  unsigned int crc = init;
+
+  if (len < 8 || !crc32_slice_ready)
+    return xcrc32_bytes (buf, len, crc);
+#if LIB_HARDWARE_DMA
+  if (len >= CRC32_DMA_MIN_LEN && xcrc32_dma (buf, len, &crc))
+    return crc;
+#endif
+  return xcrc32_slice4 (buf, len, crc);
+}
@@ -30,8 +30,11 @@ void display_init()
 {
 #if OLED_DISPLAY || LCD_DISPLAY
 #if OLED_DISPLAY
-	if (!cfg->spi_active)
+	if (!cfg->spi_active) {
+		mutex_enter_blocking(i2c_mutex);
 		oled_display_init();
+		mutex_exit(i2c_mutex);
+	}
 #endif
 #if LCD_DISPLAY
 	if (cfg->spi_active)
@@ -49,8 +52,11 @@ void clear_display()
 		lcd_clear_display();
 #endif
 #if OLED_DISPLAY
-	if (!cfg->spi_active)
+	if (!cfg->spi_active) {
+		mutex_enter_blocking(i2c_mutex);
 		oled_clear_display();
+		mutex_exit(i2c_mutex);
+	}
 #endif
 }
 
@@ -62,8 +68,11 @@ void display_status(const struct brickpico_state *state,
 		lcd_display_status(state, config);
 #endif
 #if OLED_DISPLAY
-	if (!cfg->spi_active)
+	if (!cfg->spi_active) {
+		mutex_enter_blocking(i2c_mutex);
 		oled_display_status(state, config);
+		mutex_exit(i2c_mutex);
+	}
 #endif
 }
 
@@ -74,8 +83,11 @@ void display_message(int rows, const char **text_lines)
 		lcd_display_message(rows, text_lines);
 #endif
 #if OLED_DISPLAY
-	if (!cfg->spi_active)
+	if (!cfg->spi_active) {
+		mutex_enter_blocking(i2c_mutex);
 		oled_display_message(rows, text_lines);
+		mutex_exit(i2c_mutex);
+	}
 #endif
 }
 
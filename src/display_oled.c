@@ -93,7 +93,7 @@ void oled_display_init()
 	do {
 		sleep_ms(50);
 		res = oledInit(&oled, dtype, -1, flip, invert, I2C_HW,
-			SDA_PIN, SCL_PIN, -1, 1000000L, false);
+			SDA_PIN, SCL_PIN, -1, I2C_BUS_SPEED, false);
 	} while (res == OLED_NOT_FOUND && retries++ < 10);
 
 	if (res == OLED_NOT_FOUND) {
@@ -160,6 +160,7 @@ void oled_display_status(const struct brickpico_state *state,
 		return;
 
 	int out_row_offset = (oled_height > 64 ? 1 : 0);
+	int out_count = (oled_height > 64 ? 7 : 6) * 3;  /* number of outputs that fit on screen */
 
 	if (!bg_drawn) {
 		/* Draw "background" only once... */
@@ -174,7 +175,7 @@ void oled_display_status(const struct brickpico_state *state,
 	}
 
 	/* Output port states (PWM) */
-	for (i = 0; i < OUTPUT_COUNT; i++) {
+	for (i = 0; i < OUTPUT_COUNT && i < out_count; i++) {
 		uint pwm = state->pwm[i];
 		uint pwr = state->pwr[i];
 		int row = i / 3 + out_row_offset;
@@ -19,6 +19,8 @@
    along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#define LOG_SUBSYS EFFECTS
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,7 +19,10 @@
    along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#define LOG_SUBSYS FLASH
+
 #include <stdio.h>
+#include <string.h>
 #include <malloc.h>
 #include "pico/stdlib.h"
 #include "pico/mutex.h"
@@ -33,9 +36,137 @@ extern char __flash_binary_end;
 
 #define FS_SIZE  (256*1024)
 
+#define FS_FILE_CACHE_SIZE   2      /* number of files kept open */
+#define FS_SYNC_THRESHOLD    4096   /* sync file after this many unsynced bytes */
+
+struct fs_file_cache {
+	char name[32];
+	lfs_file_t file;
+	bool open;
+	uint32_t dirty;     /* bytes written since last sync */
+	uint32_t last_used;
+};
+
 static struct lfs_config *lfs_cfg;
 static lfs_t lfs;
 static lfs_file_t lfs_file;
+static lfs_file_t read_file;             /* read-only handle for flash_file_read_at() */
+static struct lfs_file_config read_file_cfg;
+static bool lfs_mounted = false;
+static struct fs_file_cache file_cache[FS_FILE_CACHE_SIZE];
+static uint32_t file_cache_clock = 0;
+auto_init_mutex(fs_mutex_inst);
+static mutex_t *fs_mutex = &fs_mutex_inst;
+static struct flash_wear_stats wear_stats;
+static int (*lfs_prog_func)(const struct lfs_config *c, lfs_block_t block,
+			lfs_off_t off, const void *buffer, lfs_size_t size);
+static int (*lfs_erase_func)(const struct lfs_config *c, lfs_block_t block);
+
+
+/* Block device wrappers to keep track of flash wear... */
+static int lfs_prog_wrapper(const struct lfs_config *c, lfs_block_t block,
+			lfs_off_t off, const void *buffer, lfs_size_t size)
+{
+	wear_stats.prog_count++;
+	wear_stats.prog_bytes += size;
+	return lfs_prog_func(c, block, off, buffer, size);
+}
+
+static int lfs_erase_wrapper(const struct lfs_config *c, lfs_block_t block)
+{
+	wear_stats.erase_count++;
+	return lfs_erase_func(c, block);
+}
+
+
+/* Make sure filesystem is mounted (called with fs_mutex held). */
+static int fs_mount()
+{
+	int res;
+
+	if (lfs_mounted)
+		return 0;
+
+	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
+		log_msg(LOG_ERR, "lfs_mount() failed: %d", res);
+		return res;
+	}
+	log_msg(LOG_DEBUG, "Filesystem mounted OK");
+	lfs_mounted = true;
+
+	return 0;
+}
+
+static void fs_cache_close(struct fs_file_cache *c)
+{
+	int res;
+
+	if (!c->open)
+		return;
+	if ((res = lfs_file_close(&lfs, &c->file)) != LFS_ERR_OK)
+		log_msg(LOG_ERR, "Failed to close file \"%s\": %d", c->name, res);
+	c->open = false;
+	c->dirty = 0;
+}
+
+/* Close cached file handle for a file (if any), so that file can be
+   safely accessed (or removed) without using the cached handle. */
+static void fs_cache_release(const char *filename)
+{
+	for (int i = 0; i < FS_FILE_CACHE_SIZE; i++) {
+		struct fs_file_cache *c = &file_cache[i];
+
+		if (c->open && !strncmp(c->name, filename, sizeof(c->name)))
+			fs_cache_close(c);
+	}
+}
+
+static void fs_cache_close_all()
+{
+	for (int i = 0; i < FS_FILE_CACHE_SIZE; i++)
+		fs_cache_close(&file_cache[i]);
+}
+
+/* Get (cached) file handle for a file. File is created if it doesn't exist. */
+static struct fs_file_cache* fs_cache_open(const char *filename)
+{
+	struct fs_file_cache *c = NULL;
+	int i, res;
+
+	if (strlen(filename) >= sizeof(file_cache[0].name))
+		return NULL;
+
+	for (i = 0; i < FS_FILE_CACHE_SIZE; i++) {
+		if (file_cache[i].open && !strcmp(file_cache[i].name, filename)) {
+			c = &file_cache[i];
+			c->last_used = ++file_cache_clock;
+			return c;
+		}
+	}
+
+	/* Find free (or least recently used) slot... */
+	for (i = 0; i < FS_FILE_CACHE_SIZE; i++) {
+		if (!file_cache[i].open) {
+			c = &file_cache[i];
+			break;
+		}
+		if (!c || file_cache[i].last_used < c->last_used)
+			c = &file_cache[i];
+	}
+	fs_cache_close(c);
+
+	if ((res = lfs_file_open(&lfs, &c->file, filename, LFS_O_RDWR | LFS_O_CREAT)) != LFS_ERR_OK) {
+		log_msg(LOG_ERR, "Failed to open file \"%s\": %d", filename, res);
+		return NULL;
+	}
+	strncopy(c->name, filename, sizeof(c->name));
+	c->open = true;
+	c->dirty = 0;
+	c->last_used = ++file_cache_clock;
+
+	return c;
+}
+
 
 void lfs_setup(bool multicore)
 {
@@ -45,6 +176,18 @@ void lfs_setup(bool multicore)
 	if (!lfs_cfg)
 		panic("lfs_setup: not enough memory!");
 
+	memset(&wear_stats, 0, sizeof(wear_stats));
+	lfs_prog_func = lfs_cfg->prog;
+	lfs_cfg->prog = lfs_prog_wrapper;
+	lfs_erase_func = lfs_cfg->erase;
+	lfs_cfg->erase = lfs_erase_wrapper;
+
+	/* Preallocate buffer for read-only handle, so that it can be
+	   opened without allocating memory (from IRQ context). */
+	memset(&read_file_cfg, 0, sizeof(read_file_cfg));
+	if (!(read_file_cfg.buffer = malloc(lfs_cfg->cache_size)))
+		panic("lfs_setup: not enough memory!");
+
 	/* Check if we need to initialize/format filesystem... */
 	err = lfs_mount(&lfs, lfs_cfg);
 	if (err != LFS_ERR_OK) {
@@ -53,7 +196,8 @@ void lfs_setup(bool multicore)
 			return;
 		log_msg(LOG_ERR, "Filesystem successfully initialized: %d", err);
 	} else {
-		lfs_unmount(&lfs);
+		/* Keep filesystem mounted... */
+		lfs_mounted = true;
 	}
 }
 
@@ -64,14 +208,24 @@ int flash_format(bool multicore)
 	int err;
 	bool saved;
 
+	mutex_enter_blocking(fs_mutex);
+	if (lfs_mounted) {
+		fs_cache_close_all();
+		lfs_unmount(&lfs);
+		lfs_mounted = false;
+	}
+
 	saved = ctx->multicore_lockout_enabled;
 	ctx->multicore_lockout_enabled = (multicore ? true : false);
 
 	if ((err = lfs_format(&lfs, lfs_cfg)) != LFS_ERR_OK) {
 		log_msg(LOG_ERR, "Unable to format flash filesystem: %d", err);
+	} else {
+		fs_mount();
 	}
 
 	ctx->multicore_lockout_enabled = saved;
+	mutex_exit(fs_mutex);
 
 	return  (err == LFS_ERR_OK ? 0 : 1);
 }
@@ -87,12 +241,12 @@ int flash_read_file(char **bufptr, uint32_t *sizeptr, const char *filename)
 	*bufptr = NULL;
 	*sizeptr = 0;
 
-	/* Mount flash filesystem... */
-	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
-		log_msg(LOG_NOTICE, "lfs_mount() failed: %d", res);
+	mutex_enter_blocking(fs_mutex);
+	if (fs_mount()) {
+		mutex_exit(fs_mutex);
 		return -1;
 	}
-	log_msg(LOG_DEBUG, "Filesystem mounted OK");
+	fs_cache_release(filename);
 
 	res = 0;
 
@@ -123,7 +277,7 @@ int flash_read_file(char **bufptr, uint32_t *sizeptr, const char *filename)
 		}
 		lfs_file_close(&lfs, &lfs_file);
 	}
-	lfs_unmount(&lfs);
+	mutex_exit(fs_mutex);
 
 	return res;
 }
@@ -136,14 +290,16 @@ int flash_write_file(const char *buf, uint32_t size, const char *filename)
 	if (!buf || !filename)
 		return -42;
 
-	/* Mount flash filesystem... */
-	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
-		log_msg(LOG_ERR, "lfs_mount() failed: %d", res);
+	mutex_enter_blocking(fs_mutex);
+	if (fs_mount()) {
+		mutex_exit(fs_mutex);
 		return -1;
 	}
+	fs_cache_release(filename);
 
 	/* Create file */
-	if ((res = lfs_file_open(&lfs, &lfs_file, filename, LFS_O_WRONLY | LFS_O_CREAT)) != LFS_ERR_OK) {
+	if ((res = lfs_file_open(&lfs, &lfs_file, filename,
+					LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC)) != LFS_ERR_OK) {
 		log_msg(LOG_ERR, "Failed to create file \"%s\": %d", filename, res);
 		res = -2;
 	} else {
@@ -156,13 +312,13 @@ int flash_write_file(const char *buf, uint32_t size, const char *filename)
 		} else {
 			log_msg(LOG_INFO, "File \"%s\" successfully created: %li bytes",
 				filename, wrote);
+			wear_stats.file_writes++;
+			wear_stats.file_bytes += wrote;
 			res = 0;
 		}
 		lfs_file_close(&lfs, &lfs_file);
 	}
-
-	/* Unmount flash filesystem */
-	lfs_unmount(&lfs);
+	mutex_exit(fs_mutex);
 
 	return res;
 }
@@ -177,11 +333,12 @@ int flash_delete_file(const char *filename)
 	if (!filename)
 		return -42;
 
-	/* Mount flash filesystem... */
-	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
-		log_msg(LOG_ERR, "lfs_mount() failed: %d", res);
+	mutex_enter_blocking(fs_mutex);
+	if (fs_mount()) {
+		mutex_exit(fs_mutex);
 		return -1;
 	}
+	fs_cache_release(filename);
 
 	/* Check if file exists... */
 	if ((res = lfs_stat(&lfs, filename, &stat)) != LFS_ERR_OK) {
@@ -196,12 +353,181 @@ int flash_delete_file(const char *filename)
 			ret = -3;
 		}
 	}
-	lfs_unmount(&lfs);
+	mutex_exit(fs_mutex);
 
 	return ret;
 }
 
 
+/* Read from given offset of a file.
+
+   File is read using a separate read-only handle, so that reading never
+   causes (cached) unsynced writes to be committed to flash. This makes it
+   safe to call from IRQ context (HTTP server), but then unsynced data
+   is not visible to the reader (otherwise it is synced first).
+   Returns number of bytes read, or < 0 on error (-2 if filesystem is busy
+   when called from IRQ context). */
+int flash_file_read_at(const char *filename, uint32_t offset, void *buf, uint32_t size)
+{
+	bool irq = (__get_current_exception() ? true : false);
+	int res;
+
+	if (!filename || !buf)
+		return -42;
+
+	/* Avoid blocking if called from IRQ handler (HTTP server)... */
+	if (irq) {
+		if (!mutex_try_enter(fs_mutex, NULL))
+			return -2;
+		if (!lfs_mounted) {
+			mutex_exit(fs_mutex);
+			return -2;
+		}
+	} else {
+		mutex_enter_blocking(fs_mutex);
+		if (fs_mount()) {
+			mutex_exit(fs_mutex);
+			return -1;
+		}
+		for (int i = 0; i < FS_FILE_CACHE_SIZE; i++) {
+			struct fs_file_cache *c = &file_cache[i];
+
+			if (c->open && c->dirty > 0 && !strcmp(c->name, filename)) {
+				lfs_file_sync(&lfs, &c->file);
+				c->dirty = 0;
+			}
+		}
+	}
+
+	if ((res = lfs_file_opencfg(&lfs, &read_file, filename, LFS_O_RDONLY,
+						&read_file_cfg)) != LFS_ERR_OK) {
+		mutex_exit(fs_mutex);
+		return -1;
+	}
+	if ((res = lfs_file_seek(&lfs, &read_file, offset, LFS_SEEK_SET)) >= 0)
+		res = lfs_file_read(&lfs, &read_file, buf, size);
+	lfs_file_close(&lfs, &read_file);
+	mutex_exit(fs_mutex);
+
+	return res;
+}
+
+
+/* Write to given offset of a file (using cached file handle).
+   Data is not necessarily committed to flash until flash_sync() is called
+   (or FS_SYNC_THRESHOLD bytes have been written).
+   Returns number of bytes written, or < 0 on error. */
+int flash_file_write_at(const char *filename, uint32_t offset, const void *buf, uint32_t size)
+{
+	struct fs_file_cache *c;
+	int res;
+
+	if (!filename || !buf)
+		return -42;
+
+	mutex_enter_blocking(fs_mutex);
+	if (fs_mount() || !(c = fs_cache_open(filename))) {
+		mutex_exit(fs_mutex);
+		return -1;
+	}
+	if ((res = lfs_file_seek(&lfs, &c->file, offset, LFS_SEEK_SET)) >= 0)
+		res = lfs_file_write(&lfs, &c->file, buf, size);
+	if (res > 0) {
+		wear_stats.file_writes++;
+		wear_stats.file_bytes += res;
+		c->dirty += res;
+		if (c->dirty >= FS_SYNC_THRESHOLD) {
+			lfs_file_sync(&lfs, &c->file);
+			c->dirty = 0;
+		}
+	}
+	mutex_exit(fs_mutex);
+
+	return res;
+}
+
+
+/* Truncate (or extend) file to given size (using cached file handle).
+   File is created if it doesn't exist. Returns 0 on success. */
+int flash_file_truncate(const char *filename, uint32_t size)
+{
+	struct fs_file_cache *c;
+	int res;
+
+	if (!filename)
+		return -42;
+
+	mutex_enter_blocking(fs_mutex);
+	if (fs_mount() || !(c = fs_cache_open(filename))) {
+		mutex_exit(fs_mutex);
+		return -1;
+	}
+	if ((res = lfs_file_truncate(&lfs, &c->file, size)) != LFS_ERR_OK) {
+		log_msg(LOG_ERR, "Failed to truncate file \"%s\": %d", filename, res);
+		res = -2;
+	} else {
+		c->dirty++;
+	}
+	mutex_exit(fs_mutex);
+
+	return res;
+}
+
+
+/* Rename file (replacing 'newname' if it exists). Any unsynced data
+   is committed to flash first. Returns 0 on success. */
+int flash_rename_file(const char *oldname, const char *newname)
+{
+	int res;
+
+	if (!oldname || !newname)
+		return -42;
+
+	mutex_enter_blocking(fs_mutex);
+	if (fs_mount()) {
+		mutex_exit(fs_mutex);
+		return -1;
+	}
+	fs_cache_release(oldname);
+	fs_cache_release(newname);
+	if ((res = lfs_rename(&lfs, oldname, newname)) != LFS_ERR_OK) {
+		log_msg(LOG_ERR, "Failed to rename file \"%s\" to \"%s\": %d",
+			oldname, newname, res);
+		res = -2;
+	}
+	mutex_exit(fs_mutex);
+
+	return res;
+}
+
+
+void flash_get_wear_stats(struct flash_wear_stats *stats)
+{
+	if (stats)
+		*stats = wear_stats;
+}
+
+
+/* Commit any unsynced data of (cached) open files to flash. */
+void flash_sync()
+{
+	int res;
+
+	if (!mutex_try_enter(fs_mutex, NULL))
+		return;
+	for (int i = 0; i < FS_FILE_CACHE_SIZE; i++) {
+		struct fs_file_cache *c = &file_cache[i];
+
+		if (!c->open || c->dirty == 0)
+			continue;
+		if ((res = lfs_file_sync(&lfs, &c->file)) != LFS_ERR_OK)
+			log_msg(LOG_ERR, "Failed to sync file \"%s\": %d", c->name, res);
+		c->dirty = 0;
+	}
+	mutex_exit(fs_mutex);
+}
+
+
 static int littlefs_scan_dir(const char *path, size_t *files, size_t *dirs, size_t *used)
 {
 	lfs_dir_t dir;
@@ -289,9 +615,9 @@ int flash_get_fs_info(size_t *size, size_t *free, size_t *files,
 	if (!size || !free)
 		return -1;
 
-	/* Mount flash filesystem... */
-	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
-		log_msg(LOG_ERR, "lfs_mount() failed: %d", res);
+	mutex_enter_blocking(fs_mutex);
+	if (fs_mount()) {
+		mutex_exit(fs_mutex);
 		return -2;
 	}
 
@@ -313,7 +639,7 @@ int flash_get_fs_info(size_t *size, size_t *free, size_t *files,
 	if (filesizetotal)
 		*filesizetotal = fs_total;
 
-	lfs_unmount(&lfs);
+	mutex_exit(fs_mutex);
 
 	return 0;
 }
@@ -324,10 +650,10 @@ void print_rp2040_flashinfo()
 	size_t binary_size = &__flash_binary_end - &__flash_binary_start;
 	size_t fs_size = lfs_cfg->block_count * lfs_cfg->block_size;
 
-	printf("Flash memory size:                     %u\n", PICO_FLASH_SIZE_BYTES);
-	printf("Binary size:                           %u\n", binary_size);
-	printf("LittleFS size:                         %u\n", fs_size);
-	printf("Unused flash memory:                   %u\n",
+	cmd_printf("Flash memory size:                     %u\n", PICO_FLASH_SIZE_BYTES);
+	cmd_printf("Binary size:                           %u\n", binary_size);
+	cmd_printf("LittleFS size:                         %u\n", fs_size);
+	cmd_printf("Unused flash memory:                   %u\n",
 		PICO_FLASH_SIZE_BYTES - binary_size - fs_size);
 
 }
@@ -0,0 +1,603 @@
+/* history.c
+   Copyright (C) 2024 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pico/stdlib.h"
+#include "pico/mutex.h"
+
+#include "brickpico.h"
+
+
+/* History is stored as a ring of fixed size blocks, each block in its own
+   file (history.<slot>), so that a block can be rewritten without copying
+   other blocks (littlefs files are not updated in place).
+   Each block starts with a header, followed by (delta encoded) records:
+
+      <time delta (varint)> <type> <payload>
+
+   Time delta is seconds since previous record (or block base time).
+   Every block starts with a HREC_STATE record, so that each block can
+   be decoded independently (oldest blocks get overwritten).
+
+   Current block is kept in RAM and written to flash when it is full
+   (or every HISTORY_FLUSH_INTERVAL seconds).
+*/
+
+#define HISTORY_FILE           "history.%u"
+#define HISTORY_MAGIC          0x53485042  /* "BPHS" */
+#define HISTORY_TEMP_INTERVAL  300         /* seconds */
+#define HISTORY_FLUSH_INTERVAL 600         /* seconds */
+
+enum history_record_types {
+	HREC_STATE = 1,     /* <count> <value>... */
+	HREC_OUTPUT = 2,    /* <output> <value> */
+	HREC_TEMP = 3,      /* <temperature delta (zigzag varint, 0.1C)> */
+};
+
+struct history_block_header {
+	uint32_t magic;
+	uint32_t seq;
+	uint32_t t_base;
+	uint16_t len;       /* bytes used in block (including header) */
+	uint16_t count;     /* number of records */
+	uint32_t crc32;     /* CRC of the data after header */
+};
+
+#define HDR_LEN sizeof(struct history_block_header)
+
+struct history_slot {
+	uint32_t seq;       /* 0 = unused */
+	uint32_t t_base;
+};
+
+static struct history_slot slots[HISTORY_MAX_BLOCKS];
+static uint8_t blocks = 0;
+static bool active = false;
+
+static uint8_t block_buf[HISTORY_BLOCK_SIZE];
+static uint32_t block_seq = 0;
+static uint32_t block_t_base = 0;
+static uint16_t block_len = 0;
+static uint16_t block_count = 0;
+static uint32_t block_t_last = 0;
+static int32_t block_temp = 0;
+static bool block_dirty = false;
+
+static uint8_t out_value[OUTPUT_MAX_COUNT];
+static uint32_t t_temp = 0;
+static uint32_t t_flush = 0;
+
+static uint32_t records_written = 0;
+static uint32_t blocks_written = 0;
+
+auto_init_mutex(history_mutex_inst);
+static mutex_t *history_mutex = &history_mutex_inst;
+
+
+static inline uint8_t output_value(uint8_t pwm, uint8_t pwr)
+{
+	return (pwm & 0x7f) | (pwr ? 0x80 : 0);
+}
+
+static int put_varint(uint8_t *p, uint32_t val)
+{
+	int len = 0;
+
+	do {
+		p[len] = (val & 0x7f) | (val > 0x7f ? 0x80 : 0);
+		val >>= 7;
+		len++;
+	} while (val > 0);
+
+	return len;
+}
+
+static const uint8_t* get_varint(const uint8_t *p, const uint8_t *end, uint32_t *val)
+{
+	uint32_t v = 0;
+	int shift = 0;
+
+	while (p < end && shift < 32) {
+		v |= (uint32_t)(*p & 0x7f) << shift;
+		if (!(*p++ & 0x80)) {
+			*val = v;
+			return p;
+		}
+		shift += 7;
+	}
+
+	return NULL;
+}
+
+
+static void slot_filename(char *buf, size_t size, uint slot)
+{
+	snprintf(buf, size, HISTORY_FILE, slot);
+}
+
+/* Write current block to flash. Block is copied (under history_mutex)
+   before writing, so that it can be read (by history queries) while
+   the write is in progress. */
+static void write_block()
+{
+	struct history_block_header hdr;
+	char name[16];
+	uint8_t *buf;
+	uint16_t len;
+	uint slot;
+	int res;
+
+	mutex_enter_blocking(history_mutex);
+	if (!block_dirty || blocks < 1) {
+		mutex_exit(history_mutex);
+		return;
+	}
+	if (!(buf = malloc(block_len))) {
+		mutex_exit(history_mutex);
+		log_msg(LOG_ERR, "history: not enough memory to write block %lu", block_seq);
+		return;
+	}
+	hdr.magic = HISTORY_MAGIC;
+	hdr.seq = block_seq;
+	hdr.t_base = block_t_base;
+	hdr.len = len = block_len;
+	hdr.count = block_count;
+	hdr.crc32 = xcrc32(block_buf + HDR_LEN, block_len - HDR_LEN, 0xffffffff);
+	memcpy(buf, &hdr, HDR_LEN);
+	memcpy(buf + HDR_LEN, block_buf + HDR_LEN, block_len - HDR_LEN);
+	slot = block_seq % blocks;
+	block_dirty = false;
+	mutex_exit(history_mutex);
+
+	slot_filename(name, sizeof(name), slot);
+	res = flash_write_file((const char*)buf, len, name);
+	free(buf);
+
+	mutex_enter_blocking(history_mutex);
+	if (res == 0) {
+		slots[slot].seq = hdr.seq;
+		slots[slot].t_base = hdr.t_base;
+		blocks_written++;
+	} else {
+		log_msg(LOG_ERR, "history: failed to write block %lu: %d", hdr.seq, res);
+		if (hdr.seq == block_seq)
+			block_dirty = true;
+	}
+	mutex_exit(history_mutex);
+}
+
+/* Append record into current block (called with history_mutex held). */
+static bool append_record(uint32_t t, uint8_t type, const uint8_t *payload, uint8_t len)
+{
+	uint8_t tmp[8];
+	int n;
+
+	n = put_varint(tmp, (t > block_t_last ? t - block_t_last : 0));
+	tmp[n++] = type;
+	if (block_len + n + len > HISTORY_BLOCK_SIZE)
+		return false;
+
+	memcpy(block_buf + block_len, tmp, n);
+	memcpy(block_buf + block_len + n, payload, len);
+	block_len += n + len;
+	block_count++;
+	if (t > block_t_last)
+		block_t_last = t;
+	block_dirty = true;
+	records_written++;
+
+	return true;
+}
+
+/* Start a new block (called with history_mutex held). */
+static void new_block(uint32_t t)
+{
+	uint8_t state[1 + OUTPUT_MAX_COUNT];
+
+	block_seq++;
+	block_t_base = block_t_last = t;
+	block_len = HDR_LEN;
+	block_count = 0;
+	block_temp = 0;
+	memset(block_buf, 0, HDR_LEN);
+
+	state[0] = OUTPUT_COUNT;
+	memcpy(&state[1], out_value, OUTPUT_COUNT);
+	append_record(t, HREC_STATE, state, 1 + OUTPUT_COUNT);
+}
+
+static void add_record(uint32_t t, uint8_t type, const uint8_t *payload, uint8_t len)
+{
+	if (append_record(t, type, payload, len))
+		return;
+
+	/* Block is full... */
+	mutex_exit(history_mutex);
+	write_block();
+	mutex_enter_blocking(history_mutex);
+	new_block(t);
+	append_record(t, type, payload, len);
+}
+
+
+static uint8_t config_blocks()
+{
+	return (cfg->history_blocks > HISTORY_MAX_BLOCKS ?
+		HISTORY_MAX_BLOCKS : cfg->history_blocks);
+}
+
+static void history_reset(uint8_t new_blocks)
+{
+	struct history_slot old_slots[HISTORY_MAX_BLOCKS];
+	char name[16];
+	int i;
+
+	mutex_enter_blocking(history_mutex);
+	memcpy(old_slots, slots, sizeof(old_slots));
+	memset(slots, 0, sizeof(slots));
+	blocks = new_blocks;
+	block_seq = 0;
+	block_dirty = false;
+	active = false;
+	mutex_exit(history_mutex);
+
+	for (i = 0; i < HISTORY_MAX_BLOCKS; i++) {
+		if (old_slots[i].seq == 0)
+			continue;
+		slot_filename(name, sizeof(name), i);
+		flash_delete_file(name);
+	}
+}
+
+void history_init()
+{
+	struct history_block_header hdr;
+	uint32_t max_seq = 0;
+	char name[16];
+	int i;
+
+	if ((blocks = config_blocks()) < 1)
+		return;
+
+	/* Scan block headers... */
+	memset(slots, 0, sizeof(slots));
+	for (i = 0; i < blocks; i++) {
+		slot_filename(name, sizeof(name), i);
+		if (flash_file_read_at(name, 0, &hdr, HDR_LEN) != HDR_LEN)
+			continue;
+		if (hdr.magic != HISTORY_MAGIC || hdr.seq % blocks != i)
+			continue;
+		slots[i].seq = hdr.seq;
+		slots[i].t_base = hdr.t_base;
+		if (hdr.seq > max_seq)
+			max_seq = hdr.seq;
+	}
+	block_seq = max_seq;
+	log_msg(LOG_INFO, "history: %u blocks, last block: %lu", blocks, block_seq);
+}
+
+
+/* Record output state changes and temperature (called from main loop). */
+void history_update(const struct brickpico_state *state)
+{
+	time_t now;
+	uint32_t t;
+	uint8_t rec[5];
+	int i, n;
+
+	if (config_blocks() != blocks) {
+		log_msg(LOG_NOTICE, "history: blocks changed %u --> %u",
+			blocks, config_blocks());
+		history_reset(config_blocks());
+	}
+	if (blocks < 1)
+		return;
+	if (!rtc_get_time(&now))
+		return;
+	t = now;
+
+	mutex_enter_blocking(history_mutex);
+	if (!active) {
+		for (i = 0; i < OUTPUT_COUNT; i++)
+			out_value[i] = output_value(state->pwm[i], state->pwr[i]);
+		new_block(t);
+		t_temp = 0;
+		t_flush = t;
+		active = true;
+	}
+
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		uint8_t v = output_value(state->pwm[i], state->pwr[i]);
+
+		if (v == out_value[i])
+			continue;
+		out_value[i] = v;
+		rec[0] = i;
+		rec[1] = v;
+		add_record(t, HREC_OUTPUT, rec, 2);
+	}
+
+	if (t >= t_temp + HISTORY_TEMP_INTERVAL) {
+		int32_t temp = state->temp * 10 + (state->temp < 0 ? -0.5 : 0.5);
+		int32_t delta = temp - block_temp;
+
+		n = put_varint(rec, (uint32_t)((delta << 1) ^ (delta >> 31)));
+		add_record(t, HREC_TEMP, rec, n);
+		block_temp = temp;
+		t_temp = t;
+	}
+	mutex_exit(history_mutex);
+
+	if (t >= t_flush + HISTORY_FLUSH_INTERVAL) {
+		write_block();
+		t_flush = t;
+	}
+}
+
+
+void history_flush()
+{
+	if (blocks > 0 && active)
+		write_block();
+}
+
+
+void print_history_stats()
+{
+	uint32_t oldest = 0;
+	uint32_t used = 0;
+	char tmp[32];
+	int i;
+
+	mutex_enter_blocking(history_mutex);
+	for (i = 0; i < blocks; i++) {
+		if (slots[i].seq == 0)
+			continue;
+		used++;
+		if (!oldest || slots[i].t_base < oldest)
+			oldest = slots[i].t_base;
+	}
+	cmd_printf("History blocks:                        %u\n", blocks);
+	cmd_printf("Blocks in use:                         %lu\n", used);
+	cmd_printf("Current block:                         %lu (%u bytes, %u records)\n",
+		block_seq, block_len, block_count);
+	cmd_printf("Oldest record:                         %s\n",
+		(oldest ? time_t_to_str(tmp, sizeof(tmp), oldest) : "N/A"));
+	cmd_printf("Records written (since boot):          %lu\n", records_written);
+	cmd_printf("Blocks written (since boot):           %lu\n", blocks_written);
+	mutex_exit(history_mutex);
+}
+
+
+/* Start history query (can be called from IRQ context). */
+int history_query_start(struct history_query *q, uint32_t from, uint32_t to)
+{
+	int i, j;
+
+	memset(q, 0, sizeof(*q));
+	q->from = from;
+	q->to = to;
+
+	if (!mutex_try_enter(history_mutex, NULL))
+		return -1;
+	if (blocks < 1 || !active) {
+		mutex_exit(history_mutex);
+		return 0;
+	}
+
+	/* Find (completed) blocks in sequence order... */
+	for (i = 0; i < blocks; i++) {
+		uint32_t seq = slots[i].seq;
+
+		if (seq == 0 || seq >= block_seq)
+			continue;
+		for (j = q->blocks; j > 0 && slots[q->order[j - 1]].seq > seq; j--)
+			q->order[j] = q->order[j - 1];
+		q->order[j] = i;
+		q->blocks++;
+	}
+	for (i = 0; i < q->blocks; i++)
+		q->seq[i] = slots[q->order[i]].seq;
+
+	/* Skip blocks that end before start of the query... */
+	while (q->blocks - q->pos > 1 && slots[q->order[q->pos + 1]].t_base <= from)
+		q->pos++;
+	if (q->blocks - q->pos == 1 && block_t_base <= from)
+		q->pos++;
+	mutex_exit(history_mutex);
+
+	/* Current block (in RAM) is always last */
+	q->order[q->blocks++] = -1;
+	q->state_pending = true;
+
+	return 0;
+}
+
+static int load_block(struct history_query *q)
+{
+	struct history_block_header hdr;
+	char name[16];
+	int slot, res;
+
+	while (q->pos < q->blocks) {
+		slot = q->order[q->pos++];
+
+		if (slot < 0) {
+			/* Current block */
+			if (!mutex_try_enter(history_mutex, NULL)) {
+				q->pos--;
+				return -1;
+			}
+			memcpy(q->buf, block_buf, block_len);
+			q->len = block_len;
+			q->t = block_t_base;
+			mutex_exit(history_mutex);
+		} else {
+			slot_filename(name, sizeof(name), slot);
+			res = flash_file_read_at(name, 0, q->buf, HISTORY_BLOCK_SIZE);
+			if (res == -2) {
+				/* Filesystem busy, retry later */
+				q->pos--;
+				return -2;
+			}
+			if (res < (int)HDR_LEN)
+				continue;
+			memcpy(&hdr, q->buf, HDR_LEN);
+			if (hdr.magic != HISTORY_MAGIC || hdr.seq != q->seq[q->pos - 1])
+				continue;
+			if (hdr.len < HDR_LEN || hdr.len > res)
+				continue;
+			if (xcrc32(q->buf + HDR_LEN, hdr.len - HDR_LEN, 0xffffffff) != hdr.crc32)
+				continue;
+			q->len = hdr.len;
+			q->t = hdr.t_base;
+		}
+		if (q->t > q->to)
+			return 0;
+		q->p = q->buf + HDR_LEN;
+		q->end = q->buf + q->len;
+		q->temp = 0;
+		return 1;
+	}
+
+	return 0;
+}
+
+static void start_state(struct history_query *q)
+{
+	q->state_pending = false;
+	q->state_left = q->state_count;
+	if (q->state_t < q->from)
+		q->state_t = q->from;
+}
+
+/* Return next record matching the query. Returns 1 if record was found,
+   0 when there are no more records, < 0 on error.
+
+   Output states (at start of the query range) are reported before
+   any other records. */
+int history_query_next(struct history_query *q, struct history_record *r)
+{
+	uint32_t delta;
+	int res;
+
+	while (1) {
+		if (q->state_left > 0) {
+			/* Expand state into individual outputs... */
+			int i = q->state_count - q->state_left--;
+			uint8_t v = q->state[i];
+
+			r->t = q->state_t;
+			r->type = HISTORY_STATE;
+			r->output = i;
+			r->pwm = v & 0x7f;
+			r->pwr = (v & 0x80 ? 1 : 0);
+			return 1;
+		}
+		if (q->have_pending) {
+			*r = q->pending;
+			q->have_pending = false;
+			return 1;
+		}
+		if (q->done)
+			return 0;
+
+		if (!q->p || q->p >= q->end) {
+			if ((res = load_block(q)) <= 0) {
+				if (res < 0)
+					return res;
+				goto done;
+			}
+		}
+
+		if (!(q->p = get_varint(q->p, q->end, &delta)) || q->p >= q->end) {
+			q->p = NULL;
+			continue;
+		}
+		q->t += delta;
+		if (q->t > q->to)
+			goto done;
+
+		switch (*q->p++) {
+		case HREC_STATE:
+			if (q->p >= q->end || q->p + 1 + *q->p > q->end) {
+				q->p = NULL;
+				continue;
+			}
+			q->state_count = *q->p++;
+			if (q->state_count > OUTPUT_MAX_COUNT)
+				q->state_count = OUTPUT_MAX_COUNT;
+			memcpy(q->state, q->p, q->state_count);
+			q->p += q->state_count;
+			q->state_t = q->t;
+			continue;
+
+		case HREC_OUTPUT:
+			if (q->p + 2 > q->end) {
+				q->p = NULL;
+				continue;
+			}
+			r->t = q->t;
+			r->type = HISTORY_OUTPUT;
+			r->output = q->p[0];
+			r->pwm = q->p[1] & 0x7f;
+			r->pwr = (q->p[1] & 0x80 ? 1 : 0);
+			if (r->t < q->from && r->output < q->state_count)
+				q->state[r->output] = q->p[1];
+			q->p += 2;
+			break;
+
+		case HREC_TEMP:
+			if (!(q->p = get_varint(q->p, q->end, &delta)))
+				continue;
+			q->temp += (int32_t)(delta >> 1) ^ -(int32_t)(delta & 1);
+			r->t = q->t;
+			r->type = HISTORY_TEMP;
+			r->temp = q->temp / 10.0;
+			break;
+
+		default:
+			/* Unknown record type, skip rest of the block */
+			q->p = NULL;
+			continue;
+		}
+
+		if (r->t < q->from)
+			continue;
+		if (q->state_pending && q->state_count > 0) {
+			q->pending = *r;
+			q->have_pending = true;
+			start_state(q);
+			continue;
+		}
+		return 1;
+
+	done:
+		q->done = true;
+		if (q->state_pending && q->state_count > 0)
+			start_state(q);
+	}
+}
+
+/* eof :-) */
@@ -19,6 +19,8 @@
    along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#define LOG_SUBSYS HTTPD
+
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -236,6 +238,342 @@ panic:
 }
 
 
+u16_t json_cmd_stats(char *insert, int insertlen, u16_t current_tag_part, u16_t *next_tag_part)
+{
+	static char *buf = NULL;
+	static char *p;
+	static u16_t part;
+	static size_t buf_left;
+	size_t printed, count;
+
+	if (current_tag_part == 0) {
+		/* Generate 'output' into a buffer that then will be fed in chunks to LwIP... */
+		if (!(buf = cmd_stats_json()))
+			return 0;
+
+		p = buf;
+		buf_left = strlen(buf);
+		part = 1;
+	}
+
+	/* Copy a part of the multi-part response into LwIP buffer ...*/
+	count = (buf_left < insertlen - 1 ? buf_left : insertlen - 1);
+	memcpy(insert, p, count);
+
+	p += count;
+	printed = count;
+	buf_left -= count;
+
+	if (buf_left > 0) {
+		*next_tag_part = part++;
+	} else {
+		free(buf);
+		buf = p = NULL;
+	}
+
+	return printed;
+}
+
+
+static uint32_t history_from = 0;
+static uint32_t history_to = UINT32_MAX;
+
+static int history_row(char *row, size_t len, const struct history_record *r, bool json)
+{
+	if (json) {
+		if (r->type == HISTORY_TEMP)
+			return snprintf(row, len, "{\"time\":%lu,\"type\":\"temp\",\"temp\":%0.1f}",
+					r->t, r->temp);
+		return snprintf(row, len, "{\"time\":%lu,\"type\":\"%s\",\"output\":%u,"
+				"\"duty_cycle\":%u,\"state\":\"%s\"}",
+				r->t, (r->type == HISTORY_STATE ? "state" : "output"),
+				r->output + 1, r->pwm, (r->pwr ? "ON" : "OFF"));
+	}
+
+	if (r->type == HISTORY_TEMP)
+		return snprintf(row, len, "%lu,temp,,,,%0.1f\n", r->t, r->temp);
+	return snprintf(row, len, "%lu,%s,%u,%u,%s,\n", r->t,
+			(r->type == HISTORY_STATE ? "state" : "output"),
+			r->output + 1, r->pwm, (r->pwr ? "ON" : "OFF"));
+}
+
+u16_t history_data(char *insert, int insertlen, u16_t current_tag_part, u16_t *next_tag_part,
+		bool json)
+{
+	static struct history_query *q = NULL;
+	static char row[128];
+	static size_t row_len;
+	static u16_t part;
+	static uint records;
+	static bool footer;
+	struct history_record r;
+	size_t printed = 0;
+	int res;
+
+	if (current_tag_part == 0) {
+		/* Start new query (record matching the query are read from flash
+		   incrementally, as LwIP requests more data)... */
+		if (q)
+			free(q);
+		if (!(q = malloc(sizeof(struct history_query))))
+			return 0;
+		if (history_query_start(q, history_from, history_to) < 0) {
+			free(q);
+			q = NULL;
+			return 0;
+		}
+		row_len = snprintf(row, sizeof(row), "%s", (json ? "{\"history\":[\n" :
+					"time,type,output,duty_cycle,state,temp\n"));
+		records = 0;
+		footer = false;
+		part = 1;
+	}
+	if (!q)
+		return 0;
+
+	while (1) {
+		if (row_len > 0) {
+			if (printed + row_len > insertlen - 1)
+				break;
+			memcpy(insert + printed, row, row_len);
+			printed += row_len;
+			row_len = 0;
+		}
+
+		if ((res = history_query_next(q, &r)) > 0) {
+			row_len = (json && records > 0 ? snprintf(row, sizeof(row), ",\n") : 0);
+			row_len += history_row(row + row_len, sizeof(row) - row_len, &r, json);
+			if (row_len >= sizeof(row))
+				row_len = sizeof(row) - 1;
+			records++;
+			continue;
+		}
+		if (res < 0)
+			log_msg(LOG_INFO, "history query failed: %d", res);
+		if (json && !footer) {
+			row_len = snprintf(row, sizeof(row), "\n]}\n");
+			footer = true;
+			continue;
+		}
+
+		/* No more data... */
+		free(q);
+		q = NULL;
+		return printed;
+	}
+
+	*next_tag_part = part++;
+	return printed;
+}
+
+
+static void history_query_params(int numparams, char *param[], char *value[])
+{
+	int val;
+	time_t now;
+	uint32_t t_now = (rtc_get_time(&now) ? now : 0);
+
+	history_from = 0;
+	history_to = UINT32_MAX;
+
+	for (int i = 0; i < numparams; i++) {
+		if (!str_to_int(value[i], &val, 10))
+			continue;
+		/* Negative values are relative to current time */
+		if (!strncmp(param[i], "from", 5))
+			history_from = (val < 0 ? t_now + val : val);
+		else if (!strncmp(param[i], "to", 3))
+			history_to = (val < 0 ? t_now + val : val);
+	}
+}
+
+static const char* history_csv_handler(int index, int numparams, char *param[], char *value[])
+{
+	history_query_params(numparams, param, value);
+	return "/history.csv";
+}
+
+static const char* history_json_handler(int index, int numparams, char *param[], char *value[])
+{
+	history_query_params(numparams, param, value);
+	return "/history.json";
+}
+
+
+static uint32_t log_since = 0;
+static bool log_since_set = false;
+
+/* Escape string for JSON (output is truncated to fit). */
+static size_t json_escape(char *out, size_t size, const char *s)
+{
+	size_t o = 0;
+
+	while (*s && o + 7 < size) {
+		unsigned char c = *s++;
+
+		if (c == '"' || c == '\\') {
+			out[o++] = '\\';
+			out[o++] = c;
+		} else if (c < 0x20) {
+			o += snprintf(out + o, size - o, "\\u%04x", c);
+		} else {
+			out[o++] = c;
+		}
+	}
+	out[o] = 0;
+
+	return o;
+}
+
+static int log_row(char *row, size_t len, uint32_t seq, const char *msg, bool json)
+{
+	size_t o;
+
+	if (!json)
+		return snprintf(row, len, "%lu %s\n", seq, msg);
+
+	o = snprintf(row, len, "{\"seq\":%lu,\"msg\":\"", seq);
+	if (o + 3 >= len)
+		return o;
+	o += json_escape(row + o, len - o - 2, msg);
+	o += snprintf(row + o, len - o, "\"}");
+
+	return o;
+}
+
+/* Stream contents of the (persistent) log ring buffer. Records are read
+   in place, holding pmem_mutex only while filling one part. Position is
+   tracked using record sequence numbers, so records added (or overwritten)
+   between parts do not break the iteration. */
+u16_t log_data(char *insert, int insertlen, u16_t current_tag_part, u16_t *next_tag_part,
+		bool json)
+{
+	static char row[PERSISTENT_LOG_MSG_LEN + 64];
+	static size_t row_len, row_pos;
+	static uint32_t seq, end;
+	static u16_t part;
+	static uint records;
+	static bool started, done, partial, check_seq;
+	var_ringbuffer_iter_t iter;
+	const char *msg;
+	size_t printed = 0;
+	size_t l;
+	bool locked = false;
+	uint32_t first;
+	int res;
+
+	if (current_tag_part == 0) {
+		row_len = (json ? snprintf(row, sizeof(row), "{\"log\":[\n") : 0);
+		row_pos = 0;
+		seq = log_since;
+		/* (without since= export starts from oldest record) */
+		check_seq = log_since_set;
+		records = 0;
+		started = false;
+		done = false;
+		partial = false;
+		part = 1;
+	}
+
+	while (1) {
+		if (row_pos < row_len) {
+			/* (rows can be longer than insert buffer) */
+			l = row_len - row_pos;
+			if (l > insertlen - 1 - printed)
+				l = insertlen - 1 - printed;
+			memcpy(insert + printed, row + row_pos, l);
+			printed += l;
+			row_pos += l;
+			if (row_pos < row_len)
+				break;
+		}
+		row_len = row_pos = 0;
+		if (done)
+			break;
+
+		if (!locked) {
+			if (!mutex_try_enter(pmem_mutex, NULL)) {
+				if (printed > 0)
+					break;
+				/* Cannot wait for the lock here (IRQ context), so end
+				   the export and let client retry from 'next'... */
+				log_msg(LOG_INFO, "log export: failed to get pmem_mutex");
+				started = true;
+				partial = true;
+				end = seq;
+			} else {
+				locked = true;
+				if (!started) {
+					end = log_rb->seq;
+					started = true;
+				}
+				first = var_ringbuffer_iter_init_seq(log_rb, &iter, seq);
+				/* Records were overwritten before they could be sent */
+				if (check_seq && (int32_t)(first - seq) > 0)
+					partial = true;
+				check_seq = true;
+				seq = first;
+			}
+		}
+
+		if (locked && (int32_t)(end - seq) > 0
+			&& (res = persistent_log_next(&iter, &msg)) != 0) {
+			if (res > 0) {
+				row_len = (json && records > 0 ? snprintf(row, sizeof(row), ",\n") : 0);
+				row_len += log_row(row + row_len, sizeof(row) - row_len, seq, msg, json);
+				if (row_len >= sizeof(row))
+					row_len = sizeof(row) - 1;
+				records++;
+			}
+			seq++;
+			continue;
+		}
+
+		/* No more data... */
+		if (json)
+			row_len = snprintf(row, sizeof(row), "\n],\"next\":%lu,\"partial\":%s}\n",
+					seq, (partial ? "true" : "false"));
+		else if (partial)
+			row_len = snprintf(row, sizeof(row), "# partial, next=%lu\n", seq);
+		done = true;
+	}
+
+	if (locked)
+		mutex_exit(pmem_mutex);
+	if (done && row_pos >= row_len)
+		return printed;
+
+	*next_tag_part = part++;
+	return printed;
+}
+
+static void log_query_params(int numparams, char *param[], char *value[])
+{
+	int val;
+
+	log_since = 0;
+	log_since_set = false;
+
+	for (int i = 0; i < numparams; i++) {
+		if (!strncmp(param[i], "since", 6) && str_to_int(value[i], &val, 10)) {
+			log_since = val;
+			log_since_set = true;
+		}
+	}
+}
+
+static const char* log_txt_handler(int index, int numparams, char *param[], char *value[])
+{
+	log_query_params(numparams, param, value);
+	return "/log.txt";
+}
+
+static const char* log_json_handler(int index, int numparams, char *param[], char *value[])
+{
+	log_query_params(numparams, param, value);
+	return "/log.json";
+}
+
 
 int extract_tag_index(const char *tag)
 {
@@ -334,6 +672,21 @@ u16_t brickpico_ssi_handler(const char *tag, char *insert, int insertlen,
 	else if (!strncmp(tag, "jsonstat", 8)) {
 		printed = json_stats(insert, insertlen, current_tag_part, next_tag_part);
 	}
+	else if (!strncmp(tag, "cmdstat", 7)) {
+		printed = json_cmd_stats(insert, insertlen, current_tag_part, next_tag_part);
+	}
+	else if (!strncmp(tag, "histcsv", 7)) {
+		printed = history_data(insert, insertlen, current_tag_part, next_tag_part, false);
+	}
+	else if (!strncmp(tag, "histjson", 8)) {
+		printed = history_data(insert, insertlen, current_tag_part, next_tag_part, true);
+	}
+	else if (!strncmp(tag, "logtext", 7)) {
+		printed = log_data(insert, insertlen, current_tag_part, next_tag_part, false);
+	}
+	else if (!strncmp(tag, "logjson", 7)) {
+		printed = log_data(insert, insertlen, current_tag_part, next_tag_part, true);
+	}
 	else if (!strncmp(tag, "timertbl", 9)) {
 		printed = timer_table(insert, insertlen, current_tag_part, next_tag_part);
 	}
@@ -410,6 +763,10 @@ static const tCGI cgi_handlers[] = {
 	{ "/", index_handler },
 	{ "/cgi", brickpico_cgi_handler },
 	{ "/index.shtml", index_handler },
+	{ "/history.csv", history_csv_handler },
+	{ "/history.json", history_json_handler },
+	{ "/log.txt", log_txt_handler },
+	{ "/log.json", log_json_handler },
 };
 
 
@@ -0,0 +1,214 @@
+/* json_stream.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "brickpico.h"
+
+
+/* Streaming JSON writer.
+
+   Output is generated into a small fixed size buffer that is passed to
+   the write function whenever it fills up, so memory usage does not
+   depend on the size of the document. Output is formatted similarly
+   to cJSON_Print().
+ */
+
+
+void json_stream_init(struct json_stream *js, json_stream_write_func_t write, void *ctx)
+{
+	memset(js, 0, sizeof(*js));
+	js->write = write;
+	js->ctx = ctx;
+	js->first = 1;
+}
+
+
+void json_stream_flush(struct json_stream *js)
+{
+	if (js->len > 0) {
+		js->write(js->ctx, js->buf, js->len);
+		js->bytes += js->len;
+		js->len = 0;
+	}
+}
+
+
+static void js_write(struct json_stream *js, const char *data, size_t len)
+{
+	while (len > 0) {
+		size_t n = sizeof(js->buf) - js->len;
+
+		if (n > len)
+			n = len;
+		memcpy(js->buf + js->len, data, n);
+		js->len += n;
+		data += n;
+		len -= n;
+		if (js->len >= sizeof(js->buf))
+			json_stream_flush(js);
+	}
+}
+
+static void js_puts(struct json_stream *js, const char *s)
+{
+	js_write(js, s, strlen(s));
+}
+
+static void js_indent(struct json_stream *js, int depth)
+{
+	for (int i = 0; i < depth; i++)
+		js_write(js, "\t", 1);
+}
+
+static void js_string(struct json_stream *js, const char *s)
+{
+	char tmp[8];
+
+	js_write(js, "\"", 1);
+	while (*s) {
+		const char *start = s;
+
+		while (*s && *s != '"' && *s != '\\' && (unsigned char)*s >= 0x20)
+			s++;
+		if (s > start)
+			js_write(js, start, s - start);
+		if (!*s)
+			break;
+
+		switch (*s) {
+		case '"':
+			js_puts(js, "\\\"");
+			break;
+		case '\\':
+			js_puts(js, "\\\\");
+			break;
+		case '\n':
+			js_puts(js, "\\n");
+			break;
+		case '\r':
+			js_puts(js, "\\r");
+			break;
+		case '\t':
+			js_puts(js, "\\t");
+			break;
+		default:
+			snprintf(tmp, sizeof(tmp), "\\u%04x", (unsigned char)*s);
+			js_puts(js, tmp);
+		}
+		s++;
+	}
+	js_write(js, "\"", 1);
+}
+
+/* Output separator and (optional) name before a new value. */
+static void js_begin_value(struct json_stream *js, const char *name)
+{
+	bool array = (js->depth > 0 && (js->arrays & (1UL << (js->depth - 1))));
+
+	if (!js->first)
+		js_puts(js, (array ? ", " : ",\n"));
+	js->first = 0;
+
+	if (js->depth > 0 && !array) {
+		js_indent(js, js->depth);
+		js_string(js, (name ? name : ""));
+		js_write(js, ":\t", 2);
+	}
+}
+
+static void js_begin(struct json_stream *js, const char *name, bool array)
+{
+	js_begin_value(js, name);
+	js_puts(js, (array ? "[" : "{\n"));
+	if (js->depth < 32) {
+		if (array)
+			js->arrays |= (1UL << js->depth);
+		else
+			js->arrays &= ~(1UL << js->depth);
+	}
+	js->depth++;
+	js->first = 1;
+}
+
+static void js_end(struct json_stream *js, bool array)
+{
+	if (js->depth > 0)
+		js->depth--;
+	if (!array) {
+		if (!js->first)
+			js_puts(js, "\n");
+		js_indent(js, js->depth);
+	}
+	js_puts(js, (array ? "]" : "}"));
+	js->first = 0;
+}
+
+
+void json_stream_object_start(struct json_stream *js, const char *name)
+{
+	js_begin(js, name, false);
+}
+
+void json_stream_object_end(struct json_stream *js)
+{
+	js_end(js, false);
+}
+
+void json_stream_array_start(struct json_stream *js, const char *name)
+{
+	js_begin(js, name, true);
+}
+
+void json_stream_array_end(struct json_stream *js)
+{
+	js_end(js, true);
+}
+
+void json_stream_string(struct json_stream *js, const char *name, const char *val)
+{
+	js_begin_value(js, name);
+	js_string(js, (val ? val : ""));
+}
+
+void json_stream_number(struct json_stream *js, const char *name, double val)
+{
+	char tmp[32];
+
+	js_begin_value(js, name);
+	if (val == (double)(long long)val)
+		snprintf(tmp, sizeof(tmp), "%lld", (long long)val);
+	else
+		snprintf(tmp, sizeof(tmp), "%1.15g", val);
+	js_puts(js, tmp);
+}
+
+void json_stream_bool(struct json_stream *js, const char *name, bool val)
+{
+	js_begin_value(js, name);
+	js_puts(js, (val ? "true" : "false"));
+}
+
+
+/* eof :-) */
@@ -28,15 +28,19 @@
 #include <assert.h>
 #include <malloc.h>
 #include <time.h>
+#include <stdint.h>
+#include <stddef.h>
 #include "pico/stdlib.h"
 #include "pico/mutex.h"
 #include "pico/unique_id.h"
 #include "pico/util/datetime.h"
 #include "hardware/watchdog.h"
+#include "hardware/sync.h"
 #include "b64/cencode.h"
 #include "b64/cdecode.h"
 
 #include "brickpico.h"
+#include "log_args.h"
 #ifdef WIFI_SUPPORT
 #include "syslog.h"
 #endif
@@ -56,6 +60,11 @@ struct log_facility {
 	const char *name;
 };
 
+struct log_subsys {
+	const char *name;
+	int8_t level;       /* -1 = use global log level */
+};
+
 struct log_priority log_priorities[] = {
 	{ LOG_EMERG,   "EMERG" },
 	{ LOG_ALERT,   "ALERT" },
@@ -92,6 +101,18 @@ struct log_facility log_facilities[] = {
 	{ 0, NULL }
 };
 
+/* (indexed by enum log_subsystems) */
+static struct log_subsys log_subsystems[LOG_SUBSYS_COUNT] = {
+	{ "SYSTEM",  -1 },
+	{ "PWM",     -1 },
+	{ "EFFECTS", -1 },
+	{ "MQTT",    -1 },
+	{ "HTTPD",   -1 },
+	{ "TIMER",   -1 },
+	{ "FLASH",   -1 },
+	{ "NET",     -1 },
+};
+
 
 int str2log_priority(const char *pri)
 {
@@ -153,6 +174,31 @@ const char* log_facility2str(int facility)
 
 
 
+int str2log_subsys(const char *subsys)
+{
+	int i;
+
+	if (!subsys)
+		return -2;
+
+	for (i = 0; i < LOG_SUBSYS_COUNT; i++) {
+		if (!strcasecmp(log_subsystems[i].name, subsys))
+			return i;
+	}
+
+	return -1;
+}
+
+const char* log_subsys2str(int subsys)
+{
+	if (subsys < 0 || subsys >= LOG_SUBSYS_COUNT)
+		return NULL;
+
+	return log_subsystems[subsys].name;
+}
+
+
+
 int get_log_level()
 {
 	return global_log_level;
@@ -173,6 +219,36 @@ void set_syslog_level(int level)
 	global_syslog_level = level;
 }
 
+/* Returns subsystem specific log level (-1 = global log level is used). */
+int get_log_subsys_level(int subsys)
+{
+	if (subsys < 0 || subsys >= LOG_SUBSYS_COUNT)
+		return -1;
+
+	return log_subsystems[subsys].level;
+}
+
+void set_log_subsys_level(int subsys, int level)
+{
+	if (subsys < 0 || subsys >= LOG_SUBSYS_COUNT)
+		return;
+
+	log_subsystems[subsys].level = (level < 0 ? -1 : level);
+}
+
+/* Effective (console & memory log) level for a subsystem. */
+static inline int subsys_log_level(int subsys)
+{
+	int level = log_subsystems[subsys].level;
+
+	return (level < 0 ? global_log_level : level);
+}
+
+static inline bool log_level_enabled(int subsys, int priority)
+{
+	return (priority <= subsys_log_level(subsys) || priority <= global_syslog_level);
+}
+
 int get_debug_level()
 {
 	return global_debug_level;
@@ -185,25 +261,38 @@ void set_debug_level(int level)
 
 
 #define LOG_MAX_MSG_LEN 256
+#define LOG_QUEUE_LEN   32     /* entries per core */
+#define LOG_ARGS_LEN    128    /* (long strings get truncated to fit) */
+
+/* Log messages are queued (per core) with the arguments packed in binary
+   form. Formatting and output (console, log ringbuffer, syslog) is done
+   later on core0 by process_log_queue(). */
+
+struct log_entry {
+	uint64_t t;
+	const char *format;   /* NULL = args contains (preformatted) message */
+	uint8_t priority;
+	uint8_t subsys;
+	uint8_t core;
+	uint8_t args[LOG_ARGS_LEN];
+};
+
+struct log_queue {
+	struct log_entry entries[LOG_QUEUE_LEN];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile uint32_t dropped;
+	uint32_t dropped_reported;
+};
+
+static struct log_queue log_queues[2];
+static bool log_queue_active = false;
+
 
-void log_msg(int priority, const char *format, ...)
+static void log_output(int subsys, int priority, uint core, uint64_t t, char *buf)
 {
-	va_list ap;
-	char *buf;
 	char tstamp[32];
 	int len;
-	uint64_t start, end;
-	uint core = get_core_num();
-
-	if ((priority > global_log_level) && (priority > global_syslog_level))
-		return;
-	if (!(buf = malloc(LOG_MAX_MSG_LEN)))
-		return;
-
-	start = to_us_since_boot(get_absolute_time());
-	va_start(ap, format);
-	vsnprintf(buf, LOG_MAX_MSG_LEN, format, ap);
-	va_end(ap);
 
 	if ((len = strnlen(buf, LOG_MAX_MSG_LEN - 1)) > 0) {
 		/* If string ends with \n, remove it. */
@@ -211,23 +300,26 @@ void log_msg(int priority, const char *format, ...)
 			buf[len - 1] = 0;
 	}
 
-	if (priority <= global_log_level) {
-		uint64_t t = to_us_since_boot(get_absolute_time());
+	if (priority <= subsys_log_level(subsys)) {
 		snprintf(tstamp, sizeof(tstamp), "[%6llu.%06llu][%u]",
 			(t / 1000000), (t % 1000000), core);
 		printf("%s %s\n", tstamp, buf);
-		char *rbuf = malloc(255);
-		if (rbuf) {
-			if (mutex_enter_timeout_us(pmem_mutex, 100)) {
-				snprintf(rbuf, 255, "%s %s", tstamp, buf);
-				u8_ringbuffer_add(log_rb, (uint8_t*)rbuf, strlen(rbuf) + 1, true);
-				update_persistent_memory_crc();
-				mutex_exit(pmem_mutex);
-			} else {
-				printf("%s mutex timeout: FAILED to access log rinbuffer\n",
-					tstamp);
+		if (mutex_enter_timeout_us(pmem_mutex, 100)) {
+			/* Only reserve space needed for this message (reserving
+			   more would evict older records unnecessarily) */
+			size_t rlen = strlen(tstamp) + 1 + strlen(buf) + 1;
+			char *rbuf;
+
+			if (rlen > PERSISTENT_LOG_MSG_LEN)
+				rlen = PERSISTENT_LOG_MSG_LEN;
+			if ((rbuf = persistent_log_reserve(rlen))) {
+				snprintf(rbuf, rlen, "%s %s", tstamp, buf);
+				persistent_log_commit(rbuf);
 			}
-			free(rbuf);
+			mutex_exit(pmem_mutex);
+		} else {
+			printf("%s mutex timeout: FAILED to access log rinbuffer\n",
+				tstamp);
 		}
 	}
 
@@ -236,6 +328,141 @@ void log_msg(int priority, const char *format, ...)
 		syslog_msg(priority, "%s", buf);
 	}
 #endif
+}
+
+
+/* Format log message from queue entry. */
+static void format_entry(char *out, size_t size, const struct log_entry *e)
+{
+	if (!e->format) {
+		strncopy(out, (const char*)e->args, (size < LOG_ARGS_LEN ? size : LOG_ARGS_LEN));
+		return;
+	}
+	log_format_args(out, size, e->format, e->args);
+}
+
+
+static void log_enqueue(int subsys, int priority, const char *format, va_list ap)
+{
+	uint core = get_core_num();
+	struct log_queue *q = &log_queues[core];
+	struct log_entry entry;
+	uint32_t head, irq;
+	va_list aq;
+	int len;
+
+	/* Pack arguments (or format message) before disabling interrupts,
+	   only claiming a slot and copying the entry is done with
+	   interrupts disabled. */
+	entry.priority = priority;
+	entry.subsys = subsys;
+	entry.core = core;
+	entry.format = format;
+	va_copy(aq, ap);
+	len = log_pack_args(entry.args, sizeof(entry.args), format, aq);
+	va_end(aq);
+	if (len < 0) {
+		/* Fallback to formatting message immediately... */
+		vsnprintf((char*)entry.args, sizeof(entry.args), format, ap);
+		entry.format = NULL;
+		len = strnlen((char*)entry.args, sizeof(entry.args) - 1) + 1;
+	}
+
+	irq = save_and_disable_interrupts();
+	head = q->head;
+	if (head - q->tail >= LOG_QUEUE_LEN) {
+		q->dropped++;
+		restore_interrupts(irq);
+		return;
+	}
+	entry.t = to_us_since_boot(get_absolute_time());
+	memcpy(&q->entries[head % LOG_QUEUE_LEN], &entry,
+		offsetof(struct log_entry, args) + len);
+	__dmb();
+	q->head = head + 1;
+	restore_interrupts(irq);
+}
+
+
+/* Start queuing log messages (called once core0 main loop is about to start). */
+void log_enable_queue()
+{
+	log_queue_active = true;
+}
+
+
+/* Format and output queued log messages (called from core0 main loop). */
+void process_log_queue()
+{
+	static char buf[LOG_MAX_MSG_LEN];
+	struct log_queue *q;
+	struct log_entry *e;
+	uint32_t dropped;
+	int i;
+
+	if (get_core_num() != 0)
+		return;
+
+	while (1) {
+		/* Pick oldest message from the queues... */
+		q = NULL;
+		e = NULL;
+		for (i = 0; i < 2; i++) {
+			struct log_queue *lq = &log_queues[i];
+			uint32_t tail = lq->tail;
+
+			if (lq->head == tail)
+				continue;
+			__dmb();
+			if (!e || lq->entries[tail % LOG_QUEUE_LEN].t < e->t) {
+				q = lq;
+				e = &lq->entries[tail % LOG_QUEUE_LEN];
+			}
+		}
+		if (!e)
+			break;
+
+		format_entry(buf, sizeof(buf), e);
+		log_output(e->subsys, e->priority, e->core, e->t, buf);
+		__dmb();
+		q->tail++;
+	}
+
+	for (i = 0; i < 2; i++) {
+		q = &log_queues[i];
+		if ((dropped = q->dropped) != q->dropped_reported) {
+			snprintf(buf, sizeof(buf), "log queue full: %lu message(s) dropped (core%d)",
+				dropped - q->dropped_reported, i);
+			q->dropped_reported = dropped;
+			log_output(LOG_SUBSYS_SYSTEM, LOG_WARNING, 0, to_us_since_boot(get_absolute_time()), buf);
+		}
+	}
+}
+
+
+static void log_vmsg(int subsys, int priority, const char *format, va_list ap)
+{
+	char *buf;
+	uint64_t start, end;
+	uint core = get_core_num();
+
+	if (subsys < 0 || subsys >= LOG_SUBSYS_COUNT)
+		subsys = LOG_SUBSYS_SYSTEM;
+	if (!log_level_enabled(subsys, priority))
+		return;
+
+	if (log_queue_active) {
+		log_enqueue(subsys, priority, format, ap);
+		return;
+	}
+
+	if (!(buf = malloc(LOG_MAX_MSG_LEN)))
+		return;
+
+	start = to_us_since_boot(get_absolute_time());
+	vsnprintf(buf, LOG_MAX_MSG_LEN, format, ap);
+
+	log_output(subsys, priority, core, to_us_since_boot(get_absolute_time()), buf);
 
 	end = to_us_since_boot(get_absolute_time());
 	if (end - start > 10000) {
@@ -247,6 +474,58 @@ void log_msg(int priority, const char *format, ...)
 	free(buf);
 }
 
+void log_subsys_msg(int subsys, int priority, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	log_vmsg(subsys, priority, format, ap);
+	va_end(ap);
+}
+
+/* (log_msg() is normally a macro, this is for use as a callback function) */
+void (log_msg)(int priority, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	log_vmsg(LOG_SUBSYS_SYSTEM, priority, format, ap);
+	va_end(ap);
+}
+
+
+/* Check if call site (of log_msg_ratelimited()) is allowed to log. */
+int log_ratelimit(struct log_ratelimit *rl, uint32_t interval, uint32_t burst,
+		int subsys, int priority, const char *func)
+{
+	uint64_t now;
+	uint32_t suppressed;
+
+	/* Message would not be logged anyway... */
+	if (subsys < 0 || subsys >= LOG_SUBSYS_COUNT)
+		subsys = LOG_SUBSYS_SYSTEM;
+	if (!log_level_enabled(subsys, priority))
+		return 0;
+
+	now = to_us_since_boot(get_absolute_time());
+	if (rl->t_start == 0 || now - rl->t_start >= interval * 1000ULL) {
+		suppressed = rl->suppressed;
+		rl->t_start = now;
+		rl->count = 0;
+		rl->suppressed = 0;
+		if (suppressed > 0)
+			log_subsys_msg(subsys, priority, "%s: %lu message(s) suppressed (rate limit)",
+				func, suppressed);
+	}
+
+	if (rl->count < burst) {
+		rl->count++;
+		return 1;
+	}
+	rl->suppressed++;
+
+	return 0;
+}
 
 
 void debug(int debug_level, const char *fmt, ...)
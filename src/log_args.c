@@ -0,0 +1,243 @@
+/* log_args.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "log_args.h"
+
+
+enum log_arg_types {
+	ARG_INT = 0,
+	ARG_LONG,
+	ARG_LLONG,
+	ARG_SIZE,
+	ARG_INTMAX,
+	ARG_PTRDIFF,
+	ARG_DOUBLE,
+	ARG_LDOUBLE,
+	ARG_PTR,
+	ARG_STR,
+	ARG_INVALID,
+};
+
+/* Parse printf style conversion specification (p points to the character
+   after '%'). Returns pointer to the conversion character. */
+static const char* parse_conversion(const char *p, int *stars, enum log_arg_types *type)
+{
+	int mod = 0;
+
+	*stars = 0;
+	while (*p && strchr("-+ #0", *p))
+		p++;
+	if (*p == '*') {
+		(*stars)++;
+		p++;
+	}
+	while (*p >= '0' && *p <= '9')
+		p++;
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			(*stars)++;
+			p++;
+		}
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+
+	while (*p && strchr("hlLzjt", *p)) {
+		if (*p == 'l')
+			mod = (mod == 'l' ? 'q' : 'l');
+		else if (*p != 'h')
+			mod = *p;
+		p++;
+	}
+
+	switch (*p) {
+	case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+		*type = (mod == 'l' ? ARG_LONG : mod == 'q' ? ARG_LLONG :
+			mod == 'z' ? ARG_SIZE : mod == 'j' ? ARG_INTMAX :
+			mod == 't' ? ARG_PTRDIFF : ARG_INT);
+		break;
+	case 'c':
+		*type = (mod ? ARG_INVALID : ARG_INT);
+		break;
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+		*type = (mod == 'L' ? ARG_LDOUBLE : ARG_DOUBLE);
+		break;
+	case 'p':
+		*type = ARG_PTR;
+		break;
+	case 's':
+		*type = (mod ? ARG_INVALID : ARG_STR);
+		break;
+	default:
+		*type = ARG_INVALID;
+		break;
+	}
+
+	return p;
+}
+
+#define PACK_ARG(type) {						\
+		type v = va_arg(ap, type);				\
+		if (len + sizeof(v) > size)				\
+			return -1;					\
+		memcpy(buf + len, &v, sizeof(v));			\
+		len += sizeof(v);					\
+	}
+
+/* Pack arguments of a log message into a buffer. Returns length of
+   packed arguments, or -1 if they do not fit (or format is not supported).
+   Strings are copied (they may not exist anymore when message is formatted). */
+int log_pack_args(uint8_t *buf, size_t size, const char *format, va_list ap)
+{
+	const char *p = format;
+	enum log_arg_types type;
+	size_t len = 0;
+	int stars;
+
+	while ((p = strchr(p, '%'))) {
+		if (*++p == '%') {
+			p++;
+			continue;
+		}
+		p = parse_conversion(p, &stars, &type);
+		if (!*p)
+			break;
+		p++;
+		while (stars-- > 0)
+			PACK_ARG(int);
+
+		switch (type) {
+		case ARG_INT:     PACK_ARG(int); break;
+		case ARG_LONG:    PACK_ARG(long); break;
+		case ARG_LLONG:   PACK_ARG(long long); break;
+		case ARG_SIZE:    PACK_ARG(size_t); break;
+		case ARG_INTMAX:  PACK_ARG(intmax_t); break;
+		case ARG_PTRDIFF: PACK_ARG(ptrdiff_t); break;
+		case ARG_DOUBLE:  PACK_ARG(double); break;
+		case ARG_LDOUBLE: PACK_ARG(long double); break;
+		case ARG_PTR:     PACK_ARG(void*); break;
+		case ARG_STR:
+		{
+			const char *s = va_arg(ap, const char*);
+			size_t l;
+
+			if (!s)
+				s = "(null)";
+			if (len >= size)
+				return -1;
+			l = strnlen(s, size - len - 1);
+			memcpy(buf + len, s, l);
+			buf[len + l] = 0;
+			len += l + 1;
+			break;
+		}
+		default:
+			return -1;
+		}
+	}
+
+	return len;
+}
+
+#define FORMAT_ARG(type) {						\
+		type v;							\
+		memcpy(&v, a, sizeof(v));				\
+		a += sizeof(v);						\
+		res = snprintf(out + o, size - o, spec, v);		\
+	}
+
+/* Format log message from arguments packed by log_pack_args(). */
+void log_format_args(char *out, size_t size, const char *format, const uint8_t *args)
+{
+	const char *p = format;
+	const uint8_t *a = args;
+	enum log_arg_types type;
+	char spec[32];
+	size_t o = 0;
+	int res, stars;
+
+	if (size < 1)
+		return;
+
+	while (*p && o < size - 1) {
+		const char *start = p;
+		size_t sl = 0;
+
+		if (*p != '%' || p[1] == '%') {
+			out[o++] = *p;
+			p += (*p == '%' ? 2 : 1);
+			continue;
+		}
+
+		p = parse_conversion(p + 1, &stars, &type);
+		if (!*p)
+			break;
+		p++;
+
+		/* Build conversion spec (with any '*' replaced by its value) */
+		while (start < p && sl < sizeof(spec) - 12) {
+			if (*start == '*') {
+				int v;
+				memcpy(&v, a, sizeof(v));
+				a += sizeof(v);
+				sl += snprintf(spec + sl, sizeof(spec) - sl, "%d", v);
+			} else {
+				spec[sl++] = *start;
+			}
+			start++;
+		}
+		spec[sl] = 0;
+
+		res = 0;
+		switch (type) {
+		case ARG_INT:     FORMAT_ARG(int); break;
+		case ARG_LONG:    FORMAT_ARG(long); break;
+		case ARG_LLONG:   FORMAT_ARG(long long); break;
+		case ARG_SIZE:    FORMAT_ARG(size_t); break;
+		case ARG_INTMAX:  FORMAT_ARG(intmax_t); break;
+		case ARG_PTRDIFF: FORMAT_ARG(ptrdiff_t); break;
+		case ARG_DOUBLE:  FORMAT_ARG(double); break;
+		case ARG_LDOUBLE: FORMAT_ARG(long double); break;
+		case ARG_PTR:     FORMAT_ARG(void*); break;
+		case ARG_STR:
+			res = snprintf(out + o, size - o, spec, (const char*)a);
+			a += strlen((const char*)a) + 1;
+			break;
+		default:
+			break;
+		}
+		if (res > 0)
+			o += res;
+		if (o > size - 1)
+			o = size - 1;
+	}
+	out[o] = 0;
+}
+
+
+/* eof :-) */
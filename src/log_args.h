@@ -0,0 +1,36 @@
+/* log_args.h
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRICKPICO_LOG_ARGS_H
+#define BRICKPICO_LOG_ARGS_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+/* Log message arguments packed in binary form (for queuing messages
+   so that they can be formatted later). */
+
+int log_pack_args(uint8_t *buf, size_t size, const char *format, va_list ap);
+void log_format_args(char *out, size_t size, const char *format, const uint8_t *args);
+
+
+#endif /* BRICKPICO_LOG_ARGS_H */
@@ -80,7 +80,7 @@ void pico_set_system_time(long int sec);
 #define LWIP_HTTPD_SSI_RAW              1
 #define LWIP_HTTPD_SSI_MULTIPART        1
 #define LWIP_HTTPD_SSI_INCLUDE_TAG      0
-#define LWIP_HTTPD_SSI_EXTENSIONS       ".shtml", ".xml", ".json", ".csv"
+#define LWIP_HTTPD_SSI_EXTENSIONS       ".shtml", ".xml", ".json", ".csv", ".txt"
 
 #if TLS_SUPPORT
 #define HTTPD_ENABLE_HTTPS              1
@@ -19,6 +19,8 @@
    along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#define LOG_SUBSYS MQTT
+
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -39,6 +41,9 @@
 #ifdef WIFI_SUPPORT
 
 #define MQTT_CMD_MAX_LEN 100
+#define MQTT_RESP_MAX_LEN 512
+#define MQTT_RESP_MAX_PARTS 8   /* (limited by MQTT_OUTPUT_RINGBUF_SIZE) */
+#define MQTT_CMD_QUEUE_LEN 32  /* must be power of 2 */
 
 
 enum mqtt_topic_types {
@@ -56,6 +61,26 @@ struct mqtt_topic_name {
 	const char* str;
 };
 
+struct mqtt_scpi_cmd {
+	char cmd[MQTT_CMD_MAX_LEN + 1];
+	uint64_t t_queued;
+};
+
+/* Single producer (lwIP callback) / single consumer (main loop) command queue. */
+struct mqtt_cmd_queue {
+	struct mqtt_scpi_cmd cmds[MQTT_CMD_QUEUE_LEN];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+
+	/* statistics */
+	uint32_t max_depth;
+	uint32_t queued;
+	uint32_t processed;
+	uint32_t dropped;
+	uint64_t total_dwell;
+	uint64_t max_dwell;
+};
+
 
 mqtt_client_t *mqtt_client = NULL;
 mqtt_connection_status_t mqtt_client_status = MQTT_CONNECT_DISCONNECTED;
@@ -67,8 +92,7 @@ int mqtt_qos = 1;
 char mqtt_ha_birth_topic[64 + 1];
 char mqtt_ha_base_topic[64 + 1];
 char mqtt_ha_cmd_base_topic[64 + 10 + 1];
-char mqtt_scpi_cmd[MQTT_CMD_MAX_LEN + 1];
-bool mqtt_scpi_cmd_queued = false;
+static struct mqtt_cmd_queue mqtt_cmd_queue;
 u16_t mqtt_reconnect = 0;
 u16_t mqtt_ha_discovery = 0;
 
@@ -77,7 +101,6 @@ static absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(t_mqtt_ha_discovery, 0);
 static absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(publish_status_t, 0);
 static absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(publish_pwm_t, 0);
 static absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(publish_temp_t, 0);
-static absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(command_t, 0);
 
 
 
@@ -142,7 +165,11 @@ static int mqtt_publish_message(const char *topic, const char *buf, u16_t buf_le
 	return err;
 }
 
-static char* json_response_message(const char *cmd, int result, const char *msg)
+/* Generate response message. Long responses are sent in multiple parts,
+   'part' is the part number (0 = response fits in one message) and
+   msg is NULL for all but the last part. */
+static char* json_response_message(const char *cmd, int result, const char *msg,
+				const char *resp, uint part)
 {
 	char *buf;
 	cJSON *json;
@@ -151,8 +178,16 @@ static char* json_response_message(const char *cmd, int result, const char *msg)
 		goto panic;
 
 	cJSON_AddItemToObject(json, "command", cJSON_CreateString(cmd));
-	cJSON_AddItemToObject(json, "result", cJSON_CreateString(result == 0 ? "OK" : "ERROR"));
-	cJSON_AddItemToObject(json, "message", cJSON_CreateString(msg));
+	if (msg) {
+		cJSON_AddItemToObject(json, "result", cJSON_CreateString(result == 0 ? "OK" : "ERROR"));
+		cJSON_AddItemToObject(json, "message", cJSON_CreateString(msg));
+	}
+	if (part > 0) {
+		cJSON_AddItemToObject(json, "part", cJSON_CreateNumber(part));
+		cJSON_AddItemToObject(json, "more", cJSON_CreateBool(msg ? false : true));
+	}
+	if (resp && strlen(resp) > 0)
+		cJSON_AddItemToObject(json, "response", cJSON_CreateString(resp));
 
 	if (!(buf = cJSON_Print(json)))
 		goto panic;
@@ -165,15 +200,16 @@ panic:
 	return NULL;
 }
 
-static void send_mqtt_command_response(const char *cmd, int result, const char *msg)
+static void send_mqtt_command_response(const char *cmd, int result, const char *msg,
+					const char *resp, uint part)
 {
 	char *buf = NULL;
 
-	if (!cmd || !msg || !mqtt_client || strlen(cfg->mqtt_resp_topic) < 1)
+	if (!cmd || !mqtt_client || strlen(cfg->mqtt_resp_topic) < 1)
 		return;
 
 	/* Generate status message */
-	if (!(buf = json_response_message(cmd, result, msg))) {
+	if (!(buf = json_response_message(cmd, result, msg, resp, part))) {
 		log_msg(LOG_WARNING,"json_response_message(): failed");
 		return;
 	}
@@ -351,13 +387,25 @@ static void mqtt_incoming_data_cb(void *arg, const u8_t *data, u16_t len, u8_t f
 		}
 	}
 
-	if (mqtt_scpi_cmd_queued) {
+	struct mqtt_cmd_queue *q = &mqtt_cmd_queue;
+	uint32_t head = q->head;
+	uint32_t depth = head - q->tail;
+
+	if (depth >= MQTT_CMD_QUEUE_LEN) {
+		q->dropped++;
 		log_msg(LOG_NOTICE, "MQTT SCPI command queue full: '%s'", cmd);
-		send_mqtt_command_response(cmd, 1, "SCPI command queue full");
+		send_mqtt_command_response(cmd, 1, "SCPI command queue full", NULL, 0);
 	} else {
+		struct mqtt_scpi_cmd *c = &q->cmds[head & (MQTT_CMD_QUEUE_LEN - 1)];
+
 		log_msg(LOG_NOTICE, "MQTT SCPI command queued: '%s'", cmd);
-		strncopy(mqtt_scpi_cmd, cmd, sizeof(mqtt_scpi_cmd));
-		mqtt_scpi_cmd_queued = true;
+		strncopy(c->cmd, cmd, sizeof(c->cmd));
+		c->t_queued = to_us_since_boot(get_absolute_time());
+		__compiler_memory_barrier();
+		q->head = head + 1;
+		q->queued++;
+		if (++depth > q->max_depth)
+			q->max_depth = depth;
 	}
 
 }
@@ -556,7 +604,7 @@ void brickpico_setup_mqtt_client()
 	mqtt_ha_birth_topic[0] = 0;
 	mqtt_ha_base_topic[0] = 0;
 	mqtt_ha_cmd_base_topic[0] = 0;
-	mqtt_scpi_cmd[0] = 0;
+	memset(&mqtt_cmd_queue, 0, sizeof(mqtt_cmd_queue));
 
 	cyw43_arch_lwip_begin();
 	mqtt_client = mqtt_client_new();
@@ -679,7 +727,7 @@ static char* json_ha_discovery_message()
 		goto panic;
 	cJSON_AddItemToObject(o, "temp_int0", c);
 	for (int i = 1; i <= OUTPUT_COUNT; i++) {
-		if (!(c = brickpico_ha_component("out", i, cfg->mqtt_pwm_mask & (1 << (i -1)))))
+		if (!(c = brickpico_ha_component("out", i, cfg->mqtt_pwm_mask & (1UL << (i - 1)))))
 			goto panic;
 		snprintf(tmp, sizeof(tmp), "output_%d", i);
 		cJSON_AddItemToObject(o, tmp, c);
@@ -733,7 +781,7 @@ static char* json_ha_state_message()
 
 
 	for (int i = 0; i < OUTPUT_COUNT; i++) {
-		if (cfg->mqtt_pwm_mask & (1 << i)) {
+		if (cfg->mqtt_pwm_mask & (1UL << i)) {
 			snprintf(name, sizeof(name), "state%02d", i + 1);
 			cJSON_AddItemToObject(json, name, cJSON_CreateString(st->pwr[i] ? "ON" : "OFF"));
 			snprintf(name, sizeof(name), "bri%02d", i + 1);
@@ -835,7 +883,7 @@ void brickpico_mqtt_publish_duty()
 
 	if (strlen(cfg->mqtt_pwm_topic) > 0) {
 		for (int i = 0; i < OUTPUT_COUNT; i++) {
-			if (cfg->mqtt_pwm_mask & (1 << i)) {
+			if (cfg->mqtt_pwm_mask & (1UL << i)) {
 				snprintf(topic, sizeof(topic), cfg->mqtt_pwm_topic, i + 1);
 				snprintf(buf, sizeof(buf), "%u", (st->pwr[i] ? st->pwm[i] : 0));
 				mqtt_publish_message(topic, buf, strlen(buf), mqtt_qos, 0,
@@ -858,31 +906,104 @@ void brickpico_mqtt_publish_temp()
 			cfg->mqtt_temp_topic);
 }
 
+struct mqtt_resp_ctx {
+	const char *cmd;
+	uint parts;
+	bool overflow;
+};
+
+/* Publish (full) response buffer as a partial response. */
+static void mqtt_resp_drain(void *ctx, const char *data, size_t len)
+{
+	struct mqtt_resp_ctx *r = (struct mqtt_resp_ctx*)ctx;
+
+	/* Leave room for the last part... */
+	if (r->parts >= MQTT_RESP_MAX_PARTS - 1) {
+		r->overflow = true;
+		return;
+	}
+	r->parts++;
+	send_mqtt_command_response(r->cmd, 0, NULL, data, r->parts);
+}
+
 void brickpico_mqtt_scpi_command()
 {
 	struct brickpico_state *st = brickpico_state;
+	struct mqtt_cmd_queue *q = &mqtt_cmd_queue;
+	static char resp_buf[MQTT_RESP_MAX_LEN + 1];
+	struct cmd_response resp;
+	struct mqtt_resp_ctx rctx;
 	char cmd[MQTT_CMD_MAX_LEN + 1];
+	const char *c;
+	uint64_t dwell;
 	int res;
+	int count = 0;
 
-	if (!mqtt_client || !mqtt_scpi_cmd_queued)
+	if (!mqtt_client)
 		return;
 
-	strncopy(cmd, mqtt_scpi_cmd, sizeof(cmd));
-	process_command(st, (struct brickpico_config *)cfg, cmd);
-	if ((res = last_command_status()) == 0) {
-		log_msg(LOG_INFO, "MQTT SCPI command successfull: '%s'", mqtt_scpi_cmd);
-		send_mqtt_command_response(mqtt_scpi_cmd, res, "SCPI command successfull");
-	} else {
-		log_msg(LOG_NOTICE, "MQTT SCPI command failed: '%s' (%d)", mqtt_scpi_cmd, res);
-		if (res == -113)
-			send_mqtt_command_response(mqtt_scpi_cmd, res, "SCPI unknown command");
-		else
-			send_mqtt_command_response(mqtt_scpi_cmd, res, "SCPI command failed");
+	/* Process all queued commands */
+	while (q->tail != q->head) {
+		struct mqtt_scpi_cmd *e = &q->cmds[q->tail & (MQTT_CMD_QUEUE_LEN - 1)];
+
+		c = e->cmd;
+		dwell = to_us_since_boot(get_absolute_time()) - e->t_queued;
+		q->total_dwell += dwell;
+		if (dwell > q->max_dwell)
+			q->max_dwell = dwell;
+
+		strncopy(cmd, c, sizeof(cmd));
+		rctx.cmd = c;
+		rctx.parts = 0;
+		rctx.overflow = false;
+		cmd_response_init(&resp, resp_buf, sizeof(resp_buf), mqtt_resp_drain, &rctx);
+		resp.source = CMD_SRC_MQTT;
+		process_command(st, (struct brickpico_config *)cfg, cmd, &resp);
+		if (rctx.parts > 0)
+			rctx.parts++;
+		res = last_command_status();
+		if (rctx.overflow) {
+			log_msg(LOG_NOTICE, "MQTT SCPI command response too long: '%s'", c);
+			send_mqtt_command_response(c, -1, "SCPI command response too long (truncated)",
+						resp.buf, rctx.parts);
+		} else if (res == 0) {
+			log_msg(LOG_INFO, "MQTT SCPI command successfull: '%s'", c);
+			send_mqtt_command_response(c, res, "SCPI command successfull", resp.buf,
+						rctx.parts);
+		} else {
+			log_msg(LOG_NOTICE, "MQTT SCPI command failed: '%s' (%d)", c, res);
+			if (res == -113)
+				send_mqtt_command_response(c, res, "SCPI unknown command", resp.buf,
+							rctx.parts);
+			else
+				send_mqtt_command_response(c, res, "SCPI command failed", resp.buf,
+							rctx.parts);
+		}
+
+		__compiler_memory_barrier();
+		q->tail++;
+		q->processed++;
+		count++;
 	}
 
-	mqtt_scpi_cmd[0] = 0;
-	mqtt_scpi_cmd_queued = false;
-	update_core1_state();
+	if (count > 0)
+		update_core1_state();
+}
+
+
+void brickpico_mqtt_print_stats()
+{
+	const struct mqtt_cmd_queue *q = &mqtt_cmd_queue;
+
+	cmd_printf("Commands queued:                       %lu\n", q->queued);
+	cmd_printf("Commands processed:                    %lu\n", q->processed);
+	cmd_printf("Commands dropped (queue full):         %lu\n", q->dropped);
+	cmd_printf("Queue depth (current):                 %lu\n", q->head - q->tail);
+	cmd_printf("Queue depth (max):                     %lu / %u\n", q->max_depth,
+		MQTT_CMD_QUEUE_LEN);
+	cmd_printf("Queue dwell time (avg):                %llu us\n",
+		(q->processed > 0 ? q->total_dwell / q->processed : 0));
+	cmd_printf("Queue dwell time (max):                %llu us\n", q->max_dwell);
 }
 
 
@@ -904,11 +1025,6 @@ void brickpico_mqtt_poll()
 		}
 	}
 
-	/* Check for pending SCPI command received via MQTT */
-	if (time_passed(&command_t, 500)) {
-		brickpico_mqtt_scpi_command();
-	}
-
 	/* Publish status update to MQTT status topic */
 	if (cfg->mqtt_status_interval > 0) {
 		if (time_passed(&publish_status_t, cfg->mqtt_status_interval * 1000)) {
@@ -19,6 +19,8 @@
    along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#define LOG_SUBSYS NET
+
 #include <stdio.h>
 #include <time.h>
 #include <assert.h>
@@ -114,7 +116,7 @@ const char* wifi_auth_type_name(uint32_t type)
 
 void wifi_mac()
 {
-	printf("%s\n", mac_address_str(cyw43_mac));
+	cmd_printf("%s\n", mac_address_str(cyw43_mac));
 }
 
 void wifi_link_cb(struct netif *netif)
@@ -133,7 +135,7 @@ void wifi_status_cb(struct netif *netif)
 
 	if (netif_is_up(netif) && !network_initialized) {
 		/* Network interface came up, first time... */
-		syslog_open(&syslog_server, 0, LOG_USER, wifi_hostname);
+		syslog_open(&syslog_server, 0, LOG_USER, wifi_hostname, cfg->syslog_tcp);
 		network_initialized = true;
 		t_network_initialized = get_absolute_time();
 	}
@@ -292,17 +294,17 @@ void wifi_status()
 	int res;
 
 	if (!wifi_initialized) {
-		printf("0,,,\n");
+		cmd_printf("0,,,\n");
 		return;
 	}
 
 	res = cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA);
-	printf("%d,", res);
+	cmd_printf("%d,", res);
 
 	struct netif *n = &cyw43_state.netif[CYW43_ITF_STA];
-	printf("%s,", ipaddr_ntoa(netif_ip_addr4(n)));
-	printf("%s,", ipaddr_ntoa(netif_ip_netmask4(n)));
-	printf("%s\n", ipaddr_ntoa(netif_ip_gw4(n)));
+	cmd_printf("%s,", ipaddr_ntoa(netif_ip_addr4(n)));
+	cmd_printf("%s,", ipaddr_ntoa(netif_ip_netmask4(n)));
+	cmd_printf("%s\n", ipaddr_ntoa(netif_ip_gw4(n)));
 }
 
 
@@ -350,6 +352,7 @@ void wifi_poll()
 		}
 	}
 
+	syslog_poll();
 }
 
 const char* wifi_ip()
@@ -491,6 +494,14 @@ void network_poll()
 #endif
 }
 
+void network_process_commands()
+{
+#ifdef WIFI_SUPPORT
+	if (brickpico_mqtt_client_active())
+		brickpico_mqtt_scpi_command();
+#endif
+}
+
 void network_mac()
 {
 #ifdef WIFI_SUPPORT
@@ -0,0 +1,221 @@
+/* pca9685.c
+   Copyright (C) 2024 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pca9685.h"
+
+
+/* PCA9685 registers */
+#define PCA9685_MODE1         0x00
+#define PCA9685_MODE2         0x01
+#define PCA9685_LED0_ON_L     0x06
+#define PCA9685_PRESCALE      0xfe
+
+#define MODE1_ALLCALL         0x01
+#define MODE1_SLEEP           0x10
+#define MODE1_AI              0x20  /* register auto-increment */
+#define MODE2_OUTDRV          0x04  /* totem pole outputs */
+
+#define LED_FULL              0x10  /* full on/off bit in LEDn_ON_H / LEDn_OFF_H */
+
+#define PCA9685_OSC_CLOCK     25000000
+#define PCA9685_OSC_STARTUP   500   /* oscillator start-up time (us) after clearing SLEEP */
+
+
+static int pca9685_write(pca9685_t *dev, const uint8_t *buf, size_t len)
+{
+	pca9685_bus_t *bus = dev->bus;
+	int res;
+
+	res = bus->write(bus->ctx, dev->addr, buf, len);
+
+	bus->frame_transactions++;
+	bus->transactions++;
+	if (res < 0) {
+		bus->errors++;
+		return res;
+	}
+
+	/* Count the address byte as well, since that is on the bus too. */
+	bus->frame_bytes += len + 1;
+	bus->bytes += len + 1;
+
+	return (res == (int)len ? 0 : -1);
+}
+
+static int pca9685_write_reg(pca9685_t *dev, uint8_t reg, uint8_t val)
+{
+	uint8_t buf[2] = { reg, val };
+
+	return pca9685_write(dev, buf, sizeof(buf));
+}
+
+
+void pca9685_bus_init(pca9685_bus_t *bus, pca9685_write_func_t write,
+		pca9685_delay_func_t delay_us, void *ctx)
+{
+	memset(bus, 0, sizeof(*bus));
+	bus->write = write;
+	bus->delay_us = delay_us;
+	bus->ctx = ctx;
+}
+
+
+void pca9685_frame_begin(pca9685_bus_t *bus)
+{
+	bus->frame_bytes = 0;
+	bus->frame_transactions = 0;
+}
+
+
+void pca9685_frame_end(pca9685_bus_t *bus)
+{
+	if (bus->frame_transactions == 0)
+		return;
+
+	bus->frames++;
+	bus->last_frame_bytes = bus->frame_bytes;
+	if (bus->frame_bytes > bus->max_frame_bytes)
+		bus->max_frame_bytes = bus->frame_bytes;
+}
+
+
+int pca9685_init(pca9685_t *dev, pca9685_bus_t *bus, uint8_t addr, uint32_t pwm_freq)
+{
+	uint32_t prescale;
+	int i;
+
+	memset(dev, 0, sizeof(*dev));
+	dev->bus = bus;
+	dev->addr = addr;
+
+	/* Prescaler can only be changed while oscillator is off. */
+	if (pca9685_write_reg(dev, PCA9685_MODE1, MODE1_SLEEP | MODE1_AI | MODE1_ALLCALL))
+		return -1;
+
+	if (pwm_freq < 24)
+		pwm_freq = 24;
+	prescale = (PCA9685_OSC_CLOCK + (2048 * pwm_freq)) / (4096 * pwm_freq) - 1;
+	if (prescale < 3)
+		prescale = 3;
+	else if (prescale > 255)
+		prescale = 255;
+
+	if (pca9685_write_reg(dev, PCA9685_PRESCALE, prescale))
+		return -2;
+	if (pca9685_write_reg(dev, PCA9685_MODE2, MODE2_OUTDRV))
+		return -3;
+	if (pca9685_write_reg(dev, PCA9685_MODE1, MODE1_AI | MODE1_ALLCALL))
+		return -4;
+	if (bus->delay_us)
+		bus->delay_us(PCA9685_OSC_STARTUP);
+
+	/* Force all channels to be written on first flush. */
+	for (i = 0; i < PCA9685_CHANNELS; i++) {
+		dev->level[i] = 0;
+		dev->sent[i] = 0;
+	}
+	dev->dirty = 0xffff;
+	dev->present = 1;
+
+	return 0;
+}
+
+
+void pca9685_set_level(pca9685_t *dev, uint8_t channel, uint16_t level)
+{
+	uint16_t bit;
+
+	if (channel >= PCA9685_CHANNELS)
+		return;
+	if (level > PCA9685_LEVEL_MAX)
+		level = PCA9685_LEVEL_MAX;
+
+	bit = 1 << channel;
+	dev->level[channel] = level;
+	if (level != dev->sent[channel])
+		dev->dirty |= bit;
+	else
+		dev->dirty &= ~bit;
+}
+
+
+/* Write all changed channels to the device.
+
+   Since MODE1 has register auto-increment enabled, the span from the first
+   to the last changed channel is written as a single I2C transaction.
+   (Unchanged channels inside the span are simply rewritten with their
+   current values.)
+ */
+int pca9685_flush(pca9685_t *dev)
+{
+	uint8_t buf[1 + PCA9685_CHANNELS * 4];
+	uint8_t *p = buf;
+	int first, last, i, res;
+
+	if (!dev->present || !dev->dirty)
+		return 0;
+
+	first = 0;
+	while (!(dev->dirty & (1 << first)))
+		first++;
+	last = PCA9685_CHANNELS - 1;
+	while (!(dev->dirty & (1 << last)))
+		last--;
+
+	*p++ = PCA9685_LED0_ON_L + 4 * first;
+	for (i = first; i <= last; i++) {
+		uint16_t level = dev->level[i];
+
+		if (level >= PCA9685_LEVEL_MAX) {
+			/* ON = full on, OFF = 0 */
+			*p++ = 0;
+			*p++ = LED_FULL;
+			*p++ = 0;
+			*p++ = 0;
+		} else if (level == 0) {
+			/* OFF = full off */
+			*p++ = 0;
+			*p++ = 0;
+			*p++ = 0;
+			*p++ = LED_FULL;
+		} else {
+			*p++ = 0;
+			*p++ = 0;
+			*p++ = level & 0xff;
+			*p++ = level >> 8;
+		}
+	}
+
+	if ((res = pca9685_write(dev, buf, p - buf)))
+		return res;
+
+	for (i = first; i <= last; i++)
+		dev->sent[i] = dev->level[i];
+	dev->dirty = 0;
+
+	return 0;
+}
+
+
+/* eof :-) */
@@ -0,0 +1,76 @@
+/* pca9685.h
+   Copyright (C) 2024 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRICKPICO_PCA9685_H
+#define BRICKPICO_PCA9685_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PCA9685_CHANNELS      16
+#define PCA9685_BASE_ADDR     0x40
+#define PCA9685_LEVEL_MAX     4096   /* 4096 = fully on */
+
+
+/* I2C bus abstraction, so that the driver does not depend on the
+   Pico SDK (and can be driven against a mock bus).
+   write() must perform one complete I2C write transaction and return
+   number of bytes written (or < 0 on error). */
+typedef int (*pca9685_write_func_t)(void *ctx, uint8_t addr, const uint8_t *buf, size_t len);
+/* delay_us() is used to wait for oscillator start-up (may be NULL). */
+typedef void (*pca9685_delay_func_t)(uint32_t us);
+
+typedef struct pca9685_bus {
+	pca9685_write_func_t write;
+	pca9685_delay_func_t delay_us;
+	void *ctx;
+
+	/* Bus accounting */
+	uint32_t frame_bytes;
+	uint32_t frame_transactions;
+	uint32_t last_frame_bytes;
+	uint32_t max_frame_bytes;
+	uint64_t frames;
+	uint64_t transactions;
+	uint64_t bytes;
+	uint32_t errors;
+} pca9685_bus_t;
+
+typedef struct pca9685 {
+	pca9685_bus_t *bus;
+	uint8_t addr;
+	uint8_t present;
+	uint16_t dirty;   /* bitmask of channels that need to be written */
+	uint16_t level[PCA9685_CHANNELS];
+	uint16_t sent[PCA9685_CHANNELS];
+} pca9685_t;
+
+
+void pca9685_bus_init(pca9685_bus_t *bus, pca9685_write_func_t write,
+		pca9685_delay_func_t delay_us, void *ctx);
+void pca9685_frame_begin(pca9685_bus_t *bus);
+void pca9685_frame_end(pca9685_bus_t *bus);
+int pca9685_init(pca9685_t *dev, pca9685_bus_t *bus, uint8_t addr, uint32_t pwm_freq);
+void pca9685_set_level(pca9685_t *dev, uint8_t channel, uint16_t level);
+int pca9685_flush(pca9685_t *dev);
+
+
+#endif /* BRICKPICO_PCA9685_H */
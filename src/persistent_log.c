@@ -0,0 +1,132 @@
+/* persistent_log.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "brickpico.h"
+
+
+#define PERSISTENT_LOG_CRC_LEN 2
+#define LOG_RB_INDEX_SIZE 64
+
+static size_t log_rb_index[LOG_RB_INDEX_SIZE];
+
+
+static uint32_t persistent_log_crc()
+{
+	struct persistent_memory_block *m = persistent_mem;
+
+	return xcrc32((unsigned char*)&m->log_rb, sizeof(m->log_rb), 0);
+}
+
+bool persistent_log_valid()
+{
+	struct persistent_memory_block *m = persistent_mem;
+	var_ringbuffer_t *rb = &m->log_rb;
+
+	if (persistent_log_crc() != m->log_crc32)
+		return false;
+	if (rb->buf != m->log || rb->size != sizeof(m->log))
+		return false;
+	if (rb->head >= rb->size || rb->tail > rb->size || rb->free > rb->size)
+		return false;
+
+	return true;
+}
+
+void init_persistent_log()
+{
+	struct persistent_memory_block *m = persistent_mem;
+
+	memset(&m->log_rb, 0, sizeof(m->log_rb));
+	var_ringbuffer_init(&m->log_rb, m->log, sizeof(m->log));
+	m->log_crc32 = persistent_log_crc();
+}
+
+/* (Re)build index of most recent log records (index itself lives in
+   normal RAM, so it must be rebuilt after every reset). */
+void index_persistent_log()
+{
+	struct persistent_memory_block *m = persistent_mem;
+
+	m->log_rb.reserve_len = 0;
+	var_ringbuffer_set_index(&m->log_rb, log_rb_index, LOG_RB_INDEX_SIZE);
+	m->log_crc32 = persistent_log_crc();
+}
+
+/* Reserve space for log message (up to 'len' bytes including
+   terminating NUL) in persistent memory log buffer, so that message
+   can be formatted directly into the buffer.
+   Each record is stored as: <message> <NUL> <CRC-16>, so only
+   the record itself and ring buffer metadata need checksumming.
+   (caller must hold pmem_mutex until persistent_log_commit()) */
+char* persistent_log_reserve(size_t len)
+{
+	struct persistent_memory_block *m = persistent_mem;
+
+	return (char*)var_ringbuffer_reserve(&m->log_rb, len + PERSISTENT_LOG_CRC_LEN, true);
+}
+
+int persistent_log_commit(char *msg)
+{
+	struct persistent_memory_block *m = persistent_mem;
+	size_t len = strlen(msg) + 1;
+	uint16_t crc;
+	int res;
+
+	crc = xcrc32((unsigned char*)msg, len, 0);
+	msg[len++] = crc & 0xff;
+	msg[len++] = crc >> 8;
+
+	res = var_ringbuffer_commit(&m->log_rb, len);
+	m->log_crc32 = persistent_log_crc();
+
+	return res;
+}
+
+/* Get next log record from persistent memory log buffer (in place).
+   Records are only validated when read, returns -5 if record is corrupt. */
+int persistent_log_next(var_ringbuffer_iter_t *iter, const char **msg)
+{
+	const uint8_t *p;
+	uint16_t crc;
+	int len;
+
+	len = var_ringbuffer_iter_next(iter, &p);
+	if (len < 1)
+		return len;
+	if (len < PERSISTENT_LOG_CRC_LEN + 1)
+		return -5;
+
+	len -= PERSISTENT_LOG_CRC_LEN;
+	crc = p[len] | (p[len + 1] << 8);
+	if (crc != (xcrc32(p, len, 0) & 0xffff) || p[len - 1] != 0)
+		return -5;
+	*msg = (const char*)p;
+
+	return len;
+}
+
+
+/* eof :-) */
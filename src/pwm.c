@@ -19,6 +19,8 @@
    along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#define LOG_SUBSYS PWM
+
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
@@ -26,6 +28,7 @@
 #include "hardware/gpio.h"
 #include "hardware/pwm.h"
 #include "hardware/clocks.h"
+#include "hardware/i2c.h"
 
 #include "lightness.h"
 #include "brickpico.h"
@@ -60,6 +63,72 @@ uint8_t output_gpio_pwm_map[OUTPUT_MAX_COUNT] = {
 static uint16_t pwm_out_top = 0;
 static uint16_t pwm_lightness_map[LIGHTNESS_MAX + 1];
 
+#if PCA9685_COUNT > 0
+#define EXPANDER_I2C (I2C_HW == 1 ? i2c0 : i2c1)
+#define EXPANDER_I2C_TIMEOUT 2000
+
+static pca9685_bus_t expander_bus;
+static pca9685_t expanders[PCA9685_COUNT];
+static uint16_t expander_lightness_map[LIGHTNESS_MAX + 1];
+static uint32_t expander_busy = 0;
+
+
+static int expander_i2c_write(void *ctx, uint8_t addr, const uint8_t *buf, size_t len)
+{
+	return i2c_write_timeout_us((i2c_inst_t*)ctx, addr, buf, len, false,
+				EXPANDER_I2C_TIMEOUT);
+}
+
+static void expander_delay_us(uint32_t us)
+{
+	sleep_us(us);
+}
+
+
+/**
+ * Set level of an output on PCA9685 expander.
+ * Level change is only sent to the expander on next flush_pwm_outputs() call.
+ *
+ * @param out Output port (on the expanders).
+ * @param level PWM level (0..4096).
+ */
+static void set_expander_level(uint out, uint16_t level)
+{
+	assert(out < EXPANDER_OUTPUT_COUNT);
+	pca9685_set_level(&expanders[out / PCA9685_CHANNELS], out % PCA9685_CHANNELS, level);
+}
+
+
+/**
+ * Initialize PCA9685 expanders.
+ *
+ * @param pwm_freq PWM frequency.
+ */
+static void setup_pwm_expanders(uint pwm_freq)
+{
+	i2c_inst_t *i2c = EXPANDER_I2C;
+	int i, res;
+
+	log_msg(LOG_NOTICE, "Initializing PCA9685 expanders...");
+
+	/* (I2C bus has been initialized by i2c_bus_init()) */
+	mutex_enter_blocking(i2c_mutex);
+	pca9685_bus_init(&expander_bus, expander_i2c_write, expander_delay_us, i2c);
+	for (i = 0; i < PCA9685_COUNT; i++) {
+		uint8_t addr = PCA9685_BASE_ADDR + i;
+
+		if ((res = pca9685_init(&expanders[i], &expander_bus, addr, pwm_freq))) {
+			log_msg(LOG_ERR, "PCA9685 not found at 0x%02x (%d)", addr, res);
+			continue;
+		}
+		log_msg(LOG_NOTICE, "PCA9685 at 0x%02x: outputs %d-%d", addr,
+			PWM_OUTPUT_COUNT + i * PCA9685_CHANNELS + 1,
+			PWM_OUTPUT_COUNT + (i + 1) * PCA9685_CHANNELS);
+	}
+	mutex_exit(i2c_mutex);
+}
+#endif
+
 
 /**
  * Set PMW output signal duty cycle.
@@ -72,6 +141,13 @@ void set_pwm_duty_cycle(uint out, float duty)
 	uint level, pin;
 
 	assert(out < OUTPUT_COUNT);
+#if PCA9685_COUNT > 0
+	if (out >= PWM_OUTPUT_COUNT) {
+		set_expander_level(out - PWM_OUTPUT_COUNT,
+				(duty > 0.0 ? duty * PCA9685_LEVEL_MAX / 100 : 0));
+		return;
+	}
+#endif
 	pin = output_gpio_pwm_map[out];
 	if (duty >= 100.0) {
 		level = pwm_out_top + 1;
@@ -96,6 +172,13 @@ void set_pwm_lightness(uint out, uint lightness)
 	uint16_t level;
 
 	assert(out < OUTPUT_COUNT);
+#if PCA9685_COUNT > 0
+	if (out >= PWM_OUTPUT_COUNT) {
+		set_expander_level(out - PWM_OUTPUT_COUNT,
+				expander_lightness_map[lightness > LIGHTNESS_MAX ? LIGHTNESS_MAX : lightness]);
+		return;
+	}
+#endif
 	pin = output_gpio_pwm_map[out];
 	level = pwm_lightness_map[lightness > LIGHTNESS_MAX ? LIGHTNESS_MAX : lightness];
 
@@ -119,6 +202,9 @@ static void calculate_pwm_lightness(uint16_t pwm_wrap, double gamma)
 		else
 			l = cie_1931_lightness_inverse(i, LIGHTNESS_MAX);
 		pwm_lightness_map[i] = (pwm_wrap * l) / LIGHTNESS_MAX;
+#if PCA9685_COUNT > 0
+		expander_lightness_map[i] = (PCA9685_LEVEL_MAX * l) / LIGHTNESS_MAX;
+#endif
 #if 0
 		double l_r;
 		if (gamma >= 1.0)
@@ -188,7 +274,7 @@ void setup_pwm_outputs()
 
 	/* Configure PWM outputs */
 
-	for (i = 0; i < OUTPUT_COUNT; i=i+2) {
+	for (i = 0; i < PWM_OUTPUT_COUNT; i=i+2) {
 		uint pin1 = output_gpio_pwm_map[i];
 		uint pin2 = output_gpio_pwm_map[i + 1];
 
@@ -200,6 +286,57 @@ void setup_pwm_outputs()
 		pwm_init(slice_num, &config, true);
 	}
 
+#if PCA9685_COUNT > 0
+	setup_pwm_expanders(pwm_freq);
+#endif
+}
+
+
+/**
+ * Send pending output level changes to the PCA9685 expanders.
+ * All changed channels on an expander are written in one I2C transaction.
+ * (Outputs using Pico PWM hardware take effect immediately.)
+ */
+void flush_pwm_outputs()
+{
+#if PCA9685_COUNT > 0
+	int i;
+
+	/* I2C bus is shared with the OLED display, if it is busy try again on next frame... */
+	if (!mutex_enter_timeout_us(i2c_mutex, 500)) {
+		expander_busy++;
+		return;
+	}
+	pca9685_frame_begin(&expander_bus);
+	for (i = 0; i < PCA9685_COUNT; i++) {
+		pca9685_flush(&expanders[i]);
+	}
+	pca9685_frame_end(&expander_bus);
+	mutex_exit(i2c_mutex);
+#endif
+}
+
+
+void print_pwm_expander_stats()
+{
+#if PCA9685_COUNT > 0
+	const pca9685_bus_t *bus = &expander_bus;
+	int i;
+
+	for (i = 0; i < PCA9685_COUNT; i++) {
+		cmd_printf("PCA9685 at 0x%02x:                      %s\n",
+			expanders[i].addr, (expanders[i].present ? "OK" : "not found"));
+	}
+	cmd_printf("Frames sent:                           %llu\n", bus->frames);
+	cmd_printf("I2C transactions:                      %llu\n", bus->transactions);
+	cmd_printf("I2C bytes:                             %llu\n", bus->bytes);
+	cmd_printf("I2C bytes/frame (last):                %lu\n", bus->last_frame_bytes);
+	cmd_printf("I2C bytes/frame (max):                 %lu\n", bus->max_frame_bytes);
+	cmd_printf("I2C errors:                            %lu\n", bus->errors);
+	cmd_printf("Frames delayed (bus busy):             %lu\n", expander_busy);
+#else
+	cmd_printf("No PCA9685 expander support\n");
+#endif
 }
 
 
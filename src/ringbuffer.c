@@ -51,6 +51,9 @@ int u8_ringbuffer_init(u8_ringbuffer_t *rb, uint8_t *buf, size_t size)
 	rb->head = 0;
 	rb->tail = 0;
 	rb->items = 0;
+	rb->index = NULL;
+	rb->index_size = 0;
+	rb->index_pos = 0;
 
 	return 0;
 }
@@ -70,11 +73,42 @@ int u8_ringbuffer_free(u8_ringbuffer_t *rb)
 	rb->head = 0;
 	rb->tail = 0;
 	rb->items = 0;
+	rb->index = NULL;
+	rb->index_size = 0;
+	rb->index_pos = 0;
 
 	return 0;
 }
 
 
+/* Copy data into ring buffer (at most two memcpy()s). */
+static void u8_copy_in(u8_ringbuffer_t *rb, size_t offset, const uint8_t *data, size_t len)
+{
+	size_t o = offset % rb->size;
+	size_t first = rb->size - o;
+
+	if (first > len)
+		first = len;
+	memcpy(rb->buf + o, data, first);
+	if (len > first)
+		memcpy(rb->buf, data + first, len - first);
+}
+
+
+/* Copy data out of ring buffer (at most two memcpy()s). */
+static void u8_copy_out(u8_ringbuffer_t *rb, size_t offset, uint8_t *ptr, size_t len)
+{
+	size_t o = offset % rb->size;
+	size_t first = rb->size - o;
+
+	if (first > len)
+		first = len;
+	memcpy(ptr, rb->buf + o, first);
+	if (len > first)
+		memcpy(ptr + first, rb->buf, len - first);
+}
+
+
 static size_t u8_next_item_offset(u8_ringbuffer_t *rb, size_t offset)
 {
 	size_t o = (offset % rb->size) + PREFIX_LEN + rb->buf[offset] + SUFFIX_LEN;
@@ -136,6 +170,8 @@ int u8_ringbuffer_remove_last_item(u8_ringbuffer_t *rb)
 	rb->tail = u8_previous_item_offset(rb, rb->tail);
 	rb->free += item_len;
 	rb->items--;
+	if (rb->index)
+		rb->index_pos = (rb->index_pos + rb->index_size - 1) % rb->index_size;
 
 	return 0;
 }
@@ -159,21 +195,18 @@ int u8_ringbuffer_add(u8_ringbuffer_t *rb, uint8_t *data, uint8_t len, bool over
 	if (rb->free < item_len)
 		return -2;
 
-	uint8_t *src = data;
 	if (rb->items > 0)
 		rb->tail = u8_next_item_offset(rb, rb->tail);
-	uint8_t *dst = rb->buf + rb->tail;
-	*dst++ = len;
-	int i = 0;
-	while (i++ < len) {
-		if (dst >= rb->buf + rb->size)
-			dst = rb->buf;
-		*dst++ = *src++;
-	}
-	*dst++ = len;
+	rb->buf[rb->tail] = len;
+	u8_copy_in(rb, rb->tail + PREFIX_LEN, data, len);
+	rb->buf[(rb->tail + PREFIX_LEN + len) % rb->size] = len;
 
 	rb->free -= len + PREFIX_LEN + SUFFIX_LEN;
 	rb->items++;
+	if (rb->index) {
+		rb->index[rb->index_pos] = rb->tail;
+		rb->index_pos = (rb->index_pos + 1) % rb->index_size;
+	}
 
 	return 0;
 }
@@ -199,14 +232,7 @@ int u8_ringbuffer_peek(u8_ringbuffer_t *rb, size_t offset, uint8_t *ptr, size_t
 	if (len > size)
 		return -4;
 
-	uint8_t *src = rb->buf + offset + PREFIX_LEN;
-	uint8_t *dst = ptr;
-	int i = 0;
-	while (i++ < len) {
-		if (src >= rb->buf + rb->size)
-			src = rb->buf;
-		*dst++ = *src++;
-	}
+	u8_copy_out(rb, offset + PREFIX_LEN, ptr, len);
 
 	if (next && offset != rb->tail)
 		*next = u8_next_item_offset(rb, offset);
@@ -237,3 +263,479 @@ int u8_ringbuffer_remove_last(u8_ringbuffer_t *rb, uint8_t *ptr, size_t size)
 }
 
 
+/* Attach index for O(1) access to (up to 'size') most recent items.
+   Index is rebuilt from current contents of the ring buffer. */
+int u8_ringbuffer_set_index(u8_ringbuffer_t *rb, size_t *index, size_t size)
+{
+	size_t o, i;
+
+	if (!rb)
+		return -1;
+
+	rb->index = NULL;
+	rb->index_size = 0;
+	rb->index_pos = 0;
+	if (!index || size < 1)
+		return 0;
+
+	o = rb->head;
+	for (i = 0; i < rb->items; i++) {
+		index[rb->index_pos] = o;
+		rb->index_pos = (rb->index_pos + 1) % size;
+		o = u8_next_item_offset(rb, o);
+	}
+	rb->index = index;
+	rb->index_size = size;
+
+	return 0;
+}
+
+
+/* Return offset of n:th most recent item (0 = last item). */
+int u8_ringbuffer_recent_offset(u8_ringbuffer_t *rb, size_t n)
+{
+	size_t o;
+
+	if (!rb)
+		return -1;
+	if (n >= rb->items)
+		return -2;
+
+	if (rb->index && n < rb->index_size)
+		return rb->index[(rb->index_pos + rb->index_size - 1 - n) % rb->index_size];
+
+	if (n >= rb->items / 2) {
+		o = rb->head;
+		for (n = rb->items - 1 - n; n > 0; n--)
+			o = u8_next_item_offset(rb, o);
+	} else {
+		o = rb->tail;
+		for (; n > 0; n--)
+			o = u8_previous_item_offset(rb, o);
+	}
+
+	return o;
+}
+
+
+void u8_ringbuffer_iter_init(u8_ringbuffer_t *rb, u8_ringbuffer_iter_t *iter)
+{
+	iter->rb = rb;
+	iter->offset = rb->head;
+	iter->remaining = rb->items;
+}
+
+
+/* Initialize iterator to return (up to) 'count' most recent items. */
+int u8_ringbuffer_iter_init_recent(u8_ringbuffer_t *rb, u8_ringbuffer_iter_t *iter, size_t count)
+{
+	int o;
+
+	u8_ringbuffer_iter_init(rb, iter);
+	if (count >= rb->items)
+		return 0;
+	if (count == 0) {
+		iter->remaining = 0;
+		return 0;
+	}
+	if ((o = u8_ringbuffer_recent_offset(rb, count - 1)) < 0)
+		return o;
+	iter->offset = o;
+	iter->remaining = count;
+
+	return 0;
+}
+
+
+/* Copy next item into 'ptr'. Returns length of the item, 0 when
+   there are no more items, or negative value on error (if item did
+   not fit into 'ptr', iterator still advances to next item). */
+int u8_ringbuffer_iter_next(u8_ringbuffer_iter_t *iter, uint8_t *ptr, size_t size)
+{
+	u8_ringbuffer_t *rb = iter->rb;
+	uint8_t len;
+
+	if (!ptr)
+		return -1;
+	if (iter->remaining < 1 || rb->items < 1)
+		return 0;
+	if (iter->offset >= rb->size)
+		return -2;
+
+	len = rb->buf[iter->offset];
+	iter->remaining--;
+	if (len > size) {
+		iter->offset = u8_next_item_offset(rb, iter->offset);
+		return -4;
+	}
+	u8_copy_out(rb, iter->offset + PREFIX_LEN, ptr, len);
+	iter->offset = u8_next_item_offset(rb, iter->offset);
+
+	return len;
+}
+
+
+
+/* var_ringbuffer_t
+
+   Records are stored as: <varint length> <data>
+
+   If record doesn't fit at the end of the buffer, a zero byte is
+   written as a "wrap marker" and the record is written at the start
+   of the buffer instead. (Record length is always at least 1, so
+   a record never starts with a zero byte.)
+*/
+
+static size_t varint_len(size_t val)
+{
+	size_t len = 1;
+
+	while (val >= 0x80) {
+		val >>= 7;
+		len++;
+	}
+	return len;
+}
+
+
+/* Write varint padded to 'len' bytes (so that length of the header
+   doesn't change if record is shorter than reserved). */
+static void varint_write(uint8_t *p, size_t val, size_t len)
+{
+	while (len-- > 1) {
+		*p++ = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+	*p = val & 0x7f;
+}
+
+
+static size_t varint_read(const uint8_t *p, size_t maxlen, size_t *val)
+{
+	size_t v = 0;
+	size_t i = 0;
+
+	while (i < maxlen && i < 5) {
+		v |= (size_t)(p[i] & 0x7f) << (7 * i);
+		if (!(p[i++] & 0x80)) {
+			*val = v;
+			return i;
+		}
+	}
+	return 0;
+}
+
+
+/* Return offset of the record (skipping wrap marker) and its total length. */
+static size_t var_item_offset(var_ringbuffer_t *rb, size_t offset, size_t *hdr_len, size_t *len)
+{
+	if (offset >= rb->size || rb->buf[offset] == 0)
+		offset = 0;
+	*hdr_len = varint_read(rb->buf + offset, rb->size - offset, len);
+	if (*hdr_len == 0 || offset + *hdr_len + *len > rb->size) {
+		/* corrupt record */
+		*hdr_len = 1;
+		*len = rb->size - offset - 1;
+	}
+	return offset;
+}
+
+
+static size_t var_next_item_offset(var_ringbuffer_t *rb, size_t offset)
+{
+	size_t hdr_len, len;
+
+	offset = var_item_offset(rb, offset, &hdr_len, &len);
+	offset += hdr_len + len;
+	return (offset >= rb->size ? 0 : offset);
+}
+
+
+int var_ringbuffer_init(var_ringbuffer_t *rb, uint8_t *buf, size_t size)
+{
+	if (!rb)
+		return -1;
+
+	if (!buf) {
+		if (!(rb->buf = malloc(size)))
+			return -2;
+		rb->free_buf = true;
+	} else {
+		rb->buf = buf;
+		rb->free_buf = false;
+	}
+
+	rb->size = size;
+	rb->free = size;
+	rb->head = 0;
+	rb->tail = 0;
+	rb->items = 0;
+	rb->seq = 0;
+	rb->reserve_offset = 0;
+	rb->reserve_len = 0;
+	rb->index = NULL;
+	rb->index_size = 0;
+	rb->index_pos = 0;
+
+	return 0;
+}
+
+
+int var_ringbuffer_free(var_ringbuffer_t *rb)
+{
+	if (!rb)
+		return -1;
+
+	if (rb->free_buf && rb->buf)
+		free(rb->buf);
+
+	memset(rb, 0, sizeof(*rb));
+
+	return 0;
+}
+
+
+int var_ringbuffer_remove_first_item(var_ringbuffer_t *rb)
+{
+	size_t o, hdr_len, len;
+
+	if (!rb)
+		return -1;
+	if (rb->items < 1)
+		return -2;
+	if (rb->head >= rb->size)
+		return -3;
+
+	o = var_item_offset(rb, rb->head, &hdr_len, &len);
+	if (o != rb->head)
+		rb->free += rb->size - rb->head;  /* space lost at end of buffer */
+	rb->free += hdr_len + len;
+	rb->head = o + hdr_len + len;
+	rb->items--;
+
+	if (rb->items == 0) {
+		rb->head = rb->tail = 0;
+		rb->free = rb->size;
+	} else if (rb->head >= rb->size) {
+		rb->head = 0;
+	}
+
+	return 0;
+}
+
+
+/* Find offset where record of 'need' bytes fits. */
+static int var_find_space(var_ringbuffer_t *rb, size_t need, size_t *offset)
+{
+	if (rb->items == 0) {
+		*offset = 0;
+		return 0;
+	}
+	if (rb->tail > rb->head) {
+		if (rb->size - rb->tail >= need) {
+			*offset = rb->tail;
+			return 0;
+		}
+		if (rb->head >= need) {
+			*offset = 0;
+			return 0;
+		}
+	} else if (rb->head - rb->tail >= need) {
+		*offset = rb->tail;
+		return 0;
+	}
+	return -1;
+}
+
+
+/* Reserve space for a record of (up to) 'len' bytes. Returns pointer
+   to where the record data should be written, record is added
+   to the buffer when var_ringbuffer_commit() is called. */
+uint8_t* var_ringbuffer_reserve(var_ringbuffer_t *rb, size_t len, bool overwrite)
+{
+	size_t need, o;
+
+	if (!rb || len < 1)
+		return NULL;
+	need = varint_len(len) + len;
+	if (need > rb->size)
+		return NULL;
+
+	while (var_find_space(rb, need, &o)) {
+		if (!overwrite || var_ringbuffer_remove_first_item(rb))
+			return NULL;
+	}
+
+	rb->reserve_offset = o;
+	rb->reserve_len = len;
+
+	return rb->buf + o + varint_len(len);
+}
+
+
+/* Add previously reserved record into the buffer, 'len' must not exceed
+   the reserved length (0 = cancel reservation). */
+int var_ringbuffer_commit(var_ringbuffer_t *rb, size_t len)
+{
+	size_t o, hdr_len;
+
+	if (!rb)
+		return -1;
+	if (rb->reserve_len < 1 || len > rb->reserve_len)
+		return -2;
+
+	o = rb->reserve_offset;
+	hdr_len = varint_len(rb->reserve_len);
+	rb->reserve_len = 0;
+	if (len < 1)
+		return 0;
+
+	if (rb->items > 0 && o == 0 && rb->tail > rb->head) {
+		/* wrap around */
+		if (rb->tail < rb->size)
+			rb->buf[rb->tail] = 0;
+		rb->free -= rb->size - rb->tail;
+	}
+	varint_write(rb->buf + o, len, hdr_len);
+	rb->tail = o + hdr_len + len;
+	rb->free -= hdr_len + len;
+	rb->items++;
+	rb->seq++;
+
+	if (rb->index) {
+		rb->index[rb->index_pos] = o;
+		rb->index_pos = (rb->index_pos + 1) % rb->index_size;
+	}
+
+	return 0;
+}
+
+
+int var_ringbuffer_add(var_ringbuffer_t *rb, const uint8_t *data, size_t len, bool overwrite)
+{
+	uint8_t *p;
+
+	if (!data)
+		return -1;
+	if (!(p = var_ringbuffer_reserve(rb, len, overwrite)))
+		return -2;
+	memcpy(p, data, len);
+
+	return var_ringbuffer_commit(rb, len);
+}
+
+
+/* Attach index for O(1) access to (up to 'size') most recent items. */
+int var_ringbuffer_set_index(var_ringbuffer_t *rb, size_t *index, size_t size)
+{
+	size_t o, i, hdr_len, len;
+
+	if (!rb)
+		return -1;
+
+	rb->index = NULL;
+	rb->index_size = 0;
+	rb->index_pos = 0;
+	if (!index || size < 1)
+		return 0;
+
+	o = rb->head;
+	for (i = 0; i < rb->items; i++) {
+		o = var_item_offset(rb, o, &hdr_len, &len);
+		index[rb->index_pos] = o;
+		rb->index_pos = (rb->index_pos + 1) % size;
+		o = var_next_item_offset(rb, o);
+	}
+	rb->index = index;
+	rb->index_size = size;
+
+	return 0;
+}
+
+
+/* Return offset of n:th most recent item (0 = last item). */
+int var_ringbuffer_recent_offset(var_ringbuffer_t *rb, size_t n)
+{
+	size_t o, hdr_len, len;
+
+	if (!rb)
+		return -1;
+	if (n >= rb->items)
+		return -2;
+
+	if (rb->index && n < rb->index_size)
+		return rb->index[(rb->index_pos + rb->index_size - 1 - n) % rb->index_size];
+
+	o = rb->head;
+	for (n = rb->items - 1 - n; n > 0; n--)
+		o = var_next_item_offset(rb, o);
+
+	return var_item_offset(rb, o, &hdr_len, &len);
+}
+
+
+void var_ringbuffer_iter_init(var_ringbuffer_t *rb, var_ringbuffer_iter_t *iter)
+{
+	iter->rb = rb;
+	iter->offset = rb->head;
+	iter->remaining = rb->items;
+}
+
+
+int var_ringbuffer_iter_init_recent(var_ringbuffer_t *rb, var_ringbuffer_iter_t *iter, size_t count)
+{
+	int o;
+
+	var_ringbuffer_iter_init(rb, iter);
+	if (count >= rb->items)
+		return 0;
+	if (count == 0) {
+		iter->remaining = 0;
+		return 0;
+	}
+	if ((o = var_ringbuffer_recent_offset(rb, count - 1)) < 0)
+		return o;
+	iter->offset = o;
+	iter->remaining = count;
+
+	return 0;
+}
+
+
+/* Initialize iterator to start from item with sequence number 'seq' (or from
+   oldest item, if 'seq' is not in the buffer anymore). If 'seq' is newer than
+   any item in the buffer, iterator returns no items. Returns sequence number
+   of the first item iterator returns. */
+uint32_t var_ringbuffer_iter_init_seq(var_ringbuffer_t *rb, var_ringbuffer_iter_t *iter, uint32_t seq)
+{
+	uint32_t first = rb->seq - rb->items;
+
+	if ((int32_t)(seq - rb->seq) > 0)
+		seq = rb->seq;
+	else if (seq - first > rb->items)
+		seq = first;
+	var_ringbuffer_iter_init_recent(rb, iter, rb->seq - seq);
+
+	return seq;
+}
+
+
+/* Return pointer to next record (in place, no copying) and its length,
+   or 0 when there are no more records. */
+int var_ringbuffer_iter_next(var_ringbuffer_iter_t *iter, const uint8_t **ptr)
+{
+	var_ringbuffer_t *rb = iter->rb;
+	size_t o, hdr_len, len;
+
+	if (!ptr)
+		return -1;
+	if (iter->remaining < 1 || rb->items < 1)
+		return 0;
+
+	o = var_item_offset(rb, iter->offset, &hdr_len, &len);
+	*ptr = rb->buf + o + hdr_len;
+	iter->offset = o + hdr_len + len;
+	iter->remaining--;
+
+	return len;
+}
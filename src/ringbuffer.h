@@ -33,8 +33,41 @@ typedef struct u8_ringbuffer {
 	size_t head;
 	size_t tail;
 	size_t items;
+	size_t *index;       /* optional offsets of most recent items */
+	size_t index_size;
+	size_t index_pos;
 } u8_ringbuffer_t;
 
+typedef struct u8_ringbuffer_iter {
+	u8_ringbuffer_t *rb;
+	size_t offset;
+	size_t remaining;
+} u8_ringbuffer_iter_t;
+
+/* Ring buffer with variable length (varint) record lengths.
+   Records are always stored contiguously (never wrap around end of
+   buffer), so they can be formatted in place using reserve/commit. */
+typedef struct var_ringbuffer {
+	uint8_t *buf;
+	bool free_buf;
+	size_t size;
+	size_t free;
+	size_t head;
+	size_t tail;
+	size_t items;
+	uint32_t seq;        /* sequence number of next item (items added) */
+	size_t reserve_offset;
+	size_t reserve_len;  /* pending reservation (0 = none) */
+	size_t *index;       /* optional offsets of most recent items */
+	size_t index_size;
+	size_t index_pos;
+} var_ringbuffer_t;
+
+typedef struct var_ringbuffer_iter {
+	var_ringbuffer_t *rb;
+	size_t offset;
+	size_t remaining;
+} var_ringbuffer_iter_t;
 
 
 int u8_ringbuffer_init(u8_ringbuffer_t *rb, uint8_t *buf, size_t size);
@@ -45,6 +78,24 @@ int u8_ringbuffer_add(u8_ringbuffer_t *rb, uint8_t *data, uint8_t len, bool over
 int u8_ringbuffer_peek(u8_ringbuffer_t *rb, size_t offset, uint8_t *ptr, size_t size, int *next, int *prev);
 int u8_ringbuffer_remove_first(u8_ringbuffer_t *rb, uint8_t *ptr, size_t size);
 int u8_ringbuffer_remove_last(u8_ringbuffer_t *rb, uint8_t *ptr, size_t size);
+int u8_ringbuffer_set_index(u8_ringbuffer_t *rb, size_t *index, size_t size);
+int u8_ringbuffer_recent_offset(u8_ringbuffer_t *rb, size_t n);
+void u8_ringbuffer_iter_init(u8_ringbuffer_t *rb, u8_ringbuffer_iter_t *iter);
+int u8_ringbuffer_iter_init_recent(u8_ringbuffer_t *rb, u8_ringbuffer_iter_t *iter, size_t count);
+int u8_ringbuffer_iter_next(u8_ringbuffer_iter_t *iter, uint8_t *ptr, size_t size);
+
+int var_ringbuffer_init(var_ringbuffer_t *rb, uint8_t *buf, size_t size);
+int var_ringbuffer_free(var_ringbuffer_t *rb);
+int var_ringbuffer_remove_first_item(var_ringbuffer_t *rb);
+uint8_t* var_ringbuffer_reserve(var_ringbuffer_t *rb, size_t len, bool overwrite);
+int var_ringbuffer_commit(var_ringbuffer_t *rb, size_t len);
+int var_ringbuffer_add(var_ringbuffer_t *rb, const uint8_t *data, size_t len, bool overwrite);
+int var_ringbuffer_set_index(var_ringbuffer_t *rb, size_t *index, size_t size);
+int var_ringbuffer_recent_offset(var_ringbuffer_t *rb, size_t n);
+void var_ringbuffer_iter_init(var_ringbuffer_t *rb, var_ringbuffer_iter_t *iter);
+int var_ringbuffer_iter_init_recent(var_ringbuffer_t *rb, var_ringbuffer_iter_t *iter, size_t count);
+uint32_t var_ringbuffer_iter_init_seq(var_ringbuffer_t *rb, var_ringbuffer_iter_t *iter, uint32_t seq);
+int var_ringbuffer_iter_next(var_ringbuffer_iter_t *iter, const uint8_t **ptr);
 
 
 #endif /* BRICKPICO_RINGBUFFER_H */
@@ -19,6 +19,8 @@
    along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#define LOG_SUBSYS NET
+
 #include <stdio.h>
 #include <stdarg.h>
 #include <time.h>
@@ -28,10 +30,33 @@
 #include "pico/cyw43_arch.h"
 #include "lwip/pbuf.h"
 #include "lwip/udp.h"
+#include "lwip/tcp.h"
+#include "lwip/netif.h"
 
 #include "brickpico.h"
 #include "syslog.h"
+#include "syslog_frame.h"
+
+
+/* Syslog messages are not sent immediately, but queued into a ring
+   buffer and sent from syslog_poll(). Identical consecutive messages
+   are coalesced ("last message repeated N times") and sending is rate
+   limited using token bucket. If queue fills up, oldest messages
+   are dropped.
+
+   Messages are kept in the queue while network is down. With TCP
+   transport (RFC 6587 octet-counting framing) messages are removed
+   from the queue only after server has acknowledged them, so messages
+   are not lost if connection drops (some may be sent twice though).
 
+   Queue record format and framing are in syslog_frame.c.
+ */
+
+enum syslog_tcp_states {
+	SYSLOG_TCP_CLOSED = 0,
+	SYSLOG_TCP_CONNECTING,
+	SYSLOG_TCP_CONNECTED,
+};
 
 typedef struct syslog_t_ {
 	ip_addr_t server_addr;
@@ -39,18 +64,47 @@ typedef struct syslog_t_ {
 	int facility;
 	char *hostname;
 	struct udp_pcb *pcb;
+	var_ringbuffer_t queue;
+	uint32_t tokens;              /* in 1/1000 of a message */
+	absolute_time_t t_tokens;
+	uint32_t last_crc;            /* last queued message */
+	int last_severity;
+	uint32_t repeat;
+	absolute_time_t t_repeat;
+	/* TCP transport */
+	bool tcp;
+	struct tcp_pcb *tcp_pcb;
+	enum syslog_tcp_states tcp_state;
+	absolute_time_t t_tcp_connect;
+	syslog_inflight_t inflight;
+	struct syslog_stats stats;
 } syslog_t;
 
 static syslog_t *syslog = NULL;
 
 
-syslog_t* syslog_init(const ip_addr_t *ipaddr, u16_t port)
+syslog_t* syslog_init(const ip_addr_t *ipaddr, u16_t port, bool tcp)
 {
 	syslog_t *ctx = calloc(1, sizeof(syslog_t));
 	if (!ctx) {
 		printf("syslog_init(): not enough memory!\n");
 		return NULL;
 	}
+	if (var_ringbuffer_init(&ctx->queue, NULL, SYSLOG_QUEUE_SIZE)) {
+		printf("syslog_init(): not enough memory for queue!\n");
+		free(ctx);
+		return NULL;
+	}
+	ctx->tokens = SYSLOG_RATE_BURST * 1000;
+	ctx->t_tokens = get_absolute_time();
+	ctx->server_addr = *ipaddr;
+	ctx->port = (port > 0 ? port : SYSLOG_DEFAULT_PORT);
+	ctx->tcp = tcp;
+	ctx->tcp_state = SYSLOG_TCP_CLOSED;
+
+	/* TCP connection is opened from syslog_poll() */
+	if (tcp)
+		return ctx;
 
 	cyw43_arch_lwip_begin();
 
@@ -59,8 +113,6 @@ syslog_t* syslog_init(const ip_addr_t *ipaddr, u16_t port)
 		printf("syslog_init(): failed to create pcb\n");
 		goto error;
 	}
-	ctx->server_addr = *ipaddr;
-	ctx->port = (port > 0 ? port : SYSLOG_DEFAULT_PORT);
 
 	if (udp_bind(ctx->pcb, IP_ANY_TYPE, 514) != ERR_OK) {
 		printf("syslog_init(): udb bind failed\n");
@@ -80,6 +132,7 @@ error:
 	if (ctx) {
 		if (ctx->pcb)
 			udp_remove(ctx->pcb);
+		var_ringbuffer_free(&ctx->queue);
 		free(ctx);
 	}
 	cyw43_arch_lwip_end();
@@ -87,12 +140,12 @@ error:
 }
 
 
-int syslog_open(const ip_addr_t *server, u16_t port, int facility, const char *hostname)
+int syslog_open(const ip_addr_t *server, u16_t port, int facility, const char *hostname, bool tcp)
 {
 	if (!server || !hostname)
 		return 0;
 
-	syslog = syslog_init(server, port);
+	syslog = syslog_init(server, port, tcp);
 	if (syslog) {
 		syslog->facility = facility;
 		syslog->hostname = strdup(hostname);
@@ -101,6 +154,21 @@ int syslog_open(const ip_addr_t *server, u16_t port, int facility, const char *h
 }
 
 
+static void syslog_tcp_close(syslog_t *ctx)
+{
+	if (ctx->tcp_pcb) {
+		tcp_arg(ctx->tcp_pcb, NULL);
+		tcp_err(ctx->tcp_pcb, NULL);
+		tcp_recv(ctx->tcp_pcb, NULL);
+		tcp_sent(ctx->tcp_pcb, NULL);
+		if (tcp_close(ctx->tcp_pcb) != ERR_OK)
+			tcp_abort(ctx->tcp_pcb);
+		ctx->tcp_pcb = NULL;
+	}
+	ctx->tcp_state = SYSLOG_TCP_CLOSED;
+}
+
+
 void syslog_close()
 {
 	if (!syslog)
@@ -114,55 +182,358 @@ void syslog_close()
 		udp_disconnect(syslog->pcb);
 		udp_remove(syslog->pcb);
 	};
+	syslog_tcp_close(syslog);
+	var_ringbuffer_free(&syslog->queue);
 	free(syslog);
 	syslog = NULL;
 	cyw43_arch_lwip_end();
 }
 
 
+static void syslog_enqueue(int severity, time_t t, const char *msg, size_t len)
+{
+	uint8_t *p;
+	uint32_t ts = t;
+	size_t items, dropped;
+
+	if (len > SYSLOG_MAX_MSG_LEN)
+		len = SYSLOG_MAX_MSG_LEN;
+
+	items = syslog->queue.items;
+	if (!(p = var_ringbuffer_reserve(&syslog->queue, SYSLOG_REC_HDR_LEN + len, true))) {
+		syslog->stats.dropped++;
+		return;
+	}
+
+	/* Count messages that were overwritten to make room. */
+	dropped = items - syslog->queue.items;
+	syslog->stats.dropped += dropped;
+	syslog_inflight_drop(&syslog->inflight, dropped);
+
+	p[0] = severity;
+	memcpy(p + 1, &ts, sizeof(ts));
+	memcpy(p + SYSLOG_REC_HDR_LEN, msg, len);
+	var_ringbuffer_commit(&syslog->queue, SYSLOG_REC_HDR_LEN + len);
+
+	syslog->stats.queued++;
+	if (syslog->queue.items > syslog->stats.max_depth)
+		syslog->stats.max_depth = syslog->queue.items;
+}
+
+
+static void syslog_flush_repeat()
+{
+	char msg[48];
+	time_t t;
+
+	if (syslog->repeat < 1)
+		return;
+
+	if (!rtc_get_time(&t))
+		t = 0;
+	snprintf(msg, sizeof(msg), "last message repeated %lu times", syslog->repeat);
+	syslog_enqueue(syslog->last_severity, t, msg, strlen(msg));
+	syslog->repeat = 0;
+}
+
+
 int syslog_msg(int severity, const char *format, ...)
 {
+	static char buf[SYSLOG_MAX_MSG_LEN];
 	va_list args;
-	char *buf;
-	struct tm tm;
-	uint16_t len;
+	time_t t;
+	uint32_t crc;
+	size_t len;
 
 	if (!format || !syslog)
 		return 1;
-	if (!rtc_get_tm(&tm))
+	if (!rtc_get_time(&t))
 		return 2;
-	if (!(buf = malloc(SYSLOG_MAX_MSG_LEN)))
-		return 3;
 
-	/* Build syslog 'packet' ... */
-
-	/* priority */
-	snprintf(buf, 6, "<%u>",  (syslog->facility << 3) | (severity & 0x07));
-	len = strlen(buf);
-	/* timestamp */
-	strftime(&buf[len], 18, "%b %e %T ", &tm);
-	len = strlen(buf);
-	/* hostname */
-	snprintf(&buf[len], 34, "%s ", syslog->hostname);
-	len = strlen(buf);
-	/* message */
 	va_start(args, format);
-	vsnprintf(&buf[len], sizeof(buf) - len - 1, format, args);
+	vsnprintf(buf, sizeof(buf), format, args);
 	va_end(args);
 	len = strlen(buf);
 
-	/* printf("SYSLOG: '%s'\n", buf); */
+	/* Coalesce identical consecutive messages. */
+	crc = xcrc32((unsigned char*)buf, len, 0xffffffff);
+	if (crc == syslog->last_crc && severity == syslog->last_severity) {
+		if (syslog->repeat++ == 0)
+			syslog->t_repeat = get_absolute_time();
+		syslog->stats.coalesced++;
+		return 0;
+	}
+	syslog_flush_repeat();
+	syslog->last_crc = crc;
+	syslog->last_severity = severity;
+
+	syslog_enqueue(severity, t, buf, len);
+
+	return 0;
+}
+
+
+static int syslog_udp_send(const uint8_t *rec, size_t rec_len)
+{
+	static char buf[SYSLOG_MAX_MSG_LEN + 64];
+	size_t len = syslog_format(buf, sizeof(buf), syslog->facility, syslog->hostname,
+				rec, rec_len);
+	int res = 0;
 
 	/* Send syslog (UDP) packet */
 	cyw43_arch_lwip_begin();
 	struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
 	if (p) {
 		memcpy(p->payload, buf, len);
-		udp_send(syslog->pcb, p);
+		if (udp_send(syslog->pcb, p) != ERR_OK)
+			res = 1;
 		pbuf_free(p);
+	} else {
+		res = 2;
 	}
 	cyw43_arch_lwip_end();
-	free(buf);
 
-	return 0;
+	return res;
+}
+
+
+static void syslog_udp_poll()
+{
+	var_ringbuffer_iter_t iter;
+	const uint8_t *rec;
+	int len, count = 0;
+
+	while (syslog->queue.items > 0 && count < SYSLOG_DRAIN_MAX) {
+		if (syslog->tokens < 1000) {
+			syslog->stats.rate_limited++;
+			break;
+		}
+		var_ringbuffer_iter_init(&syslog->queue, &iter);
+		if ((len = var_ringbuffer_iter_next(&iter, &rec)) >= SYSLOG_REC_HDR_LEN) {
+			if (syslog_udp_send(rec, len) == 0)
+				syslog->stats.sent++;
+			else
+				syslog->stats.errors++;
+		}
+		var_ringbuffer_remove_first_item(&syslog->queue);
+		syslog->tokens -= 1000;
+		count++;
+	}
 }
+
+
+/* lwIP callbacks (these are called with lwIP lock held) */
+
+static err_t syslog_tcp_connected_cb(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+	syslog_t *ctx = (syslog_t*)arg;
+
+	if (ctx && err == ERR_OK) {
+		ctx->tcp_state = SYSLOG_TCP_CONNECTED;
+		ctx->stats.connects++;
+	}
+	return ERR_OK;
+}
+
+static void syslog_tcp_err_cb(void *arg, err_t err)
+{
+	syslog_t *ctx = (syslog_t*)arg;
+
+	/* pcb has already been freed by lwIP */
+	if (ctx) {
+		ctx->tcp_pcb = NULL;
+		ctx->tcp_state = SYSLOG_TCP_CLOSED;
+		ctx->stats.errors++;
+	}
+}
+
+static err_t syslog_tcp_recv_cb(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+	syslog_t *ctx = (syslog_t*)arg;
+
+	if (!p) {
+		/* Server closed connection */
+		if (ctx) {
+			ctx->tcp_pcb = NULL;
+			ctx->tcp_state = SYSLOG_TCP_CLOSED;
+		}
+		tcp_arg(pcb, NULL);
+		tcp_err(pcb, NULL);
+		tcp_recv(pcb, NULL);
+		tcp_sent(pcb, NULL);
+		if (tcp_close(pcb) != ERR_OK) {
+			tcp_abort(pcb);
+			return ERR_ABRT;
+		}
+		return ERR_OK;
+	}
+	/* Ignore anything server sends us... */
+	tcp_recved(pcb, p->tot_len);
+	pbuf_free(p);
+
+	return ERR_OK;
+}
+
+static err_t syslog_tcp_sent_cb(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+	syslog_t *ctx = (syslog_t*)arg;
+
+	if (ctx)
+		ctx->inflight.acked += len;
+	return ERR_OK;
+}
+
+
+static void syslog_tcp_connect()
+{
+	struct tcp_pcb *pcb;
+
+	if (!(pcb = tcp_new_ip_type(IP_GET_TYPE(&syslog->server_addr))))
+		return;
+
+	tcp_arg(pcb, syslog);
+	tcp_err(pcb, syslog_tcp_err_cb);
+	tcp_recv(pcb, syslog_tcp_recv_cb);
+	tcp_sent(pcb, syslog_tcp_sent_cb);
+
+	if (tcp_connect(pcb, &syslog->server_addr, syslog->port,
+				syslog_tcp_connected_cb) != ERR_OK) {
+		tcp_abort(pcb);
+		return;
+	}
+	syslog->tcp_pcb = pcb;
+	syslog->tcp_state = SYSLOG_TCP_CONNECTING;
+}
+
+
+static void syslog_tcp_poll()
+{
+	static char buf[SYSLOG_FRAME_HDR_MAX + SYSLOG_MAX_MSG_LEN + 64];
+	var_ringbuffer_iter_t iter;
+	const uint8_t *rec;
+	size_t i, len;
+	int rec_len, count = 0;
+
+	cyw43_arch_lwip_begin();
+
+	/* Remove messages acknowledged by the server from the queue. */
+	i = syslog_inflight_acked(&syslog->inflight);
+	while (i-- > 0) {
+		var_ringbuffer_remove_first_item(&syslog->queue);
+		syslog->stats.sent++;
+	}
+
+	if (syslog->tcp_state == SYSLOG_TCP_CLOSED) {
+		/* Connection lost, unacknowledged messages will be resent. */
+		syslog_inflight_reset(&syslog->inflight);
+		if (syslog->queue.items > 0 && time_passed(&syslog->t_tcp_connect,
+								SYSLOG_TCP_RETRY * 1000))
+			syslog_tcp_connect();
+		goto done;
+	}
+	if (syslog->tcp_state != SYSLOG_TCP_CONNECTED)
+		goto done;
+
+	/* Send queued messages (skipping ones already sent), multiple
+	   messages are written before calling tcp_output() so they can
+	   share segments. */
+	var_ringbuffer_iter_init(&syslog->queue, &iter);
+	for (i = 0; i < syslog->inflight.count; i++)
+		var_ringbuffer_iter_next(&iter, &rec);
+
+	while (count < SYSLOG_TCP_BATCH_MAX
+		&& syslog->inflight.count < SYSLOG_TCP_INFLIGHT_MAX
+		&& (rec_len = var_ringbuffer_iter_next(&iter, &rec)) >= SYSLOG_REC_HDR_LEN) {
+		len = syslog_frame(buf, sizeof(buf), syslog->facility, syslog->hostname,
+				rec, rec_len);
+
+		if (len < 1 || len > tcp_sndbuf(syslog->tcp_pcb))
+			break;
+		if (tcp_write(syslog->tcp_pcb, buf, len,
+				TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE) != ERR_OK)
+			break;
+
+		syslog_inflight_add(&syslog->inflight, len);
+		count++;
+	}
+	if (count > 0) {
+		tcp_output(syslog->tcp_pcb);
+		syslog->stats.batches++;
+	}
+
+done:
+	cyw43_arch_lwip_end();
+}
+
+
+/* Send queued messages. */
+void syslog_poll()
+{
+	absolute_time_t now;
+	int64_t elapsed;
+
+	if (!syslog)
+		return;
+
+	now = get_absolute_time();
+
+	/* Report repeated message, if no new messages have arrived in a while. */
+	if (syslog->repeat > 0
+		&& absolute_time_diff_us(syslog->t_repeat, now) > SYSLOG_REPEAT_FLUSH * 1000000LL) {
+		syslog_flush_repeat();
+		syslog->last_crc = 0;
+	}
+
+	/* Refill token bucket */
+	elapsed = absolute_time_diff_us(syslog->t_tokens, now) / 1000;
+	if (elapsed > 0) {
+		uint64_t tokens = syslog->tokens + elapsed * SYSLOG_RATE_LIMIT;
+		if (tokens > SYSLOG_RATE_BURST * 1000)
+			tokens = SYSLOG_RATE_BURST * 1000;
+		syslog->tokens = tokens;
+		syslog->t_tokens = delayed_by_ms(syslog->t_tokens, elapsed);
+	}
+
+	/* Keep messages queued while network is down. */
+	if (!netif_default || !netif_is_up(netif_default)
+		|| !netif_is_link_up(netif_default))
+		return;
+
+	if (syslog->tcp)
+		syslog_tcp_poll();
+	else
+		syslog_udp_poll();
+}
+
+
+void syslog_print_stats()
+{
+	const struct syslog_stats *st;
+
+	if (!syslog) {
+		cmd_printf("Syslog not active.\n");
+		return;
+	}
+	st = &syslog->stats;
+
+	cmd_printf("Transport:                             %s\n",
+		(syslog->tcp ? (syslog->tcp_state == SYSLOG_TCP_CONNECTED ?
+				"TCP (connected)" : "TCP (disconnected)") : "UDP"));
+	cmd_printf("Messages queued:                       %lu\n", st->queued);
+	cmd_printf("Messages sent:                         %lu\n", st->sent);
+	cmd_printf("Messages dropped (queue full):         %lu\n", st->dropped);
+	cmd_printf("Messages coalesced (repeated):         %lu\n", st->coalesced);
+	cmd_printf("Send errors:                           %lu\n", st->errors);
+	cmd_printf("Rate limited (polls):                  %lu\n", st->rate_limited);
+	if (syslog->tcp) {
+		cmd_printf("TCP connects:                          %lu\n", st->connects);
+		cmd_printf("TCP batches:                           %lu\n", st->batches);
+		cmd_printf("TCP messages in flight:                %u\n", syslog->inflight.count);
+	}
+	cmd_printf("Queue depth (current):                 %u\n", syslog->queue.items);
+	cmd_printf("Queue depth (max):                     %lu\n", st->max_depth);
+	cmd_printf("Queue free:                            %u / %u bytes\n",
+		syslog->queue.free, syslog->queue.size);
+}
+
+/* eof :-) */
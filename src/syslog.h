@@ -29,9 +29,32 @@
 #define SYSLOG_DEFAULT_PORT 514
 #define SYSLOG_MAX_MSG_LEN  256
 
-int syslog_open(const ip_addr_t *server, u16_t port, int facility, const char *hostname);
+#define SYSLOG_QUEUE_SIZE   4096  /* bytes */
+#define SYSLOG_RATE_LIMIT   10    /* messages / sec */
+#define SYSLOG_RATE_BURST   20    /* messages */
+#define SYSLOG_DRAIN_MAX    4     /* messages sent per syslog_poll() */
+#define SYSLOG_REPEAT_FLUSH 30    /* seconds */
+
+#define SYSLOG_TCP_RETRY        10  /* seconds between connection attempts */
+#define SYSLOG_TCP_BATCH_MAX    16  /* messages written per syslog_poll() */
+
+struct syslog_stats {
+	uint32_t queued;
+	uint32_t sent;
+	uint32_t dropped;
+	uint32_t coalesced;
+	uint32_t rate_limited;
+	uint32_t errors;
+	uint32_t max_depth;
+	uint32_t connects;
+	uint32_t batches;
+};
+
+int syslog_open(const ip_addr_t *server, u16_t port, int facility, const char *hostname, bool tcp);
 void syslog_close();
 int syslog_msg(int priority, const char *format, ...);
+void syslog_poll();
+void syslog_print_stats();
 
 
 #endif /* _BRICKPICO_SYSLOG_H_ */
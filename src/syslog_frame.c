@@ -0,0 +1,140 @@
+/* syslog_frame.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "syslog_frame.h"
+
+
+/* Build syslog 'packet' from queue record, returns its length. */
+size_t syslog_format(char *buf, size_t size, int facility, const char *hostname,
+		const uint8_t *rec, size_t rec_len)
+{
+	uint32_t ts;
+	time_t t;
+	struct tm tm;
+	size_t len, msg_len;
+
+	if (size < 64 || rec_len < SYSLOG_REC_HDR_LEN)
+		return 0;
+
+	memcpy(&ts, rec + 1, sizeof(ts));
+	t = ts;
+
+	/* priority */
+	snprintf(buf, 6, "<%u>",  (facility << 3) | (rec[0] & 0x07));
+	len = strlen(buf);
+	/* timestamp */
+	localtime_r(&t, &tm);
+	strftime(&buf[len], 18, "%b %e %T ", &tm);
+	len = strlen(buf);
+	/* hostname */
+	snprintf(&buf[len], 34, "%s ", hostname);
+	len = strlen(buf);
+	/* message */
+	msg_len = rec_len - SYSLOG_REC_HDR_LEN;
+	if (msg_len > size - len)
+		msg_len = size - len;
+	memcpy(&buf[len], rec + SYSLOG_REC_HDR_LEN, msg_len);
+	len += msg_len;
+
+	return len;
+}
+
+
+/* Build octet-counted (RFC 6587) frame from queue record,
+   returns frame length. */
+size_t syslog_frame(char *buf, size_t size, int facility, const char *hostname,
+		const uint8_t *rec, size_t rec_len)
+{
+	size_t len, hdr_len;
+
+	if (size <= SYSLOG_FRAME_HDR_MAX)
+		return 0;
+
+	len = syslog_format(buf + SYSLOG_FRAME_HDR_MAX, size - SYSLOG_FRAME_HDR_MAX,
+			facility, hostname, rec, rec_len);
+	if (len < 1)
+		return 0;
+	hdr_len = snprintf(buf, SYSLOG_FRAME_HDR_MAX, "%u ", (unsigned int)len);
+	memmove(buf + hdr_len, buf + SYSLOG_FRAME_HDR_MAX, len);
+
+	return hdr_len + len;
+}
+
+
+void syslog_inflight_reset(syslog_inflight_t *f)
+{
+	memset(f, 0, sizeof(*f));
+}
+
+
+/* Track a message that was just sent, returns -1 if too many
+   messages already in flight. */
+int syslog_inflight_add(syslog_inflight_t *f, size_t len)
+{
+	if (f->count >= SYSLOG_TCP_INFLIGHT_MAX)
+		return -1;
+
+	f->len[(f->head + f->count) % SYSLOG_TCP_INFLIGHT_MAX] = len;
+	f->count++;
+
+	return 0;
+}
+
+
+/* Oldest 'count' messages were dropped from the queue (to make room),
+   stop tracking those that were already sent. */
+void syslog_inflight_drop(syslog_inflight_t *f, size_t count)
+{
+	while (count-- > 0 && f->count > 0) {
+		f->ack_skip += f->len[f->head];
+		f->head = (f->head + 1) % SYSLOG_TCP_INFLIGHT_MAX;
+		f->count--;
+	}
+}
+
+
+/* Process bytes acked by the server (f->acked), returns number of
+   messages (from head of the queue) that server has now fully received. */
+size_t syslog_inflight_acked(syslog_inflight_t *f)
+{
+	size_t i, count = 0;
+
+	if (f->ack_skip > 0) {
+		i = (f->ack_skip < f->acked ? f->ack_skip : f->acked);
+		f->ack_skip -= i;
+		f->acked -= i;
+	}
+	while (f->count > 0 && f->acked >= f->len[f->head]) {
+		f->acked -= f->len[f->head];
+		f->head = (f->head + 1) % SYSLOG_TCP_INFLIGHT_MAX;
+		f->count--;
+		count++;
+	}
+
+	return count;
+}
+
+
+/* eof :-) */
@@ -0,0 +1,60 @@
+/* syslog_frame.h
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRICKPICO_SYSLOG_FRAME_H
+#define BRICKPICO_SYSLOG_FRAME_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Syslog message formatting (RFC 3164 style) and TCP transport
+   framing (RFC 6587 octet counting: MSG-LEN SP SYSLOG-MSG).
+
+   Queue record: <severity> <timestamp (4 bytes)> <message>
+*/
+
+#define SYSLOG_REC_HDR_LEN      5
+#define SYSLOG_FRAME_HDR_MAX    8   /* "MSG-LEN SP" */
+#define SYSLOG_TCP_INFLIGHT_MAX 32  /* messages sent but not yet acked */
+
+
+/* Messages sent over TCP, but not yet acknowledged by the server.
+   Messages stay in the queue until server has acknowledged them. */
+typedef struct syslog_inflight {
+	uint32_t acked;      /* bytes acked by server (not yet processed) */
+	uint32_t ack_skip;   /* bytes of in-flight messages dropped from queue */
+	uint16_t len[SYSLOG_TCP_INFLIGHT_MAX]; /* frame lengths */
+	uint8_t head;
+	uint8_t count;
+} syslog_inflight_t;
+
+
+size_t syslog_format(char *buf, size_t size, int facility, const char *hostname,
+		const uint8_t *rec, size_t rec_len);
+size_t syslog_frame(char *buf, size_t size, int facility, const char *hostname,
+		const uint8_t *rec, size_t rec_len);
+
+void syslog_inflight_reset(syslog_inflight_t *f);
+int syslog_inflight_add(syslog_inflight_t *f, size_t len);
+void syslog_inflight_drop(syslog_inflight_t *f, size_t count);
+size_t syslog_inflight_acked(syslog_inflight_t *f);
+
+#endif /* BRICKPICO_SYSLOG_FRAME_H */
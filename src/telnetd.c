@@ -19,6 +19,8 @@
    along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#define LOG_SUBSYS NET
+
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -19,6 +19,8 @@
    along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#define LOG_SUBSYS TIMER
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -256,7 +258,7 @@ int handle_timer_events(const struct brickpico_config *conf, struct brickpico_st
 			time_t_to_str(tmp, sizeof(tmp), t_now));
 
 		for (o = 0; o < OUTPUT_COUNT; o++) {
-			if (e->mask & (1 << o)) {
+			if (e->mask & (1UL << o)) {
 				state->pwr[o] = (e->action == ACTION_ON ? 1 : 0);
 			}
 		}
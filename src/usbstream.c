@@ -0,0 +1,277 @@
+/* usbstream.c
+   Copyright (C) 2024 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/mutex.h"
+#include "pico/stdio_usb.h"
+
+#include "brickpico.h"
+#include "binframe.h"
+
+
+/* Binary streaming mode for the (USB) console.
+
+   Once enabled (SYS:STREAM ON), console input is parsed as binary frames
+   (see binframe.h) instead of SCPI commands. Output levels from LEVELS
+   frames are passed directly to core1, which applies them immediately
+   (bypassing light effects) until streaming mode is exited.
+
+   While streaming mode is active, USB is removed from the stdio drivers,
+   so that log messages etc. only go to other consoles (UART, telnet),
+   and frames are read/written directly using the USB stdio driver.
+ */
+
+#define USB_STREAM_TIMEOUT 10000  /* return to SCPI mode after 10s of inactivity */
+#define USB_STREAM_PMEM_SYNC 100   /* ms between persistent memory updates */
+
+struct usb_stream_transfer {
+	volatile uint32_t seq;
+	uint8_t level[OUTPUT_MAX_COUNT];
+};
+
+static volatile bool stream_active = false;
+static binframe_parser_t parser;
+static struct usb_stream_transfer transfer;
+static absolute_time_t t_last_frame;
+static absolute_time_t t_pmem_sync;
+static bool pmem_dirty = false;
+static uint32_t acks_sent = 0;
+static uint32_t naks_sent = 0;
+static uint32_t level_frames = 0;
+static uint32_t sessions = 0;
+
+
+static void send_ack(uint8_t type, uint8_t seq, uint8_t status)
+{
+	uint8_t frame[BINFRAME_HEADER_LEN + 6 + BINFRAME_CRC_LEN];
+	uint8_t payload[6];
+	uint32_t drops = binframe_drops(&parser);
+	size_t len;
+
+	payload[0] = type;
+	payload[1] = status;
+	payload[2] = drops & 0xff;
+	payload[3] = (drops >> 8) & 0xff;
+	payload[4] = (drops >> 16) & 0xff;
+	payload[5] = (drops >> 24) & 0xff;
+
+	len = binframe_encode(frame, sizeof(frame), BINFRAME_ACK, seq, payload, sizeof(payload));
+	if (len > 0) {
+		stdio_usb.out_chars((const char*)frame, len);
+		if (stdio_usb.out_flush)
+			stdio_usb.out_flush();
+	}
+
+	if (status == BINFRAME_STATUS_OK)
+		acks_sent++;
+	else
+		naks_sent++;
+}
+
+
+static int set_levels(const uint8_t *levels, uint8_t count)
+{
+	struct brickpico_state *st = brickpico_state;
+	int i;
+
+	if (count < 1 || count > OUTPUT_COUNT)
+		return -1;
+	for (i = 0; i < count; i++) {
+		if (levels[i] > 100)
+			return -2;
+	}
+
+	mutex_enter_blocking(state_mutex);
+	for (i = 0; i < count; i++) {
+		transfer.level[i] = levels[i];
+		st->pwm[i] = levels[i];
+		st->pwr[i] = (levels[i] > 0 ? 1 : 0);
+	}
+	transfer.seq++;
+	mutex_exit(state_mutex);
+
+	/* Mirrored into persistent memory later by sync_levels() */
+	pmem_dirty = true;
+
+	level_frames++;
+	return 0;
+}
+
+
+/* Mirror new levels into persistent memory (so that they survive a reset),
+   this is throttled as CRC over the whole output state is recalculated. */
+static void sync_levels(bool force)
+{
+	if (!pmem_dirty)
+		return;
+	if (!force && !time_passed(&t_pmem_sync, USB_STREAM_PMEM_SYNC))
+		return;
+
+	pmem_dirty = false;
+	update_persistent_state(false);
+}
+
+
+static void stream_exit(const char *reason)
+{
+	sync_levels(true);
+	stream_active = false;
+	stdio_set_driver_enabled(&stdio_usb, true);
+	update_core1_state();
+	log_msg(LOG_NOTICE, "Binary streaming mode disabled (%s).", reason);
+}
+
+
+bool usb_stream_active()
+{
+	return stream_active;
+}
+
+
+void usb_stream_start()
+{
+	struct brickpico_state *st = brickpico_state;
+	int i;
+
+	if (stream_active)
+		return;
+
+	binframe_parser_init(&parser);
+	acks_sent = naks_sent = level_frames = 0;
+
+	/* Start from current output levels... */
+	mutex_enter_blocking(state_mutex);
+	for (i = 0; i < OUTPUT_COUNT; i++)
+		transfer.level[i] = (st->pwr[i] ? st->pwm[i] : 0);
+	transfer.seq++;
+	mutex_exit(state_mutex);
+
+	t_last_frame = get_absolute_time();
+	sessions++;
+	log_msg(LOG_NOTICE, "Binary streaming mode enabled.");
+	stdio_flush();
+	stdio_set_driver_enabled(&stdio_usb, false);
+	stream_active = true;
+}
+
+
+/* Read character from console (core0).
+
+   USB input is read directly from the USB stdio driver, so that
+   the caller knows which characters arrived over USB (and so that
+   USB input is available while USB is disabled in streaming mode).
+   Returns PICO_ERROR_TIMEOUT if no input is available.
+ */
+int console_getchar(bool *usb)
+{
+	char c;
+
+	if (stdio_usb.in_chars(&c, 1) == 1) {
+		*usb = true;
+		return (uint8_t)c;
+	}
+	*usb = false;
+	return getchar_timeout_us(0);
+}
+
+
+/* Process input character (core0). */
+void usb_stream_input(int c)
+{
+	int status;
+
+	if (binframe_parse_byte(&parser, c) != 1)
+		return;
+
+	t_last_frame = get_absolute_time();
+
+	switch (parser.type) {
+	case BINFRAME_LEVELS:
+		status = (set_levels(parser.payload, parser.len) ?
+			BINFRAME_STATUS_INVAL : BINFRAME_STATUS_OK);
+		break;
+	case BINFRAME_PING:
+	case BINFRAME_EXIT:
+		status = BINFRAME_STATUS_OK;
+		break;
+	default:
+		status = BINFRAME_STATUS_UNKNOWN;
+	}
+
+	send_ack(parser.type, parser.seq, status);
+
+	if (parser.type == BINFRAME_EXIT)
+		stream_exit("exit frame");
+}
+
+
+/* Check for inactivity timeout (core0). */
+void usb_stream_poll()
+{
+	if (!stream_active)
+		return;
+
+	sync_levels(false);
+	if (absolute_time_diff_us(t_last_frame, get_absolute_time()) > USB_STREAM_TIMEOUT * 1000)
+		stream_exit("timeout");
+}
+
+
+/* Get latest output levels (core1).
+
+   Returns 1 if new levels were copied to 'levels' (and 'seq' updated),
+   0 if there are no new levels available.
+ */
+int usb_stream_levels(uint32_t *seq, uint8_t *levels)
+{
+	if (transfer.seq == *seq)
+		return 0;
+
+	if (!mutex_enter_timeout_us(state_mutex, 100))
+		return 0;
+	memcpy(levels, transfer.level, OUTPUT_COUNT);
+	*seq = transfer.seq;
+	mutex_exit(state_mutex);
+
+	return 1;
+}
+
+
+void print_usb_stream_stats()
+{
+	cmd_printf("Streaming mode:                        %s\n", (stream_active ? "ON" : "OFF"));
+	cmd_printf("Sessions:                              %lu\n", sessions);
+	cmd_printf("Frames received:                       %lu\n", parser.frames);
+	cmd_printf("Level frames applied:                  %lu\n", level_frames);
+	cmd_printf("Frames dropped:                        %lu\n", binframe_drops(&parser));
+	cmd_printf("CRC errors:                            %lu\n", parser.crc_errors);
+	cmd_printf("Length errors:                         %lu\n", parser.len_errors);
+	cmd_printf("Sequence gaps:                         %lu\n", parser.seq_gaps);
+	cmd_printf("Bytes skipped (sync):                  %lu\n", parser.skipped_bytes);
+	cmd_printf("ACKs sent:                             %lu\n", acks_sent);
+	cmd_printf("NAKs sent:                             %lu\n", naks_sent);
+}
+
+
+/* eof :-) */
@@ -43,16 +43,16 @@ void print_mallinfo()
 {
 	struct mallinfo mi = mallinfo();
 
-	printf("Total non-mmapped bytes (arena):       %d\n", mi.arena);
-	printf("# of free chunks (ordblks):            %d\n", mi.ordblks);
-	printf("# of free fastbin blocks (smblks):     %d\n", mi.smblks);
-	printf("# of mapped regions (hblks):           %d\n", mi.hblks);
-	printf("Bytes in mapped regions (hblkhd):      %d\n", mi.hblkhd);
-	printf("Max. total allocated space (usmblks):  %d\n", mi.usmblks);
-	printf("Free bytes held in fastbins (fsmblks): %d\n", mi.fsmblks);
-	printf("Total allocated space (uordblks):      %d\n", mi.uordblks);
-	printf("Total free space (fordblks):           %d\n", mi.fordblks);
-	printf("Topmost releasable block (keepcost):   %d\n", mi.keepcost);
+	cmd_printf("Total non-mmapped bytes (arena):       %d\n", mi.arena);
+	cmd_printf("# of free chunks (ordblks):            %d\n", mi.ordblks);
+	cmd_printf("# of free fastbin blocks (smblks):     %d\n", mi.smblks);
+	cmd_printf("# of mapped regions (hblks):           %d\n", mi.hblks);
+	cmd_printf("Bytes in mapped regions (hblkhd):      %d\n", mi.hblkhd);
+	cmd_printf("Max. total allocated space (usmblks):  %d\n", mi.usmblks);
+	cmd_printf("Free bytes held in fastbins (fsmblks): %d\n", mi.fsmblks);
+	cmd_printf("Total allocated space (uordblks):      %d\n", mi.uordblks);
+	cmd_printf("Total free space (fordblks):           %d\n", mi.fordblks);
+	cmd_printf("Topmost releasable block (keepcost):   %d\n", mi.keepcost);
 }
 
 char *trim_str(char *s)
@@ -413,14 +413,14 @@ char *bitmask_to_str_r(uint32_t mask, uint8_t len, uint8_t base, bool range, cha
 		return buf;
 
 	/* Handle special case of all bits set... */
-	if (!range && mask == (1 << len) - 1) {
+	if (!range && mask == (len < 32 ? (1UL << len) - 1 : 0xffffffff)) {
 		*s++ = '*';
 		*s = 0;
 		return buf;
 	}
 
 	for (i = 0; i < len; i++) {
-		if (mask & (1 << i)) {
+		if (mask & (1UL << i)) {
 			int consecutive = (i - prev == 1 ? 1 : 0);
 			int w = 0;
 
@@ -482,7 +482,7 @@ int str_to_bitmask(const char *str, uint8_t len, uint32_t *mask, uint8_t base)
 		return -2;
 
 	if (!strcmp(str, "*")) {
-		*mask = (1 << len) - 1;
+		*mask = (len < 32 ? (1UL << len) - 1 : 0xffffffff);
 		return 0;
 	}
 
@@ -496,14 +496,14 @@ int str_to_bitmask(const char *str, uint8_t len, uint32_t *mask, uint8_t base)
 		if (str_to_int(tok, &a, 10)) {
 			a -= base;
 			if (a >= 0 && a < len) {
-				*mask |= (1 << a);
+				*mask |= (1UL << a);
 			}
 			tok = strtok_r(NULL, "-", &saveptr2);
 			if (str_to_int(tok, &b, 10)) {
 				b -= base;
 				if (b > a && b < len) {
 					while (++a <= b) {
-						*mask |= (1 << a);
+						*mask |= (1UL << a);
 					}
 				}
 			}
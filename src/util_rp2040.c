@@ -27,6 +27,8 @@
 #include "pico/unique_id.h"
 #include "pico/multicore.h"
 #include "hardware/watchdog.h"
+#include "hardware/gpio.h"
+#include "hardware/i2c.h"
 
 #include "pico_lfs.h"
 
@@ -64,11 +66,11 @@ inline uint32_t get_stack_free()
 
 void print_rp2040_meminfo()
 {
-	printf("Core0 stack size:                      %d\n",
+	cmd_printf("Core0 stack size:                      %d\n",
 		&__StackTop - &__StackBottom);
-	printf("Core1 stack size:                      %d\n",
+	cmd_printf("Core1 stack size:                      %d\n",
 		&__StackOneTop - &__StackOneBottom);
-	printf("Heap size:                             %d\n",
+	cmd_printf("Heap size:                             %d\n",
 		&__StackLimit - &__end__);
 }
 
@@ -145,6 +147,27 @@ int time_passed(absolute_time_t *t, uint32_t ms)
 }
 
 
+/* Initialize (hardware) I2C bus. This is done only once at boot, so that
+   all devices on the bus use the same bus speed. */
+void i2c_bus_init()
+{
+#if I2C_HW > 0
+	static bool initialized = false;
+
+	if (initialized)
+		return;
+	mutex_enter_blocking(i2c_mutex);
+	i2c_init((I2C_HW == 1 ? i2c0 : i2c1), I2C_BUS_SPEED);
+	gpio_set_function(SDA_PIN, GPIO_FUNC_I2C);
+	gpio_set_function(SCL_PIN, GPIO_FUNC_I2C);
+	gpio_pull_up(SDA_PIN);
+	gpio_pull_up(SCL_PIN);
+	mutex_exit(i2c_mutex);
+	initialized = true;
+#endif
+}
+
+
 int getstring_timeout_ms(char *str, uint32_t maxlen, uint32_t timeout)
 {
 	absolute_time_t t_timeout = get_absolute_time();
@@ -0,0 +1,11 @@
+/* brickpico-compile.h for host tests */
+
+#ifndef BRICKPICO_COMPILE_H
+#define BRICKPICO_COMPILE_H 1
+
+#define TLS_SUPPORT 0
+#define PCA9685_COUNT 0
+#define FAST_BOOT 0
+#define LOG_MAX_LEVEL 7
+
+#endif /* BRICKPICO_COMPILE_H */
@@ -0,0 +1,17 @@
+/* config.h for host tests (generated from config.h.in in firmware builds) */
+
+#ifndef BRICKPICO_CONFIG_H
+#define BRICKPICO_CONFIG_H 1
+
+#define BRICKPICO_VERSION         "0.0.0"
+#define BRICKPICO_VERSION_MAJOR   "0"
+#define BRICKPICO_VERSION_MINOR   "0"
+
+#include "boards/8.h"
+#define BRICKPICO_BOARD "8"
+
+#define BRICKPICO_BUILD_TAG       "host"
+
+#include "brickpico-compile.h"
+
+#endif /* BRICKPICO_CONFIG_H */
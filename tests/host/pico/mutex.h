@@ -0,0 +1,17 @@
+/* Minimal subset of pico/mutex.h for host tests (single threaded) */
+
+#ifndef _PICO_MUTEX_H
+#define _PICO_MUTEX_H
+
+#include "pico/stdlib.h"
+
+typedef struct { int owned; } mutex_t;
+
+#define auto_init_mutex(name) mutex_t name
+
+static inline void mutex_init(mutex_t *m) { m->owned = 0; }
+static inline void mutex_enter_blocking(mutex_t *m) { m->owned = 1; }
+static inline bool mutex_try_enter(mutex_t *m, uint32_t *owner) { (void)owner; m->owned = 1; return true; }
+static inline void mutex_exit(mutex_t *m) { m->owned = 0; }
+
+#endif /* _PICO_MUTEX_H */
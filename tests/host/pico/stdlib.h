@@ -0,0 +1,13 @@
+/* Minimal subset of pico/stdlib.h for host tests */
+
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+
+#endif /* _PICO_STDLIB_H */
@@ -0,0 +1,68 @@
+/* test.h
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRICKPICO_TEST_H
+#define BRICKPICO_TEST_H 1
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Minimal helpers for the host tests. */
+
+static int test_failures = 0;
+
+#define CHECK(expr) do {						\
+		if (!(expr)) {						\
+			fprintf(stderr, "%s:%d: check failed: %s\n",	\
+				__FILE__, __LINE__, #expr);		\
+			test_failures++;				\
+		}							\
+	} while (0)
+
+#define CHECK_EQ(a, b) do {						\
+		long long _a = (long long)(a), _b = (long long)(b);	\
+		if (_a != _b) {						\
+			fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", \
+				__FILE__, __LINE__, #a, #b, _a, _b);	\
+			test_failures++;				\
+		}							\
+	} while (0)
+
+static inline uint64_t test_time_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int test_result(const char *name)
+{
+	if (test_failures) {
+		printf("%s: %d check(s) FAILED\n", name, test_failures);
+		return 1;
+	}
+	printf("%s: OK\n", name);
+	return 0;
+}
+
+#endif /* BRICKPICO_TEST_H */
@@ -0,0 +1,252 @@
+/* test_binframe.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binframe.h"
+#include "test.h"
+
+/* crc32.c */
+void xcrc32_init(void);
+unsigned int xcrc32 (const unsigned char *buf, int len, unsigned int init);
+
+
+/* Replay harness: generate a (damaged) frame stream, feed it to the parser
+   and compare parser statistics against what was injected into the stream.
+
+   Alternatively replay a captured stream from a file:
+     test_binframe <capture.bin>
+*/
+
+#define REPLAY_FRAMES 600
+
+struct replay_stats {
+	uint32_t frames;
+	uint32_t crc_errors;
+	uint32_t len_errors;
+	uint32_t seq_gaps;
+	uint32_t skipped_bytes;
+	uint32_t bad_payload;
+};
+
+static uint8_t *stream;
+static size_t stream_len;
+static size_t stream_size;
+
+static void stream_add(const uint8_t *buf, size_t len)
+{
+	if (stream_len + len > stream_size) {
+		stream_size = (stream_size + len) * 2;
+		stream = realloc(stream, stream_size);
+		if (!stream) {
+			fprintf(stderr, "out of memory\n");
+			exit(2);
+		}
+	}
+	memcpy(stream + stream_len, buf, len);
+	stream_len += len;
+}
+
+static void fill_payload(uint8_t *payload, uint8_t len, uint8_t seq)
+{
+	for (int i = 0; i < len; i++)
+		payload[i] = (seq + i * 7) % 101;
+}
+
+static void replay(const uint8_t *buf, size_t len, binframe_parser_t *p,
+		struct replay_stats *rs)
+{
+	uint8_t expected[BINFRAME_MAX_PAYLOAD];
+
+	for (size_t i = 0; i < len; i++) {
+		if (binframe_parse_byte(p, buf[i]) != 1)
+			continue;
+		fill_payload(expected, p->len, p->seq);
+		if (memcmp(expected, p->payload, p->len))
+			rs->bad_payload++;
+	}
+}
+
+static void test_roundtrip()
+{
+	binframe_parser_t p;
+	uint8_t frame[BINFRAME_MAX_LEN];
+	uint8_t payload[BINFRAME_MAX_PAYLOAD];
+	size_t len;
+	int res = 0;
+
+	fill_payload(payload, sizeof(payload), 42);
+	binframe_parser_init(&p);
+	for (int plen = 0; plen <= BINFRAME_MAX_PAYLOAD; plen++) {
+		len = binframe_encode(frame, sizeof(frame), BINFRAME_LEVELS, plen, payload, plen);
+		CHECK_EQ(len, BINFRAME_HEADER_LEN + plen + BINFRAME_CRC_LEN);
+		for (size_t i = 0; i < len; i++) {
+			res = binframe_parse_byte(&p, frame[i]);
+			if (i < len - 1)
+				CHECK_EQ(res, 0);
+		}
+		CHECK_EQ(res, 1);
+		CHECK_EQ(p.type, BINFRAME_LEVELS);
+		CHECK_EQ(p.seq, plen);
+		CHECK_EQ(p.len, plen);
+		CHECK(memcmp(p.payload, payload, plen) == 0);
+	}
+	CHECK_EQ(p.frames, BINFRAME_MAX_PAYLOAD + 1);
+	CHECK_EQ(binframe_drops(&p), 0);
+
+	/* Encoder rejects oversized payload and too small buffer */
+	CHECK_EQ(binframe_encode(frame, sizeof(frame), BINFRAME_LEVELS, 0, payload,
+					BINFRAME_MAX_PAYLOAD + 1), 0);
+	CHECK_EQ(binframe_encode(frame, BINFRAME_HEADER_LEN + BINFRAME_CRC_LEN,
+					BINFRAME_PING, 0, NULL, 1), 0);
+	CHECK_EQ(binframe_encode(frame, BINFRAME_HEADER_LEN + BINFRAME_CRC_LEN,
+					BINFRAME_PING, 0, NULL, 0), 8);
+}
+
+static void test_replay()
+{
+	binframe_parser_t p;
+	struct replay_stats exp, rs;
+	uint8_t frame[BINFRAME_MAX_LEN];
+	uint8_t payload[BINFRAME_MAX_PAYLOAD];
+	const uint8_t noise[] = { 0x00, 0x5a, 0xff, 0x0d, 0x0a };
+	const uint8_t bad_len[] = { BINFRAME_SYNC, BINFRAME_LEVELS, 0, BINFRAME_MAX_PAYLOAD + 1 };
+	int last = -1;
+	size_t len;
+
+	memset(&exp, 0, sizeof(exp));
+	memset(&rs, 0, sizeof(rs));
+	stream_len = 0;
+
+	for (int i = 0; i < REPLAY_FRAMES; i++) {
+		uint8_t seq = i & 0xff;
+		uint8_t plen = (i * 5) % (BINFRAME_MAX_PAYLOAD + 1);
+
+		if (i % 10 == 3) {
+			/* line noise between frames */
+			stream_add(noise, sizeof(noise));
+			exp.skipped_bytes += sizeof(noise);
+		}
+		if (i % 50 == 25) {
+			/* header with invalid length */
+			stream_add(bad_len, sizeof(bad_len));
+			exp.len_errors++;
+		}
+		if (i % 29 == 7)
+			continue; /* frame lost */
+
+		fill_payload(payload, plen, seq);
+		len = binframe_encode(frame, sizeof(frame), BINFRAME_LEVELS, seq, payload, plen);
+		CHECK(len > 0);
+		if (i % 17 == 5) {
+			/* corrupted in transit */
+			frame[BINFRAME_HEADER_LEN + plen / 2] ^= 0x10;
+			exp.crc_errors++;
+		} else {
+			if (last >= 0)
+				exp.seq_gaps += i - last - 1;
+			last = i;
+			exp.frames++;
+		}
+		stream_add(frame, len);
+	}
+
+	binframe_parser_init(&p);
+	replay(stream, stream_len, &p, &rs);
+
+	CHECK_EQ(p.frames, exp.frames);
+	CHECK_EQ(p.crc_errors, exp.crc_errors);
+	CHECK_EQ(p.len_errors, exp.len_errors);
+	CHECK_EQ(p.seq_gaps, exp.seq_gaps);
+	CHECK_EQ(p.skipped_bytes, exp.skipped_bytes);
+	CHECK_EQ(rs.bad_payload, 0);
+	CHECK_EQ(binframe_drops(&p), exp.seq_gaps);
+
+	/* Replay again after a truncated frame: parser must resynchronize
+	   and lose at most the frame overlapping the truncated one. */
+	binframe_parser_init(&p);
+	replay(stream, BINFRAME_HEADER_LEN + 2, &p, &rs);
+	replay(stream, stream_len, &p, &rs);
+	CHECK(p.frames >= exp.frames - 1);
+	CHECK_EQ(rs.bad_payload, 0);
+}
+
+static void bench_parse()
+{
+	binframe_parser_t p;
+	uint64_t t, bytes = 0;
+	int rounds = 200;
+
+	binframe_parser_init(&p);
+	t = test_time_ns();
+	for (int r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < stream_len; i++)
+			binframe_parse_byte(&p, stream[i]);
+		bytes += stream_len;
+	}
+	t = test_time_ns() - t;
+	printf("binframe: parsed %llu bytes (%u frames) in %.2f ms (%.1f MB/s)\n",
+		(unsigned long long)bytes, p.frames, t / 1e6, bytes * 1e3 / (t ? t : 1));
+}
+
+static int replay_file(const char *filename)
+{
+	binframe_parser_t p;
+	uint8_t buf[4096];
+	size_t len;
+	FILE *fp;
+
+	if (!(fp = fopen(filename, "rb"))) {
+		perror(filename);
+		return 2;
+	}
+	binframe_parser_init(&p);
+	while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		for (size_t i = 0; i < len; i++)
+			binframe_parse_byte(&p, buf[i]);
+	}
+	fclose(fp);
+
+	printf("%s: frames=%u crc_errors=%u len_errors=%u seq_gaps=%u skipped_bytes=%u drops=%u\n",
+		filename, p.frames, p.crc_errors, p.len_errors, p.seq_gaps,
+		p.skipped_bytes, binframe_drops(&p));
+	return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	xcrc32_init();
+
+	if (argc > 1)
+		return replay_file(argv[1]);
+
+	test_roundtrip();
+	test_replay();
+	bench_parse();
+	free(stream);
+
+	return test_result("binframe");
+}
+
+/* eof :-) */
@@ -0,0 +1,405 @@
+/* test_cmdindex.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "cmdindex.h"
+#include "test.h"
+
+
+/* Command tree with same structure as (part of) the tables in command.c */
+
+static int cmd_dummy(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	return 0;
+}
+
+#define F cmd_dummy
+
+static const struct cmd_t display_commands[] = {
+	{ "LAYOUTR",   7, NULL, F },
+	{ "LOGO",      4, NULL, F },
+	{ "THEMe",     4, NULL, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t lfs_commands[] = {
+	{ "FORMAT",    6, NULL, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t wifi_syslog_commands[] = {
+	{ "TCP",       3, NULL, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t wifi_commands[] = {
+	{ "AUTHmode",  4, NULL, F },
+	{ "COUntry",   3, NULL, F },
+	{ "GATEway",   4, NULL, F },
+	{ "HOSTname",  4, NULL, F },
+	{ "IPaddress", 2, NULL, F },
+	{ "MAC",       3, NULL, F },
+	{ "NETMask",   4, NULL, F },
+	{ "NTP",       3, NULL, F },
+	{ "MODE",      4, NULL, F },
+	{ "PASSword",  4, NULL, F },
+	{ "SSID",      4, NULL, F },
+	{ "STATS",     5, NULL, F },
+	{ "STATus",    4, NULL, F },
+	{ "SYSLOG",    6, wifi_syslog_commands, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t stats_commands[] = {
+	{ "CMD",       3, NULL, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t log_commands[] = {
+	{ "SUBsys",    3, NULL, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t system_commands[] = {
+	{ "BOOT",      4, NULL, F },
+	{ "DEBUG",     5, NULL, F },
+	{ "DISPlay",   4, display_commands, F },
+	{ "ECHO",      4, NULL, F },
+	{ "ERRor",     3, NULL, F },
+	{ "EXPander",  3, NULL, F },
+	{ "FLASH",     5, NULL, F },
+	{ "GAMMA",     5, NULL, F },
+	{ "OUTputs",   3, NULL, F },
+	{ "LED",       3, NULL, F },
+	{ "LFS",       3, lfs_commands, F },
+	{ "LOG",       3, log_commands, F },
+	{ "MEMLOG",    6, NULL, F },
+	{ "MEMory",    3, NULL, F },
+	{ "NAME",      4, NULL, F },
+	{ "PWMfreq",   3, NULL, F },
+	{ "SERIAL",    6, NULL, F },
+	{ "SPI",       3, NULL, F },
+	{ "STATS",     5, stats_commands, NULL },
+	{ "STREAM",    6, NULL, F },
+	{ "TIMEZONE",  8, NULL, F },
+	{ "TIME",      4, NULL, F },
+	{ "UPGRADE",   7, NULL, F },
+	{ "UPTIme",    4, NULL, F },
+	{ "VERsion",   3, NULL, F },
+	{ "WIFI",      4, wifi_commands, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t defaults_c_commands[] = {
+	{ "PWM",       3, NULL, F },
+	{ "STAte",     3, NULL, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t output_c_commands[] = {
+	{ "EFFect",    3, NULL, F },
+	{ "MAXpwm",    3, NULL, F },
+	{ "MINpwm",    3, NULL, F },
+	{ "NAME",      4, NULL, F },
+	{ "PWM",       3, NULL, F },
+	{ "STAte",     3, NULL, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t timer_c_commands[] = {
+	{ "ADD",       3, NULL, F },
+	{ "DEL",       3, NULL, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t config_commands[] = {
+	{ "ABORT",     5, NULL, F },
+	{ "BEGIN",     5, NULL, F },
+	{ "COMMIT",    6, NULL, F },
+	{ "DEFAULTS",  8, defaults_c_commands, NULL },
+	{ "DELete",    3, NULL, F },
+	{ "EXPort",    3, NULL, F },
+	{ "OUTPUT",    6, output_c_commands, NULL },
+	{ "Read",      1, NULL, F },
+	{ "SAVe",      3, NULL, F },
+	{ "TIMER",     5, timer_c_commands, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t output_commands[] = {
+	{ "PWM",       3, NULL, F },
+	{ "Read",      1, NULL, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t measure_commands[] = {
+	{ "OUTPUT",    6, output_commands, F },
+	{ "Read",      1, NULL, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t write_o_commands[] = {
+	{ "PWM",       3, NULL, F },
+	{ "STAte",     3, NULL, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t write_os_commands[] = {
+	{ "PWM",       3, NULL, F },
+	{ "STAte",     3, NULL, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t write_commands[] = {
+	{ "OUTPUTS",   7, write_os_commands, NULL },
+	{ "OUTPUT",    6, write_o_commands, F },
+	{ 0, 0, 0, 0 }
+};
+
+static const struct cmd_t commands[] = {
+	{ "*CLS",      4, NULL, F },
+	{ "*ESE",      4, NULL, F },
+	{ "*ESR",      4, NULL, F },
+	{ "*IDN",      4, NULL, F },
+	{ "*OPC",      4, NULL, F },
+	{ "*RST",      4, NULL, F },
+	{ "*SRE",      4, NULL, F },
+	{ "*STB",      4, NULL, F },
+	{ "*TST",      4, NULL, F },
+	{ "*WAI",      4, NULL, F },
+	{ "CONFigure", 4, config_commands, F },
+	{ "MEAsure",   3, measure_commands, NULL },
+	{ "SYStem",    3, system_commands, NULL },
+	{ "Read",      1, NULL, F },
+	{ "WRIte",     3, write_commands, NULL },
+	{ 0, 0, 0, 0 }
+};
+
+#undef F
+
+
+static cmd_index_t ci;
+static cmd_index_t ci_linear;
+
+
+/* Resolve command (like run_cmd() does). Returns matching command or NULL. */
+static const struct cmd_t* resolve(const cmd_index_t *idx, const char *command, int *out_idx)
+{
+	const struct cmd_t *c = NULL;
+	struct cmd_pos_t pos;
+	char buf[128], *saveptr, *s, *sub;
+	int i;
+
+	strncpy(buf, command, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+	cmd_index_root(idx, &pos);
+	*out_idx = -1;
+
+	sub = strtok_r(buf, ":", &saveptr);
+	while (sub) {
+		s = sub;
+		if ((i = cmd_index_find(idx, &pos, s)) < 0)
+			return NULL;
+		c = &pos.cmds[i];
+		if (cmd_parse_index(s) >= 0)
+			*out_idx = cmd_parse_index(s);
+		sub = strtok_r(NULL, ":", &saveptr);
+		if (!sub)
+			break;
+		if (!c->subcmds)
+			return NULL;
+		cmd_index_sub(idx, &pos, i);
+	}
+
+	return c;
+}
+
+/* Look up every command in the tree (long/short/lower case forms, with
+   '?' and index suffix) and compare results with linear lookup. */
+static int cross_check_level(const struct cmd_t *cmds, const char *prefix)
+{
+	char name[128], variant[128];
+	int errors = 0;
+
+	for (int i = 0; cmds[i].cmd; i++) {
+		for (int v = 0; v < 5; v++) {
+			const struct cmd_t *a, *b;
+			int ia, ib;
+
+			switch (v) {
+			case 0:
+				snprintf(variant, sizeof(variant), "%s", cmds[i].cmd);
+				break;
+			case 1:
+				snprintf(variant, sizeof(variant), "%.*s", cmds[i].min_match, cmds[i].cmd);
+				break;
+			case 2:
+				snprintf(variant, sizeof(variant), "%s", cmds[i].cmd);
+				for (char *p = variant; *p; p++)
+					*p = tolower((int)*p);
+				break;
+			case 3:
+				snprintf(variant, sizeof(variant), "%s?", cmds[i].cmd);
+				break;
+			case 4:
+				snprintf(variant, sizeof(variant), "%s12", cmds[i].cmd);
+				break;
+			}
+			snprintf(name, sizeof(name), "%s%s", prefix, variant);
+
+			a = resolve(&ci, name, &ia);
+			b = resolve(&ci_linear, name, &ib);
+			if (a != b || ia != ib) {
+				fprintf(stderr, "mismatch: %s\n", name);
+				errors++;
+			}
+			/* Full and short forms must find the command itself (unless
+			   an earlier command in the table has same short form) */
+			if (v < 3 && a != &cmds[i]) {
+				for (int j = 0; j < i; j++) {
+					if (a == &cmds[j])
+						a = &cmds[i];
+				}
+				if (a != &cmds[i]) {
+					fprintf(stderr, "not found: %s\n", name);
+					errors++;
+				}
+			}
+		}
+		if (cmds[i].subcmds) {
+			snprintf(name, sizeof(name), "%s%s:", prefix, cmds[i].cmd);
+			errors += cross_check_level(cmds[i].subcmds, name);
+		}
+	}
+
+	return errors;
+}
+
+static void test_lookup()
+{
+	const struct cmd_t *c;
+	char name[64];
+	int idx;
+
+	CHECK_EQ(cmd_index_build(&ci, commands), 0);
+	CHECK(ci.valid);
+	ci_linear = ci;
+	ci_linear.valid = false;
+
+	CHECK_EQ(cross_check_level(commands, ""), 0);
+
+	c = resolve(&ci, "conf:output3:pwm", &idx);
+	CHECK(c == &output_c_commands[4]);
+	CHECK_EQ(idx, 2);
+	c = resolve(&ci, "SYS:TIMEZONE?", &idx);
+	CHECK(c == &system_commands[20]);
+	c = resolve(&ci, "SYS:TIME?", &idx);
+	CHECK(c == &system_commands[21]);
+	c = resolve(&ci, "WRITE:OUTPUTS:STATE", &idx);
+	CHECK(c == &write_os_commands[1]);
+	c = resolve(&ci, "WRITE:OUTPUT16:STATE", &idx);
+	CHECK(c == &write_o_commands[1]);
+	CHECK_EQ(idx, 15);
+	CHECK(resolve(&ci, "SYS:FOO", &idx) == NULL);
+	CHECK(resolve(&ci, "SY", &idx) == NULL);
+
+	/* Full command names (for statistics) */
+	CHECK_EQ(strcmp(cmd_index_name(&ci, 0, 12, name, sizeof(name)), "SYStem"), 0);
+	for (int l = 0; l < ci.level_count; l++) {
+		if (ci.levels[l].cmds == wifi_syslog_commands)
+			cmd_index_name(&ci, l, 0, name, sizeof(name));
+	}
+	CHECK_EQ(strcmp(name, "SYStem:WIFI:SYSLOG:TCP"), 0);
+	CHECK_EQ(strcmp(cmd_index_name(&ci, 0, 12, name, 8), "SYStem"), 0);
+	CHECK_EQ(strcmp(cmd_index_name(&ci, 0, 12, name, 4), "SYS"), 0);
+
+	CHECK_EQ(cmd_parse_index("OUTPUT1"), 0);
+	CHECK_EQ(cmd_parse_index("output12?"), 11);
+	CHECK_EQ(cmd_parse_index("OUTPUT"), -1);
+}
+
+/* Command tree that does not fit in the index falls back to linear lookup */
+static void test_limits()
+{
+	static struct cmd_t big[CMD_MAX_CMDS + 2];
+	static char names[CMD_MAX_CMDS + 1][8];
+	cmd_index_t *tmp = malloc(sizeof(cmd_index_t));
+	struct cmd_pos_t pos;
+
+	for (int i = 0; i <= CMD_MAX_CMDS; i++) {
+		snprintf(names[i], sizeof(names[i]), "C%03d", i);
+		big[i].cmd = names[i];
+		big[i].min_match = 4;
+	}
+	CHECK_EQ(cmd_index_build(tmp, big), -1);
+	CHECK(!tmp->valid);
+	cmd_index_root(tmp, &pos);
+	CHECK_EQ(pos.level, -1);
+	CHECK_EQ(cmd_index_find(tmp, &pos, "C064"), 64);
+	CHECK_EQ(cmd_index_find(tmp, &pos, "c010?"), 10);
+	free(tmp);
+}
+
+static void bench_lookup()
+{
+	static const char *mixed[] = {
+		"*IDN?", "CONF:OUTPUT1:PWM?", "conf:output12:effect", "MEAS:OUTPUT3:PWM?",
+		"SYS:TIME?", "SYS:TIMEZONE?", "SYS:WIFI:STATus?", "SYStem:WIFI:SYSLOG:TCP?",
+		"WRITE:OUTPUT5:PWM", "WRITE:OUTPUTS:STATE", "SYS:LOG:SUBSYS?", "SYS:STATS:CMD?",
+		"Read?", "CONF:TIMER:ADD", "CONF:DEFAULTS:PWM", "SYS:UPTIME?",
+	};
+	const int count = sizeof(mixed) / sizeof(mixed[0]);
+	const int rounds = 100000;
+	volatile int sink = 0;
+	uint64_t t;
+	double rate[2];
+
+	for (int mode = 0; mode < 2; mode++) {
+		const cmd_index_t *idx = (mode ? &ci : &ci_linear);
+
+		t = test_time_ns();
+		for (int i = 0; i < rounds; i++) {
+			int o;
+
+			sink += (resolve(idx, mixed[i % count], &o) != NULL);
+		}
+		t = test_time_ns() - t;
+		rate[mode] = rounds * 1e9 / (t ? t : 1);
+	}
+	printf("cmdindex: %d mixed commands: linear %.0f cmd/s, index %.0f cmd/s (%.2fx)\n",
+		rounds, rate[0], rate[1], rate[1] / rate[0]);
+}
+
+
+int main()
+{
+	test_lookup();
+	test_limits();
+	bench_lookup();
+
+	return test_result("cmdindex");
+}
+
+/* eof :-) */
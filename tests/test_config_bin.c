@@ -0,0 +1,583 @@
+/* test_config_bin.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#ifdef HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+#include "brickpico.h"
+#include "test.h"
+
+
+/* Stubs for functions config_bin.c uses from other parts of the firmware. */
+
+static mutex_t config_mutex_inst;
+mutex_t *config_mutex = &config_mutex_inst;
+
+static int debug_level = 0;
+static int log_level = LOG_NOTICE;
+static int syslog_level = LOG_ERR;
+static int log_errors = 0;
+
+int get_debug_level() { return debug_level; }
+void set_debug_level(int level) { debug_level = level; }
+int get_log_level() { return log_level; }
+void set_log_level(int level) { log_level = level; }
+int get_syslog_level() { return syslog_level; }
+void set_syslog_level(int level) { syslog_level = level; }
+
+void log_subsys_msg(int subsys, int priority, const char *format, ...)
+{
+	va_list ap;
+
+	if (priority <= LOG_ERR)
+		log_errors++;
+	if (getenv("TEST_VERBOSE")) {
+		va_start(ap, format);
+		vprintf(format, ap);
+		va_end(ap);
+		printf("\n");
+	}
+}
+
+char *strncopy(char *dst, const char *src, size_t size)
+{
+	if (!dst || !src || size < 1)
+		return dst;
+	if (size > 1)
+		strncpy(dst, src, size - 1);
+	dst[size - 1] = 0;
+	return dst;
+}
+
+static const char *effect_names[] = { "none", "fade", "blink", "pulse" };
+
+int str2effect(const char *s)
+{
+	for (int i = 0; i <= EFFECT_ENUM_MAX; i++) {
+		if (!strcmp(s, effect_names[i]))
+			return i;
+	}
+	return EFFECT_NONE;
+}
+
+const char* effect2str(enum light_effect_types effect)
+{
+	return (effect <= EFFECT_ENUM_MAX ? effect_names[effect] : "none");
+}
+
+/* Effect parameters are kept as a string. Live effect contexts are
+   tracked, so leaks can be detected when free() is wrapped
+   (-Wl,--wrap=free) to see frees done in config_bin.c as well. */
+
+#define MAX_EFFECT_CTX 64
+static void *effect_ctx_live[MAX_EFFECT_CTX];
+static int effect_ctx_count = 0;
+
+void* effect_parse_args(enum light_effect_types effect, const char *args)
+{
+	void *ctx;
+
+	if (effect == EFFECT_NONE || !(ctx = strdup(args)))
+		return NULL;
+	for (int i = 0; i < MAX_EFFECT_CTX; i++) {
+		if (!effect_ctx_live[i]) {
+			effect_ctx_live[i] = ctx;
+			effect_ctx_count++;
+			break;
+		}
+	}
+	return ctx;
+}
+
+#ifdef WRAP_FREE
+void __real_free(void *ptr);
+
+void __wrap_free(void *ptr)
+{
+	for (int i = 0; ptr && i < MAX_EFFECT_CTX; i++) {
+		if (effect_ctx_live[i] == ptr) {
+			effect_ctx_live[i] = NULL;
+			effect_ctx_count--;
+			break;
+		}
+	}
+	__real_free(ptr);
+}
+#endif
+
+char* effect_print_args(enum light_effect_types effect, void *ctx)
+{
+	return (effect == EFFECT_NONE || !ctx ? NULL : strdup(ctx));
+}
+
+
+#ifdef HAVE_CJSON
+/* Heap usage tracking (for cJSON) */
+
+static size_t heap_used = 0;
+static size_t heap_peak = 0;
+
+static void* counting_malloc(size_t size)
+{
+	size_t *p = malloc(size + sizeof(size_t));
+
+	if (!p)
+		return NULL;
+	*p = size;
+	heap_used += size;
+	if (heap_used > heap_peak)
+		heap_peak = heap_used;
+	return p + 1;
+}
+
+static void counting_free(void *ptr)
+{
+	size_t *p = ptr;
+
+	if (!p)
+		return;
+	heap_used -= p[-1];
+	free(p - 1);
+}
+#endif
+
+
+static void init_config(struct brickpico_config *c)
+{
+	memset(c, 0, sizeof(*c));
+	for (int i = 0; i < OUTPUT_MAX_COUNT; i++) {
+		struct pwm_output *o = &c->outputs[i];
+
+		snprintf(o->name, sizeof(o->name), "Output %d", i + 1);
+		o->max_pwm = 100;
+	}
+	strncopy(c->display_type, "default", sizeof(c->display_type));
+	strncopy(c->display_theme, "default", sizeof(c->display_theme));
+	strncopy(c->gamma, "default", sizeof(c->gamma));
+	c->pwm_freq = 1000;
+	c->adc_ref_voltage = 3.3;
+	c->temp_coefficient = 1.0;
+}
+
+static void free_config(struct brickpico_config *c)
+{
+	for (int i = 0; i < OUTPUT_MAX_COUNT; i++) {
+		free(c->outputs[i].effect_ctx);
+		c->outputs[i].effect_ctx = NULL;
+	}
+}
+
+static void fill_config(struct brickpico_config *c)
+{
+	init_config(c);
+	for (int i = 0; i < OUTPUT_COUNT; i++) {
+		struct pwm_output *o = &c->outputs[i];
+
+		snprintf(o->name, sizeof(o->name), "Light \"%d\"", i + 1);
+		o->min_pwm = i;
+		o->max_pwm = 100 - i;
+		o->default_pwm = 10 * i;
+		o->default_state = i & 1;
+		o->type = (i % 3 == 0 ? 1 : 0);
+		o->effect = i % (EFFECT_ENUM_MAX + 1);
+		if (o->effect != EFFECT_NONE)
+			o->effect_ctx = strdup("1000,2000,50");
+	}
+	c->local_echo = true;
+	c->led_mode = 2;
+	strncopy(c->display_layout_r, "M,O1,O2,O3,O4,-,O5,O6,O7,O8", sizeof(c->display_layout_r));
+	strncopy(c->name, "brickpico-test", sizeof(c->name));
+	strncopy(c->timezone, "EET-2EEST,M3.5.0/3,M10.5.0/4", sizeof(c->timezone));
+	c->serial_active = true;
+	c->pwm_freq = 2000;
+	c->adc_ref_voltage = 3.3;
+	c->temp_offset = -1.25;
+	c->temp_coefficient = 1.0 / 3.0;
+	c->history_blocks = 4;
+	c->event_count = 5;
+	for (int i = 0; i < c->event_count; i++) {
+		struct timer_event *e = &c->events[i];
+
+		snprintf(e->name, sizeof(e->name), "event%d", i);
+		e->minute = (i == 2 ? -1 : 5 * i);
+		e->hour = (i == 3 ? -1 : 20 + i % 4);
+		e->wday = 0x7f >> i;
+		e->action = (i & 1 ? ACTION_OFF : ACTION_ON);
+		e->mask = 0x0f << i;
+	}
+	debug_level = 1;
+	log_level = LOG_INFO;
+	syslog_level = LOG_WARNING;
+}
+
+static void compare_config(const struct brickpico_config *a, const struct brickpico_config *b)
+{
+	for (int i = 0; i < OUTPUT_COUNT; i++) {
+		const struct pwm_output *oa = &a->outputs[i];
+		const struct pwm_output *ob = &b->outputs[i];
+
+		CHECK(!strcmp(oa->name, ob->name));
+		CHECK_EQ(oa->min_pwm, ob->min_pwm);
+		CHECK_EQ(oa->max_pwm, ob->max_pwm);
+		CHECK_EQ(oa->default_pwm, ob->default_pwm);
+		CHECK_EQ(oa->default_state, ob->default_state);
+		CHECK_EQ(oa->type, ob->type);
+		CHECK_EQ(oa->effect, ob->effect);
+		if (oa->effect != EFFECT_NONE && oa->effect_ctx && ob->effect_ctx)
+			CHECK(!strcmp(oa->effect_ctx, ob->effect_ctx));
+		else
+			CHECK(oa->effect_ctx == ob->effect_ctx);
+	}
+	CHECK_EQ(a->local_echo, b->local_echo);
+	CHECK_EQ(a->led_mode, b->led_mode);
+	CHECK(!strcmp(a->display_type, b->display_type));
+	CHECK(!strcmp(a->display_theme, b->display_theme));
+	CHECK(!strcmp(a->display_layout_r, b->display_layout_r));
+	CHECK(!strcmp(a->gamma, b->gamma));
+	CHECK(!strcmp(a->name, b->name));
+	CHECK(!strcmp(a->timezone, b->timezone));
+	CHECK_EQ(a->spi_active, b->spi_active);
+	CHECK_EQ(a->serial_active, b->serial_active);
+	CHECK_EQ(a->pwm_freq, b->pwm_freq);
+	CHECK(a->adc_ref_voltage == b->adc_ref_voltage);
+	CHECK(a->temp_offset == b->temp_offset);
+	CHECK(a->temp_coefficient == b->temp_coefficient);
+	CHECK_EQ(a->history_blocks, b->history_blocks);
+	CHECK_EQ(a->event_count, b->event_count);
+	for (int i = 0; i < a->event_count; i++) {
+		const struct timer_event *ea = &a->events[i];
+		const struct timer_event *eb = &b->events[i];
+
+		CHECK(!strcmp(ea->name, eb->name));
+		CHECK_EQ(ea->minute, eb->minute);
+		CHECK_EQ(ea->hour, eb->hour);
+		CHECK_EQ(ea->wday, eb->wday);
+		CHECK_EQ(ea->action, eb->action);
+		CHECK_EQ(ea->mask, eb->mask);
+	}
+}
+
+
+/* Find record in serialized configuration. */
+static const uint8_t* find_record(const uint8_t *buf, uint32_t size, uint16_t tag, uint8_t idx,
+				uint8_t *len)
+{
+	const uint8_t *p = buf + 16;
+
+	while (p + 4 <= buf + size) {
+		if ((p[0] | (p[1] << 8)) == tag && p[2] == idx) {
+			*len = p[3];
+			return p + 4;
+		}
+		p += 4 + p[3];
+	}
+	return NULL;
+}
+
+/* Append record and update header (payload length and CRC). */
+static uint8_t* append_record(uint8_t *buf, uint32_t *size, uint16_t tag, uint8_t idx,
+			const char *data, size_t len)
+{
+	uint32_t payload_len, crc;
+
+	buf = realloc(buf, *size + 4 + len);
+	buf[*size] = tag & 0xff;
+	buf[*size + 1] = tag >> 8;
+	buf[*size + 2] = idx;
+	buf[*size + 3] = len;
+	memcpy(buf + *size + 4, data, len);
+	*size += 4 + len;
+
+	payload_len = *size - 16;
+	crc = xcrc32(buf + 16, payload_len, 0xffffffff);
+	memcpy(buf + 8, &payload_len, 4);
+	memcpy(buf + 12, &crc, 4);
+
+	return buf;
+}
+
+
+static void test_roundtrip()
+{
+	struct brickpico_config a, b;
+	const uint8_t *r;
+	uint8_t *buf, len;
+	uint32_t size, payload_len, bad_len;
+
+	fill_config(&a);
+	CHECK((buf = config_to_bin(&a, &size)) != NULL);
+	if (!buf)
+		return;
+	CHECK(!memcmp(buf, "BPCF", 4));
+
+	/* Doubles are stored as IEEE 754 binary64, little-endian */
+	r = find_record(buf, size, 0x001c, 0, &len);
+	CHECK(r != NULL);
+	if (r) {
+		const uint8_t v33[8] = { 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x0a, 0x40 };
+
+		CHECK_EQ(len, 8);
+		CHECK(!memcmp(r, v33, 8));
+	}
+
+	init_config(&b);
+	debug_level = log_level = syslog_level = 0;
+	CHECK_EQ(bin_to_config(buf, size, &b), 0);
+	compare_config(&a, &b);
+	CHECK_EQ(debug_level, 1);
+	CHECK_EQ(log_level, LOG_INFO);
+	CHECK_EQ(syslog_level, LOG_WARNING);
+	free_config(&b);
+
+	/* Unknown records (from newer firmware) are skipped */
+	buf = append_record(buf, &size, 0x00fe, 0, "new setting", 11);
+	buf = append_record(buf, &size, 0x0180, 1, "new output setting", 18);
+	buf = append_record(buf, &size, 0x7000, 0, "new section", 11);
+	init_config(&b);
+	CHECK_EQ(bin_to_config(buf, size, &b), 0);
+	compare_config(&a, &b);
+	free_config(&b);
+
+	/* Duplicate effect records: last one wins (without leaking the others) */
+	buf = append_record(buf, &size, 0x0107, 1, "blink\0" "100,200", 13);
+	buf = append_record(buf, &size, 0x0107, 1, "pulse\0" "300,400", 13);
+	init_config(&b);
+	effect_ctx_count = 0;
+	memset(effect_ctx_live, 0, sizeof(effect_ctx_live));
+	CHECK_EQ(bin_to_config(buf, size, &b), 0);
+	CHECK_EQ(b.outputs[1].effect, 3);
+	CHECK(b.outputs[1].effect_ctx && !strcmp(b.outputs[1].effect_ctx, "300,400"));
+	free_config(&b);
+#ifdef WRAP_FREE
+	CHECK_EQ(effect_ctx_count, 0);
+#endif
+
+	/* Corrupted and truncated files are rejected */
+	log_errors = 0;
+	init_config(&b);
+	buf[size - 1] ^= 0x01;
+	CHECK_EQ(bin_to_config(buf, size, &b), -5);
+	buf[size - 1] ^= 0x01;
+	CHECK_EQ(bin_to_config(buf, size - 1, &b), -4);
+	CHECK_EQ(bin_to_config(buf, 8, &b), -1);
+	memcpy(&payload_len, buf + 8, 4);
+	bad_len = 0xfffffff8;  /* header_len + payload_len wraps around */
+	memcpy(buf + 8, &bad_len, 4);
+	CHECK_EQ(bin_to_config(buf, size, &b), -4);
+	memcpy(buf + 8, &payload_len, 4);
+	buf[6] = buf[7] = 0xff;  /* header_len larger than the file */
+	CHECK_EQ(bin_to_config(buf, size, &b), -4);
+	buf[6] = 16;
+	buf[7] = 0;
+	buf[0] = 'X';
+	CHECK_EQ(bin_to_config(buf, size, &b), -2);
+	CHECK_EQ(log_errors, 5);
+	CHECK(!strcmp(b.name, ""));
+	free_config(&b);
+
+	free(buf);
+	free_config(&a);
+}
+
+static void test_effect_overflow()
+{
+	struct brickpico_config a;
+	char args[300];
+	uint32_t size;
+	uint8_t *buf;
+
+	/* Longest effect parameters that fit in a record ("fade\0" + args) */
+	fill_config(&a);
+	memset(args, '1', sizeof(args));
+	args[255 - 5] = 0;
+	free(a.outputs[1].effect_ctx);
+	a.outputs[1].effect_ctx = strdup(args);
+	CHECK((buf = config_to_bin(&a, &size)) != NULL);
+	free(buf);
+
+	/* One byte too long must fail instead of truncating parameters */
+	log_errors = 0;
+	args[255 - 5] = '1';
+	args[255 - 4] = 0;
+	free(a.outputs[1].effect_ctx);
+	a.outputs[1].effect_ctx = strdup(args);
+	CHECK(config_to_bin(&a, &size) == NULL);
+	CHECK(log_errors > 0);
+
+	free_config(&a);
+}
+
+
+#ifdef HAVE_CJSON
+static void json_write(void *ctx, const char *data, size_t len)
+{
+	struct { char *buf; size_t len; } *out = ctx;
+
+	out->buf = realloc(out->buf, out->len + len + 1);
+	memcpy(out->buf + out->len, data, len);
+	out->len += len;
+	out->buf[out->len] = 0;
+}
+
+/* Generate JSON document with same content (and similar layout) as
+   config_to_json() would for the configuration. */
+static char* config_json(const struct brickpico_config *c)
+{
+	struct { char *buf; size_t len; } out = { NULL, 0 };
+	struct json_stream js;
+
+	json_stream_init(&js, json_write, &out);
+	json_stream_object_start(&js, NULL);
+	json_stream_string(&js, "id", "brickpico-config-v1");
+	json_stream_number(&js, "debug", debug_level);
+	json_stream_string(&js, "log_level", "INFO");
+	json_stream_string(&js, "syslog_level", "WARNING");
+	json_stream_number(&js, "local_echo", c->local_echo);
+	json_stream_number(&js, "led_mode", c->led_mode);
+	json_stream_number(&js, "spi_active", c->spi_active);
+	json_stream_number(&js, "serial_active", c->serial_active);
+	json_stream_number(&js, "pwm_freq", c->pwm_freq);
+	json_stream_string(&js, "display_type", c->display_type);
+	json_stream_string(&js, "display_theme", c->display_theme);
+	json_stream_string(&js, "display_logo", c->display_logo);
+	json_stream_string(&js, "display_layout_r", c->display_layout_r);
+	json_stream_string(&js, "gamma", c->gamma);
+	json_stream_string(&js, "name", c->name);
+	json_stream_string(&js, "timezone", c->timezone);
+	json_stream_number(&js, "adc_ref_voltage", c->adc_ref_voltage);
+	json_stream_number(&js, "temp_offset", c->temp_offset);
+	json_stream_number(&js, "temp_coefficient", c->temp_coefficient);
+	json_stream_number(&js, "history_blocks", c->history_blocks);
+	json_stream_array_start(&js, "outputs");
+	for (int i = 0; i < OUTPUT_COUNT; i++) {
+		const struct pwm_output *o = &c->outputs[i];
+
+		json_stream_object_start(&js, NULL);
+		json_stream_number(&js, "id", i);
+		json_stream_string(&js, "name", o->name);
+		json_stream_number(&js, "min_pwm", o->min_pwm);
+		json_stream_number(&js, "max_pwm", o->max_pwm);
+		json_stream_number(&js, "default_pwm", o->default_pwm);
+		json_stream_number(&js, "default_state", o->default_state);
+		json_stream_number(&js, "type", o->type);
+		json_stream_string(&js, "effect", effect2str(o->effect));
+		if (o->effect_ctx)
+			json_stream_string(&js, "effect_args", o->effect_ctx);
+		json_stream_object_end(&js);
+	}
+	json_stream_array_end(&js);
+	json_stream_array_start(&js, "events");
+	for (int i = 0; i < c->event_count; i++) {
+		const struct timer_event *e = &c->events[i];
+
+		json_stream_object_start(&js, NULL);
+		json_stream_string(&js, "name", e->name);
+		json_stream_number(&js, "minute", e->minute);
+		json_stream_number(&js, "hour", e->hour);
+		json_stream_number(&js, "wday", e->wday);
+		json_stream_number(&js, "action", e->action);
+		json_stream_number(&js, "mask", e->mask);
+		json_stream_object_end(&js);
+	}
+	json_stream_array_end(&js);
+	json_stream_object_end(&js);
+	json_stream_flush(&js);
+
+	return out.buf;
+}
+#endif
+
+/* Compare parse time and peak heap usage of binary and JSON formats.
+   JSON numbers only include cJSON_Parse() (not json_to_config()), so
+   they are a lower bound for loading the JSON configuration. */
+static void bench_parse()
+{
+	struct brickpico_config a, b;
+	uint8_t *buf;
+	uint32_t size;
+	uint64_t t;
+	int rounds = 20000;
+
+	fill_config(&a);
+	buf = config_to_bin(&a, &size);
+	if (!buf)
+		return;
+
+	/* bin_to_config() itself does not allocate memory, peak heap usage
+	   is the file buffer plus effect contexts. */
+	t = test_time_ns();
+	for (int i = 0; i < rounds; i++) {
+		init_config(&b);
+		bin_to_config(buf, size, &b);
+		free_config(&b);
+	}
+	t = test_time_ns() - t;
+	printf("config_bin: binary: size=%u bytes, parse=%.2f us, peak heap=%u bytes (file buffer)\n",
+		size, t / 1e3 / rounds, size);
+	free(buf);
+
+#ifdef HAVE_CJSON
+	{
+		cJSON_Hooks hooks = { counting_malloc, counting_free };
+		char *json = config_json(&a);
+		size_t json_len = strlen(json);
+		cJSON *root;
+
+		cJSON_InitHooks(&hooks);
+		heap_used = heap_peak = 0;
+		root = cJSON_Parse(json);
+		CHECK(root != NULL);
+		cJSON_Delete(root);
+		CHECK_EQ(heap_used, 0);
+
+		t = test_time_ns();
+		for (int i = 0; i < rounds; i++)
+			cJSON_Delete(cJSON_Parse(json));
+		t = test_time_ns() - t;
+		printf("config_bin: JSON: size=%u bytes, parse=%.2f us, peak heap=%u bytes (file buffer + cJSON tree)\n",
+			(unsigned int)json_len, t / 1e3 / rounds,
+			(unsigned int)(json_len + 1 + heap_peak));
+		free(json);
+	}
+#else
+	printf("config_bin: cJSON not available (libs/cJSON submodule), skipping JSON comparison\n");
+#endif
+
+	free_config(&a);
+}
+
+
+int main()
+{
+	test_roundtrip();
+	test_effect_overflow();
+	bench_parse();
+
+	return test_result("config_bin");
+}
+
+/* eof :-) */
@@ -0,0 +1,136 @@
+/* test_crc32.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+/* crc32.c */
+void xcrc32_init(void);
+unsigned int xcrc32 (const unsigned char *buf, int len, unsigned int init);
+
+
+#define BUF_LEN 4096
+
+static unsigned char buf[BUF_LEN + 8];
+
+
+/* Bitwise reference implementation (poly 0x04c11db7, not reflected). */
+static unsigned int crc32_ref(const unsigned char *p, int len, unsigned int crc)
+{
+	while (len--) {
+		crc ^= (unsigned int)*p++ << 24;
+		for (int i = 0; i < 8; i++)
+			crc = (crc & 0x80000000 ? (crc << 1) ^ 0x04c11db7 : crc << 1);
+	}
+	return crc;
+}
+
+static void fill_buf()
+{
+	unsigned int x = 0x12345678;
+
+	for (int i = 0; i < sizeof(buf); i++) {
+		x = x * 1103515245 + 12345;
+		buf[i] = x >> 16;
+	}
+}
+
+/* Compare xcrc32() against reference with all lengths (up to 300 bytes)
+   and alignments. Before xcrc32_init() this exercises the original
+   byte-at-a-time table path, after it the slicing-by-4 path. */
+static void cross_check(const char *name)
+{
+	int errors = 0;
+
+	for (int offset = 0; offset < 4; offset++) {
+		for (int len = 0; len <= 300; len++) {
+			if (xcrc32(buf + offset, len, 0xffffffff)
+				!= crc32_ref(buf + offset, len, 0xffffffff))
+				errors++;
+		}
+	}
+	CHECK_EQ(xcrc32(buf, BUF_LEN, 0xffffffff), crc32_ref(buf, BUF_LEN, 0xffffffff));
+	CHECK_EQ(xcrc32(buf + 3, BUF_LEN - 3, 0), crc32_ref(buf + 3, BUF_LEN - 3, 0));
+	if (errors)
+		fprintf(stderr, "%s: %d mismatches\n", name, errors);
+	CHECK_EQ(errors, 0);
+}
+
+static void test_vectors()
+{
+	const unsigned char check[] = "123456789";
+	unsigned int crc;
+
+	/* CRC-32/MPEG-2 check value */
+	CHECK_EQ(xcrc32(check, 9, 0xffffffff), 0x0376e6e7);
+	CHECK_EQ(xcrc32(check, 0, 0xffffffff), 0xffffffff);
+
+	/* CRC can be calculated incrementally */
+	crc = xcrc32(buf, 1000, 0xffffffff);
+	crc = xcrc32(buf + 1000, 7, crc);
+	crc = xcrc32(buf + 1007, 1500, crc);
+	CHECK_EQ(crc, xcrc32(buf, 2507, 0xffffffff));
+}
+
+static double bench(int len, int rounds)
+{
+	volatile unsigned int sink = 0;
+	uint64_t t;
+
+	t = test_time_ns();
+	for (int i = 0; i < rounds; i++)
+		sink += xcrc32(buf + (i & 3), len, 0xffffffff);
+	t = test_time_ns() - t;
+
+	return (double)len * rounds * 1e3 / (t ? t : 1);
+}
+
+
+int main()
+{
+	const int lens[] = { 16, 64, 256, 4092 };
+	double bytes_mbs[4];
+
+	fill_buf();
+
+	/* Original byte-at-a-time implementation */
+	cross_check("bytes");
+	test_vectors();
+	for (int i = 0; i < 4; i++)
+		bytes_mbs[i] = bench(lens[i], (1 << 24) / lens[i]);
+
+	/* Slicing-by-4 */
+	xcrc32_init();
+	cross_check("slice4");
+	test_vectors();
+	for (int i = 0; i < 4; i++) {
+		double mbs = bench(lens[i], (1 << 24) / lens[i]);
+		printf("crc32: len=%4d bytes: %7.1f MB/s slice4: %7.1f MB/s (%.2fx)\n",
+			lens[i], bytes_mbs[i], mbs, mbs / bytes_mbs[i]);
+	}
+
+	return test_result("crc32");
+}
+
+/* eof :-) */
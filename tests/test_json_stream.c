@@ -0,0 +1,203 @@
+/* test_json_stream.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "brickpico.h"
+#include "test.h"
+
+
+/* Output sink that collects all chunks and keeps track of chunk sizes. */
+struct sink {
+	char *buf;
+	size_t len;
+	size_t writes;
+	size_t max_chunk;
+};
+
+static void sink_write(void *ctx, const char *data, size_t len)
+{
+	struct sink *s = ctx;
+
+	s->buf = realloc(s->buf, s->len + len + 1);
+	memcpy(s->buf + s->len, data, len);
+	s->len += len;
+	s->buf[s->len] = 0;
+	s->writes++;
+	if (len > s->max_chunk)
+		s->max_chunk = len;
+}
+
+static void sink_init(struct sink *s, struct json_stream *js)
+{
+	memset(s, 0, sizeof(*s));
+	json_stream_init(js, sink_write, s);
+}
+
+static void check_output(struct sink *s, struct json_stream *js, const char *expected)
+{
+	json_stream_flush(js);
+	CHECK(s->buf != NULL);
+	if (!s->buf)
+		return;
+	if (strcmp(s->buf, expected)) {
+		fprintf(stderr, "output:\n%s\nexpected:\n%s\n", s->buf, expected);
+		test_failures++;
+	}
+	CHECK_EQ(js->bytes, s->len);
+	CHECK(s->max_chunk <= sizeof(js->buf));
+	free(s->buf);
+	s->buf = NULL;
+}
+
+
+/* Strings of every length up to 300 bytes, so that chunk boundaries fall
+   at every possible position (including inside escape sequences). */
+static void test_chunks()
+{
+	struct json_stream js;
+	struct sink s;
+	char val[301], esc[601], expected[700];
+
+	for (int len = 0; len <= 300; len++) {
+		int e = 0;
+
+		for (int i = 0; i < len; i++) {
+			val[i] = (i % 7 == 3 ? '"' : 'a' + i % 26);
+			if (val[i] == '"')
+				esc[e++] = '\\';
+			esc[e++] = val[i];
+		}
+		val[len] = 0;
+		esc[e] = 0;
+		snprintf(expected, sizeof(expected), "{\n\t\"name\":\t\"%s\"\n}", esc);
+
+		sink_init(&s, &js);
+		json_stream_object_start(&js, NULL);
+		json_stream_string(&js, "name", val);
+		json_stream_object_end(&js);
+		check_output(&s, &js, expected);
+	}
+}
+
+/* Output formatting (same as cJSON_Print()). */
+static void test_format()
+{
+	struct json_stream js;
+	struct sink s;
+
+	sink_init(&s, &js);
+	json_stream_object_start(&js, NULL);
+	json_stream_number(&js, "int", 42);
+	json_stream_number(&js, "neg", -3);
+	json_stream_number(&js, "frac", 0.1);
+	json_stream_number(&js, "third", 1.0 / 3.0);
+	json_stream_bool(&js, "t", true);
+	json_stream_bool(&js, "f", false);
+	json_stream_string(&js, "esc", "a\"b\\c\n\r\t\x01");
+	json_stream_string(&js, "null", NULL);
+	json_stream_array_start(&js, "arr");
+	json_stream_number(&js, NULL, 1);
+	json_stream_number(&js, NULL, 2);
+	json_stream_string(&js, NULL, "x");
+	json_stream_array_end(&js);
+	json_stream_array_start(&js, "objs");
+	json_stream_object_start(&js, NULL);
+	json_stream_number(&js, "id", 1);
+	json_stream_object_end(&js);
+	json_stream_array_end(&js);
+	json_stream_object_start(&js, "empty");
+	json_stream_object_end(&js);
+	json_stream_object_start(&js, "sub");
+	json_stream_string(&js, "name", "value");
+	json_stream_object_end(&js);
+	json_stream_object_end(&js);
+
+	check_output(&s, &js,
+		"{\n"
+		"\t\"int\":\t42,\n"
+		"\t\"neg\":\t-3,\n"
+		"\t\"frac\":\t0.1,\n"
+		"\t\"third\":\t0.333333333333333,\n"
+		"\t\"t\":\ttrue,\n"
+		"\t\"f\":\tfalse,\n"
+		"\t\"esc\":\t\"a\\\"b\\\\c\\n\\r\\t\\u0001\",\n"
+		"\t\"null\":\t\"\",\n"
+		"\t\"arr\":\t[1, 2, \"x\"],\n"
+		"\t\"objs\":\t[{\n"
+		"\t\t\t\"id\":\t1\n"
+		"\t\t}],\n"
+		"\t\"empty\":\t{\n"
+		"\t},\n"
+		"\t\"sub\":\t{\n"
+		"\t\t\"name\":\t\"value\"\n"
+		"\t}\n"
+		"}");
+}
+
+/* Memory usage does not depend on size of the document. */
+static void test_large()
+{
+	struct json_stream js;
+	struct sink s;
+	char name[32];
+
+	sink_init(&s, &js);
+	json_stream_object_start(&js, NULL);
+	json_stream_array_start(&js, "outputs");
+	for (int i = 0; i < 1000; i++) {
+		snprintf(name, sizeof(name), "Output %d", i + 1);
+		json_stream_object_start(&js, NULL);
+		json_stream_string(&js, "name", name);
+		json_stream_number(&js, "min_pwm", 0);
+		json_stream_number(&js, "max_pwm", 100);
+		json_stream_string(&js, "effect", "fade");
+		json_stream_object_end(&js);
+	}
+	json_stream_array_end(&js);
+	json_stream_object_end(&js);
+	json_stream_flush(&js);
+
+	CHECK(s.len > 50000);
+	CHECK_EQ(js.bytes, s.len);
+	CHECK_EQ(js.depth, 0);
+	CHECK(s.max_chunk <= sizeof(js.buf));
+	/* All but the last chunk should be full */
+	CHECK_EQ(s.writes, (s.len + sizeof(js.buf) - 1) / sizeof(js.buf));
+	printf("json_stream: %u bytes in %u writes, state %u bytes\n",
+		(unsigned int)s.len, (unsigned int)s.writes, (unsigned int)sizeof(js));
+	free(s.buf);
+}
+
+
+int main()
+{
+	test_chunks();
+	test_format();
+	test_large();
+
+	return test_result("json_stream");
+}
+
+/* eof :-) */
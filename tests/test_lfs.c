@@ -0,0 +1,221 @@
+/* test_lfs.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lfs.h"
+#include "test.h"
+
+
+/* Timing of littlefs access patterns on a RAM-backed block device
+   (same geometry as the filesystem in flash):
+
+     remount: mount/unmount around every operation (as flash.c used to do)
+     cached:  filesystem stays mounted and file handle is kept open
+              (as flash.c does now), file is synced every FS_SYNC_THRESHOLD
+              bytes.
+
+   Block device read/program/erase counts are reported as well, since on
+   real flash those (not CPU time) dominate the cost. */
+
+#define FS_SIZE              (256 * 1024)
+#define FS_BLOCK_SIZE        4096
+#define FS_PAGE_SIZE         256
+#define FS_SYNC_THRESHOLD    4096
+#define OPS                  500
+#define RECORD_LEN           64
+
+struct ram_bd {
+	uint8_t data[FS_SIZE];
+	uint32_t reads;
+	uint32_t read_bytes;
+	uint32_t progs;
+	uint32_t erases;
+};
+
+static struct ram_bd bd;
+
+static int bd_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off,
+		void *buffer, lfs_size_t size)
+{
+	memcpy(buffer, bd.data + block * c->block_size + off, size);
+	bd.reads++;
+	bd.read_bytes += size;
+	return LFS_ERR_OK;
+}
+
+static int bd_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off,
+		const void *buffer, lfs_size_t size)
+{
+	memcpy(bd.data + block * c->block_size + off, buffer, size);
+	bd.progs++;
+	return LFS_ERR_OK;
+}
+
+static int bd_erase(const struct lfs_config *c, lfs_block_t block)
+{
+	memset(bd.data + block * c->block_size, 0xff, c->block_size);
+	bd.erases++;
+	return LFS_ERR_OK;
+}
+
+static int bd_sync(const struct lfs_config *c)
+{
+	return LFS_ERR_OK;
+}
+
+static const struct lfs_config cfg = {
+	.read = bd_read,
+	.prog = bd_prog,
+	.erase = bd_erase,
+	.sync = bd_sync,
+	.read_size = 1,
+	.prog_size = FS_PAGE_SIZE,
+	.block_size = FS_BLOCK_SIZE,
+	.block_count = FS_SIZE / FS_BLOCK_SIZE,
+	.block_cycles = 500,
+	.cache_size = FS_PAGE_SIZE,
+	.lookahead_size = 32,
+};
+
+static lfs_t lfs;
+
+
+static void bd_reset_stats()
+{
+	bd.reads = bd.read_bytes = bd.progs = bd.erases = 0;
+}
+
+static void fill_record(uint8_t *buf, int n)
+{
+	for (int i = 0; i < RECORD_LEN; i++)
+		buf[i] = (n * 7 + i) & 0xff;
+}
+
+/* Create some files, so that mounting has metadata to scan. */
+static void setup_fs()
+{
+	lfs_file_t f;
+	char name[32];
+	uint8_t buf[2048];
+
+	memset(bd.data, 0xff, sizeof(bd.data));
+	CHECK_EQ(lfs_format(&lfs, &cfg), LFS_ERR_OK);
+	CHECK_EQ(lfs_mount(&lfs, &cfg), LFS_ERR_OK);
+	memset(buf, 'x', sizeof(buf));
+	for (int i = 0; i < 8; i++) {
+		snprintf(name, sizeof(name), "file%d", i);
+		CHECK_EQ(lfs_file_open(&lfs, &f, name, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC), 0);
+		CHECK_EQ(lfs_file_write(&lfs, &f, buf, sizeof(buf)), sizeof(buf));
+		CHECK_EQ(lfs_file_close(&lfs, &f), 0);
+	}
+	CHECK_EQ(lfs_unmount(&lfs), LFS_ERR_OK);
+}
+
+/* Append records to a file (like history log), remounting every time. */
+static void bench_remount(const char *name)
+{
+	lfs_file_t f;
+	uint8_t rec[RECORD_LEN];
+	uint64_t t;
+
+	bd_reset_stats();
+	t = test_time_ns();
+	for (int i = 0; i < OPS; i++) {
+		fill_record(rec, i);
+		CHECK_EQ(lfs_mount(&lfs, &cfg), LFS_ERR_OK);
+		CHECK_EQ(lfs_file_open(&lfs, &f, name, LFS_O_WRONLY | LFS_O_CREAT), 0);
+		lfs_file_seek(&lfs, &f, i * RECORD_LEN, LFS_SEEK_SET);
+		CHECK_EQ(lfs_file_write(&lfs, &f, rec, sizeof(rec)), sizeof(rec));
+		lfs_file_close(&lfs, &f);
+		lfs_unmount(&lfs);
+	}
+	t = test_time_ns() - t;
+	printf("lfs: remount: %6.1f us/op, reads/op %6.1f (%7.1f bytes), progs/op %5.2f, erases/op %5.3f\n",
+		t / 1e3 / OPS, (double)bd.reads / OPS, (double)bd.read_bytes / OPS,
+		(double)bd.progs / OPS, (double)bd.erases / OPS);
+}
+
+/* Same with filesystem kept mounted and file handle cached. */
+static void bench_cached(const char *name)
+{
+	lfs_file_t f;
+	uint8_t rec[RECORD_LEN];
+	uint32_t dirty = 0;
+	uint64_t t;
+
+	bd_reset_stats();
+	t = test_time_ns();
+	CHECK_EQ(lfs_mount(&lfs, &cfg), LFS_ERR_OK);
+	CHECK_EQ(lfs_file_open(&lfs, &f, name, LFS_O_RDWR | LFS_O_CREAT), 0);
+	for (int i = 0; i < OPS; i++) {
+		fill_record(rec, i);
+		lfs_file_seek(&lfs, &f, i * RECORD_LEN, LFS_SEEK_SET);
+		CHECK_EQ(lfs_file_write(&lfs, &f, rec, sizeof(rec)), sizeof(rec));
+		if ((dirty += sizeof(rec)) >= FS_SYNC_THRESHOLD) {
+			lfs_file_sync(&lfs, &f);
+			dirty = 0;
+		}
+	}
+	lfs_file_close(&lfs, &f);
+	lfs_unmount(&lfs);
+	t = test_time_ns() - t;
+	printf("lfs: cached:  %6.1f us/op, reads/op %6.1f (%7.1f bytes), progs/op %5.2f, erases/op %5.3f\n",
+		t / 1e3 / OPS, (double)bd.reads / OPS, (double)bd.read_bytes / OPS,
+		(double)bd.progs / OPS, (double)bd.erases / OPS);
+}
+
+/* Both access patterns must produce identical file. */
+static void verify_file(const char *name)
+{
+	lfs_file_t f;
+	uint8_t rec[RECORD_LEN], buf[RECORD_LEN];
+	int errors = 0;
+
+	CHECK_EQ(lfs_mount(&lfs, &cfg), LFS_ERR_OK);
+	CHECK_EQ(lfs_file_open(&lfs, &f, name, LFS_O_RDONLY), 0);
+	CHECK_EQ(lfs_file_size(&lfs, &f), OPS * RECORD_LEN);
+	for (int i = 0; i < OPS; i++) {
+		fill_record(rec, i);
+		if (lfs_file_read(&lfs, &f, buf, sizeof(buf)) != sizeof(buf)
+			|| memcmp(rec, buf, sizeof(buf)))
+			errors++;
+	}
+	CHECK_EQ(errors, 0);
+	lfs_file_close(&lfs, &f);
+	lfs_unmount(&lfs);
+}
+
+
+int main()
+{
+	setup_fs();
+	bench_remount("remount.dat");
+	verify_file("remount.dat");
+	bench_cached("cached.dat");
+	verify_file("cached.dat");
+
+	return test_result("lfs");
+}
+
+/* eof :-) */
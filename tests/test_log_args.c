@@ -0,0 +1,233 @@
+/* test_log_args.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#define TICK_UNIT "TSC cycles"
+#else
+#define TICK_UNIT "ns"
+#endif
+
+#include "log_args.h"
+#include "test.h"
+
+
+/* Same sizes as in log.c */
+#define LOG_MAX_MSG_LEN 256
+#define LOG_ARGS_LEN    128
+
+
+/* Pack and format message, returns -1 if arguments could not be packed. */
+static int pack_format(char *out, size_t size, const char *format, ...)
+{
+	uint8_t args[LOG_ARGS_LEN];
+	va_list ap;
+	int res;
+
+	va_start(ap, format);
+	res = log_pack_args(args, sizeof(args), format, ap);
+	va_end(ap);
+	if (res >= 0)
+		log_format_args(out, size, format, args);
+
+	return res;
+}
+
+static int check_format(const char *format, ...)
+{
+	uint8_t args[LOG_ARGS_LEN];
+	char out[LOG_MAX_MSG_LEN], ref[LOG_MAX_MSG_LEN];
+	va_list ap;
+
+	va_start(ap, format);
+	vsnprintf(ref, sizeof(ref), format, ap);
+	va_end(ap);
+
+	va_start(ap, format);
+	if (log_pack_args(args, sizeof(args), format, ap) < 0) {
+		va_end(ap);
+		fprintf(stderr, "cannot pack: \"%s\"\n", format);
+		return 1;
+	}
+	va_end(ap);
+	log_format_args(out, sizeof(out), format, args);
+
+	if (strcmp(out, ref)) {
+		fprintf(stderr, "\"%s\": \"%s\" != \"%s\"\n", format, out, ref);
+		return 1;
+	}
+	return 0;
+}
+
+static void test_formats()
+{
+	int errors = 0;
+	int x = 42;
+
+	errors += check_format("no arguments");
+	errors += check_format("100%% done");
+	errors += check_format("%d %i %u %x %X %o", -1, 2, 3U, 0xabcU, 0xdefU, 8U);
+	errors += check_format("%ld %lu %lx", -123456789L, 123456789UL, 0xdeadbeefUL);
+	errors += check_format("%lld %llu", -1234567890123LL, 1234567890123ULL);
+	errors += check_format("%zu %zd %jd %td", (size_t)12345, (ssize_t)-5, (intmax_t)-77,
+			(ptrdiff_t)-3);
+	errors += check_format("%hhu %hd", 255, -12);
+	errors += check_format("%c%c%c", 'a', 'b', 'c');
+	errors += check_format("%f %.2f %e %g %10.3f", 3.14159, 2.5, 1e-5, 1e20, -0.5);
+	errors += check_format("%Lf", (long double)1.25);
+	errors += check_format("%p %p", (void*)&x, NULL);
+	errors += check_format("%s: '%s' '%10s' '%-10s' '%.3s'", "name", "", "right", "left",
+			"truncated");
+	errors += check_format("%*d|%-*d|%.*s|%*.*f", 6, 1, 4, 2, 2, "abc", 8, 2, 1.0 / 3.0);
+	errors += check_format("%08lx %+d % d %#x %#o", 0x1234UL, 5, 6, 255U, 8U);
+	errors += check_format("mixed %s=%d (%lu bytes, %.1f%%) at %p", "file", -3, 4096UL,
+			99.5, (void*)&errors);
+	CHECK_EQ(errors, 0);
+}
+
+static void test_limits()
+{
+	char out[LOG_MAX_MSG_LEN], longstr[300];
+
+	/* NULL string */
+	CHECK(pack_format(out, sizeof(out), "%s", (const char*)NULL) >= 0);
+	CHECK_EQ(strcmp(out, "(null)"), 0);
+
+	/* Long strings are truncated to fit */
+	memset(longstr, 'x', sizeof(longstr) - 1);
+	longstr[sizeof(longstr) - 1] = 0;
+	CHECK(pack_format(out, sizeof(out), "%s", longstr) >= 0);
+	CHECK_EQ(strlen(out), LOG_ARGS_LEN - 1);
+
+	/* Arguments that do not fit or unsupported conversions fail */
+	CHECK_EQ(pack_format(out, sizeof(out), "%s %d", longstr, 1), -1);
+	CHECK_EQ(pack_format(out, sizeof(out), "%ls", L"wide"), -1);
+	CHECK_EQ(pack_format(out, sizeof(out), "%n", &out[0]), -1);
+
+	/* Output buffer size is honored */
+	CHECK(pack_format(out, 8, "%s %d", "0123456789", 1) >= 0);
+	CHECK_EQ(strcmp(out, "0123456"), 0);
+}
+
+
+/* Benchmark cost of log_msg() on the calling core:
+
+     inline: what log_msg() used to do before returning (malloc() message
+             buffer, vsnprintf(), format timestamp and copy message into
+             persistent log), not including the (blocking) console output.
+     queued: pack arguments into local entry and copy it into queue slot
+             (what log_msg() does now), formatting happens later in
+             process_log_queue(). Only the copy is done with interrupts
+             disabled, that part is also reported separately.
+*/
+
+static char sink[LOG_MAX_MSG_LEN];
+static uint8_t queue_slot[8 + LOG_ARGS_LEN];
+static uint64_t critical_ticks = 0;
+
+static uint64_t ticks();
+
+static void log_inline(const char *format, ...)
+{
+	char tstamp[32];
+	char *buf;
+	va_list ap;
+
+	if (!(buf = malloc(LOG_MAX_MSG_LEN)))
+		return;
+	va_start(ap, format);
+	vsnprintf(buf, LOG_MAX_MSG_LEN, format, ap);
+	va_end(ap);
+	snprintf(tstamp, sizeof(tstamp), "[%6llu.%06llu][%u]", 123ULL, 456789ULL, 0);
+	snprintf(sink, sizeof(sink), "%s %s", tstamp, buf);
+	free(buf);
+}
+
+static void log_queued(const char *format, ...)
+{
+	uint8_t entry[8 + LOG_ARGS_LEN];
+	uint64_t t;
+	va_list ap;
+	int len;
+
+	va_start(ap, format);
+	len = log_pack_args(entry + 8, sizeof(entry) - 8, format, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+
+	t = ticks();
+	memcpy(queue_slot, entry, 8 + len);
+	critical_ticks += ticks() - t;
+}
+
+static uint64_t ticks()
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return test_time_ns();
+#endif
+}
+
+static void bench_log()
+{
+	const int rounds = 200000;
+	uint64_t t[2], c[2];
+
+	for (int mode = 0; mode < 2; mode++) {
+		t[mode] = test_time_ns();
+		c[mode] = ticks();
+		for (int i = 0; i < rounds; i++) {
+			if (mode == 0)
+				log_inline("effect: output %d: pwm=%u (%s) %lu", i & 15, i & 0xff,
+					"fade", (unsigned long)i);
+			else
+				log_queued("effect: output %d: pwm=%u (%s) %lu", i & 15, i & 0xff,
+					"fade", (unsigned long)i);
+		}
+		c[mode] = ticks() - c[mode];
+		t[mode] = test_time_ns() - t[mode];
+	}
+
+	printf("log_args: inline: %.1f ns/call (%.0f " TICK_UNIT "), queued: %.1f ns/call (%.0f "
+		TICK_UNIT ", %.0f " TICK_UNIT " with interrupts disabled)\n",
+		(double)t[0] / rounds, (double)c[0] / rounds,
+		(double)t[1] / rounds, (double)c[1] / rounds,
+		(double)critical_ticks / rounds);
+}
+
+
+int main()
+{
+	test_formats();
+	test_limits();
+	bench_log();
+
+	return test_result("log_args");
+}
+
+/* eof :-) */
@@ -0,0 +1,241 @@
+/* test_pca9685.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pca9685.h"
+#include "test.h"
+
+
+/* Mock I2C bus that records all transactions (and delays). */
+
+#define MOCK_MAX_EVENTS 64
+
+struct mock_event {
+	int delay;          /* != 0 for delay_us() call */
+	uint8_t addr;
+	uint8_t len;
+	uint8_t data[1 + PCA9685_CHANNELS * 4];
+};
+
+struct mock_bus {
+	struct mock_event events[MOCK_MAX_EVENTS];
+	int count;
+	int fail;           /* fail next write */
+};
+
+static struct mock_bus mock;
+
+static int mock_write(void *ctx, uint8_t addr, const uint8_t *buf, size_t len)
+{
+	struct mock_bus *m = (struct mock_bus*)ctx;
+	struct mock_event *e;
+
+	if (m->fail) {
+		m->fail = 0;
+		return -1;
+	}
+	if (m->count >= MOCK_MAX_EVENTS || len > sizeof(e->data))
+		return -1;
+	e = &m->events[m->count++];
+	e->delay = 0;
+	e->addr = addr;
+	e->len = len;
+	memcpy(e->data, buf, len);
+
+	return len;
+}
+
+static void mock_delay_us(uint32_t us)
+{
+	if (mock.count < MOCK_MAX_EVENTS)
+		mock.events[mock.count++].delay = us;
+}
+
+static void mock_reset()
+{
+	memset(&mock, 0, sizeof(mock));
+}
+
+static int is_reg_write(const struct mock_event *e, uint8_t addr, uint8_t reg, uint8_t val)
+{
+	return (!e->delay && e->addr == addr && e->len == 2
+		&& e->data[0] == reg && e->data[1] == val);
+}
+
+static void check_channel(const uint8_t *p, uint8_t on_l, uint8_t on_h, uint8_t off_l, uint8_t off_h)
+{
+	CHECK_EQ(p[0], on_l);
+	CHECK_EQ(p[1], on_h);
+	CHECK_EQ(p[2], off_l);
+	CHECK_EQ(p[3], off_h);
+}
+
+
+static void test_init(pca9685_bus_t *bus, pca9685_t *dev)
+{
+	mock_reset();
+	CHECK_EQ(pca9685_init(dev, bus, PCA9685_BASE_ADDR + 1, 1000), 0);
+
+	/* MODE1 (sleep), PRESCALE, MODE2, MODE1 (wake), oscillator delay */
+	CHECK_EQ(mock.count, 5);
+	CHECK(is_reg_write(&mock.events[0], 0x41, 0x00, 0x31));
+	/* round(25MHz / (4096 * 1000Hz)) - 1 = 5 */
+	CHECK(is_reg_write(&mock.events[1], 0x41, 0xfe, 5));
+	CHECK(is_reg_write(&mock.events[2], 0x41, 0x01, 0x04));
+	CHECK(is_reg_write(&mock.events[3], 0x41, 0x00, 0x21));
+	CHECK_EQ(mock.events[4].delay, 500);
+	CHECK_EQ(dev->present, 1);
+	CHECK_EQ(dev->dirty, 0xffff);
+}
+
+static void test_first_flush(pca9685_t *dev)
+{
+	const struct mock_event *e;
+
+	/* All channels are written in one auto-increment transaction */
+	mock_reset();
+	CHECK_EQ(pca9685_flush(dev), 0);
+	CHECK_EQ(mock.count, 1);
+	e = &mock.events[0];
+	CHECK_EQ(e->len, 1 + PCA9685_CHANNELS * 4);
+	CHECK_EQ(e->data[0], 0x06);
+	for (int i = 0; i < PCA9685_CHANNELS; i++)
+		check_channel(&e->data[1 + i * 4], 0, 0, 0, 0x10);
+	CHECK_EQ(dev->dirty, 0);
+
+	/* Nothing to write anymore */
+	mock_reset();
+	CHECK_EQ(pca9685_flush(dev), 0);
+	CHECK_EQ(mock.count, 0);
+}
+
+static void test_span(pca9685_t *dev)
+{
+	const struct mock_event *e;
+
+	mock_reset();
+	pca9685_set_level(dev, 3, 2048);
+	pca9685_set_level(dev, 7, PCA9685_LEVEL_MAX + 100);  /* clamped to full on */
+	CHECK_EQ(dev->dirty, (1 << 3) | (1 << 7));
+	CHECK_EQ(pca9685_flush(dev), 0);
+	CHECK_EQ(mock.count, 1);
+	e = &mock.events[0];
+	/* span from channel 3 to channel 7 */
+	CHECK_EQ(e->len, 1 + 5 * 4);
+	CHECK_EQ(e->data[0], 0x06 + 3 * 4);
+	check_channel(&e->data[1], 0, 0, 0x00, 0x08);
+	for (int i = 4; i < 7; i++)
+		check_channel(&e->data[1 + (i - 3) * 4], 0, 0, 0, 0x10);
+	check_channel(&e->data[1 + 4 * 4], 0, 0x10, 0, 0);
+
+	/* Setting same level again does not cause a write */
+	mock_reset();
+	pca9685_set_level(dev, 3, 2048);
+	CHECK_EQ(dev->dirty, 0);
+	CHECK_EQ(pca9685_flush(dev), 0);
+	CHECK_EQ(mock.count, 0);
+
+	/* Change and revert before flush */
+	pca9685_set_level(dev, 5, 100);
+	pca9685_set_level(dev, 5, 0);
+	CHECK_EQ(dev->dirty, 0);
+
+	/* Invalid channel is ignored */
+	pca9685_set_level(dev, PCA9685_CHANNELS, 100);
+	CHECK_EQ(dev->dirty, 0);
+}
+
+static void test_errors(pca9685_bus_t *bus, pca9685_t *dev)
+{
+	uint32_t errors = bus->errors;
+
+	/* Failed write keeps channels dirty, so they are retried */
+	mock_reset();
+	mock.fail = 1;
+	pca9685_set_level(dev, 15, 1);
+	CHECK(pca9685_flush(dev) < 0);
+	CHECK_EQ(bus->errors, errors + 1);
+	CHECK_EQ(dev->dirty, 1 << 15);
+	CHECK_EQ(pca9685_flush(dev), 0);
+	CHECK_EQ(mock.count, 1);
+	CHECK_EQ(mock.events[0].len, 5);
+	CHECK_EQ(mock.events[0].data[0], 0x06 + 15 * 4);
+	check_channel(&mock.events[0].data[1], 0, 0, 1, 0);
+	CHECK_EQ(dev->dirty, 0);
+}
+
+static void test_accounting(pca9685_bus_t *bus, pca9685_t *dev1, pca9685_t *dev2)
+{
+	uint64_t frames = bus->frames;
+
+	/* Both devices share the bus, frame counts bytes on the bus
+	   (including address byte) for both of them */
+	mock_reset();
+	pca9685_frame_begin(bus);
+	pca9685_set_level(dev1, 0, 10);
+	pca9685_set_level(dev2, 1, 10);
+	pca9685_flush(dev1);
+	pca9685_flush(dev2);
+	pca9685_frame_end(bus);
+	CHECK_EQ(mock.count, 2);
+	CHECK_EQ(mock.events[0].addr, dev1->addr);
+	CHECK_EQ(mock.events[1].addr, dev2->addr);
+	CHECK_EQ(bus->frames, frames + 1);
+	CHECK_EQ(bus->frame_transactions, 2);
+	CHECK_EQ(bus->last_frame_bytes, 2 * (1 + 1 + 4));
+
+	/* Frames without any transactions are not counted */
+	pca9685_frame_begin(bus);
+	pca9685_flush(dev1);
+	pca9685_frame_end(bus);
+	CHECK_EQ(bus->frames, frames + 1);
+}
+
+
+int main()
+{
+	pca9685_bus_t bus;
+	pca9685_t dev1, dev2;
+
+	pca9685_bus_init(&bus, mock_write, mock_delay_us, &mock);
+	test_init(&bus, &dev1);
+	test_first_flush(&dev1);
+	test_span(&dev1);
+	test_errors(&bus, &dev1);
+
+	mock_reset();
+	CHECK_EQ(pca9685_init(&dev2, &bus, PCA9685_BASE_ADDR + 2, 1000), 0);
+	pca9685_flush(&dev2);
+	test_accounting(&bus, &dev1, &dev2);
+
+	/* Init fails if device does not respond */
+	mock_reset();
+	mock.fail = 1;
+	CHECK(pca9685_init(&dev2, &bus, PCA9685_BASE_ADDR + 3, 1000) < 0);
+	CHECK_EQ(dev2.present, 0);
+
+	return test_result("pca9685");
+}
+
+/* eof :-) */
@@ -0,0 +1,224 @@
+/* test_persistent_log.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "brickpico.h"
+#include "test.h"
+
+
+/* persistent_log.c only needs the persistent memory block and xcrc32()
+   from the rest of the firmware. xcrc32() here is the plain bitwise
+   version, that also counts how many bytes were checksummed. */
+
+static struct persistent_memory_block pmem_block;
+struct persistent_memory_block *persistent_mem = &pmem_block;
+
+static uint64_t crc_bytes = 0;
+
+unsigned int xcrc32(const unsigned char *buf, int len, unsigned int init)
+{
+	unsigned int crc = init;
+
+	crc_bytes += len;
+	while (len-- > 0) {
+		crc ^= (unsigned int)*buf++ << 24;
+		for (int i = 0; i < 8; i++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+	}
+	return crc;
+}
+
+
+static void add_msg(const char *msg)
+{
+	size_t len = strlen(msg) + 1;
+	char *buf = persistent_log_reserve(len);
+
+	CHECK(buf != NULL);
+	if (!buf)
+		return;
+	memcpy(buf, msg, len);
+	CHECK(persistent_log_commit(buf) == 0);
+}
+
+static int read_log(char msgs[][64], int max, int *corrupt)
+{
+	var_ringbuffer_iter_t iter;
+	const char *msg;
+	int count = 0;
+	int len;
+
+	*corrupt = 0;
+	var_ringbuffer_iter_init(&persistent_mem->log_rb, &iter);
+	while ((len = persistent_log_next(&iter, &msg)) != 0) {
+		if (len == -5) {
+			(*corrupt)++;
+			continue;
+		}
+		if (len < 0)
+			break;
+		if (count < max)
+			snprintf(msgs[count], sizeof(msgs[0]), "%s", msg);
+		count++;
+	}
+	return count;
+}
+
+static void test_roundtrip()
+{
+	char msgs[8][64];
+	int corrupt;
+
+	init_persistent_log();
+	index_persistent_log();
+	CHECK(persistent_log_valid());
+
+	add_msg("first message");
+	add_msg("second message");
+	add_msg("");
+	CHECK_EQ(read_log(msgs, 8, &corrupt), 3);
+	CHECK_EQ(corrupt, 0);
+	CHECK(!strcmp(msgs[0], "first message"));
+	CHECK(!strcmp(msgs[1], "second message"));
+	CHECK(!strcmp(msgs[2], ""));
+	CHECK(persistent_log_valid());
+}
+
+/* Log buffer wraps around, only the most recent messages remain. */
+static void test_wraparound()
+{
+	char msgs[512][64];
+	char buf[64];
+	int corrupt, count;
+	int total = 2000;
+
+	init_persistent_log();
+	index_persistent_log();
+	for (int i = 0; i < total; i++) {
+		snprintf(buf, sizeof(buf), "message %05d %.*s", i, i % 40,
+			"........................................");
+		add_msg(buf);
+	}
+	CHECK(persistent_log_valid());
+
+	count = read_log(msgs, 512, &corrupt);
+	CHECK_EQ(corrupt, 0);
+	CHECK(count > 0 && count < total && count <= 512);
+	for (int i = 0; i < count && i < 512; i++) {
+		int n = total - count + i;
+		snprintf(buf, sizeof(buf), "message %05d %.*s", n, n % 40,
+			"........................................");
+		CHECK(!strcmp(msgs[i], buf));
+	}
+}
+
+/* Corrupted record is reported (and skipped), other records are still readable. */
+static void test_corrupt_record()
+{
+	char msgs[8][64];
+	int corrupt;
+	char *p;
+
+	init_persistent_log();
+	index_persistent_log();
+	add_msg("aaaaaaaa");
+	add_msg("bbbbbbbb");
+	add_msg("cccccccc");
+
+	p = memmem(pmem_block.log, sizeof(pmem_block.log), "bbbbbbbb", 8);
+	CHECK(p != NULL);
+	if (p)
+		p[3] = 'x';
+
+	CHECK_EQ(read_log(msgs, 8, &corrupt), 2);
+	CHECK_EQ(corrupt, 1);
+	CHECK(!strcmp(msgs[0], "aaaaaaaa"));
+	CHECK(!strcmp(msgs[1], "cccccccc"));
+	CHECK(persistent_log_valid());
+}
+
+/* Corrupted ring buffer metadata is detected (log gets reinitialized on boot). */
+static void test_corrupt_metadata()
+{
+	init_persistent_log();
+	index_persistent_log();
+	add_msg("test");
+	CHECK(persistent_log_valid());
+
+	pmem_block.log_rb.head ^= 0x10;
+	CHECK(!persistent_log_valid());
+	pmem_block.log_rb.head ^= 0x10;
+	CHECK(persistent_log_valid());
+
+	pmem_block.log_crc32 ^= 1;
+	CHECK(!persistent_log_valid());
+
+	init_persistent_log();
+	pmem_block.log_rb.size = 16;
+	pmem_block.log_crc32 = xcrc32((unsigned char*)&pmem_block.log_rb,
+				sizeof(pmem_block.log_rb), 0);
+	CHECK(!persistent_log_valid());
+}
+
+/* Bytes checksummed per logged message, compared to recomputing CRC over
+   whole persistent memory block header + log buffer (as before log records
+   had their own CRCs). */
+static void benchmark()
+{
+	const char *msg = "1970-01-01 00:00:12 brickpico: output 3 set to 100% (pwm=255)";
+	size_t old_bytes = offsetof(struct persistent_memory_block, state);
+	int rounds = 20000;
+	uint64_t start, t;
+
+	init_persistent_log();
+	index_persistent_log();
+	crc_bytes = 0;
+	start = test_time_ns();
+	for (int i = 0; i < rounds; i++)
+		add_msg(msg);
+	t = test_time_ns() - start;
+
+	CHECK_EQ(crc_bytes / rounds, strlen(msg) + 1 + sizeof(var_ringbuffer_t));
+	printf("CRC bytes per log call: %llu (full block recompute: %zu, %.1fx less)\n",
+		(unsigned long long)(crc_bytes / rounds), old_bytes,
+		(double)old_bytes * rounds / crc_bytes);
+	printf("persistent log: %.1f ns/message (incl. bitwise CRC)\n",
+		(double)t / rounds);
+}
+
+
+int main(int argc, char **argv)
+{
+	test_roundtrip();
+	test_wraparound();
+	test_corrupt_record();
+	test_corrupt_metadata();
+	benchmark();
+
+	return test_result("persistent_log");
+}
+
+/* eof :-) */
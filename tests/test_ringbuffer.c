@@ -0,0 +1,307 @@
+/* test_ringbuffer.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ringbuffer.h"
+#include "test.h"
+
+
+/* Same size as the log buffer in persistent memory. */
+#define LOG_BUF_SIZE 8192
+#define INDEX_SIZE   64
+#define ADD_COUNT    5000
+
+
+/* Records are generated from their sequence number, so contents of
+   the ring buffer can be verified without keeping a copy of the data. */
+static size_t record_len(uint32_t i, size_t max)
+{
+	return 1 + (i * 37 + (i >> 3)) % max;
+}
+
+static void record_fill(uint8_t *buf, uint32_t i, size_t len)
+{
+	for (size_t j = 0; j < len; j++)
+		buf[j] = (i * 31 + j) & 0xff;
+}
+
+static int record_check(const uint8_t *buf, uint32_t i, size_t len, size_t max)
+{
+	if (len != record_len(i, max))
+		return 0;
+	for (size_t j = 0; j < len; j++) {
+		if (buf[j] != ((i * 31 + j) & 0xff))
+			return 0;
+	}
+	return 1;
+}
+
+
+static void test_u8_ringbuffer()
+{
+	u8_ringbuffer_t rb;
+	u8_ringbuffer_iter_t iter;
+	size_t index[INDEX_SIZE];
+	uint8_t buf[256];
+	uint32_t total = 0, first;
+	int len, o, errors = 0;
+
+	CHECK_EQ(u8_ringbuffer_init(&rb, NULL, LOG_BUF_SIZE - 3), 0);
+	CHECK_EQ(u8_ringbuffer_set_index(&rb, index, INDEX_SIZE), 0);
+
+	for (total = 0; total < ADD_COUNT; total++) {
+		len = record_len(total, 255);
+		record_fill(buf, total, len);
+		if (u8_ringbuffer_add(&rb, buf, len, true))
+			errors++;
+		/* Check that last (and n:th recent) item is where index says */
+		if (total % 97 == 0) {
+			o = u8_ringbuffer_recent_offset(&rb, 0);
+			len = u8_ringbuffer_peek(&rb, o, buf, sizeof(buf), NULL, NULL);
+			if (!record_check(buf, total, len, 255))
+				errors++;
+		}
+	}
+	CHECK_EQ(errors, 0);
+	CHECK(rb.items > 0);
+	CHECK(rb.free < 256 + 2);
+
+	/* Walk all items from oldest to newest */
+	first = total - rb.items;
+	u8_ringbuffer_iter_init(&rb, &iter);
+	for (uint32_t i = first; i < total; i++) {
+		len = u8_ringbuffer_iter_next(&iter, buf, sizeof(buf));
+		if (!record_check(buf, i, len, 255))
+			errors++;
+	}
+	CHECK_EQ(u8_ringbuffer_iter_next(&iter, buf, sizeof(buf)), 0);
+	CHECK_EQ(errors, 0);
+
+	/* Recent items using index and by walking the buffer */
+	for (size_t n = 0; n < rb.items; n++) {
+		int io = u8_ringbuffer_recent_offset(&rb, n);
+		size_t *saved = rb.index;
+		rb.index = NULL;
+		int wo = u8_ringbuffer_recent_offset(&rb, n);
+		rb.index = saved;
+		if (io != wo)
+			errors++;
+		len = u8_ringbuffer_peek(&rb, wo, buf, sizeof(buf), NULL, NULL);
+		if (!record_check(buf, total - 1 - n, len, 255))
+			errors++;
+	}
+	CHECK_EQ(errors, 0);
+	CHECK_EQ(u8_ringbuffer_recent_offset(&rb, rb.items), -2);
+
+	/* Iterate 10 most recent items */
+	CHECK_EQ(u8_ringbuffer_iter_init_recent(&rb, &iter, 10), 0);
+	for (uint32_t i = total - 10; i < total; i++) {
+		len = u8_ringbuffer_iter_next(&iter, buf, sizeof(buf));
+		CHECK(record_check(buf, i, len, 255));
+	}
+	CHECK_EQ(u8_ringbuffer_iter_next(&iter, buf, sizeof(buf)), 0);
+
+	/* Too small buffer: error, but iterator advances */
+	CHECK_EQ(u8_ringbuffer_iter_init_recent(&rb, &iter, 2), 0);
+	CHECK_EQ(u8_ringbuffer_iter_next(&iter, buf, 0), -4);
+	len = u8_ringbuffer_iter_next(&iter, buf, sizeof(buf));
+	CHECK(record_check(buf, total - 1, len, 255));
+
+	/* Remove from both ends */
+	len = u8_ringbuffer_remove_last(&rb, buf, sizeof(buf));
+	CHECK(record_check(buf, total - 1, len, 255));
+	len = u8_ringbuffer_remove_first(&rb, buf, sizeof(buf));
+	CHECK(record_check(buf, first, len, 255));
+	o = u8_ringbuffer_recent_offset(&rb, 0);
+	len = u8_ringbuffer_peek(&rb, o, buf, sizeof(buf), NULL, NULL);
+	CHECK(record_check(buf, total - 2, len, 255));
+
+	u8_ringbuffer_free(&rb);
+
+	/* Without overwrite, full buffer rejects new items */
+	u8_ringbuffer_init(&rb, NULL, 16);
+	record_fill(buf, 0, 10);
+	CHECK_EQ(u8_ringbuffer_add(&rb, buf, 10, false), 0);
+	CHECK(u8_ringbuffer_add(&rb, buf, 10, false) < 0);
+	CHECK_EQ(u8_ringbuffer_add(&rb, buf, 10, true), 0);
+	CHECK_EQ(rb.items, 1);
+	u8_ringbuffer_free(&rb);
+}
+
+
+static void test_var_ringbuffer()
+{
+	var_ringbuffer_t rb;
+	var_ringbuffer_iter_t iter;
+	size_t index[INDEX_SIZE];
+	const uint8_t *p;
+	uint8_t *w;
+	uint32_t total, first, seq;
+	int len, errors = 0;
+
+	CHECK_EQ(var_ringbuffer_init(&rb, NULL, LOG_BUF_SIZE), 0);
+	CHECK_EQ(var_ringbuffer_set_index(&rb, index, INDEX_SIZE), 0);
+
+	/* Empty buffer */
+	CHECK_EQ(var_ringbuffer_iter_init_seq(&rb, &iter, 0), 0);
+	CHECK_EQ(var_ringbuffer_iter_next(&iter, &p), 0);
+
+	/* Records longer than 255 bytes, formatted in place. Every third
+	   record is committed shorter than reserved. */
+	for (total = 0; total < ADD_COUNT; total++) {
+		len = record_len(total, 1000);
+		if (total % 3 == 0) {
+			w = var_ringbuffer_reserve(&rb, len + 50, true);
+			CHECK(w != NULL);
+			if (!w)
+				break;
+			record_fill(w, total, len);
+			CHECK_EQ(var_ringbuffer_commit(&rb, len), 0);
+		} else {
+			uint8_t buf[1000];
+
+			record_fill(buf, total, len);
+			CHECK_EQ(var_ringbuffer_add(&rb, buf, len, true), 0);
+		}
+	}
+	CHECK_EQ(rb.seq, total);
+	CHECK(rb.items > 0);
+
+	first = total - rb.items;
+	var_ringbuffer_iter_init(&rb, &iter);
+	for (uint32_t i = first; i < total; i++) {
+		len = var_ringbuffer_iter_next(&iter, &p);
+		if (!record_check(p, i, len, 1000))
+			errors++;
+	}
+	CHECK_EQ(var_ringbuffer_iter_next(&iter, &p), 0);
+	CHECK_EQ(errors, 0);
+
+	/* Index and walking must agree */
+	for (size_t n = 0; n < rb.items; n++) {
+		int io = var_ringbuffer_recent_offset(&rb, n);
+		size_t *saved = rb.index;
+		rb.index = NULL;
+		if (io != var_ringbuffer_recent_offset(&rb, n))
+			errors++;
+		rb.index = saved;
+	}
+	CHECK_EQ(errors, 0);
+
+	/* Iterating from a sequence number */
+	seq = total - 3;
+	CHECK_EQ(var_ringbuffer_iter_init_seq(&rb, &iter, seq), seq);
+	for (uint32_t i = seq; i < total; i++) {
+		len = var_ringbuffer_iter_next(&iter, &p);
+		CHECK(record_check(p, i, len, 1000));
+	}
+	CHECK_EQ(var_ringbuffer_iter_next(&iter, &p), 0);
+
+	/* Sequence number no longer in the buffer: start from oldest */
+	CHECK_EQ(var_ringbuffer_iter_init_seq(&rb, &iter, 0), first);
+	len = var_ringbuffer_iter_next(&iter, &p);
+	CHECK(record_check(p, first, len, 1000));
+
+	/* Sequence number in the future: no items */
+	CHECK_EQ(var_ringbuffer_iter_init_seq(&rb, &iter, total), total);
+	CHECK_EQ(var_ringbuffer_iter_next(&iter, &p), 0);
+	CHECK_EQ(var_ringbuffer_iter_init_seq(&rb, &iter, total + 1000), total);
+	CHECK_EQ(var_ringbuffer_iter_next(&iter, &p), 0);
+
+	/* Cancelled reservation does not add anything */
+	CHECK(var_ringbuffer_reserve(&rb, 10, true) != NULL);
+	CHECK_EQ(var_ringbuffer_commit(&rb, 0), 0);
+	CHECK_EQ(rb.seq, total);
+	CHECK_EQ(var_ringbuffer_commit(&rb, 1), -2);
+
+	/* Record larger than the buffer */
+	CHECK(var_ringbuffer_reserve(&rb, LOG_BUF_SIZE, true) == NULL);
+
+	var_ringbuffer_free(&rb);
+}
+
+
+/* Fill 8 KB buffer with log sized records and measure access speed. */
+static void bench_u8_ringbuffer()
+{
+	u8_ringbuffer_t rb;
+	u8_ringbuffer_iter_t iter;
+	size_t index[INDEX_SIZE];
+	uint8_t buf[256];
+	uint64_t t, count;
+	volatile int sink = 0;
+	int rounds = 2000;
+	uint32_t i;
+
+	u8_ringbuffer_init(&rb, NULL, LOG_BUF_SIZE);
+	t = test_time_ns();
+	for (i = 0; i < 200000; i++) {
+		size_t len = 20 + i % 60;
+		record_fill(buf, i, len);
+		u8_ringbuffer_add(&rb, buf, len, true);
+	}
+	t = test_time_ns() - t;
+	printf("u8_ringbuffer: add: %.1f M items/s (%zu items in buffer)\n",
+		i * 1e3 / (t ? t : 1), rb.items);
+
+	count = 0;
+	t = test_time_ns();
+	for (int r = 0; r < rounds; r++) {
+		u8_ringbuffer_iter_init(&rb, &iter);
+		while (u8_ringbuffer_iter_next(&iter, buf, sizeof(buf)) > 0)
+			count++;
+	}
+	t = test_time_ns() - t;
+	printf("u8_ringbuffer: iterate: %.1f M items/s\n", count * 1e3 / (t ? t : 1));
+
+	/* Access N most recent items by offset (as MEMLOG dump did) */
+	for (int indexed = 0; indexed < 2; indexed++) {
+		u8_ringbuffer_set_index(&rb, indexed ? index : NULL, INDEX_SIZE);
+		count = 0;
+		t = test_time_ns();
+		for (int r = 0; r < rounds; r++) {
+			for (size_t n = 0; n < INDEX_SIZE; n++) {
+				sink += u8_ringbuffer_recent_offset(&rb, n);
+				count++;
+			}
+		}
+		t = test_time_ns() - t;
+		printf("u8_ringbuffer: recent_offset (%s): %.1f M items/s\n",
+			indexed ? "index" : "walk", count * 1e3 / (t ? t : 1));
+	}
+
+	u8_ringbuffer_free(&rb);
+}
+
+
+int main()
+{
+	test_u8_ringbuffer();
+	test_var_ringbuffer();
+	bench_u8_ringbuffer();
+
+	return test_result("ringbuffer");
+}
+
+/* eof :-) */
@@ -0,0 +1,464 @@
+/* test_syslog_frame.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "ringbuffer.h"
+#include "syslog_frame.h"
+#include "test.h"
+
+/* Store-and-forward syslog over TCP tested against a local TCP listener.
+
+   Sender below mirrors syslog_enqueue() / syslog_tcp_poll() in syslog.c
+   (lwIP tcp_write() + tcp_output() replaced with one send() per batch).
+   Bytes read by the listener are passed back as acknowledged, like the
+   lwIP sent callback does. */
+
+#define QUEUE_SIZE   4096  /* SYSLOG_QUEUE_SIZE */
+#define BATCH_MAX    16    /* SYSLOG_TCP_BATCH_MAX */
+#define MAX_MSG_LEN  256   /* SYSLOG_MAX_MSG_LEN */
+#define FACILITY     1
+#define HOSTNAME     "brickpico"
+#define MAX_IDS      4096
+
+struct sender {
+	var_ringbuffer_t queue;
+	syslog_inflight_t inflight;
+	int fd;
+	/* ids of messages in queue (mirrors queue) */
+	int ids[MAX_IDS];
+	int ids_head, ids_count;
+	uint32_t queued, dropped, sent, batches, max_batch;
+};
+
+struct listener {
+	int fd;
+	int conn;
+	char buf[65536];
+	size_t len;
+	uint32_t bytes, frames, errors, duplicates;
+	int received[MAX_IDS];
+	int last_id;
+};
+
+static bool lost[MAX_IDS];
+
+
+static void make_record(uint8_t *rec, size_t *rec_len, int severity, uint32_t ts, const char *msg)
+{
+	size_t len = strlen(msg);
+
+	rec[0] = severity;
+	memcpy(rec + 1, &ts, sizeof(ts));
+	memcpy(rec + SYSLOG_REC_HDR_LEN, msg, len);
+	*rec_len = SYSLOG_REC_HDR_LEN + len;
+}
+
+static void test_format()
+{
+	uint8_t rec[SYSLOG_REC_HDR_LEN + MAX_MSG_LEN];
+	char buf[8 + MAX_MSG_LEN + 64];
+	char msg[MAX_MSG_LEN + 1];
+	const char *expected = "35 <11>Jan  1 00:00:00 brickpico hello";
+	size_t rec_len, len;
+
+	make_record(rec, &rec_len, 3, 0, "hello");
+	len = syslog_format(buf, sizeof(buf), FACILITY, HOSTNAME, rec, rec_len);
+	CHECK_EQ(len, strlen(expected) - 3);
+	CHECK(!memcmp(buf, expected + 3, len));
+
+	len = syslog_frame(buf, sizeof(buf), FACILITY, HOSTNAME, rec, rec_len);
+	CHECK_EQ(len, strlen(expected));
+	CHECK(!memcmp(buf, expected, len));
+
+	/* longest message */
+	memset(msg, 'x', MAX_MSG_LEN);
+	msg[MAX_MSG_LEN] = 0;
+	make_record(rec, &rec_len, 7, 86400, msg);
+	len = syslog_frame(buf, sizeof(buf), 23, HOSTNAME, rec, rec_len);
+	CHECK(!strncmp(buf, "287 <191>Jan  2 00:00:00 brickpico xxx", 38));
+	CHECK_EQ(len, 4 + 287);
+
+	/* invalid arguments */
+	CHECK_EQ(syslog_frame(buf, 8, FACILITY, HOSTNAME, rec, rec_len), 0);
+	CHECK_EQ(syslog_format(buf, 32, FACILITY, HOSTNAME, rec, rec_len), 0);
+	CHECK_EQ(syslog_format(buf, sizeof(buf), FACILITY, HOSTNAME, rec, 4), 0);
+}
+
+static void test_inflight()
+{
+	syslog_inflight_t f;
+
+	syslog_inflight_reset(&f);
+	CHECK_EQ(syslog_inflight_add(&f, 10), 0);
+	CHECK_EQ(syslog_inflight_add(&f, 20), 0);
+	CHECK_EQ(syslog_inflight_add(&f, 30), 0);
+	CHECK_EQ(syslog_inflight_acked(&f), 0);
+
+	f.acked += 15;
+	CHECK_EQ(syslog_inflight_acked(&f), 1);
+	CHECK_EQ(f.acked, 5);
+	f.acked += 15;
+	CHECK_EQ(syslog_inflight_acked(&f), 1);
+	CHECK_EQ(f.count, 1);
+
+	/* message dropped from queue while in flight */
+	syslog_inflight_drop(&f, 5);
+	CHECK_EQ(f.count, 0);
+	CHECK_EQ(f.ack_skip, 30);
+	CHECK_EQ(syslog_inflight_add(&f, 40), 0);
+	f.acked += 50;
+	CHECK_EQ(syslog_inflight_acked(&f), 0);
+	CHECK_EQ(f.ack_skip, 0);
+	CHECK_EQ(f.acked, 20);
+	f.acked += 20;
+	CHECK_EQ(syslog_inflight_acked(&f), 1);
+	CHECK_EQ(f.acked, 0);
+
+	for (int i = 0; i < SYSLOG_TCP_INFLIGHT_MAX; i++)
+		CHECK_EQ(syslog_inflight_add(&f, i + 1), 0);
+	CHECK_EQ(syslog_inflight_add(&f, 1), -1);
+	f.acked = SYSLOG_TCP_INFLIGHT_MAX * (SYSLOG_TCP_INFLIGHT_MAX + 1) / 2;
+	CHECK_EQ(syslog_inflight_acked(&f), SYSLOG_TCP_INFLIGHT_MAX);
+	CHECK_EQ(f.count, 0);
+}
+
+
+static void sender_enqueue(struct sender *s, int id)
+{
+	uint8_t *p;
+	char msg[MAX_MSG_LEN];
+	size_t items, dropped, len;
+	uint32_t ts = 1700000000 + id;
+
+	snprintf(msg, sizeof(msg), "output %d: test message %d %.*s", id % 16, id,
+		(id * 7) % 60, "------------------------------------------------------------");
+	len = strlen(msg);
+
+	items = s->queue.items;
+	p = var_ringbuffer_reserve(&s->queue, SYSLOG_REC_HDR_LEN + len, true);
+	CHECK(p != NULL);
+	if (!p)
+		return;
+
+	dropped = items - s->queue.items;
+	s->dropped += dropped;
+	syslog_inflight_drop(&s->inflight, dropped);
+	while (dropped-- > 0) {
+		lost[s->ids[s->ids_head]] = true;
+		s->ids_head = (s->ids_head + 1) % MAX_IDS;
+		s->ids_count--;
+	}
+
+	p[0] = 6;
+	memcpy(p + 1, &ts, sizeof(ts));
+	memcpy(p + SYSLOG_REC_HDR_LEN, msg, len);
+	var_ringbuffer_commit(&s->queue, SYSLOG_REC_HDR_LEN + len);
+	s->ids[(s->ids_head + s->ids_count) % MAX_IDS] = id;
+	s->ids_count++;
+	s->queued++;
+}
+
+static void sender_poll(struct sender *s, const struct listener *l)
+{
+	static char batch[BATCH_MAX * (SYSLOG_FRAME_HDR_MAX + MAX_MSG_LEN + 64)];
+	var_ringbuffer_iter_t iter;
+	const uint8_t *rec;
+	size_t i, len, batch_len = 0;
+	int rec_len, count = 0;
+
+	/* Remove messages acknowledged by the server from the queue. */
+	i = syslog_inflight_acked(&s->inflight);
+	while (i-- > 0) {
+		/* never remove a message before server has received it */
+		CHECK(l->received[s->ids[s->ids_head]] > 0);
+		var_ringbuffer_remove_first_item(&s->queue);
+		s->ids_head = (s->ids_head + 1) % MAX_IDS;
+		s->ids_count--;
+		s->sent++;
+	}
+	CHECK_EQ(s->ids_count, s->queue.items);
+
+	if (s->fd < 0) {
+		syslog_inflight_reset(&s->inflight);
+		return;
+	}
+
+	var_ringbuffer_iter_init(&s->queue, &iter);
+	for (i = 0; i < s->inflight.count; i++)
+		var_ringbuffer_iter_next(&iter, &rec);
+
+	while (count < BATCH_MAX
+		&& s->inflight.count < SYSLOG_TCP_INFLIGHT_MAX
+		&& (rec_len = var_ringbuffer_iter_next(&iter, &rec)) >= SYSLOG_REC_HDR_LEN) {
+		len = syslog_frame(batch + batch_len, sizeof(batch) - batch_len,
+				FACILITY, HOSTNAME, rec, rec_len);
+		CHECK(len > 0);
+		if (len < 1)
+			break;
+		batch_len += len;
+		syslog_inflight_add(&s->inflight, len);
+		count++;
+	}
+	if (count > 0) {
+		CHECK_EQ(send(s->fd, batch, batch_len, MSG_NOSIGNAL), batch_len);
+		s->batches++;
+		if (count > s->max_batch)
+			s->max_batch = count;
+	}
+}
+
+
+static int listener_open(struct listener *l)
+{
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	l->conn = -1;
+	l->last_id = -1;
+	if ((l->fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		return -1;
+	if (bind(l->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+		|| listen(l->fd, 1) < 0
+		|| getsockname(l->fd, (struct sockaddr*)&addr, &addr_len) < 0) {
+		close(l->fd);
+		return -1;
+	}
+	return ntohs(addr.sin_port);
+}
+
+static int sender_connect(struct sender *s, struct listener *l, int port)
+{
+	struct sockaddr_in addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	if ((s->fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		return -1;
+	if (connect(s->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+		return -1;
+	if ((l->conn = accept(l->fd, NULL, NULL)) < 0)
+		return -1;
+	l->len = 0;
+	return 0;
+}
+
+/* Parse received octet-counted frames. */
+static void listener_parse(struct listener *l)
+{
+	char *p = l->buf;
+	char *end = l->buf + l->len;
+	char *sp, *msg;
+	unsigned long len;
+	char c;
+	int id;
+
+	while (p < end) {
+		if (!(sp = memchr(p, ' ', end - p)))
+			break;
+		len = strtoul(p, NULL, 10);
+		if (len < 1 || len > MAX_MSG_LEN + 64) {
+			l->errors++;
+			l->len = 0;
+			return;
+		}
+		if (end - (sp + 1) < len)
+			break;
+		msg = sp + 1;
+		c = msg[len];
+		msg[len] = 0;
+		if (strncmp(msg, "<14>", 4) || !strstr(msg, " " HOSTNAME " ")
+			|| !(p = strstr(msg, "test message "))
+			|| sscanf(p, "test message %d", &id) != 1
+			|| id < 0 || id >= MAX_IDS) {
+			l->errors++;
+		} else {
+			if (l->received[id] > 0)
+				l->duplicates++;
+			else if (id < l->last_id)
+				l->errors++;  /* out of order */
+			l->received[id]++;
+			if (id > l->last_id)
+				l->last_id = id;
+		}
+		l->frames++;
+		msg[len] = c;
+		p = msg + len;
+	}
+	l->len = end - p;
+	memmove(l->buf, p, l->len);
+}
+
+/* Read available data, returns number of bytes read (or -1 on EOF). */
+static int listener_read(struct listener *l, int timeout)
+{
+	struct pollfd pfd = { .fd = l->conn, .events = POLLIN };
+	ssize_t n;
+
+	if (poll(&pfd, 1, timeout) < 1)
+		return 0;
+	n = recv(l->conn, l->buf + l->len, sizeof(l->buf) - l->len - 1, 0);
+	if (n <= 0)
+		return -1;
+	l->len += n;
+	l->bytes += n;
+	listener_parse(l);
+	return n;
+}
+
+
+static void test_store_and_forward()
+{
+	struct sender s;
+	struct listener l;
+	int port, n, id = 0, drops = 0, expected = 0;
+	int iterations = 0;
+
+	memset(&s, 0, sizeof(s));
+	memset(&l, 0, sizeof(l));
+	memset(lost, 0, sizeof(lost));
+	s.fd = -1;
+	CHECK_EQ(var_ringbuffer_init(&s.queue, NULL, QUEUE_SIZE), 0);
+
+	if ((port = listener_open(&l)) < 0) {
+		printf("cannot open local TCP listener, skipping store-and-forward test\n");
+		var_ringbuffer_free(&s.queue);
+		return;
+	}
+
+	/* Network down: messages stay queued (oldest dropped when queue fills up) */
+	for (; id < 150; id++) {
+		sender_enqueue(&s, id);
+		sender_poll(&s, &l);
+	}
+	CHECK(s.dropped > 0);
+	CHECK_EQ(s.sent, 0);
+	CHECK_EQ(s.queue.items, s.queued - s.dropped);
+
+	/* Connected: drain queue (in bulk), while new messages keep coming in */
+	CHECK_EQ(sender_connect(&s, &l, port), 0);
+	while (s.queue.items > 0 || id < 1000) {
+		if (id < 1000) {
+			sender_enqueue(&s, id++);
+			if (id % 3 == 0)
+				sender_enqueue(&s, id++);
+		}
+		sender_poll(&s, &l);
+
+		/* Connection drops with messages in flight (before they are acked) */
+		if (id == 400 || id == 700 || (id > 900 && s.inflight.count > 0 && drops < 3)) {
+			close(s.fd);
+			s.fd = -1;
+			while ((n = listener_read(&l, 100)) > 0)
+				;
+			close(l.conn);
+			sender_poll(&s, &l);
+			/* Queue fills up while disconnected */
+			if (drops == 1) {
+				for (int i = 0; i < 120; i++)
+					sender_enqueue(&s, id++);
+			}
+			CHECK_EQ(sender_connect(&s, &l, port), 0);
+			drops++;
+			continue;
+		}
+
+		/* Burst of messages while previous ones are still in flight */
+		if (id == 550 && s.inflight.count > 0) {
+			for (int i = 0; i < 120; i++)
+				sender_enqueue(&s, id++);
+			CHECK(s.inflight.ack_skip > 0);
+		}
+
+		/* Server receives data, sender gets acks */
+		if ((n = listener_read(&l, (s.inflight.count > 0 ? 100 : 0))) > 0)
+			s.inflight.acked += n;
+		if (++iterations > 100000)
+			break;
+	}
+	close(s.fd);
+	close(l.conn);
+	close(l.fd);
+
+	CHECK_EQ(s.queue.items, 0);
+	CHECK_EQ(l.errors, 0);
+	CHECK(l.duplicates > 0);
+	CHECK_EQ(s.sent + s.dropped, s.queued);
+	for (int i = 0; i < id; i++) {
+		if (lost[i]) {
+			continue;
+		}
+		expected++;
+		if (!l.received[i]) {
+			printf("message %d not received\n", i);
+			test_failures++;
+			break;
+		}
+	}
+	CHECK_EQ(expected, s.sent);
+	CHECK(l.frames >= s.sent + l.duplicates);
+
+	printf("store-and-forward: %lu queued, %lu dropped (queue full), %lu delivered,"
+		" %lu duplicates after %d reconnects\n",
+		(unsigned long)s.queued, (unsigned long)s.dropped, (unsigned long)s.sent,
+		(unsigned long)l.duplicates, drops);
+	printf("batching: %lu frames in %lu writes (%.1f messages / %.0f bytes per write,"
+		" max %lu messages)\n",
+		(unsigned long)l.frames, (unsigned long)s.batches,
+		(double)l.frames / s.batches, (double)l.bytes / s.batches,
+		(unsigned long)s.max_batch);
+	CHECK_EQ(s.max_batch, BATCH_MAX);
+
+	var_ringbuffer_free(&s.queue);
+}
+
+
+int main(int argc, char **argv)
+{
+	setenv("TZ", "UTC", 1);
+	tzset();
+
+	test_format();
+	test_inflight();
+	test_store_and_forward();
+
+	return test_result("syslog_frame");
+}
+
+/* eof :-) */